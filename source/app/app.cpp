@@ -1,7 +1,15 @@
 #define VMA_IMPLEMENTATION
 #include <app/app.h>
 
+#include <ctpl_stl.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <thread>
 
 #ifdef _DEBUG
 #define ENABLE_VALIDATION true
@@ -11,6 +19,32 @@
 
 //#define ENABLE_FULLSCREEN
 
+// Persistently mapped staging memory shared by all uploads
+static constexpr VkDeviceSize UPLOAD_RING_SIZE = 64ull << 20;
+
+// Variable descriptor count of every bindless texture set, lowered to the device limits
+static constexpr uint32_t MAX_BINDLESS_TEXTURES = 16384;
+
+// Frame slots with their own fences, secondary command buffers, uniform buffers and culling outputs.
+// Independent of the swapchain image count, which may change when the swapchain is recreated
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// Geometry request keys kept by a trace recording, 16 MB
+static constexpr size_t MAX_REQUEST_TRACE_SIZE = 1 << 22;
+
+// Logical device does not exist yet when features are chosen, so ask the physical device
+static bool deviceExtensionSupported(VkPhysicalDevice physical_device, const char* name)
+{
+	uint32_t count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr);
+	std::vector<VkExtensionProperties> extensions(count);
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data());
+
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) {
+		return std::strcmp(extension.extensionName, name) == 0;
+	});
+}
+
 Application::Application() : VulkanExampleBase(ENABLE_VALIDATION)
 {
 	glm::vec3 eye = { 0,0,-2.25999832 };
@@ -66,10 +100,15 @@ Application::Application() : VulkanExampleBase(ENABLE_VALIDATION)
 	physicalDeviceDescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
 	physicalDeviceDescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
 
+	// timeline semaphore extension for async compute scheduling, checked in getEnabledFeatures
+	physicalDeviceTimelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	physicalDeviceTimelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
 	deviceCreatepNextChain = &physicalDeviceDescriptorIndexingFeatures;
+	physicalDeviceDescriptorIndexingFeatures.pNext = &physicalDeviceTimelineSemaphoreFeatures;
 
 #ifdef ENABLE_DYNAMIC_STATE
-	physicalDeviceDescriptorIndexingFeatures.pNext = &physicalDeviceExtendedDynamicStateFeatures;
+	physicalDeviceTimelineSemaphoreFeatures.pNext = &physicalDeviceExtendedDynamicStateFeatures;
 #endif // ENABLE_DYNAMIC_STATE
 
 	enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
@@ -78,21 +117,85 @@ Application::Application() : VulkanExampleBase(ENABLE_VALIDATION)
 
 Application::~Application()
 {
+	vkDeviceWaitIdle(device);
+
+#ifdef ENABLE_SHADER_HOT_RELOAD
+	// Stop rebuilding before pipelines are destroyed
+	shader_reloader.reset();
+#endif // ENABLE_SHADER_HOT_RELOAD
+
+	// Running loads finish, queued ones are skipped, before caches and uploads go away
+	chaf::JobSystem::get().destroy();
+
+	destroyFramesInFlight();
+
+	profiler.reset();
+
+	// Finished uploads hand their buffers to the scene caches, which release them
+	chaf::UploadManager::get().destroy();
+
 	scene.reset();
 
 	culling_pipeline.reset();
 	scene_pipeline.reset();
 	hiz_pipeline.reset();
 	debug_pipeline.reset();
+	vis_bindless_pipeline.reset();
+
+	chaf::Allocator::get().destroy();
+
+	chaf::KernelTuner::get().destroy();
+	chaf::LayoutCache::get().destroy();
+	chaf::PipelineCache::get().destroy();
+	chaf::TextureCache::get().destroy();
 }
 
 void Application::buildCommandBuffers()
 {
+	// Secondary command buffers belong to frame slots, so they outlive swapchain recreation
+	if (secondary_cmd_buffers.scene.empty())
+	{
+		secondary_cmd_buffers.scene.resize(MAX_FRAMES_IN_FLIGHT);
+		secondary_cmd_buffers.overlay.resize(MAX_FRAMES_IN_FLIGHT);
+		secondary_cmd_buffers.scene_threads.resize(MAX_FRAMES_IN_FLIGHT);
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+			vks::initializers::commandBufferAllocateInfo(
+				cmdPool,
+				VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+				MAX_FRAMES_IN_FLIGHT);
+
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, secondary_cmd_buffers.scene.data()));
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, secondary_cmd_buffers.overlay.data()));
+
+		cmd_buffer_dirty.scene.resize(MAX_FRAMES_IN_FLIGHT);
+		cmd_buffer_dirty.overlay.resize(MAX_FRAMES_IN_FLIGHT);
+	}
+
+	// Recorded by draw() once the frame slot is free
+	markSceneDirty();
+	markOverlayDirty();
+}
+
+void Application::recordCommandBuffer(uint32_t frame, uint32_t image)
+{
+	if (cmd_buffer_dirty.scene[frame])
+	{
+		recordSceneCommandBuffer(frame);
+	}
+
+	if (cmd_buffer_dirty.overlay[frame])
+	{
+		recordOverlayCommandBuffer(frame);
+	}
+
+	// Frame slots and swapchain images do not pair up the same way every frame, so the primary command buffer of the
+	// image is recorded each time. It only executes secondary command buffers, which keeps that cheap
 	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 	VkClearValue clearValues[2];
-	clearValues[0].color = defaultClearColor;
-	clearValues[0].color = { { 0.25f, 0.25f, 0.25f, 1.0f } };;	clearValues[1].depthStencil = { 1.0f, 0 };
+	clearValues[0].color = { { 0.25f, 0.25f, 0.25f, 1.0f } };
+	clearValues[1].depthStencil = { 1.0f, 0 };
 
 	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
 	renderPassBeginInfo.renderPass = renderPass;
@@ -102,52 +205,239 @@ void Application::buildCommandBuffers()
 	renderPassBeginInfo.renderArea.extent.height = height;
 	renderPassBeginInfo.clearValueCount = 2;
 	renderPassBeginInfo.pClearValues = clearValues;
+	renderPassBeginInfo.framebuffer = frameBuffers[image];
+
+	VkCommandBuffer cmd_buffer = drawCmdBuffers[image];
+
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buffer, &cmdBufInfo));
+
+	culling_pipeline->acquireIndirectBuffer(cmd_buffer, frame);
+
+	vkCmdBeginRenderPass(cmd_buffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	std::vector<VkCommandBuffer> secondary_cmd_buffer = secondary_cmd_buffers.scene_threads[frame];
+	secondary_cmd_buffer.push_back(secondary_cmd_buffers.scene[frame]);
+	if (settings.overlay)
+	{
+		secondary_cmd_buffer.push_back(secondary_cmd_buffers.overlay[frame]);
+	}
+
+	vkCmdExecuteCommands(cmd_buffer, static_cast<uint32_t>(secondary_cmd_buffer.size()), secondary_cmd_buffer.data());
+
+	vkCmdEndRenderPass(cmd_buffer);
+
+	// Depth copy for Hi-z is submitted separately, it alternates between depth copies independent of swapchain image
+	culling_pipeline->releaseIndirectBuffer(cmd_buffer, frame);
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buffer));
+}
+
+void Application::recordSceneCommandBuffer(uint32_t frame)
+{
+	// Framebuffer is left unspecified, the command buffer runs in the render pass of whichever image the frame renders to
+	VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+	renderPassBeginInfo.renderPass = renderPass;
 
 	const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.f, 1.f);
 	const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
-	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-	{
-		renderPassBeginInfo.framebuffer = frameBuffers[i];
-		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+	VkCommandBuffer cmd_buffer = secondary_cmd_buffers.scene[frame];
 
-		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+	auto record_start = std::chrono::high_resolution_clock::now();
 
-		scene_pipeline->commandRecord(drawCmdBuffers[i], *culling_pipeline);
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buffer, &cmdBufInfo));
+
+	vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+	if (scene_pipeline->enable_multi_thread)
+	{
+		// Scene draws go to per-thread secondary command buffers, this one only keeps the remaining passes
+		secondary_cmd_buffers.scene_threads[frame] = scene_pipeline->commandRecordMultiThread(inheritanceInfo, viewport, scissor, *culling_pipeline, frame);
+	}
+	else
+	{
+		secondary_cmd_buffers.scene_threads[frame].clear();
+		scene_pipeline->commandRecord(cmd_buffer, *culling_pipeline, frame);
+	}
 
 #ifdef ENABLE_DYNAMIC_STATE
-		if (display_debug > 0)
-		{
-			vkCmdSetDepthTestEnableEXT(drawCmdBuffers[i], VK_FALSE);
-			debug_pipeline->buildCommandBuffer(drawCmdBuffers[i], renderPassBeginInfo);
-			vkCmdSetDepthTestEnableEXT(drawCmdBuffers[i], VK_TRUE);
-		}
+	if (display_debug > 0)
+	{
+		vkCmdSetDepthTestEnableEXT(cmd_buffer, VK_FALSE);
+		debug_pipeline->buildCommandBuffer(cmd_buffer, renderPassBeginInfo);
+		vkCmdSetDepthTestEnableEXT(cmd_buffer, VK_TRUE);
+	}
 #endif // ENABLE_DYNAMIC_STATE
 
-		if (display_bindless_texture)
+	if (display_bindless_texture)
+	{
+		vis_bindless_pipeline->commandRecord(cmd_buffer, frame);
+	}
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buffer));
+
+	scene_record_time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - record_start).count();
+
+	cmd_buffer_dirty.scene[frame] = false;
+}
+
+void Application::recordOverlayCommandBuffer(uint32_t frame)
+{
+	VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkCommandBuffer cmd_buffer = secondary_cmd_buffers.overlay[frame];
+
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buffer, &cmdBufInfo));
+
+	// Same as UIOverlay::draw, but from the geometry buffers of this frame slot
+	ImDrawData* draw_data = ImGui::GetDrawData();
+	if (settings.overlay && UIOverlay.visible && draw_data && draw_data->CmdListsCount > 0 && updateOverlayBuffers(frame, *draw_data))
+	{
+		const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, UIOverlay.pipeline);
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, UIOverlay.pipelineLayout, 0, 1, &UIOverlay.descriptorSet, 0, nullptr);
+
+		ImGuiIO& io = ImGui::GetIO();
+		UIOverlay.pushConstBlock.scale = glm::vec2(2.0f / io.DisplaySize.x, 2.0f / io.DisplaySize.y);
+		UIOverlay.pushConstBlock.translate = glm::vec2(-1.0f);
+		vkCmdPushConstants(cmd_buffer, UIOverlay.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(UIOverlay.pushConstBlock), &UIOverlay.pushConstBlock);
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &overlay_buffers.vertex[frame].buffer, offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, overlay_buffers.index[frame].buffer, 0, sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+		int32_t vertex_offset = 0;
+		uint32_t index_offset = 0;
+		for (int32_t i = 0; i < draw_data->CmdListsCount; i++)
 		{
-			vis_bindless_pipeline->commandRecord(drawCmdBuffers[i]);
+			const ImDrawList* cmd_list = draw_data->CmdLists[i];
+			for (int32_t j = 0; j < cmd_list->CmdBuffer.Size; j++)
+			{
+				const ImDrawCmd& draw_cmd = cmd_list->CmdBuffer[j];
+
+				VkRect2D scissor;
+				scissor.offset.x = std::max(static_cast<int32_t>(draw_cmd.ClipRect.x), 0);
+				scissor.offset.y = std::max(static_cast<int32_t>(draw_cmd.ClipRect.y), 0);
+				scissor.extent.width = static_cast<uint32_t>(draw_cmd.ClipRect.z - draw_cmd.ClipRect.x);
+				scissor.extent.height = static_cast<uint32_t>(draw_cmd.ClipRect.w - draw_cmd.ClipRect.y);
+				vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+				vkCmdDrawIndexed(cmd_buffer, draw_cmd.ElemCount, 1, index_offset, vertex_offset, 0);
+				index_offset += draw_cmd.ElemCount;
+			}
+			vertex_offset += cmd_list->VtxBuffer.Size;
 		}
+	}
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buffer));
 
-		drawUI(drawCmdBuffers[i]);
+	cmd_buffer_dirty.overlay[frame] = false;
+}
 
-		vkCmdEndRenderPass(drawCmdBuffers[i]);
+bool Application::updateOverlayBuffers(uint32_t frame, const ImDrawData& draw_data)
+{
+	VkDeviceSize vertex_size = static_cast<VkDeviceSize>(draw_data.TotalVtxCount) * sizeof(ImDrawVert);
+	VkDeviceSize index_size = static_cast<VkDeviceSize>(draw_data.TotalIdxCount) * sizeof(ImDrawIdx);
+	if (vertex_size == 0 || index_size == 0)
+	{
+		return false;
+	}
 
-		if (culling_pipeline->enable_hiz && !display_bindless_texture)
+	// Only this frame slot draws from its buffers and its fence has signalled, so they can be replaced and written.
+	// Grown with headroom, the overlay changes size a little most frames
+	auto reserve = [](chaf::Buffer& buffer, VkBufferUsageFlags usage, VkDeviceSize size) {
+		if (buffer.buffer == VK_NULL_HANDLE || buffer.size < size)
 		{
-			hiz_pipeline->copyDepth(drawCmdBuffers[i], depthStencil.image);
+			buffer.destroy();
+			chaf::Allocator::get().createBuffer(chaf::MemoryUsage::Upload, usage, size + size / 2, buffer);
 		}
+	};
+	reserve(overlay_buffers.vertex[frame], VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_size);
+	reserve(overlay_buffers.index[frame], VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_size);
 
-		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	auto vertex_dst = static_cast<ImDrawVert*>(overlay_buffers.vertex[frame].mapped);
+	auto index_dst = static_cast<ImDrawIdx*>(overlay_buffers.index[frame].mapped);
+	for (int32_t i = 0; i < draw_data.CmdListsCount; i++)
+	{
+		const ImDrawList* cmd_list = draw_data.CmdLists[i];
+		std::memcpy(vertex_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+		std::memcpy(index_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+		vertex_dst += cmd_list->VtxBuffer.Size;
+		index_dst += cmd_list->IdxBuffer.Size;
 	}
+
+	return true;
+}
+
+void Application::markSceneDirty()
+{
+	std::fill(cmd_buffer_dirty.scene.begin(), cmd_buffer_dirty.scene.end(), true);
+}
+
+void Application::markOverlayDirty()
+{
+	std::fill(cmd_buffer_dirty.overlay.begin(), cmd_buffer_dirty.overlay.end(), true);
 }
 
 void Application::prepare()
 {
 	VulkanExampleBase::prepare();
 
+	// Loads, culling and command recording share one work stealing scheduler
+	chaf::JobSystem::get().initialize();
+
+	// All pipelines share one cache, which is loaded from disk and saved periodically
+	chaf::PipelineCache::get().initialize(*vulkanDevice, "../data/cache/pipeline_cache.bin", pipeline_creation_feedback);
+
+	// Descriptor set and pipeline layouts are reflected from shaders and shared between pipelines
+	chaf::LayoutCache::get().initialize(*vulkanDevice);
+
+	// GPU caches evict against the device local memory budget
+	chaf::MemoryBudget::get().initialize(instance, *vulkanDevice, memory_budget);
+
+	// Buffers and images are sub-allocated from pools per usage class
+	chaf::Allocator::get().initialize(instance, *vulkanDevice, memory_budget);
+
+	// Buffers and textures are streamed through one staging ring, copies are submitted once per frame
+	chaf::UploadManager::get().initialize(*vulkanDevice, queue, UPLOAD_RING_SIZE);
+
+	// Compute workgroup sizes are timed once per device and driver
+	chaf::KernelTuner::get().initialize(*vulkanDevice, "../data/cache/kernel_tuning.txt");
+
+	// Shaders are compiled from GLSL at runtime, unchanged shaders come from the SPIR-V cache. Headers shared by
+	// shader sets are included relative to the GLSL root
+	chaf::ShaderLibrary::get().initialize(*vulkanDevice, "../data/cache/shaders", { "../data/shaders/glsl" });
+	precompileShaders();
+
+	// Textures are decoded and mip mapped once per content, warm loads map the cached payload. Mip levels of
+	// PNG and JPG textures are blitted after upload instead with -gpumipmaps
+	auto mip_generation = chaf::TextureCache::MipGeneration::Cpu;
+	for (auto arg : args)
+	{
+		if (std::string(arg) == "-gpumipmaps")
+		{
+			mip_generation = chaf::TextureCache::MipGeneration::Gpu;
+		}
+	}
+	chaf::TextureCache::get().initialize(*vulkanDevice, "../data/cache/textures", mip_generation);
+
 #ifdef ENABLE_DYNAMIC_STATE
 	vkCmdSetDepthTestEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(vkGetDeviceProcAddr(device, "vkCmdSetDepthTestEnableEXT"));
 	if (!vkCmdSetDepthTestEnableEXT)
@@ -158,31 +448,154 @@ void Application::prepare()
 
 	//scene = chaf::SceneLoader::LoadFromFile(*vulkanDevice, std::string(PROJECT_SOURCE_DIR) + "data/models/sponza/sponza.gltf", queue);
 	scene = chaf::SceneLoader::LoadFromFile(*vulkanDevice, std::string(PROJECT_SOURCE_DIR) + "data/test/test.gltf", queue);
-	scene->buffer_cacher = std::make_unique<chaf::BufferCacher>(*vulkanDevice, queue);
-	scene->buffer_cacher->addBuffer(0, chaf::SceneLoader::vertex_buffer, chaf::SceneLoader::index_buffer);
+	scene->buffer_cacher = std::make_unique<chaf::BufferCacher>(*vulkanDevice);
+	for (auto& mesh_primitives : chaf::SceneLoader::primitives)
+	{
+		for (auto& primitive : mesh_primitives)
+		{
+			chaf::BufferCacher::GeometrySource source;
+			source.vertices = chaf::SceneLoader::vertex_buffer.data() + primitive.first_vertex;
+			source.vertex_count = primitive.vertex_count;
+			source.indices = chaf::SceneLoader::index_buffer.data() + primitive.first_index;
+			source.index_count = primitive.index_count;
+			scene->buffer_cacher->addBuffer(primitive.buffer_index, source);
+		}
+	}
+
+	// Bindless slots are bounded by the update after bind limits of sampled images and samplers
+	physicalDeviceDescriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2KHR deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR };
+	deviceProperties2.pNext = &physicalDeviceDescriptorIndexingProperties;
+	auto vkGetPhysicalDeviceProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+	vkGetPhysicalDeviceProperties2KHR(physicalDevice, &deviceProperties2);
+
+	uint32_t slot_capacity = std::min({
+		MAX_BINDLESS_TEXTURES,
+		physicalDeviceDescriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		physicalDeviceDescriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		physicalDeviceDescriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+		physicalDeviceDescriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSamplers });
+
+	// Base color and emissive textures hold color, their mip levels are filtered in linear space
+	std::vector<bool> color_images(scene->images.size(), false);
+	for (auto& material : scene->materials)
+	{
+		for (int32_t index : { material.value.baseColorTextureIndex, material.value.emissiveTextureIndex })
+		{
+			if (index >= 0 && index < static_cast<int32_t>(color_images.size()))
+			{
+				color_images[index] = true;
+			}
+		}
+	}
+
+	// Slot of image i is i, which is what materials refer to
+	scene->image_cacher = std::make_unique<chaf::ImageCacher>(*vulkanDevice, slot_capacity);
+	for (size_t i = 0; i < scene->images.size(); i++)
+	{
+		if (scene->image_cacher->addImage(scene->images[i].path, color_images[i]) == chaf::ImageCacher::INVALID_SLOT)
+		{
+			std::cout << "Scene has more textures than bindless slots: " << slot_capacity << std::endl;
+			break;
+		}
+	}
+
+	// Default texture and object data have to be resident before the first frame, scene textures stream in once drawn
+	chaf::UploadManager::get().flush();
 
 	culling_pipeline = std::make_unique<CullingPipeline>(*vulkanDevice, *scene);
 	scene_pipeline = std::make_unique<ScenePipeline>(*vulkanDevice, *scene);
 	hiz_pipeline = std::make_unique<HizPipeline>(*vulkanDevice, width, height);
 
+	prepareFramesInFlight();
+
 	hiz_pipeline->prepare(queue, depthFormat);
-	scene_pipeline->prepare(renderPass, queue);
+	scene_pipeline->prepare(renderPass, queue, MAX_FRAMES_IN_FLIGHT);
 
+	// Debug view only reads viewport range, which is the same for all frames
 	debug_pipeline = std::make_unique<DebugPipeline>(*vulkanDevice);
-	debug_pipeline->setupDescriptors(*hiz_pipeline, scene_pipeline->sceneUBO.buffer);
+	debug_pipeline->setupDescriptors(*hiz_pipeline, scene_pipeline->sceneUBO.buffers[0]);
 	debug_pipeline->prepare(renderPass);
 
 	culling_pipeline->prepare(queue, *scene_pipeline, *hiz_pipeline);
+	prefetcher.setBounds(culling_pipeline->draw_bounds);
+
+	hiz_pipeline->buildCopyCommandBuffers(depthStencil.image);
+
+	profiler = std::make_unique<TimestampProfiler>(*vulkanDevice, MAX_FRAMES_IN_FLIGHT);
+	profiler_scopes.compute = profiler->addScope("compute", vulkanDevice->queueFamilyIndices.compute);
+	profiler_scopes.graphics = profiler->addScope("graphics", vulkanDevice->queueFamilyIndices.graphics);
 
 	vis_bindless_pipeline = std::make_unique<VisBindlessPipeline>(*vulkanDevice, *scene);
-	vis_bindless_pipeline->prepare(renderPass, queue);
+	vis_bindless_pipeline->prepare(renderPass, queue, MAX_FRAMES_IN_FLIGHT);
+
+#ifdef ENABLE_SHADER_HOT_RELOAD
+	// Whole GLSL root, so headers in the include directory are watched too
+	shader_reloader = std::make_unique<chaf::ShaderReloader>(*vulkanDevice, "../data/shaders/glsl");
+	shader_reloader->addPipeline(*culling_pipeline);
+	shader_reloader->addPipeline(*scene_pipeline);
+	shader_reloader->addPipeline(*hiz_pipeline);
+	shader_reloader->addPipeline(*debug_pipeline);
+	shader_reloader->addPipeline(*vis_bindless_pipeline);
+#endif // ENABLE_SHADER_HOT_RELOAD
 
 	buildCommandBuffers();
 	prepared = true;
 }
 
+void Application::precompileShaders()
+{
+	const std::string shader_path = "../data/shaders/glsl/gpudrivenpipeline/";
+
+	// Every permutation pipelines may switch to at runtime, toggles then never wait for the compiler
+	std::vector<chaf::ShaderLibrary::Job> jobs = {
+		{ VK_SHADER_STAGE_COMPUTE_BIT, shader_path + "culling.comp" },
+		{ VK_SHADER_STAGE_COMPUTE_BIT, shader_path + "culling_hiz.comp" },
+		{ VK_SHADER_STAGE_COMPUTE_BIT, shader_path + "hiz.comp" },
+		{ VK_SHADER_STAGE_VERTEX_BIT, shader_path + "scene_indexing.vert" },
+		{ VK_SHADER_STAGE_FRAGMENT_BIT, shader_path + "scene_indexing.frag" },
+		{ VK_SHADER_STAGE_VERTEX_BIT, shader_path + "scene_indexing_tes.vert" },
+		{ VK_SHADER_STAGE_FRAGMENT_BIT, shader_path + "scene_indexing_tes.frag" },
+		{ VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, shader_path + "scene_indexing_tes.tesc" },
+		{ VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, shader_path + "scene_indexing_tes.tese" },
+		{ VK_SHADER_STAGE_VERTEX_BIT, shader_path + "debug.vert" },
+		{ VK_SHADER_STAGE_FRAGMENT_BIT, shader_path + "debug.frag" },
+		{ VK_SHADER_STAGE_VERTEX_BIT, shader_path + "vis_bindless.vert" },
+		{ VK_SHADER_STAGE_FRAGMENT_BIT, shader_path + "vis_bindless.frag" },
+	};
+
+	try
+	{
+		chaf::ShaderLibrary::get().loadBatch(jobs);
+	}
+	catch (const std::runtime_error& e)
+	{
+		// Pipelines fall back to prebuilt SPIR-V for shaders that fail here
+		std::cerr << e.what() << std::endl;
+	}
+}
+
 void Application::getEnabledFeatures()
 {
+	// Compute and graphics submits wait on frame numbers, there is no binary semaphore path
+	if (!deviceExtensionSupported(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+	{
+		vks::tools::exitFatal("Selected GPU does not support VK_KHR_timeline_semaphore, required for async compute scheduling", VK_ERROR_EXTENSION_NOT_PRESENT);
+	}
+	enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+	if (deviceExtensionSupported(physicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+	{
+		enabledDeviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+		pipeline_creation_feedback = true;
+	}
+
+	if (deviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+	{
+		enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		memory_budget = true;
+	}
+
 	if (deviceFeatures.multiDrawIndirect)
 	{
 		enabledFeatures.multiDrawIndirect = VK_TRUE;
@@ -220,110 +633,578 @@ void Application::getEnabledFeatures()
 	}
 }
 
-void Application::draw()
+void Application::prepareFramesInFlight()
 {
+	const uint32_t frame_count = MAX_FRAMES_IN_FLIGHT;
 
-	VulkanExampleBase::prepareFrame();
+	frames_in_flight.fences.resize(frame_count);
+	frames_in_flight.image_fences.resize(drawCmdBuffers.size(), VK_NULL_HANDLE);
 
-	if (culling_pipeline->enable_hiz)
+	// Created on first use
+	overlay_buffers.vertex.resize(frame_count);
+	overlay_buffers.index.resize(frame_count);
+	frames_in_flight.present_complete.resize(frame_count);
+	frames_in_flight.render_complete.resize(frame_count);
+
+	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+
+	for (uint32_t i = 0; i < frame_count; i++)
 	{
-		//vkWaitForFences(device, 1, &hiz_pipeline->fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &hiz_pipeline->fence);
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &frames_in_flight.fences[i]));
+
+		if (i == 0)
+		{
+			frames_in_flight.present_complete[i] = semaphores.presentComplete;
+			frames_in_flight.render_complete[i] = semaphores.renderComplete;
+		}
+		else
+		{
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames_in_flight.present_complete[i]));
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames_in_flight.render_complete[i]));
+		}
 	}
-	else
+
+	VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo{};
+	semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	semaphoreTypeCreateInfo.initialValue = 0;
+	semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &timeline_semaphores.compute));
+	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &timeline_semaphores.graphics));
+}
+
+void Application::destroyFramesInFlight()
+{
+	for (uint32_t i = 0; i < frames_in_flight.fences.size(); i++)
 	{
-		//vkWaitForFences(device, 1, &culling_pipeline->fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &culling_pipeline->fence);
+		vkDestroyFence(device, frames_in_flight.fences[i], nullptr);
+
+		if (i > 0)
+		{
+			vkDestroySemaphore(device, frames_in_flight.present_complete[i], nullptr);
+			vkDestroySemaphore(device, frames_in_flight.render_complete[i], nullptr);
+		}
 	}
 
-	if (culling_pipeline->enable_hiz)
+	// Hand the original semaphores back to VulkanExampleBase
+	if (!frames_in_flight.fences.empty())
 	{
-		VkSubmitInfo hizSubmitInfo = vks::initializers::submitInfo();
-		hizSubmitInfo.commandBufferCount = 1;
-		hizSubmitInfo.pCommandBuffers = &hiz_pipeline->command_buffer;
-		hizSubmitInfo.signalSemaphoreCount = 1;
-		hizSubmitInfo.pSignalSemaphores = &hiz_pipeline->semaphore;
-		hizSubmitInfo.waitSemaphoreCount = 0;
-		hizSubmitInfo.pWaitSemaphores = nullptr;
+		semaphores.presentComplete = frames_in_flight.present_complete[0];
+		semaphores.renderComplete = frames_in_flight.render_complete[0];
+	}
 
-		std::array<VkPipelineStageFlags, 1> hizStageFlags = {
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		};
+	vkDestroySemaphore(device, timeline_semaphores.compute, nullptr);
+	vkDestroySemaphore(device, timeline_semaphores.graphics, nullptr);
 
-		hizSubmitInfo.pWaitDstStageMask = hizStageFlags.data();
+	for (auto& buffer : overlay_buffers.vertex)
+	{
+		buffer.destroy();
+	}
+	for (auto& buffer : overlay_buffers.index)
+	{
+		buffer.destroy();
+	}
+	overlay_buffers.vertex.clear();
+	overlay_buffers.index.clear();
+
+	frames_in_flight.fences.clear();
+	frames_in_flight.image_fences.clear();
+	frames_in_flight.present_complete.clear();
+	frames_in_flight.render_complete.clear();
+}
 
-		VK_CHECK_RESULT(vkQueueSubmit(hiz_pipeline->compute_queue, 1, &hizSubmitInfo, VK_NULL_HANDLE));
+void Application::presentFrame()
+{
+	// Unlike VulkanExampleBase::submitFrame, do not wait for queue idle, frame fences keep frames in flight apart
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR)))
+	{
+		// Out of date swapchain is recreated by next prepareFrame
+		if (result != VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			VK_CHECK_RESULT(result);
+		}
 	}
+}
 
-	VkSubmitInfo cullSubmitInfo = vks::initializers::submitInfo();
-	cullSubmitInfo.commandBufferCount = 1;
-	cullSubmitInfo.pCommandBuffers = &culling_pipeline->command_buffer;
-	cullSubmitInfo.signalSemaphoreCount = 1;
-	cullSubmitInfo.pSignalSemaphores = &culling_pipeline->semaphore;
+void Application::draw()
+{
+	const uint32_t frame = frames_in_flight.index;
 
-	if (culling_pipeline->enable_hiz)
+	// Wait until the semaphores of this frame slot are no longer in use
+	vkWaitForFences(device, 1, &frames_in_flight.fences[frame], VK_TRUE, UINT64_MAX);
+
+	updateGpuTiming(frame);
+
+	semaphores.presentComplete = frames_in_flight.present_complete[frame];
+	semaphores.renderComplete = frames_in_flight.render_complete[frame];
+
+	VulkanExampleBase::prepareFrame();
+
+	// Primary command buffer of the acquired image may still be used by an earlier frame in another slot
+	if (frames_in_flight.image_fences[currentBuffer] != VK_NULL_HANDLE)
 	{
-		std::array<VkPipelineStageFlags, 1> cullStageFlags = {
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		};
-		cullSubmitInfo.waitSemaphoreCount = 1;
-		cullSubmitInfo.pWaitSemaphores = &hiz_pipeline->semaphore;
-		cullSubmitInfo.pWaitDstStageMask = cullStageFlags.data();
+		vkWaitForFences(device, 1, &frames_in_flight.image_fences[currentBuffer], VK_TRUE, UINT64_MAX);
+	}
+	frames_in_flight.image_fences[currentBuffer] = frames_in_flight.fences[frame];
+
+	// Culling result of the last frame in this slot is complete now, stats lag a few frames behind
+	culling_pipeline->updateDrawCount(frame);
+
+	// Meshes placed, evicted or moved in the geometry arenas since this slot was last culled
+	culling_pipeline->updateIndirectCommands(frame);
+
+	// Texture slots loaded or evicted since this frame slot was last rendered
+	requestResources();
+	scene_pipeline->updateDescriptors(frame);
+	vis_bindless_pipeline->updateDescriptors(frame);
+
+	cull_count = 0;
+	for (auto& draw_count : culling_pipeline->indirect_status.draw_count)
+	{
+		cull_count += draw_count;
+	}
+
+	frame_number++;
+
+	// Hi-z is built from the depth of this many frames ago
+	const uint32_t depth_latency = async_compute ? 2 : 1;
+	const uint64_t depth_frame = frame_number > depth_latency ? frame_number - depth_latency : 0;
+	const bool build_hiz = culling_pipeline->enable_hiz && depth_frame > 0 && depth_copy_frames[depth_frame % HizPipeline::DEPTH_COPY_COUNT] == depth_frame;
+	const bool copy_depth = culling_pipeline->enable_hiz && !display_bindless_texture;
+
+	scene_pipeline->updateUniformBuffers(frame, depth_latency);
+
+	// Secondary command buffers of the frame slot are only re-recorded when something changed
+	recordCommandBuffer(frame, currentBuffer);
+
+	vkResetFences(device, 1, &frames_in_flight.fences[frame]);
+
+	submitCompute(frame, depth_frame, build_hiz);
+	submitGraphics(frame, copy_depth);
+
+	presentFrame();
+
+	frames_in_flight.index = (frame + 1) % static_cast<uint32_t>(frames_in_flight.fences.size());
+}
+
+void Application::submitCompute(uint32_t frame, uint64_t depth_frame, bool build_hiz)
+{
+	std::vector<VkCommandBuffer> cmd_buffers = { profiler->getBeginCommandBuffer(profiler_scopes.compute, frame) };
+	if (build_hiz)
+	{
+		cmd_buffers.push_back(hiz_pipeline->command_buffers[depth_frame % HizPipeline::DEPTH_COPY_COUNT]);
+
+		// Each depth copy release is matched by exactly one acquire on compute queue
+		depth_copy_frames[depth_frame % HizPipeline::DEPTH_COPY_COUNT] = 0;
 	}
+	cmd_buffers.push_back(culling_pipeline->command_buffers[frame]);
+	cmd_buffers.push_back(profiler->getEndCommandBuffer(profiler_scopes.compute, frame));
+
+	// Hi-z waits for the graphics frame that wrote its depth copy, culling alone only depends on host synchronized buffers
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineSubmitInfo.waitSemaphoreValueCount = build_hiz ? 1 : 0;
+	timelineSubmitInfo.pWaitSemaphoreValues = &depth_frame;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &frame_number;
+
+	VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
+	computeSubmitInfo.pNext = &timelineSubmitInfo;
+	computeSubmitInfo.commandBufferCount = static_cast<uint32_t>(cmd_buffers.size());
+	computeSubmitInfo.pCommandBuffers = cmd_buffers.data();
+	computeSubmitInfo.waitSemaphoreCount = build_hiz ? 1 : 0;
+	computeSubmitInfo.pWaitSemaphores = &timeline_semaphores.graphics;
+	computeSubmitInfo.pWaitDstStageMask = &waitStage;
+	computeSubmitInfo.signalSemaphoreCount = 1;
+	computeSubmitInfo.pSignalSemaphores = &timeline_semaphores.compute;
+
+	VK_CHECK_RESULT(vkQueueSubmit(culling_pipeline->compute_queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+
+	profiler->markSubmitted(profiler_scopes.compute, frame);
+}
+
+void Application::submitGraphics(uint32_t frame, bool copy_depth)
+{
+	std::vector<VkCommandBuffer> cmd_buffers = {
+		profiler->getBeginCommandBuffer(profiler_scopes.graphics, frame),
+		drawCmdBuffers[currentBuffer]
+	};
 
-	VK_CHECK_RESULT(vkQueueSubmit(culling_pipeline->compute_queue, 1, &cullSubmitInfo, VK_NULL_HANDLE));
+	if (copy_depth)
+	{
+		uint32_t copy_index = static_cast<uint32_t>(frame_number % HizPipeline::DEPTH_COPY_COUNT);
+		cmd_buffers.push_back(hiz_pipeline->copy_command_buffers[copy_index]);
+		depth_copy_frames[copy_index] = frame_number;
+	}
 
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+	cmd_buffers.push_back(profiler->getEndCommandBuffer(profiler_scopes.graphics, frame));
 
-	// Wait on present and compute semaphores
-	std::array<VkPipelineStageFlags, 1> stageFlags = {
+	// Wait on present and compute semaphores, depth copy must also wait until Hi-z no longer reads it
+	std::array<VkPipelineStageFlags, 2> stageFlags = {
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		//VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
 	};
 	std::array<VkSemaphore, 2> waitSemaphores = {
 		semaphores.presentComplete,						// Wait for presentation to finished
-		culling_pipeline->semaphore								// Wait for compute to finish
+		timeline_semaphores.compute						// Wait for compute of this frame to finish
+	};
+	std::array<VkSemaphore, 2> signalSemaphores = {
+		semaphores.renderComplete,
+		timeline_semaphores.graphics
 	};
 
-	submitInfo.pWaitSemaphores = waitSemaphores.data();
-	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
-	submitInfo.pWaitDstStageMask = stageFlags.data();
+	// Values of binary semaphores are ignored
+	std::array<uint64_t, 2> waitValues = { 0, frame_number };
+	std::array<uint64_t, 2> signalValues = { 0, frame_number };
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo graphicsSubmitInfo = vks::initializers::submitInfo();
+	graphicsSubmitInfo.pNext = &timelineSubmitInfo;
+	graphicsSubmitInfo.commandBufferCount = static_cast<uint32_t>(cmd_buffers.size());
+	graphicsSubmitInfo.pCommandBuffers = cmd_buffers.data();
+	graphicsSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	graphicsSubmitInfo.pWaitSemaphores = waitSemaphores.data();
+	graphicsSubmitInfo.pWaitDstStageMask = stageFlags.data();
+	graphicsSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	graphicsSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &graphicsSubmitInfo, frames_in_flight.fences[frame]));
+
+	profiler->markSubmitted(profiler_scopes.graphics, frame);
+}
 
-	if (culling_pipeline->enable_hiz)
-	{
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, hiz_pipeline->fence));
-	}
-	else
-	{
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, culling_pipeline->fence));
-	}
+void Application::updateGpuTiming(uint32_t frame)
+{
+	// Frame slot has finished, compare its compute work with graphics work of the frame before
+	profiler->resolve(frame);
 
-	VulkanExampleBase::submitFrame();
+	uint32_t previous_frame = (frame + static_cast<uint32_t>(frames_in_flight.fences.size()) - 1) % static_cast<uint32_t>(frames_in_flight.fences.size());
 
-	memcpy(&culling_pipeline->indirect_status.draw_count[0], culling_pipeline->indircet_draw_count_buffer.mapped, sizeof(uint32_t) * culling_pipeline->indirect_status.draw_count.size());
+	const auto& compute_interval = profiler->getInterval(profiler_scopes.compute, frame);
+	const auto& graphics_interval = profiler->getInterval(profiler_scopes.graphics, frame);
+	const auto& previous_graphics_interval = profiler->getInterval(profiler_scopes.graphics, previous_frame);
 
-	cull_count = 0;
-	for (auto& draw_count : culling_pipeline->indirect_status.draw_count)
+	if (compute_interval.valid && graphics_interval.valid)
 	{
-		cull_count += draw_count;
+		gpu_timing.compute = TimestampProfiler::getDuration(compute_interval);
+		gpu_timing.graphics = TimestampProfiler::getDuration(graphics_interval);
+		gpu_timing.overlap = TimestampProfiler::getOverlap(compute_interval, previous_graphics_interval);
 	}
 }
 
 void Application::render()
 {
+#ifdef ENABLE_SHADER_HOT_RELOAD
+	// Frame boundary, pipelines using changed shaders are rebuilt and swapped in here
+	if (shader_reloader->update())
+	{
+		markSceneDirty();
+	}
+#endif // ENABLE_SHADER_HOT_RELOAD
+
+	// Copies queued since last frame are submitted ahead of the frame which may use them
+	chaf::UploadManager::get().update();
+
+	chaf::Allocator::get().update(static_cast<uint32_t>(frame_number));
+
 	draw();
-	buildCommandBuffers();
 	if (camera.updated)
 	{
 		update();
 	}
+
+	chaf::PipelineCache::get().update();
+
+	scene->buffer_cacher->update(static_cast<uint32_t>(frames_in_flight.fences.size()));
+	scene->image_cacher->update();
 }
 
-void Application::update()
+void Application::requestResources()
+{
+	// Draws inside the culling frustum keep their geometry and textures resident, GPU culling results come too late to start loads
+	chaf::Frustum frustum;
+	std::copy(std::begin(scene_pipeline->sceneUBO.values.frustum), std::end(scene_pipeline->sceneUBO.values.frustum), frustum.planes.begin());
+
+	auto& draw_primitives = culling_pipeline->draw_primitives;
+	draw_visible.resize(draw_primitives.size());
+
+	// Tested in parallel, slots are gathered in draw order afterwards
+	chaf::JobSystem::get().parallelFor(chaf::JobPriority::Frame, static_cast<uint32_t>(draw_primitives.size()), [&](uint32_t begin, uint32_t end) {
+		chaf::Frustum range_frustum = frustum;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			draw_visible[i] = range_frustum.checkAABB(culling_pipeline->draw_bounds[i]);
+		}
+	}, 1024);
+
+	texture_requests.clear();
+	geometry_requests.clear();
+	for (size_t i = 0; i < draw_primitives.size(); i++)
+	{
+		if (!draw_visible[i])
+		{
+			continue;
+		}
+
+		const auto* primitive = draw_primitives[i];
+		geometry_requests.push_back(primitive->buffer_index);
+
+		if (primitive->material_index < 0 || primitive->material_index >= static_cast<int32_t>(scene->materials.size()))
+		{
+			continue;
+		}
+
+		auto& material = scene->materials[primitive->material_index].value;
+		for (int32_t slot : { material.baseColorTextureIndex, material.normalTextureIndex, material.emissiveTextureIndex, material.occlusionTextureIndex, material.metallicRoughnessTextureIndex })
+		{
+			if (slot >= 0)
+			{
+				texture_requests.push_back(static_cast<uint32_t>(slot));
+			}
+		}
+	}
+
+	// Once per slot, so hit rate counts textures rather than draws
+	std::sort(texture_requests.begin(), texture_requests.end());
+	texture_requests.erase(std::unique(texture_requests.begin(), texture_requests.end()), texture_requests.end());
+
+	for (uint32_t slot : texture_requests)
+	{
+		scene->image_cacher->request(slot);
+	}
+
+	// Once per key, instances of a mesh are one use
+	std::sort(geometry_requests.begin(), geometry_requests.end());
+	geometry_requests.erase(std::unique(geometry_requests.begin(), geometry_requests.end()), geometry_requests.end());
+
+	// Bounded so a forgotten recording does not grow without limit
+	if (record_request_trace && request_trace.size() + geometry_requests.size() <= MAX_REQUEST_TRACE_SIZE)
+	{
+		request_trace.insert(request_trace.end(), geometry_requests.begin(), geometry_requests.end());
+	}
+
+	for (uint32_t key : geometry_requests)
+	{
+		scene->buffer_cacher->request(key);
+	}
+
+	// Predicting from a fixed frustum would prefetch for a view not rendered
+	if (prefetch && !fix_frustum)
+	{
+		prefetchResources();
+	}
+}
+
+void Application::prefetchResources()
+{
+	prefetcher.update(camera.matrices.view);
+
+	prefetch_draws.clear();
+	prefetcher.query(camera.matrices.perspective, camera.matrices.view, prefetch_draws);
+
+	auto& draw_primitives = culling_pipeline->draw_primitives;
+
+	int load_count = 0;
+	for (uint32_t draw : prefetch_draws)
+	{
+		if (load_count >= max_prefetch_loads)
+		{
+			break;
+		}
+
+		const auto* primitive = draw_primitives[draw];
+		if (scene->buffer_cacher->prefetch(primitive->buffer_index))
+		{
+			load_count++;
+		}
+
+		if (primitive->material_index < 0 || primitive->material_index >= static_cast<int32_t>(scene->materials.size()))
+		{
+			continue;
+		}
+
+		auto& material = scene->materials[primitive->material_index].value;
+		for (int32_t slot : { material.baseColorTextureIndex, material.normalTextureIndex, material.emissiveTextureIndex, material.occlusionTextureIndex, material.metallicRoughnessTextureIndex })
+		{
+			if (slot >= 0 && scene->image_cacher->prefetch(static_cast<uint32_t>(slot)))
+			{
+				load_count++;
+			}
+		}
+	}
+}
+
+void Application::benchmarkJobs()
+{
+	// Small jobs, so scheduling overhead dominates
+	constexpr uint32_t JOB_COUNT = 1 << 16;
+
+	std::atomic<uint64_t> sum{ 0 };
+	auto work = [&sum](uint32_t index) {
+		uint64_t value = index;
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			value = value * 6364136223846793005ull + 1442695040888963407ull;
+		}
+		sum += value;
+	};
+
+	// Workers and the waiting thread
+	ctpl::thread_pool thread_pool(static_cast<int>(chaf::JobSystem::get().getWorkerCount() + 1));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::future<void>> futures;
+	futures.reserve(JOB_COUNT);
+	for (uint32_t i = 0; i < JOB_COUNT; i++)
+	{
+		futures.push_back(thread_pool.push([&work, i](int) { work(i); }));
+	}
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+	job_benchmark.ctpl = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	chaf::JobHandle group;
+	for (uint32_t i = 0; i < JOB_COUNT; i++)
+	{
+		group = chaf::JobSystem::get().push(chaf::JobPriority::Frame, [&work, i]() { work(i); }, group);
+	}
+	group.wait();
+	job_benchmark.job_system = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Application::benchmarkCacheContention()
+{
+	// Per thread, mostly lookups with an insert every 8th operation, like render thread requests racing loader workers
+	static constexpr uint32_t OPERATION_COUNT = 1 << 16;
+	static constexpr uint32_t KEY_COUNT = 4096;
+	static constexpr size_t CACHE_SIZE = 1024;
+
+	// Returns million operations per second
+	auto run = [](uint32_t thread_count, auto& cache) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::thread> threads;
+		for (uint32_t t = 0; t < thread_count; t++)
+		{
+			threads.emplace_back([&cache, t]() {
+				uint32_t state = t * 2654435761u + 1;
+				uint64_t value = 0;
+				for (uint32_t i = 0; i < OPERATION_COUNT; i++)
+				{
+					state = state * 1664525u + 1013904223u;
+					uint32_t key = (state >> 8) % KEY_COUNT;
+					if ((i & 7) == 0)
+					{
+						cache.insert(key, uint64_t{ state });
+					}
+					else
+					{
+						cache.try_get(key, value);
+					}
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		double time = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+		return static_cast<double>(thread_count) * OPERATION_COUNT / time;
+	};
+
+	auto contended = [](uint64_t contended_count, uint64_t acquired_count) {
+		return acquired_count == 0 ? 0.0 : static_cast<double>(contended_count) / acquired_count;
+	};
+
+	// Up to workers and the render thread, which is what shares caches at runtime
+	uint32_t max_thread_count = chaf::JobSystem::get().getWorkerCount() + 1;
+
+	job_benchmark.contention.clear();
+	for (uint32_t thread_count = 1; ; thread_count = std::min(thread_count * 2, max_thread_count))
+	{
+		chaf::LruCacher<uint32_t, uint64_t, chaf::ContentionMutex> single_lock(CACHE_SIZE, CACHE_SIZE / 8);
+		chaf::ShardedLruCacher<uint32_t, uint64_t> sharded(CACHE_SIZE, CACHE_SIZE / 8);
+
+		decltype(job_benchmark)::Contention result{};
+		result.thread_count = thread_count;
+		result.single_lock = run(thread_count, single_lock);
+		result.sharded = run(thread_count, sharded);
+		result.single_lock_contended = contended(single_lock.getLock().getContended(), single_lock.getLock().getAcquired());
+		auto sharded_stats = sharded.getStats();
+		result.sharded_contended = contended(sharded_stats.lock_contended, sharded_stats.lock_acquired);
+		job_benchmark.contention.push_back(result);
+
+		if (thread_count == max_thread_count)
+		{
+			break;
+		}
+	}
+}
+
+void Application::benchmarkCachePolicies()
 {
-	memcpy(scene_pipeline->last_sceneUBO_buffer.mapped, scene_pipeline->sceneUBO.buffer.mapped, sizeof(scene_pipeline->sceneUBO.values));
+	std::vector<uint32_t> keys = request_trace;
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	job_benchmark.trace_size = request_trace.size();
+	job_benchmark.trace_key_count = keys.size();
+	job_benchmark.policy_hit_rate.clear();
+
+	// Every request misses once its key was evicted and is inserted again, like BufferCacher loading it
+	auto replay = [this](auto& cache) {
+		uint64_t value = 0;
+		for (uint32_t key : request_trace)
+		{
+			if (!cache.try_get(key, value))
+			{
+				cache.insert(key, uint64_t{ key });
+			}
+		}
+		auto stats = cache.getStats();
+		uint64_t lookup_count = stats.hit_count + stats.miss_count;
+		return lookup_count == 0 ? 0.0 : static_cast<double>(stats.hit_count) / lookup_count;
+	};
+
+	// Caches holding an eighth, a quarter and half of the keys on the path
+	for (size_t divisor : { 8, 4, 2 })
+	{
+		size_t cache_size = std::max<size_t>(keys.size() / divisor, 1);
+
+		chaf::LruCacher<uint32_t, uint64_t, chaf::NullLock, chaf::LruPolicy> lru(cache_size, 0);
+		chaf::LruCacher<uint32_t, uint64_t, chaf::NullLock, chaf::TwoQPolicy> two_q(cache_size, 0);
+		chaf::LruCacher<uint32_t, uint64_t, chaf::NullLock, chaf::ArcPolicy> arc(cache_size, 0);
+		chaf::LruCacher<uint32_t, uint64_t, chaf::NullLock, chaf::WTinyLfuPolicy> w_tiny_lfu(cache_size, 0);
+
+		decltype(job_benchmark)::PolicyHitRate result{};
+		result.cache_size = cache_size;
+		result.lru = replay(lru);
+		result.two_q = replay(two_q);
+		result.arc = replay(arc);
+		result.w_tiny_lfu = replay(w_tiny_lfu);
+		job_benchmark.policy_hit_rate.push_back(result);
+	}
+}
 
+void Application::update()
+{
+	// Values are uploaded to the uniform buffers of the current frame in draw()
 	scene_pipeline->sceneUBO.values.projection = camera.matrices.perspective;
 	scene_pipeline->sceneUBO.values.view = camera.matrices.view;
 	scene_pipeline->sceneUBO.values.viewPos = camera.viewPos;
@@ -334,9 +1215,6 @@ void Application::update()
 	{
 		memcpy(scene_pipeline->sceneUBO.values.frustum, frustum.planes.data(), sizeof(glm::vec4) * 6);
 	}
-	memcpy(scene_pipeline->sceneUBO.buffer.mapped, &scene_pipeline->sceneUBO.values, sizeof(scene_pipeline->sceneUBO.values));
-
-
 }
 
 void Application::OnUpdateUIOverlay(vks::UIOverlay* overlay)
@@ -406,6 +1284,184 @@ void Application::updateOverlay()
 		ImGui::Text("ave fps: %.1d", ave_fps);
 		ImGui::Text("max fps: %.1d", max_fps);
 		ImGui::Text("min fps: %.1d", min_fps);
+		ImGui::Text("scene record time: %.3f ms", scene_record_time);
+		ImGui::Text("compute time: %.3f ms", gpu_timing.compute);
+		ImGui::Text("graphics time: %.3f ms", gpu_timing.graphics);
+		ImGui::Text("compute overlap: %.3f ms", gpu_timing.overlap);
+
+		auto heaps = chaf::MemoryBudget::get().getHeaps();
+		ImGui::Text("VRAM budget: %llu MB%s, usage: %llu MB, buffer cache: %llu MB, image cache: %llu MB",
+			static_cast<unsigned long long>(heaps.budget >> 20), heaps.from_extension ? "" : " (estimated)",
+			static_cast<unsigned long long>(heaps.usage >> 20), static_cast<unsigned long long>(scene->buffer_cacher->getSize() >> 20),
+			static_cast<unsigned long long>(scene->image_cacher->getSize() >> 20));
+
+		auto upload_stats = chaf::UploadManager::get().getStats();
+		ImGui::Text("uploads: %llu (%llu MB) in %llu batches, %u in flight, %s queue",
+			static_cast<unsigned long long>(upload_stats.upload_count), static_cast<unsigned long long>(upload_stats.uploaded_bytes >> 20),
+			static_cast<unsigned long long>(upload_stats.batch_count), upload_stats.batches_in_flight, upload_stats.dedicated_queue ? "dedicated" : "graphics");
+		ImGui::Text("staging ring: %llu / %llu MB, stalls: %llu",
+			static_cast<unsigned long long>(upload_stats.ring_used >> 20), static_cast<unsigned long long>(upload_stats.ring_size >> 20),
+			static_cast<unsigned long long>(upload_stats.stall_count));
+
+		auto allocator_stats = chaf::Allocator::get().getStats();
+		ImGui::Text("VMA budget: %llu MB, usage: %llu MB, blocks: %u, allocations: %u",
+			static_cast<unsigned long long>(allocator_stats.budget >> 20), static_cast<unsigned long long>(allocator_stats.usage >> 20),
+			allocator_stats.block_count, allocator_stats.allocation_count);
+		ImGui::Text("VMA used: %llu MB, unused: %llu MB",
+			static_cast<unsigned long long>(allocator_stats.used_bytes >> 20), static_cast<unsigned long long>(allocator_stats.unused_bytes >> 20));
+		for (auto& pool_stats : allocator_stats.pools)
+		{
+			ImGui::Text("%s pool: %llu blocks, %llu MB, %llu allocations, %llu MB unused",
+				pool_stats.name, static_cast<unsigned long long>(pool_stats.block_count), static_cast<unsigned long long>(pool_stats.block_bytes >> 20),
+				static_cast<unsigned long long>(pool_stats.allocation_count), static_cast<unsigned long long>(pool_stats.unused_bytes >> 20));
+		}
+
+		auto arena_stats = scene->buffer_cacher->getArenaStats();
+		for (auto [name, stats] : { std::make_pair("vertex", arena_stats.vertex), std::make_pair("index", arena_stats.index) })
+		{
+			ImGui::Text("%s arena: %u / %u (%llu MB), largest free: %u, ranges: %u, relocations: %u",
+				name, stats.used, stats.capacity, static_cast<unsigned long long>((stats.capacity * stats.stride) >> 20),
+				stats.largest_free, stats.allocation_count, stats.relocation_count);
+		}
+		ImGui::Text("loads waiting for arena space: %u", arena_stats.deferred_count);
+
+		auto slot_stats = scene->image_cacher->getSlotStats();
+		ImGui::Text("texture slots: %u / %u, resident: %u, loading: %u, shared: %u, retired: %u",
+			slot_stats.used, slot_stats.capacity, slot_stats.resident, slot_stats.loading, slot_stats.shared, slot_stats.retired);
+
+		auto texture_cache_stats = chaf::TextureCache::get().getStats();
+		ImGui::Text("texture cache: %u mapped (%.1f ms), %u decoded (%.1f ms), %u shared, %u hashed",
+			texture_cache_stats.disk_hit_count, texture_cache_stats.map_time, texture_cache_stats.decode_count, texture_cache_stats.decode_time,
+			texture_cache_stats.memory_hit_count, texture_cache_stats.hash_count);
+		if (chaf::TextureCache::get().getMipGeneration() == chaf::TextureCache::MipGeneration::Gpu)
+		{
+			ImGui::Text("mip maps: GPU blits of %llu textures", static_cast<unsigned long long>(upload_stats.mipmap_blit_count));
+		}
+		else
+		{
+			ImGui::Text("mip maps: CPU box filter, %.1f ms", texture_cache_stats.mipmap_time);
+		}
+		if (texture_cache_stats.astc_decoded_bytes > 0)
+		{
+			ImGui::Text("ASTC software decode: %llu MB in %.1f ms, %.1f MB/s",
+				static_cast<unsigned long long>(texture_cache_stats.astc_decoded_bytes >> 20), texture_cache_stats.astc_decode_time,
+				texture_cache_stats.getAstcThroughput());
+		}
+
+		auto prefetch_stats = scene->image_cacher->getPrefetchStats();
+		ImGui::Text("prefetch: %llu issued, %llu used, %llu late, %llu wasted, %llu on demand, accuracy %.1f%%, camera %.1f/s",
+			static_cast<unsigned long long>(prefetch_stats.issued), static_cast<unsigned long long>(prefetch_stats.used),
+			static_cast<unsigned long long>(prefetch_stats.late), static_cast<unsigned long long>(prefetch_stats.wasted),
+			static_cast<unsigned long long>(prefetch_stats.demand), prefetch_stats.getAccuracy() * 100.0, prefetcher.getSpeed());
+		auto mesh_prefetch_stats = scene->buffer_cacher->getPrefetchStats();
+		ImGui::Text("mesh prefetch: %llu issued, %llu used, %llu late, %llu wasted, %llu on demand, accuracy %.1f%%",
+			static_cast<unsigned long long>(mesh_prefetch_stats.issued), static_cast<unsigned long long>(mesh_prefetch_stats.used),
+			static_cast<unsigned long long>(mesh_prefetch_stats.late), static_cast<unsigned long long>(mesh_prefetch_stats.wasted),
+			static_cast<unsigned long long>(mesh_prefetch_stats.demand), mesh_prefetch_stats.getAccuracy() * 100.0);
+		ImGui::Checkbox("prefetch meshes and textures", &prefetch);
+		ImGui::SliderFloat("prefetch look ahead (s)", &prefetcher.settings.look_ahead, 0.1f, 4.f);
+		ImGui::SliderInt("prefetch loads per frame", &max_prefetch_loads, 1, 128);
+
+		// Lower than the memory budget to watch textures stream in and out
+		int texture_budget = static_cast<int>(scene->image_cacher->getBudgetLimit() >> 20);
+		if (ImGui::SliderInt("texture budget (MB, 0: memory budget)", &texture_budget, 0, 4096))
+		{
+			scene->image_cacher->setBudgetLimit(static_cast<VkDeviceSize>(texture_budget) << 20);
+		}
+
+		if (ImGui::Button("compact geometry"))
+		{
+			// Frames in flight keep drawing from the old arena buffers, skipped while meshes are loading
+			scene->buffer_cacher->compact();
+		}
+
+		for (auto& cache_stats : chaf::Cacher::getAllStats())
+		{
+			ImGui::Text("%s cache: %llu entries, %llu MB, hit rate %.1f%% (%llu / %llu), evictions: %llu",
+				cache_stats.name.c_str(), static_cast<unsigned long long>(cache_stats.resident_count), static_cast<unsigned long long>(cache_stats.resident_bytes >> 20),
+				cache_stats.getHitRate() * 100.0, static_cast<unsigned long long>(cache_stats.hit_count), static_cast<unsigned long long>(cache_stats.hit_count + cache_stats.miss_count),
+				static_cast<unsigned long long>(cache_stats.eviction_count));
+
+			uint64_t load_count = cache_stats.getLoadCount();
+			ImGui::Text("%s cache: in flight %u, loads %llu (avg %.2f ms), locks %llu, contended %llu",
+				cache_stats.name.c_str(), cache_stats.in_flight, static_cast<unsigned long long>(load_count),
+				load_count == 0 ? 0.0 : cache_stats.load_latency_total / load_count,
+				static_cast<unsigned long long>(cache_stats.lock_acquired), static_cast<unsigned long long>(cache_stats.lock_contended));
+
+			// Bucket i: loads under 2^i ms
+			std::array<float, chaf::LatencyHistogram::BUCKET_COUNT> latency;
+			std::transform(cache_stats.load_latency.begin(), cache_stats.load_latency.end(), latency.begin(), [](uint64_t count) { return static_cast<float>(count); });
+			ImGui::PlotHistogram((cache_stats.name + " load latency").c_str(), latency.data(), static_cast<int>(latency.size()));
+		}
+
+		if (ImGui::Button("dump cache stats"))
+		{
+			chaf::Cacher::dumpStats("../data/cache/cache_stats.json");
+		}
+
+		auto job_stats = chaf::JobSystem::get().getStats();
+		ImGui::Text("jobs: %u workers, %llu run, %llu stolen, %llu cancelled, queued frame %u, load %u, prefetch %u",
+			job_stats.worker_count, static_cast<unsigned long long>(job_stats.executed_count), static_cast<unsigned long long>(job_stats.stolen_count),
+			static_cast<unsigned long long>(job_stats.cancelled_count), job_stats.queued[static_cast<size_t>(chaf::JobPriority::Frame)],
+			job_stats.queued[static_cast<size_t>(chaf::JobPriority::Load)], job_stats.queued[static_cast<size_t>(chaf::JobPriority::Prefetch)]);
+		if (ImGui::Button("benchmark jobs"))
+		{
+			benchmarkJobs();
+			benchmarkCacheContention();
+		}
+		ImGui::Text("65536 jobs, job system: %.2f ms, ctpl: %.2f ms", job_benchmark.job_system, job_benchmark.ctpl);
+		for (auto& contention : job_benchmark.contention)
+		{
+			ImGui::Text("cache, %u threads: single lock %.1f Mops/s (%.0f%% contended), sharded %.1f Mops/s (%.0f%% contended)",
+				contention.thread_count, contention.single_lock, contention.single_lock_contended * 100.0, contention.sharded, contention.sharded_contended * 100.0);
+		}
+
+		ImGui::Checkbox("record request trace", &record_request_trace);
+		ImGui::SameLine();
+		if (ImGui::Button("clear trace"))
+		{
+			request_trace.clear();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("replay trace"))
+		{
+			benchmarkCachePolicies();
+		}
+		ImGui::Text("trace: %llu requests, replayed %llu requests of %llu keys", static_cast<unsigned long long>(request_trace.size()),
+			static_cast<unsigned long long>(job_benchmark.trace_size), static_cast<unsigned long long>(job_benchmark.trace_key_count));
+		for (auto& hit_rate : job_benchmark.policy_hit_rate)
+		{
+			ImGui::Text("hit rate, %llu entries: LRU %.3f, 2Q %.3f, ARC %.3f, W-TinyLFU %.3f",
+				static_cast<unsigned long long>(hit_rate.cache_size), hit_rate.lru, hit_rate.two_q, hit_rate.arc, hit_rate.w_tiny_lfu);
+		}
+
+		auto pipeline_cache_stats = chaf::PipelineCache::get().getStats();
+		ImGui::Text("pipelines: %u, creation time: %.3f ms", pipeline_cache_stats.pipeline_count, pipeline_cache_stats.creation_time);
+		if (pipeline_cache_stats.feedback)
+		{
+			ImGui::Text("pipeline cache hit: %u, miss: %u", pipeline_cache_stats.hit_count, pipeline_cache_stats.miss_count);
+		}
+		ImGui::Text("pipeline cache loaded: %zu KB, saved: %zu KB", pipeline_cache_stats.loaded_size / 1024, pipeline_cache_stats.saved_size / 1024);
+
+		auto shader_library_stats = chaf::ShaderLibrary::get().getStats();
+		ImGui::Text("shaders compiled: %u (%.1f ms), from disk: %u, from memory: %u",
+			shader_library_stats.compile_count, shader_library_stats.compile_time, shader_library_stats.disk_hit_count, shader_library_stats.memory_hit_count);
+
+		auto layout_cache_stats = chaf::LayoutCache::get().getStats();
+		ImGui::Text("set layouts: %u / %u requests, pipeline layouts: %u / %u requests",
+			layout_cache_stats.set_layout_count, layout_cache_stats.set_layout_requests, layout_cache_stats.pipeline_layout_count, layout_cache_stats.pipeline_layout_requests);
+
+		for (auto& [kernel, result] : chaf::KernelTuner::get().getResults())
+		{
+			ImGui::Text("%s: %ux%u, options %u, %.3f ms%s",
+				kernel.c_str(), result.config.group_size_x, result.config.group_size_y, result.config.options, result.time, result.tuned ? " (tuned)" : "");
+		}
+
+#ifdef ENABLE_SHADER_HOT_RELOAD
+		auto shader_reloader_stats = shader_reloader->getStats();
+		ImGui::Text("shader reloads: %u (last %.1f ms), failed: %u",
+			shader_reloader_stats.reload_count, shader_reloader_stats.last_reload_time, shader_reloader_stats.failure_count);
+#endif // ENABLE_SHADER_HOT_RELOAD
 
 		ImGui::Checkbox("begin benckmark", &begin);
 	}
@@ -415,8 +1471,9 @@ void Application::updateOverlay()
 		if (ImGui::Button(scene_pipeline->line_mode ? "fill mode" : "line mode"))
 		{
 			scene_pipeline->line_mode = !scene_pipeline->line_mode;
+			vkDeviceWaitIdle(device);
 			scene_pipeline->setupPipeline(renderPass);
-			UIOverlay.updated = true;
+			markSceneDirty();
 		}
 
 		ImGui::SameLine();
@@ -424,22 +1481,36 @@ void Application::updateOverlay()
 		if (ImGui::Button(scene_pipeline->enable_tessellation ? "tessellation disable" : "tessellation enable"))
 		{
 			scene_pipeline->enable_tessellation = !scene_pipeline->enable_tessellation;
+			vkDeviceWaitIdle(device);
 			scene_pipeline->setupPipeline(renderPass);
-			UIOverlay.updated = true;
+			markSceneDirty();
+		}
+
+		if (ImGui::Button(scene_pipeline->enable_multi_thread ? "multi-thread recording disable" : "multi-thread recording enable"))
+		{
+			scene_pipeline->enable_multi_thread = !scene_pipeline->enable_multi_thread;
+			markSceneDirty();
 		}
 
 		if (ImGui::Button(display_bindless_texture ? "bindless texture visualization disable" : "bindless texture visualization enable"))
 		{
 			display_bindless_texture = !display_bindless_texture;
-			UIOverlay.updated = true;
+			markSceneDirty();
 		}
 
 		if (ImGui::Button(culling_pipeline->enable_hiz ? "hiz disable" : "hiz enable"))
 		{
 			culling_pipeline->enable_hiz = !culling_pipeline->enable_hiz;
+			// Culling resources may still be used by frames in flight
+			vkDeviceWaitIdle(device);
 			culling_pipeline->destroy();
 			culling_pipeline->setupPipeline(queue, *scene_pipeline, *hiz_pipeline);
-			UIOverlay.updated = true;
+			markSceneDirty();
+		}
+
+		if (ImGui::Button(async_compute ? "async compute disable" : "async compute enable"))
+		{
+			async_compute = !async_compute;
 		}
 
 		if (ImGui::Button(fix_frustum ? "fixed frustum disable" : "fixed frustum enable"))
@@ -468,9 +1539,10 @@ void Application::updateOverlay()
 			{
 				if (display_debug > 0)
 				{
+					vkDeviceWaitIdle(device);
 					debug_pipeline->updateDescriptors(*hiz_pipeline, display_debug - 1);
-					UIOverlay.updated = true;
 				}
+				markSceneDirty();
 			}
 		}
 #endif // ENABLE_DYNAMIC_STATE
@@ -611,22 +1683,34 @@ void Application::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
-	if (UIOverlay.update() || UIOverlay.updated || scene->buffer_cacher->updated)
+	// New geometry every ImGui frame. Each frame slot copies it into its own buffers when it records the overlay,
+	// so frames in flight never read geometry the CPU is writing
+	markOverlayDirty();
+	UIOverlay.updated = false;
+
+	if (scene->buffer_cacher->updated)
 	{
-		buildCommandBuffers();
-		UIOverlay.updated = false;
+		markSceneDirty();
 		scene->buffer_cacher->updated = false;
 	}
 }
 
 void Application::windowResized()
 {
+	// Image count may have changed, the device is idle so no image is in use
+	frames_in_flight.image_fences.assign(drawCmdBuffers.size(), VK_NULL_HANDLE);
+
 	hiz_pipeline->resize(width, height, queue);
+	hiz_pipeline->buildCopyCommandBuffers(depthStencil.image);
+	depth_copy_frames.fill(0);
 	if (culling_pipeline->enable_hiz)
 	{
 		culling_pipeline->destroy();
 		culling_pipeline->setupPipeline(queue, *scene_pipeline, *hiz_pipeline);
 	}
+
+	// Depth copy targets the recreated hiz depth image
+	markSceneDirty();
 }
 
 void Application::saveScreenShot()
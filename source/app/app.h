@@ -2,6 +2,11 @@
 
 #include <scene/scene_loader.h>
 #include <scene/cacher/buffer_cacher.h>
+#include <scene/cacher/image_cacher.h>
+#include <scene/cacher/prefetcher.h>
+#include <scene/cacher/allocator.h>
+#include <scene/cacher/upload_manager.h>
+#include <scene/cacher/texture_cache.h>
 #include <scene/components/transform.h>
 #include <scene/components/camera.h>
 #include <scene/components/mesh.h>
@@ -13,6 +18,11 @@
 #include <renderer/hiz_pipeline.h>
 #include <renderer/debug_pipeline.h>
 #include <renderer/vis_bindless_pipeline.h>
+#include <renderer/timestamp_profiler.h>
+#include <renderer/pipeline_cache.h>
+#include <renderer/layout_cache.h>
+#include <renderer/kernel_tuner.h>
+#include <renderer/shader_reloader.h>
 
 #include <vk_mem_alloc.h>
 
@@ -23,6 +33,7 @@ class Application :public VulkanExampleBase
 public:
 	VkPhysicalDeviceDescriptorIndexingFeaturesEXT physicalDeviceDescriptorIndexingFeatures{};
 	VkPhysicalDeviceDescriptorIndexingPropertiesEXT physicalDeviceDescriptorIndexingProperties{};
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR physicalDeviceTimelineSemaphoreFeatures{};
 #ifdef ENABLE_DYNAMIC_STATE
 	PFN_vkCmdSetDepthTestEnableEXT vkCmdSetDepthTestEnableEXT;
 	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT physicalDeviceExtendedDynamicStateFeatures;
@@ -35,6 +46,13 @@ public:
 
 	void buildCommandBuffers();
 
+	// Secondary command buffers of a frame slot which are dirty, then the primary command buffer of a swapchain image executing them
+	void recordCommandBuffer(uint32_t frame, uint32_t image);
+
+	void markSceneDirty();
+
+	void markOverlayDirty();
+
 	void prepare();
 
 	virtual void getEnabledFeatures() override;
@@ -53,6 +71,44 @@ public:
 
 	void saveScreenShot();
 
+private:
+	void recordSceneCommandBuffer(uint32_t frame);
+
+	void recordOverlayCommandBuffer(uint32_t frame);
+
+	// Copy ImGui geometry into the buffers of a frame slot, false if there is nothing to draw
+	bool updateOverlayBuffers(uint32_t frame, const ImDrawData& draw_data);
+
+	// Compile all shader permutations in parallel before pipelines are created
+	void precompileShaders();
+
+	void prepareFramesInFlight();
+
+	void destroyFramesInFlight();
+
+	void presentFrame();
+
+	void submitCompute(uint32_t frame, uint64_t depth_frame, bool build_hiz);
+
+	void submitGraphics(uint32_t frame, bool copy_depth);
+
+	void updateGpuTiming(uint32_t frame);
+
+	// Load geometry and textures of draws in the view frustum and keep them from being evicted
+	void requestResources();
+
+	// Start low priority loads of meshes and textures of draws the camera is moving towards
+	void prefetchResources();
+
+	// Time many small jobs through the job system and through a ctpl thread pool of as many threads
+	void benchmarkJobs();
+
+	// Hammer a single lock cache and a sharded one from a growing number of threads
+	void benchmarkCacheContention();
+
+	// Replay the recorded geometry request trace through a cache of each replacement policy
+	void benchmarkCachePolicies();
+
 private:
 	std::unique_ptr<chaf::Scene> scene{ nullptr };
 
@@ -62,9 +118,140 @@ private:
 	std::unique_ptr<DebugPipeline> debug_pipeline;
 	std::unique_ptr<VisBindlessPipeline> vis_bindless_pipeline;
 
+#ifdef ENABLE_SHADER_HOT_RELOAD
+	std::unique_ptr<chaf::ShaderReloader> shader_reloader;
+#endif // ENABLE_SHADER_HOT_RELOAD
+
 	int32_t display_debug{ 0 };
 	bool display_bindless_texture{ false };
 	bool fix_frustum{ false };
 
 	uint32_t cull_count{ 0 };
+
+	// Texture slots and geometry keys requested this frame
+	std::vector<uint32_t> texture_requests;
+
+	std::vector<uint32_t> geometry_requests;
+
+	// Geometry keys requested per frame while recording, replayed by benchmarkCachePolicies
+	bool record_request_trace{ false };
+	std::vector<uint32_t> request_trace;
+
+	// Frustum test of every draw, written by parallel jobs
+	std::vector<uint8_t> draw_visible;
+
+	chaf::Prefetcher prefetcher;
+	bool prefetch{ true };
+
+	// Draws entering the view, nearest look ahead first
+	std::vector<uint32_t> prefetch_draws;
+
+	// Prefetch loads started per frame, so they trickle in behind requested ones
+	int max_prefetch_loads{ 32 };
+
+	// ms of the last job benchmark
+	struct
+	{
+		double job_system{ 0.0 };
+		double ctpl{ 0.0 };
+
+		struct Contention
+		{
+			uint32_t thread_count;
+			// Million cache operations per second
+			double single_lock;
+			double sharded;
+			// Fraction of lock acquisitions that found the lock taken
+			double single_lock_contended;
+			double sharded_contended;
+		};
+		std::vector<Contention> contention;
+
+		struct PolicyHitRate
+		{
+			size_t cache_size;
+			double lru;
+			double two_q;
+			double arc;
+			double w_tiny_lfu;
+		};
+		std::vector<PolicyHitRate> policy_hit_rate;
+		size_t trace_size{ 0 };
+		size_t trace_key_count{ 0 };
+	}job_benchmark;
+
+	// CPU time of last scene command buffer recording in ms
+	float scene_record_time{ 0.f };
+
+	// Pipeline cache hits are only reported with creation feedback extension
+	bool pipeline_creation_feedback{ false };
+
+	bool memory_budget{ false };
+
+	// Scene and overlay are recorded into secondary command buffers per frame slot, primary command buffers only execute them
+	struct
+	{
+		std::vector<VkCommandBuffer> scene;
+		std::vector<VkCommandBuffer> overlay;
+		// Scene draws recorded by worker threads when multi-thread recording is enabled
+		std::vector<std::vector<VkCommandBuffer>> scene_threads;
+	}secondary_cmd_buffers;
+
+	// Per frame slot dirty flags, secondary command buffers are re-recorded only when flagged
+	struct
+	{
+		std::vector<bool> scene;
+		std::vector<bool> overlay;
+	}cmd_buffer_dirty;
+
+	// Frames in flight, resources of a frame slot are reused only after the frame that last used them has finished
+	struct
+	{
+		std::vector<VkFence> fences;
+		// Fence of the frame that last rendered to each swapchain image, resized when the swapchain is recreated
+		std::vector<VkFence> image_fences;
+		// Slot 0 holds the semaphores owned by VulkanExampleBase
+		std::vector<VkSemaphore> present_complete;
+		std::vector<VkSemaphore> render_complete;
+		uint32_t index{ 0 };
+	}frames_in_flight;
+
+	// ImGui geometry per frame slot, UIOverlay's own buffers are shared by all frames in flight
+	struct
+	{
+		std::vector<chaf::Buffer> vertex;
+		std::vector<chaf::Buffer> index;
+	}overlay_buffers;
+
+	// Async compute schedule, Hi-z and culling of next frame overlap shading of current frame.
+	// Otherwise Hi-z waits for the depth of previous frame, serializing compute and graphics
+	bool async_compute{ true };
+
+	// Timeline values are frame numbers
+	struct
+	{
+		VkSemaphore compute{ VK_NULL_HANDLE };
+		VkSemaphore graphics{ VK_NULL_HANDLE };
+	}timeline_semaphores;
+
+	uint64_t frame_number{ 0 };
+
+	// Frame number that last wrote each Hi-z depth copy
+	std::array<uint64_t, HizPipeline::DEPTH_COPY_COUNT> depth_copy_frames{};
+
+	std::unique_ptr<TimestampProfiler> profiler;
+
+	struct
+	{
+		uint32_t compute{ 0 };
+		uint32_t graphics{ 0 };
+	}profiler_scopes;
+
+	// Milliseconds, measured by timestamp profiler
+	struct
+	{
+		double compute{ 0.0 };
+		double graphics{ 0.0 };
+		double overlap{ 0.0 };
+	}gpu_timing;
 };
\ No newline at end of file
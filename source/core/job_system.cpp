@@ -0,0 +1,453 @@
+#include <core/job_system.h>
+
+#include <VulkanTools.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace chaf
+{
+	static constexpr uint32_t NOT_A_WORKER = ~0u;
+
+	// Index of the worker running on this thread
+	static thread_local uint32_t current_worker = NOT_A_WORKER;
+
+	void JobHandle::cancel() const
+	{
+		if (state)
+		{
+			state->cancelled = true;
+		}
+	}
+
+	bool JobHandle::isCancelled() const
+	{
+		return state && state->cancelled;
+	}
+
+	bool JobHandle::isDone() const
+	{
+		return !state || state->pending == 0;
+	}
+
+	void JobHandle::wait() const
+	{
+		if (state)
+		{
+			JobSystem::get().wait(*state);
+		}
+	}
+
+	bool JobHandle::empty() const
+	{
+		return !state;
+	}
+
+	JobSystem& JobSystem::get()
+	{
+		static JobSystem job_system;
+		return job_system;
+	}
+
+	JobSystem::~JobSystem()
+	{
+		destroy();
+	}
+
+	void JobSystem::initialize(uint32_t worker_count)
+	{
+		std::lock_guard<std::mutex> lock(start_mutex);
+
+		if (running)
+		{
+			return;
+		}
+
+		if (worker_count == 0)
+		{
+			worker_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		}
+		background_limit = std::max(1u, worker_count - 1);
+
+		for (uint32_t i = 0; i < worker_count; i++)
+		{
+			workers.push_back(std::make_unique<Worker>());
+		}
+
+		// Published only once the workers exist, push reads workers as soon as it sees running
+		running.store(true, std::memory_order_release);
+		started.store(true, std::memory_order_release);
+
+		// Started once all deques exist, workers steal from each other right away
+		for (uint32_t i = 0; i < worker_count; i++)
+		{
+			workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+		}
+	}
+
+	void JobSystem::destroy()
+	{
+		std::lock_guard<std::mutex> lock(start_mutex);
+
+		if (!running)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> sleep_lock(sleep_mutex);
+			running = false;
+		}
+		sleep_condition.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker->thread.join();
+		}
+
+		// Waiters are released as if the jobs were cancelled
+		for (auto& worker : workers)
+		{
+			for (auto& lane : worker->lanes)
+			{
+				for (auto& job : lane)
+				{
+					cancelled_count++;
+					finish(job);
+				}
+				lane.clear();
+			}
+		}
+
+		for (auto& count : queued)
+		{
+			count = 0;
+		}
+		workers.clear();
+	}
+
+	void JobSystem::ensureRunning()
+	{
+		if (running.load(std::memory_order_acquire))
+		{
+			return;
+		}
+
+		// Only started lazily before the first initialize(), a push after destroy() would bring workers back
+		// while the caches their jobs use are torn down
+		if (started.load(std::memory_order_acquire))
+		{
+			assert(!"Job pushed after JobSystem::destroy()");
+			vks::tools::exitFatal("Job pushed after the job system was destroyed", -1);
+		}
+
+		initialize();
+	}
+
+	JobHandle JobSystem::push(JobPriority priority, std::function<void()>&& job, JobHandle group)
+	{
+		ensureRunning();
+
+		if (!group.state)
+		{
+			group.state = std::make_shared<JobHandle::State>();
+			group.state->priority = priority;
+		}
+		group.state->pending++;
+
+		// Jobs pushed by a job stay with its worker, others are spread
+		uint32_t index = current_worker != NOT_A_WORKER ? current_worker : next_worker++ % static_cast<uint32_t>(workers.size());
+		uint32_t lane = static_cast<uint32_t>(priority);
+		{
+			std::lock_guard<std::mutex> lock(workers[index]->mutex);
+			workers[index]->lanes[lane].push_back({ std::move(job), group.state });
+		}
+		queued[lane]++;
+
+		wake();
+
+		return group;
+	}
+
+	void JobSystem::parallelFor(JobPriority priority, uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& func, uint32_t grain)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		// A job still finishing while destroy() joins the workers runs all ranges itself
+		if (current_worker != NOT_A_WORKER && !running.load(std::memory_order_acquire))
+		{
+			func(0, count);
+			return;
+		}
+
+		ensureRunning();
+
+		if (grain == 0)
+		{
+			// A few ranges per thread, so stealing evens out uneven ranges
+			grain = std::max(1u, count / ((getWorkerCount() + 1) * 4));
+		}
+
+		JobHandle group;
+		for (uint32_t begin = grain; begin < count; begin += grain)
+		{
+			uint32_t end = std::min(count, begin + grain);
+			group = push(priority, [&func, begin, end]() { func(begin, end); }, group);
+		}
+
+		// First range on the calling thread, func has to outlive the others even if it throws
+		std::exception_ptr exception;
+		try
+		{
+			func(0, std::min(count, grain));
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		try
+		{
+			group.wait();
+		}
+		catch (...)
+		{
+			if (!exception)
+			{
+				exception = std::current_exception();
+			}
+		}
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+	uint32_t JobSystem::getWorkerCount() const
+	{
+		return static_cast<uint32_t>(workers.size());
+	}
+
+	JobSystem::Stats JobSystem::getStats() const
+	{
+		Stats stats;
+		stats.worker_count = getWorkerCount();
+		stats.executed_count = executed_count;
+		stats.stolen_count = stolen_count;
+		stats.cancelled_count = cancelled_count;
+		for (size_t lane = 0; lane < LANE_COUNT; lane++)
+		{
+			stats.queued[lane] = queued[lane];
+		}
+		return stats;
+	}
+
+	void JobSystem::workerLoop(uint32_t index)
+	{
+		current_worker = index;
+
+		while (true)
+		{
+			Job job;
+			uint32_t lane;
+			if (take(static_cast<uint32_t>(LANE_COUNT - 1), true, job, lane))
+			{
+				run(job);
+
+				if (lane != static_cast<uint32_t>(JobPriority::Frame))
+				{
+					// Another background job may start now
+					background_count--;
+					wake();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			sleep_condition.wait(lock, [this]() { return !running || hasWork(); });
+			if (!running)
+			{
+				break;
+			}
+		}
+	}
+
+	bool JobSystem::take(uint32_t max_lane, bool limit_background, Job& job, uint32_t& lane)
+	{
+		uint32_t self = current_worker;
+		uint32_t worker_count = static_cast<uint32_t>(workers.size());
+
+		for (lane = 0; lane <= max_lane; lane++)
+		{
+			if (queued[lane] == 0)
+			{
+				continue;
+			}
+
+			bool background = lane != static_cast<uint32_t>(JobPriority::Frame);
+			if (background && limit_background)
+			{
+				uint32_t count = background_count;
+				do
+				{
+					if (count >= background_limit)
+					{
+						return false;
+					}
+				} while (!background_count.compare_exchange_weak(count, count + 1));
+			}
+
+			// Own jobs newest first, they are likely still in cache
+			bool found = false;
+			if (self != NOT_A_WORKER)
+			{
+				std::lock_guard<std::mutex> lock(workers[self]->mutex);
+				auto& deque = workers[self]->lanes[lane];
+				if (!deque.empty())
+				{
+					job = std::move(deque.back());
+					deque.pop_back();
+					found = true;
+				}
+			}
+
+			// Oldest of others, starting at the next worker so thieves spread out
+			for (uint32_t i = 0; i < worker_count && !found; i++)
+			{
+				uint32_t victim = (self == NOT_A_WORKER ? i : self + 1 + i) % worker_count;
+				if (victim == self)
+				{
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(workers[victim]->mutex);
+				auto& deque = workers[victim]->lanes[lane];
+				if (!deque.empty())
+				{
+					job = std::move(deque.front());
+					deque.pop_front();
+					found = true;
+
+					if (self != NOT_A_WORKER)
+					{
+						stolen_count++;
+					}
+				}
+			}
+
+			if (found)
+			{
+				queued[lane]--;
+				return true;
+			}
+
+			if (background && limit_background)
+			{
+				background_count--;
+			}
+		}
+
+		return false;
+	}
+
+	void JobSystem::run(Job& job)
+	{
+		if (job.state->cancelled)
+		{
+			cancelled_count++;
+		}
+		else
+		{
+			try
+			{
+				job.func();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(job.state->mutex);
+				if (!job.state->exception)
+				{
+					job.state->exception = std::current_exception();
+				}
+			}
+			executed_count++;
+		}
+
+		finish(job);
+	}
+
+	void JobSystem::finish(Job& job)
+	{
+		// Captures are released before waiters return
+		job.func = nullptr;
+
+		if (--job.state->pending == 0)
+		{
+			std::lock_guard<std::mutex> lock(job.state->mutex);
+			job.state->done.notify_all();
+		}
+	}
+
+	void JobSystem::wake()
+	{
+		// Taken so a worker checking for work in between does not miss the notification
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		sleep_condition.notify_one();
+	}
+
+	bool JobSystem::hasWork() const
+	{
+		if (queued[static_cast<size_t>(JobPriority::Frame)] > 0)
+		{
+			return true;
+		}
+
+		if (background_count >= background_limit)
+		{
+			return false;
+		}
+
+		for (size_t lane = static_cast<size_t>(JobPriority::Frame) + 1; lane < LANE_COUNT; lane++)
+		{
+			if (queued[lane] > 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void JobSystem::wait(JobHandle::State& state)
+	{
+		// Help with jobs at least as urgent as the group, a frame must not wait for a load it picked up
+		uint32_t max_lane = static_cast<uint32_t>(state.priority);
+
+		while (state.pending > 0)
+		{
+			Job job;
+			uint32_t lane;
+			if (running && take(max_lane, false, job, lane))
+			{
+				run(job);
+				continue;
+			}
+
+			// Remaining jobs are running elsewhere, or were queued after the last look
+			std::unique_lock<std::mutex> lock(state.mutex);
+			state.done.wait_for(lock, std::chrono::microseconds(100), [&state]() { return state.pending == 0; });
+		}
+
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.exception)
+		{
+			std::rethrow_exception(state.exception);
+		}
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chaf
+{
+	// Lanes in the order workers take jobs from
+	enum class JobPriority : uint32_t
+	{
+		// Needed by the frame being recorded, e.g. command recording and culling
+		Frame,
+		// Requested by the frame, e.g. mesh, texture and shader loads
+		Load,
+		// Speculative, e.g. loads ahead of the camera
+		Prefetch,
+		Count
+	};
+
+	// Completion and cancellation of a group of jobs, copies refer to the same group
+	class JobHandle
+	{
+	public:
+		// Jobs of the group which have not started are skipped, running ones may poll isCancelled
+		void cancel() const;
+
+		bool isCancelled() const;
+
+		// Every job pushed so far has finished or was skipped, true for an empty handle
+		bool isDone() const;
+
+		// Runs queued jobs of the group priority or above meanwhile. Rethrows the first exception thrown by a job
+		void wait() const;
+
+		bool empty() const;
+
+	private:
+		friend class JobSystem;
+
+		struct State
+		{
+			JobPriority priority;
+			std::atomic<uint32_t> pending{ 0 };
+			std::atomic<bool> cancelled{ false };
+			std::mutex mutex;
+			std::condition_variable done;
+			std::exception_ptr exception;
+		};
+
+		std::shared_ptr<State> state;
+	};
+
+	// Work stealing scheduler shared by loaders, cachers, culling and command recording. Every worker owns a deque per
+	// lane, it runs its own jobs newest first and steals the oldest of others, always from the most urgent lane first.
+	// Load and prefetch jobs occupy all workers but one, so frame jobs never wait behind a slow load
+	class JobSystem
+	{
+	public:
+		struct Stats
+		{
+			uint32_t worker_count{ 0 };
+			uint64_t executed_count{ 0 };
+			// Taken by a worker from the deque of another
+			uint64_t stolen_count{ 0 };
+			uint64_t cancelled_count{ 0 };
+			std::array<uint32_t, static_cast<size_t>(JobPriority::Count)> queued{};
+		};
+
+	public:
+		static JobSystem& get();
+
+		~JobSystem();
+
+		// Workers start on first use otherwise. worker_count 0 leaves one hardware thread to the render thread
+		void initialize(uint32_t worker_count = 0);
+
+		// Join workers, queued jobs are skipped. Pushing meanwhile or afterwards is a fatal error
+		void destroy();
+
+		// Add job to group, or to a new group if it is empty. Any thread, jobs included
+		JobHandle push(JobPriority priority, std::function<void()>&& job, JobHandle group = {});
+
+		// Call func on ranges of about grain indices in parallel, the calling thread takes part. Returns when all are
+		// done and rethrows the first exception. grain 0 spreads count over all workers
+		void parallelFor(JobPriority priority, uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& func, uint32_t grain = 0);
+
+		uint32_t getWorkerCount() const;
+
+		Stats getStats() const;
+
+	private:
+		JobSystem() = default;
+
+		static constexpr size_t LANE_COUNT = static_cast<size_t>(JobPriority::Count);
+
+		struct Job
+		{
+			std::function<void()> func;
+			std::shared_ptr<JobHandle::State> state;
+		};
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::array<std::deque<Job>, LANE_COUNT> lanes;
+			std::thread thread;
+		};
+
+		// Start workers on first use, fatal once destroyed
+		void ensureRunning();
+
+		void workerLoop(uint32_t index);
+
+		// Take a job of lane max_lane or a more urgent one. Workers only take background jobs while under the limit
+		bool take(uint32_t max_lane, bool limit_background, Job& job, uint32_t& lane);
+
+		void run(Job& job);
+
+		void finish(Job& job);
+
+		void wake();
+
+		bool hasWork() const;
+
+		void wait(JobHandle::State& state);
+
+		friend class JobHandle;
+
+	private:
+		std::mutex start_mutex;
+
+		std::atomic<bool> running{ false };
+
+		// Set by the first initialize() and never cleared
+		std::atomic<bool> started{ false };
+
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		// Load and prefetch jobs running on workers, and the most there may be
+		std::atomic<uint32_t> background_count{ 0 };
+
+		uint32_t background_limit{ 0 };
+
+		std::array<std::atomic<uint32_t>, LANE_COUNT> queued{};
+
+		std::atomic<uint32_t> next_worker{ 0 };
+
+		std::mutex sleep_mutex;
+
+		std::condition_variable sleep_condition;
+
+		std::atomic<uint64_t> executed_count{ 0 };
+
+		std::atomic<uint64_t> stolen_count{ 0 };
+
+		std::atomic<uint64_t> cancelled_count{ 0 };
+	};
+}
@@ -1,18 +1,32 @@
 #include <renderer/base_pipeline.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
 namespace chaf
 {
+	void SpecializationConstants::set(uint32_t constant_id, uint32_t value)
+	{
+		entries.push_back(vks::initializers::specializationMapEntry(constant_id, static_cast<uint32_t>(data.size() * sizeof(uint32_t)), sizeof(uint32_t)));
+		data.push_back(value);
+	}
+
+	const VkSpecializationInfo* SpecializationConstants::getInfo()
+	{
+		info = vks::initializers::specializationInfo(static_cast<uint32_t>(entries.size()), entries.data(), data.size() * sizeof(uint32_t), data.data());
+		return &info;
+	}
+
 	PipelineBase::PipelineBase(vks::VulkanDevice& device) :
 		device{ device }
 	{
-		VkPipelineCacheCreateInfo pipelineCacheCI{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
-		vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipeline_cache);
+		pipeline_cache = PipelineCache::get().getHandle();
 	}
 
 	PipelineBase::~PipelineBase()
 	{
-		vkDestroyPipelineCache(device, pipeline_cache, nullptr);
-
+		std::lock_guard<std::mutex> lock(shader_mutex);
 		for (auto& shader_module : shader_modules)
 		{
 			vkDestroyShaderModule(device.logicalDevice, shader_module, nullptr);
@@ -20,20 +34,143 @@ namespace chaf
 		shader_modules.clear();
 	}
 
-	VkPipelineShaderStageCreateInfo PipelineBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
+	VkPipeline PipelineBase::createPipeline()
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	void PipelineBase::replacePipeline(VkPipeline pipeline)
+	{
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+
+	std::vector<ShaderLibrary::Job> PipelineBase::getShaderJobs()
+	{
+		std::lock_guard<std::mutex> lock(shader_mutex);
+		return shader_jobs;
+	}
+
+	VkPipelineShaderStageCreateInfo PipelineBase::loadShader(std::string fileName, VkShaderStageFlagBits stage, const ShaderVariant& variant)
 	{
 		VkPipelineShaderStageCreateInfo shaderStage = {};
 		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStage.stage = stage;
-		shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
+
+		std::string source = fileName;
+		if (source.size() > 4 && source.compare(source.size() - 4, 4, ".spv") == 0)
+		{
+			source.resize(source.size() - 4);
+		}
+
+		// Compiler log of the last failure, reported if there is no fallback
+		std::string error;
+
+		if (std::filesystem::exists(source))
+		{
+			try
+			{
+				auto shader = ShaderLibrary::get().load(stage, source, variant);
+
+				VkShaderModuleCreateInfo moduleCreateInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+				moduleCreateInfo.codeSize = shader->spirv.size() * sizeof(uint32_t);
+				moduleCreateInfo.pCode = shader->spirv.data();
+				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &shaderStage.module));
+
+				// Remembered for hot reload
+				std::lock_guard<std::mutex> lock(shader_mutex);
+				auto it = std::find_if(shader_jobs.begin(), shader_jobs.end(), [&](const ShaderLibrary::Job& job) {
+					return job.stage == stage && job.filename == source && job.variant.getPreamble() == variant.getPreamble();
+				});
+				if (it == shader_jobs.end())
+				{
+					shader_jobs.push_back({ stage, source, variant });
+				}
+			}
+			catch (const std::runtime_error& e)
+			{
+				error = e.what();
+				std::cerr << error << std::endl;
+			}
+		}
+
+		// Variants can not come from prebuilt SPIR-V
+		if (shaderStage.module == VK_NULL_HANDLE && variant.getPreamble().empty())
+		{
+			shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
+		}
 		shaderStage.pName = "main";
-		assert(shaderStage.module != VK_NULL_HANDLE);
+
+		// Hot reload compiles before rebuilding and keeps the old pipeline on failure, so only startup gets here
+		if (shaderStage.module == VK_NULL_HANDLE)
+		{
+			vks::tools::exitFatal("Could not load shader " + source + (error.empty() ? std::string() : ":\n" + error), -1);
+		}
+
+		std::lock_guard<std::mutex> lock(shader_mutex);
 		shader_modules.push_back(shaderStage.module);
 		return shaderStage;
 	}
 
+	LayoutCache::Layout PipelineBase::reflectLayout(const std::vector<std::pair<std::string, VkShaderStageFlagBits>>& shaders, const ShaderVariant& variant)
+	{
+		std::vector<ShaderResource> resources;
+		for (auto& [fileName, stage] : shaders)
+		{
+			auto shader = getShader(fileName, stage, variant);
+			resources.insert(resources.end(), shader->resources.begin(), shader->resources.end());
+		}
+
+		return LayoutCache::reflect(resources);
+	}
+
+	bool PipelineBase::hasSpecializationConstant(const std::string& fileName, VkShaderStageFlagBits stage, uint32_t constant_id)
+	{
+		auto shader = getShader(fileName, stage, {});
+		return std::any_of(shader->resources.begin(), shader->resources.end(), [constant_id](const ShaderResource& resource) {
+			return resource.type == ShaderResourceType::SpecializationConstant && resource.constant_id == constant_id;
+		});
+	}
+
+	std::shared_ptr<const ShaderLibrary::Shader> PipelineBase::getShader(const std::string& fileName, VkShaderStageFlagBits stage, const ShaderVariant& variant)
+	{
+		std::string source = fileName;
+		if (source.size() > 4 && source.compare(source.size() - 4, 4, ".spv") == 0)
+		{
+			source.resize(source.size() - 4);
+		}
+
+		if (std::filesystem::exists(source))
+		{
+			try
+			{
+				return ShaderLibrary::get().load(stage, source, variant);
+			}
+			catch (const std::runtime_error& e)
+			{
+				// Same fallback as loadShader
+				if (!variant.getPreamble().empty())
+				{
+					throw;
+				}
+				std::cerr << e.what() << std::endl;
+			}
+		}
+
+		return ShaderLibrary::loadPrebuilt(stage, fileName, variant);
+	}
+
 	uint32_t PipelineBase::getGroupCount(uint32_t thread_count, uint32_t group_size)
 	{
 		return (thread_count + group_size - 1) / group_size;
 	}
+
+	void PipelineBase::createGraphicsPipeline(VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline)
+	{
+		PipelineCache::get().createGraphicsPipeline(create_info, pipeline);
+	}
+
+	void PipelineBase::createComputePipeline(VkComputePipelineCreateInfo& create_info, VkPipeline* pipeline)
+	{
+		PipelineCache::get().createComputePipeline(create_info, pipeline);
+	}
 }
\ No newline at end of file
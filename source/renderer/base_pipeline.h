@@ -2,8 +2,31 @@
 
 #include <vulkanexamplebase.h>
 
+#include <renderer/pipeline_cache.h>
+#include <renderer/layout_cache.h>
+
+#include <shader_compiler/shader_library.h>
+
+#include <mutex>
+
 namespace chaf
 {
+	// Backing storage of specialization constants, must outlive pipeline creation
+	class SpecializationConstants
+	{
+	public:
+		void set(uint32_t constant_id, uint32_t value);
+
+		const VkSpecializationInfo* getInfo();
+
+	private:
+		std::vector<VkSpecializationMapEntry> entries;
+
+		std::vector<uint32_t> data;
+
+		VkSpecializationInfo info{};
+	};
+
 	class PipelineBase
 	{
 	public:
@@ -11,15 +34,47 @@ namespace chaf
 
 		virtual ~PipelineBase();
 
+		// Hot reload: build a replacement pipeline from current shaders and state, called on the render thread at a frame boundary.
+		// Returns VK_NULL_HANDLE if the pipeline can not be rebuilt on its own
+		virtual VkPipeline createPipeline();
+
+		// Hot reload: take ownership of a rebuilt pipeline, called on the render thread while the device is idle
+		virtual void replacePipeline(VkPipeline pipeline);
+
+		// Shaders compiled from GLSL by loadShader so far
+		std::vector<ShaderLibrary::Job> getShaderJobs();
+
 	protected:
-		VkPipelineShaderStageCreateInfo PipelineBase::loadShader(std::string fileName, VkShaderStageFlagBits stage);
+		// Compiles GLSL source next to given SPIR-V file through the shader library, prebuilt SPIR-V is the fallback
+		VkPipelineShaderStageCreateInfo PipelineBase::loadShader(std::string fileName, VkShaderStageFlagBits stage, const ShaderVariant& variant = {});
+
+		// Merge reflected resources of all shader stages into one layout, stages are given by SPIR-V file name like loadShader
+		LayoutCache::Layout reflectLayout(const std::vector<std::pair<std::string, VkShaderStageFlagBits>>& shaders, const ShaderVariant& variant = {});
+
+		// Whether the shader loadShader would use declares given specialization constant, prebuilt SPIR-V may predate it
+		bool hasSpecializationConstant(const std::string& fileName, VkShaderStageFlagBits stage, uint32_t constant_id);
 
 		uint32_t getGroupCount(uint32_t thread_count, uint32_t group_size);
 
+		// Create pipelines through the shared pipeline cache, which keeps creation statistics
+		void createGraphicsPipeline(VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline);
+
+		void createComputePipeline(VkComputePipelineCreateInfo& create_info, VkPipeline* pipeline);
+
 		vks::VulkanDevice& device;
 
+		// Shared by all pipelines, owned by PipelineCache
 		VkPipelineCache pipeline_cache;
 		
 		std::vector<VkShaderModule> shader_modules;
+
+		std::vector<ShaderLibrary::Job> shader_jobs;
+
+		// Guards shader modules and jobs
+		std::mutex shader_mutex;
+
+	private:
+		// Shader from GLSL source if it compiles, prebuilt SPIR-V otherwise
+		std::shared_ptr<const ShaderLibrary::Shader> getShader(const std::string& fileName, VkShaderStageFlagBits stage, const ShaderVariant& variant);
 	};
 }
\ No newline at end of file
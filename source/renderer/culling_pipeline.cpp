@@ -13,9 +13,19 @@ CullingPipeline::CullingPipeline(vks::VulkanDevice& device, chaf::Scene& scene)
 
 CullingPipeline::~CullingPipeline()
 {
-	indirect_command_buffer.destroy();
+	for (auto& buffer : indirect_command_buffers)
+	{
+		buffer.destroy();
+	}
+	for (auto& buffer : indircet_draw_count_buffers)
+	{
+		buffer.destroy();
+	}
+	for (auto& buffer : indirect_base_buffers)
+	{
+		buffer.destroy();
+	}
 	instance_buffer.destroy();
-	indircet_draw_count_buffer.destroy();
 	query_result_buffer.destroy();
 
 #ifdef DEBUG_HIZ
@@ -34,8 +44,6 @@ void CullingPipeline::destroy()
 {
 	if (has_init)
 	{
-		vkDestroyPipelineLayout(device.logicalDevice, pipeline_layout, nullptr);
-		vkDestroyDescriptorSetLayout(device.logicalDevice, descriptor_set_layout, nullptr);
 		vkDestroyDescriptorPool(device.logicalDevice, descriptor_pool, nullptr);
 		vkDestroyPipeline(device.logicalDevice, pipeline, nullptr);
 		vkDestroyFence(device.logicalDevice, fence, nullptr);
@@ -45,152 +53,248 @@ void CullingPipeline::destroy()
 	}
 }
 
-void CullingPipeline::buildCommandBuffer()
+VkPipeline CullingPipeline::createPipeline()
 {
-	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	return createPipeline(kernel_config);
+}
 
-	VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &cmdBufInfo));
+VkPipeline CullingPipeline::createPipeline(const chaf::KernelConfig& config)
+{
+	// Constant 0: workgroup size, 2: bounding sphere pretest
+	chaf::SpecializationConstants constants;
+	constants.set(0, config.group_size_x);
+	constants.set(2, config.options & 1);
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipeline_layout, 0);
+	computePipelineCreateInfo.stage = loadShader(getShaderFile(), VK_SHADER_STAGE_COMPUTE_BIT);
+	computePipelineCreateInfo.stage.pSpecializationInfo = constants.getInfo();
+
+	VkPipeline new_pipeline;
+	createComputePipeline(computePipelineCreateInfo, &new_pipeline);
+	return new_pipeline;
+}
 
+void CullingPipeline::replacePipeline(VkPipeline pipeline)
+{
+	// Destroyed while the replacement was built
+	if (!has_init)
 	{
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, 0);
+		vkDestroyPipeline(device, pipeline, nullptr);
+		return;
+	}
+
+	vkDestroyPipeline(device, this->pipeline, nullptr);
+	this->pipeline = pipeline;
 
-		vkCmdDispatch(command_buffer, getGroupCount(primitive_count, 64), 1, 1);
+	// Compute command buffers are recorded once, the pipeline is baked into them
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		buildCommandBuffer(i);
 	}
+}
 
-	vkEndCommandBuffer(command_buffer);
+std::string CullingPipeline::getShaderFile() const
+{
+	return enable_hiz ?
+		"../data/shaders/glsl/gpudrivenpipeline/culling_hiz.comp.spv" :
+		"../data/shaders/glsl/gpudrivenpipeline/culling.comp.spv";
 }
 
-void CullingPipeline::setupPipeline(VkQueue& queue, ScenePipeline& scene_pipeline, HizPipeline& hiz_pipeline)
+void CullingPipeline::buildCommandBuffer(uint32_t frame_index)
 {
-	// Prepare compute queue
-	vkGetDeviceQueue(device, device.queueFamilyIndices.compute, 0, &compute_queue);
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, device.properties.limits.maxDescriptorSetUniformBuffers),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, device.properties.limits.maxDescriptorSetStorageBuffers),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, device.properties.limits.maxDescriptorSetSampledImages),
-	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolInfo, nullptr, &descriptor_pool));
+	VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffers[frame_index], &cmdBufInfo));
 
-	// Descriptor set layout binding
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		// Binding 0: Instance input data buffer
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			0),
-		// Binding 1: Indirect draw command output buffer (input)
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			1),
-		// Binding 2: Uniform buffer with global matrices (input)
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			2),
-		// Binding 3: Indirect draw stats (output)
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			3)
-	};
+	indirectBufferBarrier(command_buffers[frame_index], frame_index, true, true);
 
-	if (enable_hiz)
+	// Draws are reset from the host written commands every frame, which carry the arena offsets of the meshes
 	{
-		// (Binding 4: Hiz image)
-		setLayoutBindings.push_back(
-			vks::initializers::descriptorSetLayoutBinding(
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				VK_SHADER_STAGE_COMPUTE_BIT,
-				4)
-		);
+		VkBufferCopy region{};
+		region.size = indirect_base_buffers[frame_index].size;
+		vkCmdCopyBuffer(command_buffers[frame_index], indirect_base_buffers[frame_index].buffer, indirect_command_buffers[frame_index].buffer, 1, &region);
+
+		VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+		barrier.buffer = indirect_command_buffers[frame_index].buffer;
+		barrier.size = VK_WHOLE_SIZE;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(command_buffers[frame_index], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
 	}
 
-	// Descriptor set layout
-	VkDescriptorSetLayoutCreateInfo descriptorLayout =
-		vks::initializers::descriptorSetLayoutCreateInfo(
-			setLayoutBindings.data(),
-			static_cast<uint32_t>(setLayoutBindings.size()));
+	// Hi-z render graph leaves the pyramid visible to compute reads, no barrier needed here
 
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorLayout, nullptr, &descriptor_set_layout));
+	{
+		vkCmdBindPipeline(command_buffers[frame_index], VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(command_buffers[frame_index], VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[frame_index], 0, 0);
 
-	// Pipeline layout
-	VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-		vks::initializers::pipelineLayoutCreateInfo(
-			&descriptor_set_layout,
-			1);
+		vkCmdDispatch(command_buffers[frame_index], getGroupCount(primitive_count, kernel_config.group_size_x), 1, 1);
+	}
 
-	VK_CHECK_RESULT(vkCreatePipelineLayout(device.logicalDevice, &pPipelineLayoutCreateInfo, nullptr, &pipeline_layout));
+	indirectBufferBarrier(command_buffers[frame_index], frame_index, false, false);
 
-	// Descriptor sets
-	VkDescriptorSetAllocateInfo allocInfo =
-		vks::initializers::descriptorSetAllocateInfo(
-			descriptor_pool,
-			&descriptor_set_layout,
-			1);
+	vkEndCommandBuffer(command_buffers[frame_index]);
+}
 
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_set));
+void CullingPipeline::acquireIndirectBuffer(VkCommandBuffer cmd_buffer, uint32_t frame_index)
+{
+	indirectBufferBarrier(cmd_buffer, frame_index, false, true);
+}
 
-	// update descriptor sets
-	std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+void CullingPipeline::releaseIndirectBuffer(VkCommandBuffer cmd_buffer, uint32_t frame_index)
+{
+	indirectBufferBarrier(cmd_buffer, frame_index, true, false);
+}
+
+bool CullingPipeline::hasDedicatedComputeQueue() const
+{
+	return device.queueFamilyIndices.graphics != device.queueFamilyIndices.compute;
+}
+
+void CullingPipeline::indirectBufferBarrier(VkCommandBuffer cmd_buffer, uint32_t frame_index, bool to_compute, bool acquire)
+{
+	// Same queue family, semaphores are enough
+	if (!hasDedicatedComputeQueue())
 	{
-		// Binding 0: Instance input data buffer
-		vks::initializers::writeDescriptorSet(
-			descriptor_set,
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			0,
-			&instance_buffer.descriptor),
-		// Binding 1: Indirect draw command output buffer
-		vks::initializers::writeDescriptorSet(
-			descriptor_set,
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			1,
-			&indirect_command_buffer.descriptor),
-		// Binding 2: Uniform buffer with global matrices
-		vks::initializers::writeDescriptorSet(
-			descriptor_set,
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			2,
-			&scene_pipeline.last_sceneUBO_buffer.descriptor),
-		// Binding 3: Indirect draw stats (written in shader)
-		vks::initializers::writeDescriptorSet(
-			descriptor_set,
-			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			3,
-			&indircet_draw_count_buffer.descriptor),
-	};
+		return;
+	}
 
-	if (enable_hiz)
+	// Culling only writes instance count, so the buffer content must survive the round trip between queue families
+	VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+	bufferBarrier.buffer = indirect_command_buffers[frame_index].buffer;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+	bufferBarrier.srcQueueFamilyIndex = to_compute ? device.queueFamilyIndices.graphics : device.queueFamilyIndices.compute;
+	bufferBarrier.dstQueueFamilyIndex = to_compute ? device.queueFamilyIndices.compute : device.queueFamilyIndices.graphics;
+
+	VkPipelineStageFlags graphics_stage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	VkPipelineStageFlags compute_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	VkPipelineStageFlags src_stage;
+	VkPipelineStageFlags dst_stage;
+
+	if (acquire)
 	{
-		computeWriteDescriptorSets.push_back(
-			// Binding 4: hiz image
-			vks::initializers::writeDescriptorSet(
-				descriptor_set,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				4,
-				&hiz_pipeline.hiz_image.descriptor)
-		);
+		bufferBarrier.srcAccessMask = 0;
+		bufferBarrier.dstAccessMask = to_compute ? VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dst_stage = to_compute ? VK_PIPELINE_STAGE_TRANSFER_BIT | compute_stage : graphics_stage;
+	}
+	else
+	{
+		bufferBarrier.srcAccessMask = to_compute ? 0 : VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = 0;
+		src_stage = to_compute ? graphics_stage : compute_stage;
+		dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 	}
 
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+	vkCmdPipelineBarrier(
+		cmd_buffer,
+		src_stage,
+		dst_stage,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		0, nullptr);
+}
 
-	// Create pipeline
-	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipeline_layout, 0);
+void CullingPipeline::setupPipeline(VkQueue& queue, ScenePipeline& scene_pipeline, HizPipeline& hiz_pipeline)
+{
+	// Prepare compute queue
+	vkGetDeviceQueue(device, device.queueFamilyIndices.compute, 0, &compute_queue);
+
+	// Binding 0: instance input, 1: indirect draw output, 2: global matrices, 3: draw stats, (4: Hi-z image)
+	layout = reflectLayout({ { getShaderFile(), VK_SHADER_STAGE_COMPUTE_BIT } });
+	descriptor_set_layout = chaf::LayoutCache::get().getSetLayout(layout.sets[0]);
+	pipeline_layout = chaf::LayoutCache::get().getPipelineLayout(layout);
+
+	// Prepare descriptor pool, sized for the reflected bindings of one set per frame
+	std::vector<VkDescriptorPoolSize> poolSizes = layout.getPoolSizes(0, frame_count);
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, frame_count);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolInfo, nullptr, &descriptor_pool));
 
-	if (enable_hiz)
+	// Descriptor sets, one per frame in flight
+	descriptor_sets.resize(frame_count);
+
+	for (uint32_t i = 0; i < frame_count; i++)
 	{
-		computePipelineCreateInfo.stage = loadShader("../data/shaders/glsl/gpudrivenpipeline/culling_hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VkDescriptorSetAllocateInfo allocInfo =
+			vks::initializers::descriptorSetAllocateInfo(
+				descriptor_pool,
+				&descriptor_set_layout,
+				1);
+
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_sets[i]));
+
+		// update descriptor sets
+		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		{
+			// Binding 0: Instance input data buffer
+			vks::initializers::writeDescriptorSet(
+				descriptor_sets[i],
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				0,
+				&instance_buffer.descriptor),
+			// Binding 1: Indirect draw command output buffer
+			vks::initializers::writeDescriptorSet(
+				descriptor_sets[i],
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				1,
+				&indirect_command_buffers[i].descriptor),
+			// Binding 2: Uniform buffer with global matrices
+			vks::initializers::writeDescriptorSet(
+				descriptor_sets[i],
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				2,
+				&scene_pipeline.last_sceneUBO.buffers[i].descriptor),
+			// Binding 3: Indirect draw stats (written in shader)
+			vks::initializers::writeDescriptorSet(
+				descriptor_sets[i],
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				3,
+				&indircet_draw_count_buffers[i].descriptor),
+		};
+
+		if (enable_hiz)
+		{
+			computeWriteDescriptorSets.push_back(
+				// Binding 4: hiz image
+				vks::initializers::writeDescriptorSet(
+					descriptor_sets[i],
+					VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					4,
+					&hiz_pipeline.hiz_image.descriptor)
+			);
+		}
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+	}
+
+	// Prebuilt SPIR-V has a fixed workgroup size of 32
+	if (hasSpecializationConstant(getShaderFile(), VK_SHADER_STAGE_COMPUTE_BIT, 0))
+	{
+		std::vector<chaf::KernelConfig> configs;
+		for (uint32_t size : { 32u, 64u, 128u, 256u })
+		{
+			configs.push_back({ size, 1, 0 });
+			configs.push_back({ size, 1, 1 });
+		}
+
+		kernel_config = chaf::KernelTuner::get().tune(
+			enable_hiz ? "culling_hiz" : "culling",
+			chaf::KernelTuner::get().getCandidates(configs),
+			[this](const chaf::KernelConfig& config) { return createPipeline(config); },
+			[this](VkCommandBuffer cmd_buffer, VkPipeline pipeline, const chaf::KernelConfig& config) {
+				vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+				vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[0], 0, 0);
+				vkCmdDispatch(cmd_buffer, getGroupCount(primitive_count, config.group_size_x), 1, 1);
+			});
 	}
 	else
 	{
-		computePipelineCreateInfo.stage = loadShader("../data/shaders/glsl/gpudrivenpipeline/culling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		kernel_config = { 32, 1, 1 };
 	}
 
-	VK_CHECK_RESULT(vkCreateComputePipelines(device.logicalDevice, pipeline_cache, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+	pipeline = createPipeline();
 
 	VkCommandPoolCreateInfo cmdPoolInfo = {};
 	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -198,14 +302,16 @@ void CullingPipeline::setupPipeline(VkQueue& queue, ScenePipeline& scene_pipelin
 	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	VK_CHECK_RESULT(vkCreateCommandPool(device.logicalDevice, &cmdPoolInfo, nullptr, &command_pool));
 
-	// Create a command buffer for compute operations
+	// Create command buffers for compute operations
+	command_buffers.resize(frame_count);
+
 	VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 		vks::initializers::commandBufferAllocateInfo(
 			command_pool,
 			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			1);
+			frame_count);
 
-	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, &command_buffer));
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, command_buffers.data()));
 
 	// Fence for compute CB sync
 	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
@@ -214,47 +320,102 @@ void CullingPipeline::setupPipeline(VkQueue& queue, ScenePipeline& scene_pipelin
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
 	VK_CHECK_RESULT(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &semaphore));
 
-	// Build command buffer
-	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-
-	VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &cmdBufInfo));
-
+	// Build command buffers
+	for (uint32_t i = 0; i < frame_count; i++)
 	{
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, 0);
-
-		vkCmdDispatch(command_buffer, getGroupCount(primitive_count, 32), 1, 1);
+		buildCommandBuffer(i);
 	}
 
-	vkEndCommandBuffer(command_buffer);
-
 	has_init = true;
 }
 
 void CullingPipeline::prepare(VkQueue& queue, ScenePipeline& scene_pipeline, HizPipeline& hiz_pipeline)
 {
 	destroy();
-	prepareBuffers(queue);
+	prepareBuffers(queue, scene_pipeline.getFrameCount());
 	setupPipeline(queue, scene_pipeline, hiz_pipeline);
 }
 
-void CullingPipeline::submit()
+void CullingPipeline::submit(uint32_t frame_index)
 {
 	vkWaitForFences(device.logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
 	vkResetFences(device.logicalDevice, 1, &fence);
 
 	VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
 	computeSubmitInfo.commandBufferCount = 1;
-	computeSubmitInfo.pCommandBuffers = &command_buffer;
+	computeSubmitInfo.pCommandBuffers = &command_buffers[frame_index];
 	computeSubmitInfo.signalSemaphoreCount = 1;
 	computeSubmitInfo.pSignalSemaphores = &semaphore;
 
 	VK_CHECK_RESULT(vkQueueSubmit(compute_queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
 }
 
-void CullingPipeline::prepareBuffers(VkQueue& queue)
+void CullingPipeline::updateDrawCount(uint32_t frame_index)
+{
+	memcpy(&indirect_status.draw_count[0], indircet_draw_count_buffers[frame_index].mapped, sizeof(uint32_t) * indirect_status.draw_count.size());
+}
+
+void CullingPipeline::updateIndirectCommands(uint32_t frame_index)
+{
+	uint64_t version = scene.buffer_cacher->getPlacementVersion();
+	if (version != placement_version)
+	{
+		buildIndirectCommands(version);
+	}
+
+	if (base_versions[frame_index] != placement_version)
+	{
+		memcpy(indirect_base_buffers[frame_index].mapped, indirect_commands.data(), indirect_commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+		base_versions[frame_index] = placement_version;
+	}
+}
+
+void CullingPipeline::buildIndirectCommands(uint64_t version)
+{
+	// Read before the lookups, a change meanwhile is picked up next frame
+	placement_version = version;
+
+	struct Placement
+	{
+		bool resident{ false };
+		int32_t vertex_offset{ 0 };
+		uint32_t first_index{ 0 };
+	};
+
+	// Looked up once per key, nodes instancing a mesh share its primitives' keys
+	std::unordered_map<uint32_t, Placement> placements;
+
+	for (size_t i = 0; i < draw_primitives.size(); i++)
+	{
+		const auto& primitive = *draw_primitives[i];
+
+		auto it = placements.find(primitive.buffer_index);
+		if (it == placements.end())
+		{
+			chaf::VertexBuffer vbo{};
+			chaf::IndexBuffer ebo{};
+
+			Placement placement;
+			placement.resident = scene.buffer_cacher->tryGetRanges(primitive.buffer_index, vbo, ebo);
+			placement.vertex_offset = static_cast<int32_t>(vbo.range.getOffset());
+			placement.first_index = ebo.range.getOffset();
+			it = placements.emplace(primitive.buffer_index, placement).first;
+		}
+
+		// Meshes which are not resident draw nothing until they are streamed in
+		indirect_commands[i].indexCount = it->second.resident ? primitive.index_count : 0;
+		indirect_commands[i].firstIndex = it->second.first_index;
+		indirect_commands[i].vertexOffset = it->second.vertex_offset;
+	}
+}
+
+void CullingPipeline::prepareBuffers(VkQueue& queue, uint32_t frame_count)
 {
-	vks::Buffer stagingBuffer;
+	this->frame_count = frame_count;
+
+	auto& allocator = chaf::Allocator::get();
+
+	chaf::Buffer stagingBuffer;
 
 	primitive_count = 0;
 
@@ -273,6 +434,8 @@ void CullingPipeline::prepareBuffers(VkQueue& queue)
 	std::fill(query_result.begin(), query_result.end(), 1);
 
 	indirect_commands.resize(primitive_count);
+	draw_primitives.resize(primitive_count);
+	draw_bounds.resize(primitive_count);
 
 	uint32_t idx = 0;
 
@@ -294,11 +457,11 @@ void CullingPipeline::prepareBuffers(VkQueue& queue)
 				instance_data[idx].max = world_bounds.getMax();
 				instance_data[idx].min = world_bounds.getMin();
 
-				indirect_commands[idx].indexCount = mesh.getPrimitives()[i].index_count;
+				// Index count and offsets depend on where the mesh is resident
 				indirect_commands[idx].instanceCount = 1;
-				indirect_commands[idx].firstIndex = mesh.getPrimitives()[i].first_index;
-				indirect_commands[idx].vertexOffset = 0;
 				indirect_commands[idx].firstInstance = idx;
+				draw_primitives[idx] = &mesh.getPrimitives()[i];
+				draw_bounds[idx] = world_bounds;
 
 				if (id_lookup.find(node->getID()) == id_lookup.end())
 				{
@@ -317,84 +480,71 @@ void CullingPipeline::prepareBuffers(VkQueue& queue)
 	debug_z.z.resize(indirect_commands.size());
 #endif // DEBUG_HIZ
 
-	// Transfer indirect command buffer
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		indirect_commands.size() * sizeof(VkDrawIndexedIndirectCommand),
-		indirect_commands.data()));
-
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&indirect_command_buffer,
-		stagingBuffer.size));
-
-	device.copyBuffer(&stagingBuffer, &indirect_command_buffer, queue);
-	stagingBuffer.destroy();
+	buildIndirectCommands(scene.buffer_cacher->getPlacementVersion());
 
-	// indirect draw count buffer
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&indircet_draw_count_buffer,
-		sizeof(uint32_t)*indirect_status.draw_count.size()));
+	// Transfer indirect command buffer, every frame in flight gets its own culling outputs
+	allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		indirect_commands.size() * sizeof(VkDrawIndexedIndirectCommand), stagingBuffer, indirect_commands.data());
 
-	VK_CHECK_RESULT(indircet_draw_count_buffer.map());
+	indirect_command_buffers.resize(frame_count);
+	indircet_draw_count_buffers.resize(frame_count);
+	indirect_base_buffers.resize(frame_count);
+	base_versions.assign(frame_count, placement_version);
+
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		// Host side of the draws, rewritten when meshes were placed, evicted or moved
+		allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			stagingBuffer.size, indirect_base_buffers[i], indirect_commands.data());
+
+		allocator.createBuffer(chaf::MemoryUsage::Storage, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			stagingBuffer.size, indirect_command_buffers[i]);
+
+		allocator.copyBuffer(stagingBuffer, indirect_command_buffers[i], queue);
+
+		// Indirect command buffer rests on graphics queue family, hand it over to the first culling dispatch
+		if (hasDedicatedComputeQueue())
+		{
+			VkCommandBuffer releaseCmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			releaseIndirectBuffer(releaseCmd, i);
+			device.flushCommandBuffer(releaseCmd, queue, true);
+		}
+
+		// indirect draw count buffer, read back every frame
+		allocator.createBuffer(chaf::MemoryUsage::Readback, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			sizeof(uint32_t) * indirect_status.draw_count.size(), indircet_draw_count_buffers[i], indirect_status.draw_count.data());
+	}
+
+	stagingBuffer.destroy();
 
 	// Transfer instance data
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		instance_data.size() * sizeof(InstanceData),
-		instance_data.data()));
-
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&instance_buffer,
-		stagingBuffer.size));
-
-	device.copyBuffer(&stagingBuffer, &instance_buffer, queue);
+	allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		instance_data.size() * sizeof(InstanceData), stagingBuffer, instance_data.data());
+
+	allocator.createBuffer(chaf::MemoryUsage::Storage, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		stagingBuffer.size, instance_buffer);
+
+	allocator.copyBuffer(stagingBuffer, instance_buffer, queue);
 	stagingBuffer.destroy();
 
 	// Transfer query result data
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		query_result.size() * sizeof(uint32_t),
-		query_result.data()));
-
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&query_result_buffer,
-		stagingBuffer.size));
-
-	device.copyBuffer(&stagingBuffer, &query_result_buffer, queue);
+	allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		query_result.size() * sizeof(uint32_t), stagingBuffer, query_result.data());
+
+	allocator.createBuffer(chaf::MemoryUsage::Storage, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT,
+		stagingBuffer.size, query_result_buffer);
+
+	allocator.copyBuffer(stagingBuffer, query_result_buffer, queue);
 	stagingBuffer.destroy();
 
 #ifdef DEBUG_HIZ
 	// debug depth
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&debug_depth_buffer,
-		sizeof(float) * debug_depth.depth.size()));
-
-	VK_CHECK_RESULT(debug_depth_buffer.map());
+	allocator.createBuffer(chaf::MemoryUsage::Readback, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		sizeof(float) * debug_depth.depth.size(), debug_depth_buffer);
 
 	// debug z
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&debug_z_buffer,
-		sizeof(float)* debug_z.z.size()));
-
-	VK_CHECK_RESULT(debug_z_buffer.map());
+	allocator.createBuffer(chaf::MemoryUsage::Readback, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		sizeof(float) * debug_z.z.size(), debug_z_buffer);
 #endif // DEBUG_HIZ
 
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include <renderer/base_pipeline.h>
 #include <renderer/hiz_pipeline.h>
+#include <renderer/kernel_tuner.h>
+
+#include <scene/cacher/allocator.h>
 
 #include <scene/scene.h>
 
@@ -28,51 +31,100 @@ public:
 
 	void destroy();
 
-	void buildCommandBuffer();
+	void buildCommandBuffer(uint32_t frame_index);
 
 	void setupPipeline(VkQueue& queue, ScenePipeline& scene_pipeline, HizPipeline& hiz_pipeline);
 
 	void prepare(VkQueue& queue, ScenePipeline& scene_pipeline, HizPipeline& hiz_pipeline);
 
-	void submit();
+	VkPipeline createPipeline() override;
+
+	void replacePipeline(VkPipeline pipeline) override;
+
+	void submit(uint32_t frame_index);
+
+	bool hasDedicatedComputeQueue() const;
+
+	void prepareBuffers(VkQueue& queue, uint32_t frame_count);
+
+	// Read back draw count of given frame, must be called after that frame has finished
+	void updateDrawCount(uint32_t frame_index);
+
+	// Refresh draws of given frame with the current geometry arena offsets, must be called after that frame has finished
+	void updateIndirectCommands(uint32_t frame_index);
+
+	// Queue family ownership transfer of indirect command buffer, recorded into graphics command buffers around indirect draws
+	void acquireIndirectBuffer(VkCommandBuffer cmd_buffer, uint32_t frame_index);
+
+	void releaseIndirectBuffer(VkCommandBuffer cmd_buffer, uint32_t frame_index);
+
+private:
+	void indirectBufferBarrier(VkCommandBuffer cmd_buffer, uint32_t frame_index, bool to_compute, bool acquire);
 
-	void prepareBuffers(VkQueue& queue);
+	std::string getShaderFile() const;
+
+	void buildIndirectCommands(uint64_t version);
+
+	VkPipeline createPipeline(const chaf::KernelConfig& config);
 
 public:
 	chaf::Scene& scene;
 
-	vks::Buffer indirect_command_buffer;
+	// Culling outputs, one per frame in flight
+	std::vector<chaf::Buffer> indirect_command_buffers;
+
+	std::vector<chaf::Buffer> indircet_draw_count_buffers;
+
+	// Copied into the indirect command buffer ahead of culling
+	std::vector<chaf::Buffer> indirect_base_buffers;
+
+	// Placement version each base buffer was written with
+	std::vector<uint64_t> base_versions;
 
-	vks::Buffer indircet_draw_count_buffer;
+	uint64_t placement_version{ 0 };
 
-	vks::Buffer instance_buffer;
+	chaf::Buffer instance_buffer;
 
-	vks::Buffer query_result_buffer;
+	chaf::Buffer query_result_buffer;
 
 	VkQueue compute_queue{ VK_NULL_HANDLE };
 
 	std::vector<VkDrawIndexedIndirectCommand> indirect_commands;
 
+	// Primitive of each draw
+	std::vector<const chaf::Primitive*> draw_primitives;
+
+	// World space bounds of each draw
+	std::vector<chaf::AABB> draw_bounds;
+
 	VkCommandPool command_pool{ VK_NULL_HANDLE };
 
-	VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+	std::vector<VkCommandBuffer> command_buffers;
 
 	VkFence fence{ VK_NULL_HANDLE };
 
 	VkSemaphore semaphore{ VK_NULL_HANDLE };
 
+	// Reflected from the culling shader, layouts are owned by LayoutCache
+	chaf::LayoutCache::Layout layout;
+
 	VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
 
 	VkDescriptorPool descriptor_pool;
 
-	VkDescriptorSet descriptor_set{ VK_NULL_HANDLE };
+	std::vector<VkDescriptorSet> descriptor_sets;
 
 	VkPipelineLayout pipeline_layout{ VK_NULL_HANDLE };
 
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 
+	// Workgroup size x, option 1: bounding sphere pretest
+	chaf::KernelConfig kernel_config{ 32, 1, 1 };
+
 	uint32_t primitive_count{ 0 };
 
+	uint32_t frame_count{ 1 };
+
 	bool has_init{ false };
 
 	bool enable_hiz{ false };
@@ -88,14 +140,14 @@ public:
 		std::vector<float> depth;
 	}debug_depth;
 
-	vks::Buffer debug_depth_buffer;
+	chaf::Buffer debug_depth_buffer;
 
 	struct
 	{
 		std::vector<float> z;
 	}debug_z;
 
-	vks::Buffer debug_z_buffer;
+	chaf::Buffer debug_z_buffer;
 #endif // DEBUG_HIZ
 
 
@@ -7,8 +7,6 @@ DebugPipeline::DebugPipeline(vks::VulkanDevice& device) :
 
 DebugPipeline::~DebugPipeline()
 {
-	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
 	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 }
@@ -26,47 +24,22 @@ void DebugPipeline::buildCommandBuffer(VkCommandBuffer& cmd_buffer, VkRenderPass
 	//vkCmdEndRenderPass(cmd_buffer);
 }
 
-void DebugPipeline::setupDescriptors(HizPipeline& hiz_pipeline, vks::Buffer& uniform_buffer)
+void DebugPipeline::setupDescriptors(HizPipeline& hiz_pipeline, chaf::Buffer& uniform_buffer)
 {
+	// Binding 0: render image, binding 1: debug settings
+	auto layout = reflectLayout({
+		{ "../data/shaders/glsl/gpudrivenpipeline/debug.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/debug.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT } });
+	descriptor_set_layout = chaf::LayoutCache::get().getSetLayout(layout.sets[0]);
+	pipeline_layout = chaf::LayoutCache::get().getPipelineLayout(layout);
+
 	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
-	};
+	std::vector<VkDescriptorPoolSize> poolSizes = layout.getPoolSizes(0, 1);
 
 	// Setting descriptor pool
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolInfo, nullptr, &descriptor_pool));
 
-	// Setting layout bindings
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		// Binding 0: render image
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			0),
-		// Binding 0: render image
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			1)
-	};
-
-	// Create descriptor layout
-	VkDescriptorSetLayoutCreateInfo descriptorLayout =
-		vks::initializers::descriptorSetLayoutCreateInfo(
-			setLayoutBindings.data(),
-			static_cast<uint32_t>(setLayoutBindings.size()));
-
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorLayout, nullptr, &descriptor_set_layout));
-
-	// Pipeline layout
-	VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-		vks::initializers::pipelineLayoutCreateInfo(
-			&descriptor_set_layout,
-			1);
-	VK_CHECK_RESULT(vkCreatePipelineLayout(device.logicalDevice, &pPipelineLayoutCreateInfo, nullptr, &pipeline_layout));
-
 	// Descriptor sets
 	VkDescriptorSetAllocateInfo allocInfo =
 		vks::initializers::descriptorSetAllocateInfo(
@@ -91,6 +64,12 @@ void DebugPipeline::setupDescriptors(HizPipeline& hiz_pipeline, vks::Buffer& uni
 }
 
 void DebugPipeline::prepare(VkRenderPass& render_pass)
+{
+	this->render_pass = render_pass;
+	pipeline = createPipeline();
+}
+
+VkPipeline DebugPipeline::createPipeline()
 {
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 	VkPipelineRasterizationStateCreateInfo rasterizationStateCI = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
@@ -120,7 +99,15 @@ void DebugPipeline::prepare(VkRenderPass& render_pass)
 	shaderStages[0] = loadShader("../data/shaders/glsl/gpudrivenpipeline/debug.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 	shaderStages[1] = loadShader("../data/shaders/glsl/gpudrivenpipeline/debug.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineCI, nullptr, &pipeline));
+	VkPipeline new_pipeline;
+	createGraphicsPipeline(pipelineCI, &new_pipeline);
+	return new_pipeline;
+}
+
+void DebugPipeline::replacePipeline(VkPipeline pipeline)
+{
+	vkDestroyPipeline(device, this->pipeline, nullptr);
+	this->pipeline = pipeline;
 }
 
 void DebugPipeline::updateDescriptors(HizPipeline& hiz_pipeline, uint32_t index)
@@ -15,10 +15,14 @@ public:
 
 	void buildCommandBuffer(VkCommandBuffer& cmd_buffer, VkRenderPassBeginInfo& renderPassBeginInfo);
 
-	void setupDescriptors(HizPipeline& hiz_pipeline, vks::Buffer& uniform_buffer);
+	void setupDescriptors(HizPipeline& hiz_pipeline, chaf::Buffer& uniform_buffer);
 
 	void prepare(VkRenderPass& render_pass);
 
+	VkPipeline createPipeline() override;
+
+	void replacePipeline(VkPipeline pipeline) override;
+
 	void updateDescriptors(HizPipeline& hiz_pipeline, uint32_t index);
 
 private:
@@ -28,6 +32,8 @@ private:
 
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 
+	VkRenderPass render_pass{ VK_NULL_HANDLE };
+
 	VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
 
 	VkDescriptorPool descriptor_pool{ VK_NULL_HANDLE };
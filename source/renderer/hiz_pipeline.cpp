@@ -1,17 +1,17 @@
 #include <renderer/hiz_pipeline.h>
 
 HizPipeline::HizPipeline(vks::VulkanDevice& device, uint32_t width, uint32_t height) :
-	PipelineBase{ device }
+	PipelineBase{ device }, width{ width }, height{ height }
 {
-	depth_image.width = width;
-	depth_image.height = height;
-
 	VkCommandPoolCreateInfo cmdPoolInfo = {};
 	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	cmdPoolInfo.queueFamilyIndex = device.queueFamilyIndices.compute;
 	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &command_pool));
 
+	cmdPoolInfo.queueFamilyIndex = device.queueFamilyIndices.graphics;
+	VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &copy_command_pool));
+
 	vkGetDeviceQueue(device, device.queueFamilyIndices.compute, 0, &compute_queue);
 }
 
@@ -23,10 +23,9 @@ HizPipeline::~HizPipeline()
 	destroyDepth();
 	destroyHiz();
 
-	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
 	vkDestroyCommandPool(device, command_pool, nullptr);
+	vkDestroyCommandPool(device, copy_command_pool, nullptr);
 
 	vkDestroyFence(device, fence, nullptr);
 	vkDestroySemaphore(device, semaphore, nullptr);
@@ -34,13 +33,13 @@ HizPipeline::~HizPipeline()
 
 void HizPipeline::prepareHiz()
 {
-	hiz_image.depth_pyramid_levels = static_cast<uint32_t>(floor(log2(std::max(depth_image.width, depth_image.height))));
+	hiz_image.depth_pyramid_levels = static_cast<uint32_t>(floor(log2(std::max(width, height))));
 
 	// Setup Hi-z image
 	VkImageCreateInfo image = vks::initializers::imageCreateInfo();
 	image.imageType = VK_IMAGE_TYPE_2D;
-	image.extent.width = depth_image.width;
-	image.extent.height = depth_image.height;
+	image.extent.width = width;
+	image.extent.height = height;
 	image.extent.depth = 1;
 	image.mipLevels = hiz_image.depth_pyramid_levels;
 	image.arrayLayers = 1;
@@ -49,20 +48,10 @@ void HizPipeline::prepareHiz()
 	image.format = VK_FORMAT_R32_SFLOAT;																// Depth stencil attachment
 	image.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;		// We will sample directly from the depth attachment for the shadow mapping
 	image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &hiz_image.image));
+	chaf::Allocator::get().createImage(chaf::MemoryUsage::Attachment, image, hiz_image.image, hiz_image.allocation);
 
 	VkCommandBuffer layoutCmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, command_pool, true);
 
-	// Setup Hi-z image memory
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetImageMemoryRequirements(device, hiz_image.image, &memReqs);
-
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device.getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &hiz_image.mem));
-	VK_CHECK_RESULT(vkBindImageMemory(device, hiz_image.image, hiz_image.mem, 0));
-
 	for (uint32_t i = 0; i < hiz_image.depth_pyramid_levels; i++)
 	{
 		VkImageSubresourceRange subresourceRange = {};
@@ -127,193 +116,202 @@ void HizPipeline::destroyHiz()
 		vkDestroyImageView(device, view, nullptr);
 	}
 
-	vkDestroyImage(device, hiz_image.image, nullptr);
-	vkFreeMemory(device, hiz_image.mem, nullptr);
+	chaf::Allocator::get().destroyImage(hiz_image.image, hiz_image.allocation);
 	vkDestroySampler(device, hiz_image.sampler, nullptr);
 }
 
 void HizPipeline::prepareDepth(VkQueue queue, VkFormat depth_format)
 {
-	// Setup depth image
-	depth_image.format = depth_format;
-
-	VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-	image.imageType = VK_IMAGE_TYPE_2D;
-	image.extent.width = depth_image.width;
-	image.extent.height = depth_image.height;
-	image.extent.depth = 1;
-	image.mipLevels = 1;
-	image.arrayLayers = 1;
-	image.samples = VK_SAMPLE_COUNT_1_BIT;
-	image.tiling = VK_IMAGE_TILING_OPTIMAL;
-	image.format = depth_format;																// Depth stencil attachment
-	image.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;		// We will sample directly from the depth attachment for the shadow mapping
-	VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &depth_image.image));
+	this->depth_format = depth_format;
 
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
+	depth_images.resize(DEPTH_COPY_COUNT);
 
 	VkCommandBuffer layoutCmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-	// Setup memory
-	vkGetImageMemoryRequirements(device, depth_image.image, &memReqs);
-
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device.getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &depth_image.mem));
-	VK_CHECK_RESULT(vkBindImageMemory(device, depth_image.image, depth_image.mem, 0));
-
-	// Setup image barrier
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
-	vks::tools::setImageLayout(
-		layoutCmd,
-		depth_image.image,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		subresourceRange);
+	for (auto& depth_image : depth_images)
+	{
+		// Setup depth image
+		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
+		image.imageType = VK_IMAGE_TYPE_2D;
+		image.extent.width = width;
+		image.extent.height = height;
+		image.extent.depth = 1;
+		image.mipLevels = 1;
+		image.arrayLayers = 1;
+		image.samples = VK_SAMPLE_COUNT_1_BIT;
+		image.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image.format = depth_format;																// Depth stencil attachment
+		image.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;		// We will sample directly from the depth attachment for the shadow mapping
+		chaf::Allocator::get().createImage(chaf::MemoryUsage::Attachment, image, depth_image.image, depth_image.allocation);
+
+		// Setup image barrier
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		subresourceRange.baseMipLevel = 0;
+		subresourceRange.levelCount = 1;
+		subresourceRange.layerCount = 1;
+		vks::tools::setImageLayout(
+			layoutCmd,
+			depth_image.image,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			subresourceRange);
+
+		// Setup view
+		VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view.format = depth_format;
+		view.components = { VK_COMPONENT_SWIZZLE_R };
+		view.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT , 0, 1, 0, 1 };
+		view.subresourceRange.layerCount = 1;
+		view.image = depth_image.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &depth_image.view));
+
+		// Setup sampler
+		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
+		sampler.magFilter = VK_FILTER_NEAREST;
+		sampler.minFilter = VK_FILTER_NEAREST;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeV = sampler.addressModeU;
+		sampler.addressModeW = sampler.addressModeU;
+		sampler.mipLodBias = 0.0f;
+		sampler.maxAnisotropy = 1.0f;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = 1.0f;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device.logicalDevice, &sampler, nullptr, &depth_image.sampler));
+
+		// Setup descriptor
+		depth_image.descriptor =
+			vks::initializers::descriptorImageInfo(
+				depth_image.sampler,
+				depth_image.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
 
 	device.flushCommandBuffer(layoutCmd, queue, true);
-
-	// Setup view
-	VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
-	view.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	view.format = depth_format;
-	view.components = { VK_COMPONENT_SWIZZLE_R };
-	view.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT , 0, 1, 0, 1 };
-	view.subresourceRange.layerCount = 1;
-	view.image = depth_image.image;
-	VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &depth_image.view));
-
-	// Setup sampler
-	VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
-	sampler.magFilter = VK_FILTER_NEAREST;
-	sampler.minFilter = VK_FILTER_NEAREST;
-	sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	sampler.addressModeV = sampler.addressModeU;
-	sampler.addressModeW = sampler.addressModeU;
-	sampler.mipLodBias = 0.0f;
-	sampler.maxAnisotropy = 1.0f;
-	sampler.minLod = 0.0f;
-	sampler.maxLod = 1.0f;
-	sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	VK_CHECK_RESULT(vkCreateSampler(device.logicalDevice, &sampler, nullptr, &depth_image.sampler));
-
-	// Setup descriptor
-	depth_image.descriptor =
-		vks::initializers::descriptorImageInfo(
-			depth_image.sampler,
-			depth_image.view,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
 
 void HizPipeline::destroyDepth()
 {
-	vkDestroySampler(device, depth_image.sampler, nullptr);
-	vkDestroyImageView(device, depth_image.view, nullptr);
-	vkDestroyImage(device, depth_image.image, nullptr);
-	vkFreeMemory(device, depth_image.mem, nullptr);
+	for (auto& depth_image : depth_images)
+	{
+		vkDestroySampler(device, depth_image.sampler, nullptr);
+		vkDestroyImageView(device, depth_image.view, nullptr);
+		chaf::Allocator::get().destroyImage(depth_image.image, depth_image.allocation);
+	}
+	depth_images.clear();
+}
+
+void HizPipeline::copyDepth(VkCommandBuffer cmd_buffer, VkImage depth_stencil_image, uint32_t copy_index)
+{
+	auto& depth_image = depth_images[copy_index];
+
+	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 };
+
+	auto& graph = copy_graphs[copy_index];
+	graph = std::make_unique<RenderGraph>(device, device.queueFamilyIndices.graphics);
+
+	auto depth_attachment = graph->importImage("depth attachment", depth_stencil_image, subresourceRange, RenderGraph::Access::DepthAttachmentWrite);
+	graph->setFinalAccess(depth_attachment, RenderGraph::Access::DepthAttachmentWrite);
+
+	// Old content is discarded, so no ownership transfer back from compute queue is needed
+	auto depth_copy = graph->importImage("depth copy", depth_image.image, subresourceRange);
+	graph->setFinalAccess(depth_copy, RenderGraph::Access::ComputeSampledRead, device.queueFamilyIndices.compute);
+
+	auto pass = graph->addPass("copy depth", [this, depth_stencil_image, &depth_image](VkCommandBuffer cmd_buffer) {
+		VkImageCopy copyRegion = {};
+
+		copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		copyRegion.srcSubresource.baseArrayLayer = 0;
+		copyRegion.srcSubresource.mipLevel = 0;
+		copyRegion.srcSubresource.layerCount = 1;
+		copyRegion.srcOffset = { 0, 0, 0 };
+
+		copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		copyRegion.dstSubresource.baseArrayLayer = 0;
+		copyRegion.dstSubresource.mipLevel = 0;
+		copyRegion.dstSubresource.layerCount = 1;
+		copyRegion.dstOffset = { 0, 0, 0 };
+
+		copyRegion.extent.width = width;
+		copyRegion.extent.height = height;
+		copyRegion.extent.depth = 1;
+
+		vkCmdCopyImage(
+			cmd_buffer,
+			depth_stencil_image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			depth_image.image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&copyRegion);
+	});
+	graph->read(pass, depth_attachment, RenderGraph::Access::TransferRead);
+	graph->write(pass, depth_copy, RenderGraph::Access::TransferWrite);
+
+	// Layout transitions of both images and the release to compute queue family come from the graph
+	graph->execute(cmd_buffer);
 }
 
-void HizPipeline::copyDepth(VkCommandBuffer cmd_buffer, VkImage depth_stencil_image)
+void HizPipeline::buildCopyCommandBuffers(VkImage depth_stencil_image)
 {
-	vks::tools::setImageLayout(
-		cmd_buffer,
-		depth_stencil_image,
-		VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = 1;
-	subresourceRange.baseArrayLayer = 0;
-	subresourceRange.layerCount = 1;
-
-	// Change image layout of one cubemap face to transfer destination
-	vks::tools::setImageLayout(
-		cmd_buffer,
-		depth_image.image,
-		VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	// Copy region for transfer from framebuffer to cube face
-	VkImageCopy copyRegion = {};
-
-	copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	copyRegion.srcSubresource.baseArrayLayer = 0;
-	copyRegion.srcSubresource.mipLevel = 0;
-	copyRegion.srcSubresource.layerCount = 1;
-	copyRegion.srcOffset = { 0, 0, 0 };
-
-	copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	copyRegion.dstSubresource.baseArrayLayer = 0;
-	copyRegion.dstSubresource.mipLevel = 0;
-	copyRegion.dstSubresource.layerCount = 1;
-	copyRegion.dstOffset = { 0, 0, 0 };
-
-	copyRegion.extent.width = depth_image.width;
-	copyRegion.extent.height = depth_image.height;
-	copyRegion.extent.depth = 1;
-
-	// Put image copy into command buffer
-	vkCmdCopyImage(
-		cmd_buffer,
-		depth_stencil_image,
-		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		depth_image.image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&copyRegion);
-
-	// Transform framebuffer color attachment back
-	vks::tools::setImageLayout(
-		cmd_buffer,
-		depth_stencil_image,
-		VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
-		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-	// Change image layout of copied face to shader read
-	vks::tools::setImageLayout(
-		cmd_buffer,
-		depth_image.image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		subresourceRange);
+	if (copy_command_buffers.empty())
+	{
+		copy_command_buffers.resize(DEPTH_COPY_COUNT);
+		copy_graphs.resize(DEPTH_COPY_COUNT);
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+			vks::initializers::commandBufferAllocateInfo(
+				copy_command_pool,
+				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+				DEPTH_COPY_COUNT);
+
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, copy_command_buffers.data()));
+	}
+
+	for (uint32_t i = 0; i < DEPTH_COPY_COUNT; i++)
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(copy_command_buffers[i], &cmdBufInfo));
+
+		copyDepth(copy_command_buffers[i], depth_stencil_image, i);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(copy_command_buffers[i]));
+	}
 }
 
 void HizPipeline::resize(uint32_t width, uint32_t height, VkQueue queue)
 {
-	depth_image.width = width;
-	depth_image.height = height;
+	this->width = width;
+	this->height = height;
 
 	destroyDepth();
-	prepareDepth(queue,depth_image.format);
+	prepareDepth(queue, depth_format);
 
 	destroyHiz();
 	prepareHiz();
 
 	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 
-	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiz_image.depth_pyramid_levels),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, hiz_image.depth_pyramid_levels)
-	};
+	prepareDescriptorSets();
+
+	buildCommandBuffer();
+}
+
+void HizPipeline::prepareDescriptorSets()
+{
+	// Prepare descriptor pool, one set per mip level of each depth copy
+	std::vector<VkDescriptorPoolSize> poolSizes = layout.getPoolSizes(0, DEPTH_COPY_COUNT * hiz_image.depth_pyramid_levels);
 
 	// Setting descriptor pool
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, hiz_image.depth_pyramid_levels);
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, DEPTH_COPY_COUNT * hiz_image.depth_pyramid_levels);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolInfo, nullptr, &descriptor_pool));
 
 	// Descriptor sets
-	descriptor_sets.resize(hiz_image.depth_pyramid_levels);
+	descriptor_sets.resize(DEPTH_COPY_COUNT * hiz_image.depth_pyramid_levels);
 	VkDescriptorSetAllocateInfo allocInfo =
 		vks::initializers::descriptorSetAllocateInfo(
 			descriptor_pool,
@@ -325,7 +323,57 @@ void HizPipeline::resize(uint32_t width, uint32_t height, VkQueue queue)
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_sets[i]));
 	}
 
-	buildCommandBuffer();
+	// Views only change with the sets, so command buffers still in flight never see a set being written
+	writeDescriptorSets();
+}
+
+void HizPipeline::writeDescriptorSets()
+{
+	for (uint32_t copy_index = 0; copy_index < DEPTH_COPY_COUNT; copy_index++)
+	{
+		for (uint32_t i = 0; i < hiz_image.depth_pyramid_levels; i++)
+		{
+			VkDescriptorSet descriptor_set = descriptor_sets[copy_index * hiz_image.depth_pyramid_levels + i];
+
+			VkDescriptorImageInfo dstTarget;
+			dstTarget.sampler = depth_images[copy_index].sampler;
+			dstTarget.imageView = hiz_image.views[i];
+			dstTarget.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo srcTarget;
+			srcTarget.sampler = depth_images[copy_index].sampler;
+
+			if (i == 0)
+			{
+				srcTarget.imageView = depth_images[copy_index].view;
+				srcTarget.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			}
+			else
+			{
+				srcTarget.imageView = hiz_image.views[i - 1];
+				srcTarget.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+
+			// Update descriptor set
+			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+			{
+				// Binding 0: Store output image
+				vks::initializers::writeDescriptorSet(
+					descriptor_set,
+					VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					0,
+					&dstTarget),
+				// Binding 1: Sample input image
+				vks::initializers::writeDescriptorSet(
+					descriptor_set,
+					VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					1,
+					&srcTarget)
+			};
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		}
+	}
 }
 
 void HizPipeline::prepare(VkQueue queue, VkFormat depth_format)
@@ -333,78 +381,26 @@ void HizPipeline::prepare(VkQueue queue, VkFormat depth_format)
 	prepareDepth(queue, depth_format);
 	prepareHiz();
 
-	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiz_image.depth_pyramid_levels),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, hiz_image.depth_pyramid_levels)
-	};
+	// Binding 0: Store output image, binding 1: sample input image, push constant: reduce size
+	layout = reflectLayout({ { "../data/shaders/glsl/gpudrivenpipeline/hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } });
+	descriptor_set_layout = chaf::LayoutCache::get().getSetLayout(layout.sets[0]);
+	pipeline_layout = chaf::LayoutCache::get().getPipelineLayout(layout);
 
-	// Setting descriptor pool
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, hiz_image.depth_pyramid_levels);
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device.logicalDevice, &descriptorPoolInfo, nullptr, &descriptor_pool));
-
-	// Setting layout bindings
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		// Binding 0: Store output image
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			0),
-		// Binding 1: Sample input image
-		vks::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			1)
-	};
-
-	// Create descriptor layout
-	VkDescriptorSetLayoutCreateInfo descriptorLayout =
-		vks::initializers::descriptorSetLayoutCreateInfo(
-			setLayoutBindings.data(),
-			static_cast<uint32_t>(setLayoutBindings.size()));
-
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorLayout, nullptr, &descriptor_set_layout));
-
-	// Pipeline layout
-	VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-		vks::initializers::pipelineLayoutCreateInfo(
-			&descriptor_set_layout,
-			1);
-
-	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(glm::vec2), 0);
-	// Push constant ranges are part of the pipeline layout
-	pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-	pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
-
-	VK_CHECK_RESULT(vkCreatePipelineLayout(device.logicalDevice, &pPipelineLayoutCreateInfo, nullptr, &pipeline_layout));
-
-	// Descriptor sets
-	descriptor_sets.resize(hiz_image.depth_pyramid_levels);
-	VkDescriptorSetAllocateInfo allocInfo =
-		vks::initializers::descriptorSetAllocateInfo(
-			descriptor_pool,
-			&descriptor_set_layout,
-			1);
-
-	for (uint32_t i = 0; i < descriptor_sets.size(); i++)
-	{
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_sets[i]));
-	}
+	prepareDescriptorSets();
 
-	// Create pipeline
-	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipeline_layout, 0);
-	computePipelineCreateInfo.stage = loadShader("../data/shaders/glsl/gpudrivenpipeline/hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);;
+	pipeline = createPipeline();
 
-	VK_CHECK_RESULT(vkCreateComputePipelines(device.logicalDevice, pipeline_cache, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+	// Create a command buffer for compute operations of each depth copy
+	command_buffers.resize(DEPTH_COPY_COUNT);
+	graphs.resize(DEPTH_COPY_COUNT);
 
-	// Create a command buffer for compute operations
 	VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 		vks::initializers::commandBufferAllocateInfo(
 			command_pool,
 			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			1);
+			DEPTH_COPY_COUNT);
 
-	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, &command_buffer));
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.logicalDevice, &cmdBufAllocateInfo, command_buffers.data()));
 
 	// Fence for compute CB sync
 	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
@@ -414,93 +410,139 @@ void HizPipeline::prepare(VkQueue queue, VkFormat depth_format)
 	VK_CHECK_RESULT(vkCreateSemaphore(device.logicalDevice, &semaphoreCreateInfo, nullptr, &semaphore));
 
 	buildCommandBuffer();
+
+	tuneKernel();
 }
 
-void HizPipeline::buildCommandBuffer()
+VkPipeline HizPipeline::createPipeline()
 {
-	// Begin recording command buffer
-	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-	VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &cmdBufInfo));
+	return createPipeline(kernel_config);
+}
 
-	// Bind pipeline
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+VkPipeline HizPipeline::createPipeline(const chaf::KernelConfig& config)
+{
+	// Constant 0, 1: workgroup size
+	chaf::SpecializationConstants constants;
+	constants.set(0, config.group_size_x);
+	constants.set(1, config.group_size_y);
 
-	// Bind descriptor & dispatch task
+	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipeline_layout, 0);
+	computePipelineCreateInfo.stage = loadShader("../data/shaders/glsl/gpudrivenpipeline/hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	computePipelineCreateInfo.stage.pSpecializationInfo = constants.getInfo();
 
-	for (uint32_t i = 0; i < hiz_image.depth_pyramid_levels; i++)
+	VkPipeline new_pipeline;
+	createComputePipeline(computePipelineCreateInfo, &new_pipeline);
+	return new_pipeline;
+}
+
+void HizPipeline::replacePipeline(VkPipeline pipeline)
+{
+	vkDestroyPipeline(device, this->pipeline, nullptr);
+	this->pipeline = pipeline;
+
+	// Pipeline is baked into the compute command buffers
+	buildCommandBuffer();
+}
+
+void HizPipeline::tuneKernel()
+{
+	// Prebuilt SPIR-V has a fixed workgroup size of 32x32
+	if (!hasSpecializationConstant("../data/shaders/glsl/gpudrivenpipeline/hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, 0))
+	{
+		return;
+	}
+
+	// Timed on mip 1, the depth copy feeding mip 0 is owned by the graphics queue until the first frame
+	if (hiz_image.depth_pyramid_levels < 2)
 	{
-		VkDescriptorImageInfo dstTarget;
-		dstTarget.sampler = depth_image.sampler;
-		dstTarget.imageView = hiz_image.views[i];
-		dstTarget.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		return;
+	}
+
+	std::vector<chaf::KernelConfig> configs = { { 8, 8, 0 }, { 16, 8, 0 }, { 16, 16, 0 }, { 32, 8, 0 }, { 32, 32, 0 } };
 
-		VkDescriptorImageInfo srcTarget;
-		srcTarget.sampler = depth_image.sampler;
+	auto config = chaf::KernelTuner::get().tune(
+		"hiz",
+		chaf::KernelTuner::get().getCandidates(configs),
+		[this](const chaf::KernelConfig& config) { return createPipeline(config); },
+		[this](VkCommandBuffer cmd_buffer, VkPipeline pipeline, const chaf::KernelConfig& config) {
+			uint32_t levelWidth = std::max(width >> 1, 1u);
+			uint32_t levelHeight = std::max(height >> 1, 1u);
+			glm::vec2 reduce_data = { levelWidth, levelHeight };
 
-		if (i == 0)
+			vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[1], 0, nullptr);
+			vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec2), &reduce_data);
+			vkCmdDispatch(cmd_buffer, getGroupCount(levelWidth, config.group_size_x), getGroupCount(levelHeight, config.group_size_y), 1);
+		});
+
+	if (config.group_size_x != kernel_config.group_size_x || config.group_size_y != kernel_config.group_size_y)
+	{
+		kernel_config = config;
+		replacePipeline(createPipeline());
+	}
+}
+
+void HizPipeline::buildCommandBuffer()
+{
+	for (uint32_t copy_index = 0; copy_index < DEPTH_COPY_COUNT; copy_index++)
+	{
+		VkCommandBuffer command_buffer = command_buffers[copy_index];
+
+		// Begin recording command buffer, it may be pending from an earlier frame in flight
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &cmdBufInfo));
+
+		auto& graph = graphs[copy_index];
+		graph = std::make_unique<RenderGraph>(device, device.queueFamilyIndices.compute);
+
+		// Depth copy was released by graphics queue after transfer
+		auto depth_copy = graph->importImage("depth copy", depth_images[copy_index].image, { VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 }, RenderGraph::Access::ComputeSampledRead);
+		if (device.queueFamilyIndices.graphics != device.queueFamilyIndices.compute)
 		{
-			srcTarget.imageView = depth_image.view;
-			srcTarget.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			graph->acquire(depth_copy, RenderGraph::Access::TransferWrite, device.queueFamilyIndices.graphics);
 		}
-		else
+
+		// Previous culling dispatch may still read the pyramid, culling reads it again after this
+		std::vector<RenderGraph::ResourceHandle> mips(hiz_image.depth_pyramid_levels);
+		for (uint32_t i = 0; i < hiz_image.depth_pyramid_levels; i++)
 		{
-			srcTarget.imageView = hiz_image.views[i - 1];
-			srcTarget.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			mips[i] = graph->importImage("hiz mip " + std::to_string(i), hiz_image.image, { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 }, RenderGraph::Access::ComputeStorageRead);
+			graph->setFinalAccess(mips[i], RenderGraph::Access::ComputeStorageRead);
 		}
 
-		// Update descriptor set
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		for (uint32_t i = 0; i < hiz_image.depth_pyramid_levels; i++)
 		{
-			// Binding 0: Store output image
-			vks::initializers::writeDescriptorSet(
-				descriptor_sets[i],
-				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				0,
-				&dstTarget),
-			// Binding 1: Sample input image
-			vks::initializers::writeDescriptorSet(
-				descriptor_sets[i],
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				1,
-				&srcTarget)
-		};
-
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
-
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[i], 0, nullptr);
-
-		uint32_t levelWidth = depth_image.width >> i;
-		uint32_t levelHeight = depth_image.height >> i;
-
-		if (levelHeight < 1) levelHeight = 1;
-		if (levelWidth < 1) levelWidth = 1;
-
-		glm::vec2 reduce_data = { levelWidth, levelHeight };
-
-		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec2), &reduce_data);
-		vkCmdDispatch(command_buffer, getGroupCount(levelWidth, 16), getGroupCount(levelHeight, 16), 1);
-
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		imageMemoryBarrier.image = hiz_image.image;
-		imageMemoryBarrier.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT , 0, 1, 0, 1};
-		imageMemoryBarrier.srcQueueFamilyIndex = device.queueFamilyIndices.compute;
-		imageMemoryBarrier.dstQueueFamilyIndex = device.queueFamilyIndices.compute;
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_DEPENDENCY_BY_REGION_BIT,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier);
-	}
+			VkDescriptorSet descriptor_set = descriptor_sets[copy_index * hiz_image.depth_pyramid_levels + i];
+
+			uint32_t levelWidth = std::max(width >> i, 1u);
+			uint32_t levelHeight = std::max(height >> i, 1u);
+
+			auto pass = graph->addPass("hiz mip " + std::to_string(i), [this, descriptor_set, levelWidth, levelHeight](VkCommandBuffer cmd_buffer) {
+				vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+				vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+
+				glm::vec2 reduce_data = { levelWidth, levelHeight };
+
+				vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec2), &reduce_data);
+				vkCmdDispatch(cmd_buffer, getGroupCount(levelWidth, kernel_config.group_size_x), getGroupCount(levelHeight, kernel_config.group_size_y), 1);
+			});
+
+			if (i == 0)
+			{
+				graph->read(pass, depth_copy, RenderGraph::Access::ComputeSampledRead);
+			}
+			else
+			{
+				graph->read(pass, mips[i - 1], RenderGraph::Access::ComputeStorageRead);
+			}
+			graph->write(pass, mips[i], RenderGraph::Access::ComputeStorageWrite);
+		}
+
+		graph->execute(command_buffer);
 
-	vkEndCommandBuffer(command_buffer);
+		vkEndCommandBuffer(command_buffer);
+	}
 
 	hiz_image.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 	hiz_image.descriptor.imageView = hiz_image.views[0];
@@ -514,7 +556,7 @@ void HizPipeline::submit()
 
 	VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
 	computeSubmitInfo.commandBufferCount = 1;
-	computeSubmitInfo.pCommandBuffers = &command_buffer;
+	computeSubmitInfo.pCommandBuffers = &command_buffers[0];
 	computeSubmitInfo.signalSemaphoreCount = 1;
 	computeSubmitInfo.pSignalSemaphores = &semaphore;
 
@@ -1,9 +1,19 @@
 #pragma once
 
 #include <renderer/base_pipeline.h>
+#include <renderer/render_graph.h>
+#include <renderer/kernel_tuner.h>
+
+#include <scene/cacher/allocator.h>
+
+#include <memory>
 
 class HizPipeline :public chaf::PipelineBase
 {
+public:
+	// Depth copies are double buffered, so next frame's Hi-z can be built while current frame writes the other copy
+	static constexpr uint32_t DEPTH_COPY_COUNT = 2;
+
 public:
 	HizPipeline(vks::VulkanDevice& device, uint32_t width, uint32_t height);
 
@@ -15,6 +25,13 @@ public:
 
 	void buildCommandBuffer();
 
+	VkPipeline createPipeline() override;
+
+	void replacePipeline(VkPipeline pipeline) override;
+
+	// Record depth attachment to depth copy command buffers, must be called again when the depth attachment is recreated
+	void buildCopyCommandBuffers(VkImage depth_stencil_image);
+
 	void submit();
 
 public:
@@ -24,25 +41,45 @@ public:
 
 	VkSemaphore semaphore;
 
+	// Reflected from hiz.comp, layouts are owned by LayoutCache
+	chaf::LayoutCache::Layout layout;
+
 	VkPipelineLayout pipeline_layout;
 
 	VkPipeline pipeline;
 
+	// Workgroup size x and y
+	chaf::KernelConfig kernel_config{ 32, 32, 0 };
+
 	VkDescriptorSetLayout descriptor_set_layout;
 
+	// Depth copy index * pyramid levels + mip level
 	std::vector<VkDescriptorSet> descriptor_sets;
 
 	VkDescriptorPool descriptor_pool;
 
 	VkCommandPool command_pool;
 
-	VkCommandBuffer command_buffer;
+	// Graphics queue command pool for depth copy
+	VkCommandPool copy_command_pool;
+
+	// Hi-z build command buffer of each depth copy
+	std::vector<VkCommandBuffer> command_buffers;
+
+	// Depth attachment copy command buffer of each depth copy, submitted after scene rendering on graphics queue
+	std::vector<VkCommandBuffer> copy_command_buffers;
+
+	// Render graphs recorded into command buffers above, barriers between Hi-z levels and queues are derived from them.
+	// Depth copies and the pyramid are imported, not graph transients: a depth copy is written by the graphics graph and
+	// read by the compute graph, and the pyramid is shared by both compute graphs and read by next frame's culling
+	std::vector<std::unique_ptr<RenderGraph>> graphs;
+	std::vector<std::unique_ptr<RenderGraph>> copy_graphs;
 
 	struct
 	{
 		uint32_t depth_pyramid_levels{ 1 };
 		VkSampler sampler{ VK_NULL_HANDLE };
-		VkDeviceMemory mem{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
 		VkImage image{ VK_NULL_HANDLE };
 		std::vector<VkImageView> views;
 		VkDescriptorImageInfo descriptor;
@@ -51,18 +88,33 @@ public:
 	void prepareHiz();
 	void destroyHiz();
 
-	struct
+	struct DepthImage
 	{
 		VkSampler sampler{ VK_NULL_HANDLE };
 		VkImageView view{ VK_NULL_HANDLE };
 		VkImage image{ VK_NULL_HANDLE };
-		VkDeviceMemory mem{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
 		VkDescriptorImageInfo descriptor;
-		uint32_t width, height;
-		VkFormat format;
-	}depth_image;
+	};
+
+	std::vector<DepthImage> depth_images;
+
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	VkFormat depth_format{ VK_FORMAT_UNDEFINED };
 
 	void prepareDepth(VkQueue queue, VkFormat depth_format);
 	void destroyDepth();
-	void copyDepth(VkCommandBuffer cmd_buffer, VkImage depth_stencil_image);
+	void copyDepth(VkCommandBuffer cmd_buffer, VkImage depth_stencil_image, uint32_t copy_index);
+
+private:
+	// Allocate a set per depth copy and mip level and write them, after depth copies and pyramid views exist
+	void prepareDescriptorSets();
+
+	void writeDescriptorSets();
+
+	VkPipeline createPipeline(const chaf::KernelConfig& config);
+
+	// Pick workgroup size with the kernel tuner, needs descriptor sets written by prepareDescriptorSets
+	void tuneKernel();
 };
@@ -0,0 +1,257 @@
+#include <renderer/kernel_tuner.h>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace chaf
+{
+	// Dispatches run before timing, so clocks and caches settle
+	static constexpr uint32_t WARMUP_DISPATCH_COUNT = 2;
+
+	static constexpr uint32_t TIMED_DISPATCH_COUNT = 8;
+
+	KernelTuner& KernelTuner::get()
+	{
+		static KernelTuner kernel_tuner;
+		return kernel_tuner;
+	}
+
+	void KernelTuner::initialize(vks::VulkanDevice& device, const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->device = &device;
+		this->path = path;
+
+		vkGetDeviceQueue(device, device.queueFamilyIndices.compute, 0, &queue);
+
+		VkCommandPoolCreateInfo cmdPoolInfo = {};
+		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmdPoolInfo.queueFamilyIndex = device.queueFamilyIndices.compute;
+		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &command_pool));
+
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &query_pool));
+
+		load();
+	}
+
+	void KernelTuner::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!device)
+		{
+			return;
+		}
+
+		if (dirty)
+		{
+			save();
+		}
+
+		vkDestroyQueryPool(*device, query_pool, nullptr);
+		vkDestroyCommandPool(*device, command_pool, nullptr);
+		query_pool = VK_NULL_HANDLE;
+		command_pool = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	KernelConfig KernelTuner::tune(const std::string& kernel, const std::vector<KernelConfig>& candidates, const CreatePipeline& create_pipeline, const Record& record)
+	{
+		if (candidates.empty())
+		{
+			throw std::runtime_error("No candidate configuration for kernel " + kernel);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!device)
+		{
+			throw std::runtime_error("Kernel tuner is used before initialization");
+		}
+
+		// Cached result is only valid if it is still a candidate
+		auto it = results.find(kernel);
+		if (it != results.end())
+		{
+			for (auto& candidate : candidates)
+			{
+				if (candidate.group_size_x == it->second.config.group_size_x &&
+					candidate.group_size_y == it->second.config.group_size_y &&
+					candidate.options == it->second.config.options)
+				{
+					return candidate;
+				}
+			}
+		}
+
+		bool supported = device->queueFamilyProperties[device->queueFamilyIndices.compute].timestampValidBits > 0 && device->properties.limits.timestampPeriod > 0.f;
+		if (!supported)
+		{
+			return candidates.front();
+		}
+
+		Result best;
+		best.time = std::numeric_limits<double>::max();
+		best.tuned = true;
+
+		for (auto& candidate : candidates)
+		{
+			VkPipeline pipeline = create_pipeline(candidate);
+			double time = measure(pipeline, candidate, record);
+			vkDestroyPipeline(*device, pipeline, nullptr);
+
+			if (time < best.time)
+			{
+				best.config = candidate;
+				best.time = time;
+			}
+		}
+
+		results[kernel] = best;
+		dirty = true;
+		save();
+
+		return best.config;
+	}
+
+	std::vector<KernelConfig> KernelTuner::getCandidates(const std::vector<KernelConfig>& configs) const
+	{
+		auto& limits = device->properties.limits;
+
+		std::vector<KernelConfig> candidates;
+		for (auto& config : configs)
+		{
+			if (config.group_size_x <= limits.maxComputeWorkGroupSize[0] &&
+				config.group_size_y <= limits.maxComputeWorkGroupSize[1] &&
+				config.group_size_x * config.group_size_y <= limits.maxComputeWorkGroupInvocations)
+			{
+				candidates.push_back(config);
+			}
+		}
+
+		return candidates;
+	}
+
+	std::map<std::string, KernelTuner::Result> KernelTuner::getResults()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return results;
+	}
+
+	double KernelTuner::measure(VkPipeline pipeline, const KernelConfig& config, const Record& record)
+	{
+		VkCommandBuffer cmd_buffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, command_pool, true);
+
+		// Dispatches are serialized, so each one is timed on its own rather than overlapped
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		auto dispatch = [&]() {
+			record(cmd_buffer, pipeline, config);
+			vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		};
+
+		vkCmdResetQueryPool(cmd_buffer, query_pool, 0, 2);
+
+		for (uint32_t i = 0; i < WARMUP_DISPATCH_COUNT; i++)
+		{
+			dispatch();
+		}
+
+		// Bottom of pipe, so the begin timestamp waits for the warmup to finish
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 0);
+		for (uint32_t i = 0; i < TIMED_DISPATCH_COUNT; i++)
+		{
+			dispatch();
+		}
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1);
+
+		device->flushCommandBuffer(cmd_buffer, queue, command_pool, true);
+
+		std::array<uint64_t, 2> timestamps{};
+		VK_CHECK_RESULT(vkGetQueryPoolResults(*device, query_pool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+		return static_cast<double>(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1e6 / TIMED_DISPATCH_COUNT;
+	}
+
+	std::string KernelTuner::getDeviceKey() const
+	{
+		std::stringstream ss;
+		for (auto byte : device->properties.pipelineCacheUUID)
+		{
+			ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(byte);
+		}
+		return ss.str();
+	}
+
+	void KernelTuner::load()
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			return;
+		}
+
+		// One result per line: device key, kernel, workgroup size x and y, options, ms per dispatch
+		auto device_key = getDeviceKey();
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream ss(line);
+			std::string key, kernel;
+			Result result;
+			if (!(ss >> key >> kernel >> result.config.group_size_x >> result.config.group_size_y >> result.config.options >> result.time))
+			{
+				continue;
+			}
+
+			if (key == device_key)
+			{
+				results[kernel] = result;
+			}
+			else
+			{
+				other_lines.push_back(line);
+			}
+		}
+	}
+
+	void KernelTuner::save()
+	{
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "Could not write kernel tuning cache " << path << std::endl;
+			return;
+		}
+
+		for (auto& line : other_lines)
+		{
+			file << line << "\n";
+		}
+
+		auto device_key = getDeviceKey();
+		for (auto& [kernel, result] : results)
+		{
+			file << device_key << " " << kernel << " " << result.config.group_size_x << " " << result.config.group_size_y << " "
+				<< result.config.options << " " << result.time << "\n";
+		}
+
+		dirty = false;
+	}
+}
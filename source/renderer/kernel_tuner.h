@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkanexamplebase.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace chaf
+{
+	// Launch configuration of a compute kernel, workgroup size is specialization constant 0 and 1
+	struct KernelConfig
+	{
+		uint32_t group_size_x{ 1 };
+		uint32_t group_size_y{ 1 };
+		// Kernel specific toggles which do not change results, tuned together with the workgroup size
+		uint32_t options{ 0 };
+	};
+
+	// Times candidate configurations of compute kernels with timestamp queries and keeps the fastest per device.
+	// Results are cached on disk by pipeline cache UUID, so a driver update tunes again
+	class KernelTuner
+	{
+	public:
+		struct Result
+		{
+			KernelConfig config;
+			// ms per dispatch of the fastest candidate
+			double time{ 0.0 };
+			// False if loaded from cache
+			bool tuned{ false };
+		};
+
+		using CreatePipeline = std::function<VkPipeline(const KernelConfig&)>;
+
+		// Record one dispatch of the kernel
+		using Record = std::function<void(VkCommandBuffer, VkPipeline, const KernelConfig&)>;
+
+	public:
+		static KernelTuner& get();
+
+		void initialize(vks::VulkanDevice& device, const std::string& path);
+
+		// Save results and release resources
+		void destroy();
+
+		// Cached configuration of kernel, otherwise time every candidate on the compute queue.
+		// Falls back to first candidate if timestamps are not supported
+		KernelConfig tune(const std::string& kernel, const std::vector<KernelConfig>& candidates, const CreatePipeline& create_pipeline, const Record& record);
+
+		// Workgroup sizes from given list within device limits
+		std::vector<KernelConfig> getCandidates(const std::vector<KernelConfig>& configs) const;
+
+		std::map<std::string, Result> getResults();
+
+	private:
+		KernelTuner() = default;
+
+		double measure(VkPipeline pipeline, const KernelConfig& config, const Record& record);
+
+		std::string getDeviceKey() const;
+
+		void load();
+
+		void save();
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		std::string path;
+
+		std::mutex mutex;
+
+		// Results of this device
+		std::map<std::string, Result> results;
+
+		// Cache lines of other devices, written back unchanged
+		std::vector<std::string> other_lines;
+
+		bool dirty{ false };
+
+		VkQueue queue{ VK_NULL_HANDLE };
+
+		VkCommandPool command_pool{ VK_NULL_HANDLE };
+
+		VkQueryPool query_pool{ VK_NULL_HANDLE };
+	};
+}
@@ -0,0 +1,299 @@
+#include <renderer/layout_cache.h>
+
+#include <algorithm>
+
+namespace chaf
+{
+	template <typename T>
+	inline void appendKey(std::string& key, const T& value)
+	{
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	inline bool getDescriptorType(const ShaderResource& resource, VkDescriptorType& type)
+	{
+		switch (resource.type)
+		{
+		case ShaderResourceType::InputAttachment:
+			type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			return true;
+		case ShaderResourceType::Image:
+			type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			return true;
+		case ShaderResourceType::ImageSampler:
+			type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			return true;
+		case ShaderResourceType::ImageStorage:
+			type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			return true;
+		case ShaderResourceType::Sampler:
+			type = VK_DESCRIPTOR_TYPE_SAMPLER;
+			return true;
+		case ShaderResourceType::BufferUniform:
+			type = resource.mode == ShaderResourceMode::Dynamic ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			return true;
+		case ShaderResourceType::BufferStorage:
+			type = resource.mode == ShaderResourceMode::Dynamic ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	VkDescriptorSetLayoutBinding* LayoutCache::Layout::findBinding(uint32_t set, uint32_t binding)
+	{
+		if (set >= sets.size())
+		{
+			return nullptr;
+		}
+
+		auto& bindings = sets[set].bindings;
+		auto it = std::find_if(bindings.begin(), bindings.end(), [binding](const VkDescriptorSetLayoutBinding& layout_binding) {
+			return layout_binding.binding == binding;
+		});
+
+		return it == bindings.end() ? nullptr : &(*it);
+	}
+
+	void LayoutCache::Layout::setDescriptorCount(uint32_t set, uint32_t binding, uint32_t count)
+	{
+		auto layout_binding = findBinding(set, binding);
+		if (!layout_binding)
+		{
+			throw std::runtime_error("Layout has no binding " + std::to_string(binding) + " in set " + std::to_string(set));
+		}
+
+		layout_binding->descriptorCount = count;
+	}
+
+	void LayoutCache::Layout::setBindingFlags(uint32_t set, uint32_t binding, VkDescriptorBindingFlagsEXT flags)
+	{
+		auto layout_binding = findBinding(set, binding);
+		if (!layout_binding)
+		{
+			throw std::runtime_error("Layout has no binding " + std::to_string(binding) + " in set " + std::to_string(set));
+		}
+
+		auto& set_layout = sets[set];
+		set_layout.binding_flags.resize(set_layout.bindings.size(), 0);
+		set_layout.binding_flags[layout_binding - set_layout.bindings.data()] = flags;
+	}
+
+	std::vector<VkDescriptorPoolSize> LayoutCache::Layout::getPoolSizes(uint32_t set, uint32_t set_count) const
+	{
+		std::vector<VkDescriptorPoolSize> pool_sizes;
+		if (set >= sets.size())
+		{
+			return pool_sizes;
+		}
+
+		for (auto& binding : sets[set].bindings)
+		{
+			auto it = std::find_if(pool_sizes.begin(), pool_sizes.end(), [&binding](const VkDescriptorPoolSize& pool_size) {
+				return pool_size.type == binding.descriptorType;
+			});
+
+			if (it == pool_sizes.end())
+			{
+				pool_sizes.push_back(vks::initializers::descriptorPoolSize(binding.descriptorType, 0));
+				it = pool_sizes.end() - 1;
+			}
+
+			it->descriptorCount += binding.descriptorCount * set_count;
+		}
+
+		return pool_sizes;
+	}
+
+	LayoutCache& LayoutCache::get()
+	{
+		static LayoutCache layout_cache;
+		return layout_cache;
+	}
+
+	void LayoutCache::initialize(vks::VulkanDevice& device)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->device = &device;
+	}
+
+	void LayoutCache::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& [key, pipeline_layout] : pipeline_layouts)
+		{
+			vkDestroyPipelineLayout(*device, pipeline_layout, nullptr);
+		}
+		pipeline_layouts.clear();
+
+		for (auto& [key, set_layout] : set_layouts)
+		{
+			vkDestroyDescriptorSetLayout(*device, set_layout, nullptr);
+		}
+		set_layouts.clear();
+	}
+
+	LayoutCache::Layout LayoutCache::reflect(const std::vector<ShaderResource>& resources)
+	{
+		Layout layout;
+
+		for (auto& resource : resources)
+		{
+			if (resource.type == ShaderResourceType::PushConstant)
+			{
+				// Stages sharing a push constant block share one range
+				auto it = std::find_if(layout.push_constant_ranges.begin(), layout.push_constant_ranges.end(), [&resource](const VkPushConstantRange& range) {
+					return range.offset == resource.offset;
+				});
+
+				if (it == layout.push_constant_ranges.end())
+				{
+					layout.push_constant_ranges.push_back(vks::initializers::pushConstantRange(resource.stages, resource.size, resource.offset));
+				}
+				else
+				{
+					it->stageFlags |= resource.stages;
+					it->size = std::max(it->size, resource.size);
+				}
+				continue;
+			}
+
+			VkDescriptorType type;
+			if (!getDescriptorType(resource, type))
+			{
+				continue;
+			}
+
+			if (resource.set >= layout.sets.size())
+			{
+				layout.sets.resize(resource.set + 1);
+			}
+
+			auto binding = layout.findBinding(resource.set, resource.binding);
+			if (binding)
+			{
+				if (binding->descriptorType != type)
+				{
+					throw std::runtime_error("Shader stages disagree on type of set " + std::to_string(resource.set) + " binding " + std::to_string(resource.binding));
+				}
+
+				binding->stageFlags |= resource.stages;
+				binding->descriptorCount = std::max(binding->descriptorCount, resource.array_size);
+				continue;
+			}
+
+			layout.sets[resource.set].bindings.push_back(vks::initializers::descriptorSetLayoutBinding(type, resource.stages, resource.binding, resource.array_size));
+		}
+
+		for (auto& set : layout.sets)
+		{
+			std::sort(set.bindings.begin(), set.bindings.end(), [](const VkDescriptorSetLayoutBinding& lhs, const VkDescriptorSetLayoutBinding& rhs) {
+				return lhs.binding < rhs.binding;
+			});
+		}
+
+		return layout;
+	}
+
+	VkDescriptorSetLayout LayoutCache::getSetLayout(const SetLayout& set_layout)
+	{
+		auto key = getKey(set_layout);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.set_layout_requests++;
+
+		auto it = set_layouts.find(key);
+		if (it != set_layouts.end())
+		{
+			return it->second;
+		}
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(set_layout.bindings.data(), static_cast<uint32_t>(set_layout.bindings.size()));
+		descriptorSetLayoutCI.flags = set_layout.flags;
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlags{};
+		setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		if (!set_layout.binding_flags.empty())
+		{
+			setLayoutBindingFlags.bindingCount = static_cast<uint32_t>(set_layout.binding_flags.size());
+			setLayoutBindingFlags.pBindingFlags = set_layout.binding_flags.data();
+			descriptorSetLayoutCI.pNext = &setLayoutBindingFlags;
+		}
+
+		VkDescriptorSetLayout descriptor_set_layout;
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*device, &descriptorSetLayoutCI, nullptr, &descriptor_set_layout));
+
+		stats.set_layout_count++;
+		set_layouts.emplace(key, descriptor_set_layout);
+		return descriptor_set_layout;
+	}
+
+	VkPipelineLayout LayoutCache::getPipelineLayout(const Layout& layout)
+	{
+		std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
+		for (auto& set : layout.sets)
+		{
+			descriptor_set_layouts.push_back(getSetLayout(set));
+		}
+
+		// Set layouts are interned, so their handles identify them
+		std::string key;
+		for (auto& descriptor_set_layout : descriptor_set_layouts)
+		{
+			appendKey(key, descriptor_set_layout);
+		}
+		for (auto& range : layout.push_constant_ranges)
+		{
+			appendKey(key, range.stageFlags);
+			appendKey(key, range.offset);
+			appendKey(key, range.size);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.pipeline_layout_requests++;
+
+		auto it = pipeline_layouts.find(key);
+		if (it != pipeline_layouts.end())
+		{
+			return it->second;
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(descriptor_set_layouts.data(), static_cast<uint32_t>(descriptor_set_layouts.size()));
+		pipelineLayoutCI.pushConstantRangeCount = static_cast<uint32_t>(layout.push_constant_ranges.size());
+		pipelineLayoutCI.pPushConstantRanges = layout.push_constant_ranges.data();
+
+		VkPipelineLayout pipeline_layout;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(*device, &pipelineLayoutCI, nullptr, &pipeline_layout));
+
+		stats.pipeline_layout_count++;
+		pipeline_layouts.emplace(key, pipeline_layout);
+		return pipeline_layout;
+	}
+
+	LayoutCache::Stats LayoutCache::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	std::string LayoutCache::getKey(const SetLayout& set_layout)
+	{
+		std::string key;
+		appendKey(key, set_layout.flags);
+
+		for (size_t i = 0; i < set_layout.bindings.size(); i++)
+		{
+			auto& binding = set_layout.bindings[i];
+			appendKey(key, binding.binding);
+			appendKey(key, binding.descriptorType);
+			appendKey(key, binding.descriptorCount);
+			appendKey(key, binding.stageFlags);
+
+			VkDescriptorBindingFlagsEXT flags = i < set_layout.binding_flags.size() ? set_layout.binding_flags[i] : 0;
+			appendKey(key, flags);
+		}
+
+		return key;
+	}
+}
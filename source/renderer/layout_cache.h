@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vulkanexamplebase.h>
+
+#include <shader_compiler/shader_compiler.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace chaf
+{
+	// Process wide cache of descriptor set layouts and pipeline layouts, identical layouts are created once and shared.
+	// Layouts are owned by the cache, pipelines must not destroy them
+	class LayoutCache
+	{
+	public:
+		struct SetLayout
+		{
+			// Sorted by binding
+			std::vector<VkDescriptorSetLayoutBinding> bindings;
+			// Empty or one per binding
+			std::vector<VkDescriptorBindingFlagsEXT> binding_flags;
+			VkDescriptorSetLayoutCreateFlags flags{ 0 };
+		};
+
+		// Layout of a pipeline merged from the reflection of all its stages
+		struct Layout
+		{
+			// Indexed by set number
+			std::vector<SetLayout> sets;
+			std::vector<VkPushConstantRange> push_constant_ranges;
+
+			// Runtime sized arrays are reflected with zero descriptors, their size comes from the pipeline
+			void setDescriptorCount(uint32_t set, uint32_t binding, uint32_t count);
+
+			void setBindingFlags(uint32_t set, uint32_t binding, VkDescriptorBindingFlagsEXT flags);
+
+			// Pool sizes for given number of descriptor sets of a set index
+			std::vector<VkDescriptorPoolSize> getPoolSizes(uint32_t set, uint32_t set_count) const;
+
+			VkDescriptorSetLayoutBinding* findBinding(uint32_t set, uint32_t binding);
+		};
+
+		struct Stats
+		{
+			uint32_t set_layout_requests{ 0 };
+			uint32_t set_layout_count{ 0 };
+			uint32_t pipeline_layout_requests{ 0 };
+			uint32_t pipeline_layout_count{ 0 };
+		};
+
+	public:
+		static LayoutCache& get();
+
+		void initialize(vks::VulkanDevice& device);
+
+		// Destroy all layouts, no pipeline may use them anymore
+		void destroy();
+
+		static Layout reflect(const std::vector<ShaderResource>& resources);
+
+		VkDescriptorSetLayout getSetLayout(const SetLayout& set_layout);
+
+		VkPipelineLayout getPipelineLayout(const Layout& layout);
+
+		Stats getStats();
+
+	private:
+		LayoutCache() = default;
+
+		static std::string getKey(const SetLayout& set_layout);
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		std::mutex mutex;
+
+		std::unordered_map<std::string, VkDescriptorSetLayout> set_layouts;
+
+		std::unordered_map<std::string, VkPipelineLayout> pipeline_layouts;
+
+		Stats stats;
+	};
+}
@@ -0,0 +1,281 @@
+#include <renderer/pipeline_cache.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace chaf
+{
+	static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x5043534c;
+
+	PipelineCache& PipelineCache::get()
+	{
+		static PipelineCache pipeline_cache;
+		return pipeline_cache;
+	}
+
+	void PipelineCache::initialize(vks::VulkanDevice& device, const std::string& path, bool creation_feedback)
+	{
+		if (pipeline_cache != VK_NULL_HANDLE)
+		{
+			destroy();
+		}
+
+		this->device = &device;
+		this->path = path;
+		this->creation_feedback = creation_feedback;
+
+		stats = {};
+		stats.feedback = creation_feedback;
+
+		load();
+
+		last_save = std::chrono::steady_clock::now();
+	}
+
+	void PipelineCache::destroy()
+	{
+		if (pipeline_cache == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		save();
+
+		vkDestroyPipelineCache(*device, pipeline_cache, nullptr);
+		pipeline_cache = VK_NULL_HANDLE;
+	}
+
+	VkPipelineCache PipelineCache::getHandle() const
+	{
+		if (pipeline_cache == VK_NULL_HANDLE)
+		{
+			throw std::runtime_error("Pipeline cache is used before initialization");
+		}
+
+		return pipeline_cache;
+	}
+
+	void PipelineCache::createGraphicsPipeline(VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline)
+	{
+		VkPipelineCreationFeedbackEXT feedback{};
+		std::vector<VkPipelineCreationFeedbackEXT> stage_feedbacks(create_info.stageCount);
+
+		VkPipelineCreationFeedbackCreateInfoEXT feedbackCreateInfo{};
+		feedbackCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedbackCreateInfo.pNext = create_info.pNext;
+		feedbackCreateInfo.pPipelineCreationFeedback = &feedback;
+		feedbackCreateInfo.pipelineStageCreationFeedbackCount = create_info.stageCount;
+		feedbackCreateInfo.pPipelineStageCreationFeedbacks = stage_feedbacks.data();
+
+		const void* next = create_info.pNext;
+		if (creation_feedback)
+		{
+			create_info.pNext = &feedbackCreateInfo;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(*device, getHandle(), 1, &create_info, nullptr, pipeline));
+		auto end = std::chrono::high_resolution_clock::now();
+
+		create_info.pNext = next;
+
+		recordCreation(std::chrono::duration<double, std::milli>(end - start).count(), feedback);
+	}
+
+	void PipelineCache::createComputePipeline(VkComputePipelineCreateInfo& create_info, VkPipeline* pipeline)
+	{
+		VkPipelineCreationFeedbackEXT feedback{};
+		VkPipelineCreationFeedbackEXT stage_feedback{};
+
+		VkPipelineCreationFeedbackCreateInfoEXT feedbackCreateInfo{};
+		feedbackCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedbackCreateInfo.pNext = create_info.pNext;
+		feedbackCreateInfo.pPipelineCreationFeedback = &feedback;
+		feedbackCreateInfo.pipelineStageCreationFeedbackCount = 1;
+		feedbackCreateInfo.pPipelineStageCreationFeedbacks = &stage_feedback;
+
+		const void* next = create_info.pNext;
+		if (creation_feedback)
+		{
+			create_info.pNext = &feedbackCreateInfo;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		VK_CHECK_RESULT(vkCreateComputePipelines(*device, getHandle(), 1, &create_info, nullptr, pipeline));
+		auto end = std::chrono::high_resolution_clock::now();
+
+		create_info.pNext = next;
+
+		recordCreation(std::chrono::duration<double, std::milli>(end - start).count(), feedback);
+	}
+
+	void PipelineCache::update()
+	{
+		if (dirty && std::chrono::steady_clock::now() - last_save >= save_interval)
+		{
+			save();
+		}
+	}
+
+	void PipelineCache::save()
+	{
+		if (pipeline_cache == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		dirty = false;
+		last_save = std::chrono::steady_clock::now();
+
+		size_t size = 0;
+		VK_CHECK_RESULT(vkGetPipelineCacheData(*device, pipeline_cache, &size, nullptr));
+
+		std::vector<char> data(size);
+		VK_CHECK_RESULT(vkGetPipelineCacheData(*device, pipeline_cache, &size, data.data()));
+		data.resize(size);
+
+		auto header = makeHeader(data.size(), getChecksum(data));
+
+		// Write to a temporary file first, so a crash while saving never leaves a broken cache behind
+		std::filesystem::path file_path(path);
+		if (file_path.has_parent_path())
+		{
+			std::error_code error;
+			std::filesystem::create_directories(file_path.parent_path(), error);
+		}
+
+		std::string temp_path = path + ".tmp";
+		{
+			std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Could not write pipeline cache to " << temp_path << std::endl;
+				return;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+			file.write(data.data(), data.size());
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::cerr << "Could not replace pipeline cache " << path << ": " << error.message() << std::endl;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.saved_size = data.size();
+	}
+
+	PipelineCache::Stats PipelineCache::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	void PipelineCache::load()
+	{
+		std::vector<char> data;
+
+		std::ifstream file(path, std::ios::binary);
+		if (file.is_open())
+		{
+			FileHeader header{};
+			file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+
+			auto expected = makeHeader(header.data_size, 0);
+			bool valid = file.gcount() == sizeof(FileHeader) &&
+				header.magic == expected.magic &&
+				header.header_size == expected.header_size &&
+				header.vendor_id == expected.vendor_id &&
+				header.device_id == expected.device_id &&
+				header.driver_version == expected.driver_version &&
+				std::memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) == 0;
+
+			// Size in header must match the rest of file, never allocate what a broken header claims
+			std::error_code error;
+			auto file_size = std::filesystem::file_size(path, error);
+			valid = valid && !error && file_size >= sizeof(FileHeader) && header.data_size == file_size - sizeof(FileHeader);
+
+			if (valid)
+			{
+				data.resize(header.data_size);
+				file.read(data.data(), data.size());
+				valid = static_cast<uint64_t>(file.gcount()) == header.data_size && getChecksum(data) == header.checksum;
+			}
+
+			if (!valid)
+			{
+				std::cout << "Pipeline cache " << path << " was written by another device or driver, or is corrupted, starting with an empty cache" << std::endl;
+				data.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo pipelineCacheCI{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		pipelineCacheCI.initialDataSize = data.size();
+		pipelineCacheCI.pInitialData = data.empty() ? nullptr : data.data();
+
+		// Driver may still reject data it does not like, fall back to an empty cache
+		if (vkCreatePipelineCache(*device, &pipelineCacheCI, nullptr, &pipeline_cache) != VK_SUCCESS)
+		{
+			data.clear();
+			pipelineCacheCI.initialDataSize = 0;
+			pipelineCacheCI.pInitialData = nullptr;
+			VK_CHECK_RESULT(vkCreatePipelineCache(*device, &pipelineCacheCI, nullptr, &pipeline_cache));
+		}
+
+		stats.loaded_size = data.size();
+	}
+
+	PipelineCache::FileHeader PipelineCache::makeHeader(uint64_t data_size, uint64_t checksum) const
+	{
+		FileHeader header{};
+		header.magic = PIPELINE_CACHE_MAGIC;
+		header.header_size = sizeof(FileHeader);
+		header.vendor_id = device->properties.vendorID;
+		header.device_id = device->properties.deviceID;
+		header.driver_version = device->properties.driverVersion;
+		std::memcpy(header.uuid, device->properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.data_size = data_size;
+		header.checksum = checksum;
+		return header;
+	}
+
+	uint64_t PipelineCache::getChecksum(const std::vector<char>& data)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : data)
+		{
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void PipelineCache::recordCreation(double time, const VkPipelineCreationFeedbackEXT& feedback)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stats.pipeline_count++;
+		stats.creation_time += time;
+
+		if (creation_feedback && (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+		{
+			if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+			{
+				stats.hit_count++;
+			}
+			else
+			{
+				stats.miss_count++;
+			}
+		}
+
+		dirty = true;
+	}
+}
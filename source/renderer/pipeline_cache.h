@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkanexamplebase.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace chaf
+{
+	// Process wide pipeline cache shared by all pipelines, persisted to disk between launches
+	class PipelineCache
+	{
+	public:
+		struct Stats
+		{
+			uint32_t pipeline_count{ 0 };
+			// Only counted when pipeline creation feedback is available
+			uint32_t hit_count{ 0 };
+			uint32_t miss_count{ 0 };
+			double creation_time{ 0.0 };
+			// Size of cache data loaded from disk, zero if it was missing or rejected
+			size_t loaded_size{ 0 };
+			size_t saved_size{ 0 };
+			bool feedback{ false };
+		};
+
+	public:
+		static PipelineCache& get();
+
+		// Load cache from file, data written by another device or driver is discarded
+		void initialize(vks::VulkanDevice& device, const std::string& path, bool creation_feedback);
+
+		// Save to disk and destroy cache, pipelines created from it stay valid
+		void destroy();
+
+		VkPipelineCache getHandle() const;
+
+		void createGraphicsPipeline(VkGraphicsPipelineCreateInfo& create_info, VkPipeline* pipeline);
+
+		void createComputePipeline(VkComputePipelineCreateInfo& create_info, VkPipeline* pipeline);
+
+		// Save if new pipelines were created and the save interval has passed, called once per frame
+		void update();
+
+		void save();
+
+		Stats getStats();
+
+	public:
+		std::chrono::seconds save_interval{ 30 };
+
+	private:
+		PipelineCache() = default;
+
+		// Header of cache file, identifies the device and driver that wrote the data
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t header_size;
+			uint32_t vendor_id;
+			uint32_t device_id;
+			uint32_t driver_version;
+			uint8_t uuid[VK_UUID_SIZE];
+			uint64_t data_size;
+			uint64_t checksum;
+		};
+
+		void load();
+
+		FileHeader makeHeader(uint64_t data_size, uint64_t checksum) const;
+
+		static uint64_t getChecksum(const std::vector<char>& data);
+
+		void recordCreation(double time, const VkPipelineCreationFeedbackEXT& feedback);
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		VkPipelineCache pipeline_cache{ VK_NULL_HANDLE };
+
+		std::string path;
+
+		bool creation_feedback{ false };
+
+		// Pipelines may be created from several threads
+		std::mutex mutex;
+
+		Stats stats;
+
+		std::atomic<bool> dirty{ false };
+
+		std::chrono::steady_clock::time_point last_save;
+	};
+}
@@ -0,0 +1,582 @@
+#include <renderer/render_graph.h>
+
+#include <algorithm>
+
+RenderGraph::RenderGraph(vks::VulkanDevice& device, uint32_t queue_family_index) :
+	device{ device }, queue_family_index{ queue_family_index }
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	destroyTransients();
+}
+
+RenderGraph::ResourceHandle RenderGraph::importImage(const std::string& name, VkImage image, const VkImageSubresourceRange& range, Access initial_access)
+{
+	Resource resource;
+	resource.name = name;
+	resource.image = image;
+	resource.range = range;
+	resource.initial_access = initial_access;
+	resources.push_back(resource);
+	compiled = false;
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::importBuffer(const std::string& name, VkBuffer buffer, Access initial_access)
+{
+	Resource resource;
+	resource.name = name;
+	resource.is_image = false;
+	resource.buffer = buffer;
+	resource.initial_access = initial_access;
+	resources.push_back(resource);
+	compiled = false;
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::createImage(const std::string& name, const VkImageCreateInfo& create_info, VkImageAspectFlags aspect)
+{
+	Resource resource;
+	resource.name = name;
+	resource.transient = true;
+	resource.create_info = create_info;
+	resource.create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.range = { aspect, 0, create_info.mipLevels, 0, create_info.arrayLayers };
+	resources.push_back(resource);
+	compiled = false;
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+void RenderGraph::acquire(ResourceHandle resource, Access released_access, uint32_t src_queue_family)
+{
+	resources[resource].acquire_access = released_access;
+	resources[resource].acquire_queue_family = src_queue_family;
+	compiled = false;
+}
+
+void RenderGraph::setFinalAccess(ResourceHandle resource, Access access, uint32_t dst_queue_family)
+{
+	resources[resource].final_access = access;
+	resources[resource].final_queue_family = dst_queue_family;
+	resources[resource].output = true;
+	compiled = false;
+}
+
+RenderGraph::PassHandle RenderGraph::addPass(const std::string& name, std::function<void(VkCommandBuffer)> record)
+{
+	Pass pass;
+	pass.name = name;
+	pass.record = record;
+	passes.push_back(pass);
+	compiled = false;
+	return static_cast<PassHandle>(passes.size() - 1);
+}
+
+void RenderGraph::read(PassHandle pass, ResourceHandle resource, Access access)
+{
+	passes[pass].reads.push_back({ resource, access });
+	compiled = false;
+}
+
+void RenderGraph::write(PassHandle pass, ResourceHandle resource, Access access)
+{
+	passes[pass].writes.push_back({ resource, access });
+	compiled = false;
+}
+
+void RenderGraph::setSideEffect(PassHandle pass)
+{
+	passes[pass].side_effect = true;
+	compiled = false;
+}
+
+void RenderGraph::compile()
+{
+	destroyTransients();
+
+	stats = {};
+	stats.pass_count = static_cast<uint32_t>(passes.size());
+
+	cullPasses();
+	allocateTransients();
+	buildBarriers();
+
+	compiled = true;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd_buffer)
+{
+	if (!compiled)
+	{
+		compile();
+	}
+
+	auto record_barrier = [cmd_buffer](const Barrier& barrier) {
+		if (barrier.image_barriers.empty() && barrier.buffer_barriers.empty())
+		{
+			return;
+		}
+
+		vkCmdPipelineBarrier(
+			cmd_buffer,
+			barrier.src_stage,
+			barrier.dst_stage,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(barrier.buffer_barriers.size()), barrier.buffer_barriers.data(),
+			static_cast<uint32_t>(barrier.image_barriers.size()), barrier.image_barriers.data());
+	};
+
+	for (auto& pass : passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		record_barrier(pass.barrier);
+
+		if (pass.record)
+		{
+			pass.record(cmd_buffer);
+		}
+	}
+
+	record_barrier(final_barrier);
+}
+
+void RenderGraph::reset()
+{
+	destroyTransients();
+	resources.clear();
+	passes.clear();
+	final_barrier = {};
+	stats = {};
+	compiled = false;
+}
+
+VkImage RenderGraph::getImage(ResourceHandle resource) const
+{
+	return resources[resource].image;
+}
+
+VkImageView RenderGraph::getImageView(ResourceHandle resource) const
+{
+	return resources[resource].view;
+}
+
+const RenderGraph::Stats& RenderGraph::getStats() const
+{
+	return stats;
+}
+
+RenderGraph::AccessInfo RenderGraph::getAccessInfo(Access access)
+{
+	switch (access)
+	{
+	case Access::ColorAttachmentWrite:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+	case Access::DepthAttachmentWrite:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+	case Access::ComputeSampledRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case Access::ComputeStorageRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+	case Access::ComputeStorageWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+	case Access::FragmentSampledRead:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case Access::TransferRead:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+	case Access::TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+	case Access::IndirectRead:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	default:
+		return { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	}
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walk passes backwards, a pass is kept if it writes something a kept pass or the outside of graph needs
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		needed[i] = resources[i].output;
+	}
+
+	for (auto it = passes.rbegin(); it != passes.rend(); it++)
+	{
+		auto& pass = *it;
+
+		pass.culled = !pass.side_effect;
+		for (auto& write : pass.writes)
+		{
+			if (needed[write.resource])
+			{
+				pass.culled = false;
+				break;
+			}
+		}
+
+		if (pass.culled)
+		{
+			stats.culled_pass_count++;
+			continue;
+		}
+
+		for (auto& read : pass.reads)
+		{
+			needed[read.resource] = true;
+		}
+	}
+
+	// Lifetime of resources over kept passes
+	for (auto& resource : resources)
+	{
+		resource.first_pass = -1;
+		resource.last_pass = -1;
+	}
+
+	for (int32_t i = 0; i < static_cast<int32_t>(passes.size()); i++)
+	{
+		if (passes[i].culled)
+		{
+			continue;
+		}
+
+		auto touch = [this, i](const ResourceAccess& resource_access) {
+			auto& resource = resources[resource_access.resource];
+			if (resource.first_pass < 0)
+			{
+				resource.first_pass = i;
+			}
+			resource.last_pass = i;
+		};
+
+		std::for_each(passes[i].reads.begin(), passes[i].reads.end(), touch);
+		std::for_each(passes[i].writes.begin(), passes[i].writes.end(), touch);
+	}
+
+	// Outputs are used after the last pass
+	for (auto& resource : resources)
+	{
+		if (resource.output && resource.first_pass >= 0)
+		{
+			resource.last_pass = static_cast<int32_t>(passes.size());
+		}
+	}
+}
+
+void RenderGraph::allocateTransients()
+{
+	struct MemoryBlock
+	{
+		VkMemoryRequirements requirements{ 0, 1, ~0u };
+		std::vector<uint32_t> resources;
+	};
+
+	std::vector<uint32_t> transients;
+	std::vector<VkMemoryRequirements> requirements(resources.size());
+
+	for (uint32_t i = 0; i < resources.size(); i++)
+	{
+		auto& resource = resources[i];
+		resource.memory_block = -1;
+
+		// Transient image nobody uses is never created
+		if (!resource.transient || resource.first_pass < 0)
+		{
+			continue;
+		}
+
+		VK_CHECK_RESULT(vkCreateImage(device, &resource.create_info, nullptr, &resource.image));
+		vkGetImageMemoryRequirements(device, resource.image, &requirements[i]);
+		stats.transient_memory_unaliased += requirements[i].size;
+		transients.push_back(i);
+	}
+
+	// Largest first, each image goes to the first block whose images never live at the same time
+	std::sort(transients.begin(), transients.end(), [&requirements](uint32_t lhs, uint32_t rhs) {
+		return requirements[lhs].size > requirements[rhs].size;
+	});
+
+	std::vector<MemoryBlock> blocks;
+	for (auto index : transients)
+	{
+		auto& resource = resources[index];
+
+		int32_t block_index = -1;
+		for (int32_t i = 0; i < static_cast<int32_t>(blocks.size()) && block_index < 0; i++)
+		{
+			auto& block = blocks[i];
+			if ((block.requirements.memoryTypeBits & requirements[index].memoryTypeBits) == 0)
+			{
+				continue;
+			}
+
+			bool overlap = std::any_of(block.resources.begin(), block.resources.end(), [this, &resource](uint32_t other) {
+				return resources[other].first_pass <= resource.last_pass && resource.first_pass <= resources[other].last_pass;
+			});
+
+			if (!overlap)
+			{
+				block_index = i;
+			}
+		}
+
+		if (block_index < 0)
+		{
+			blocks.emplace_back();
+			block_index = static_cast<int32_t>(blocks.size() - 1);
+		}
+
+		auto& block = blocks[block_index];
+		resource.memory_block = block_index;
+		block.requirements.size = std::max(block.requirements.size, requirements[index].size);
+		block.requirements.alignment = std::max(block.requirements.alignment, requirements[index].alignment);
+		block.requirements.memoryTypeBits &= requirements[index].memoryTypeBits;
+		block.resources.push_back(index);
+	}
+
+	for (auto& block : blocks)
+	{
+		// Every image of the block is bound at its start
+		VmaAllocation allocation;
+		chaf::Allocator::get().allocateMemory(chaf::MemoryUsage::Attachment, block.requirements, allocation);
+		memory_blocks.push_back(allocation);
+		stats.transient_memory += block.requirements.size;
+
+		for (auto index : block.resources)
+		{
+			auto& resource = resources[index];
+			chaf::Allocator::get().bindImage(resource.image, allocation);
+
+			VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
+			view.viewType = resource.create_info.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+			view.format = resource.create_info.format;
+			view.subresourceRange = resource.range;
+			view.image = resource.image;
+			VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &resource.view));
+		}
+	}
+}
+
+void RenderGraph::buildBarriers()
+{
+	std::vector<ResourceState> states(resources.size());
+	std::vector<bool> pending_acquire(resources.size(), false);
+
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		auto& resource = resources[i];
+		auto& state = states[i];
+
+		if (resource.transient)
+		{
+			// Content is undefined, but the memory may still be in use by an earlier image bound to it or by the previous
+			// execution of the graph
+			state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			state.read_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			continue;
+		}
+
+		auto info = getAccessInfo(resource.initial_access);
+		state.layout = info.layout;
+		if (info.write)
+		{
+			state.write_stage = info.stage;
+			state.write_access = info.access;
+		}
+		else
+		{
+			state.read_stages = info.stage;
+		}
+
+		pending_acquire[i] = resource.acquire_queue_family != VK_QUEUE_FAMILY_IGNORED && resource.acquire_queue_family != queue_family_index;
+	}
+
+	for (auto& pass : passes)
+	{
+		pass.barrier = {};
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		// Merge accesses of a resource within the pass, so it gets at most one barrier
+		std::vector<std::pair<ResourceHandle, AccessInfo>> accesses;
+		auto merge = [this, &pass, &accesses](const ResourceAccess& resource_access) {
+			auto info = getAccessInfo(resource_access.access);
+			auto it = std::find_if(accesses.begin(), accesses.end(), [&resource_access](const auto& access) {
+				return access.first == resource_access.resource;
+			});
+
+			if (it == accesses.end())
+			{
+				accesses.push_back({ resource_access.resource, info });
+				return;
+			}
+
+			if (it->second.layout != info.layout)
+			{
+				vks::tools::exitFatal("Render graph pass \"" + pass.name + "\" accesses \"" + resources[resource_access.resource].name + "\" with different layouts", -1);
+			}
+
+			it->second.stage |= info.stage;
+			it->second.access |= info.access;
+			it->second.write |= info.write;
+		};
+
+		std::for_each(pass.reads.begin(), pass.reads.end(), merge);
+		std::for_each(pass.writes.begin(), pass.writes.end(), merge);
+
+		for (auto& [handle, info] : accesses)
+		{
+			auto& resource = resources[handle];
+			auto& state = states[handle];
+
+			if (pending_acquire[handle])
+			{
+				// Matches the release of the other queue family, which transitioned from released state to initial state
+				auto released = getAccessInfo(resource.acquire_access);
+				VkImageLayout layout = state.layout;
+				state = {};
+				state.layout = released.layout;
+				pending_acquire[handle] = false;
+
+				addBarrier(pass.barrier, resource, state, { info.stage, info.access, layout, info.write }, resource.acquire_queue_family, queue_family_index);
+
+				if (layout != info.layout)
+				{
+					vks::tools::exitFatal("Render graph resource \"" + resource.name + "\" is first used in a different layout than it was released to", -1);
+				}
+				continue;
+			}
+
+			addBarrier(pass.barrier, resource, state, info, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		}
+	}
+
+	// Bring outputs to their final state, releasing them to another queue family if requested
+	final_barrier = {};
+	for (size_t i = 0; i < resources.size(); i++)
+	{
+		auto& resource = resources[i];
+		if (resource.transient || !resource.output || resource.final_access == Access::None)
+		{
+			continue;
+		}
+
+		auto info = getAccessInfo(resource.final_access);
+		if (resource.final_queue_family != VK_QUEUE_FAMILY_IGNORED && resource.final_queue_family != queue_family_index)
+		{
+			// Release only makes writes available, acquire on the other queue makes them visible
+			addBarrier(final_barrier, resource, states[i], { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, info.layout, false }, queue_family_index, resource.final_queue_family);
+		}
+		else
+		{
+			addBarrier(final_barrier, resource, states[i], info, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		}
+	}
+}
+
+void RenderGraph::addBarrier(Barrier& barrier, Resource& resource, ResourceState& state, const AccessInfo& info, uint32_t src_queue_family, uint32_t dst_queue_family)
+{
+	bool ownership_transfer = src_queue_family != dst_queue_family;
+	bool layout_change = resource.is_image && info.layout != state.layout;
+
+	VkPipelineStageFlags src_stage = 0;
+	VkAccessFlags src_access = 0;
+	bool needed = ownership_transfer || layout_change;
+
+	if (info.write || layout_change)
+	{
+		// Write after write, and write after read which only needs an execution dependency
+		src_stage = state.write_stage | state.read_stages;
+		src_access = state.write_access;
+		needed |= src_stage != 0;
+	}
+	else if (state.write_stage != 0 && (info.stage & ~state.visible_stages) != 0)
+	{
+		// Read after write that is not yet visible to this stage
+		src_stage = state.write_stage;
+		src_access = state.write_access;
+		needed = true;
+	}
+
+	if (info.write)
+	{
+		state.write_stage = info.stage;
+		state.write_access = info.access;
+		state.read_stages = 0;
+		state.visible_stages = 0;
+	}
+	else
+	{
+		state.read_stages |= info.stage;
+		state.visible_stages |= info.stage;
+	}
+
+	if (!needed)
+	{
+		return;
+	}
+
+	barrier.src_stage |= src_stage != 0 ? src_stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	barrier.dst_stage |= info.stage;
+	stats.barrier_count++;
+
+	if (resource.is_image)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier = vks::initializers::imageMemoryBarrier();
+		imageMemoryBarrier.oldLayout = state.layout;
+		imageMemoryBarrier.newLayout = info.layout;
+		imageMemoryBarrier.srcAccessMask = src_access;
+		imageMemoryBarrier.dstAccessMask = info.access;
+		imageMemoryBarrier.srcQueueFamilyIndex = ownership_transfer ? src_queue_family : VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = ownership_transfer ? dst_queue_family : VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = resource.image;
+		imageMemoryBarrier.subresourceRange = resource.range;
+		barrier.image_barriers.push_back(imageMemoryBarrier);
+
+		state.layout = info.layout;
+	}
+	else
+	{
+		VkBufferMemoryBarrier bufferMemoryBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferMemoryBarrier.srcAccessMask = src_access;
+		bufferMemoryBarrier.dstAccessMask = info.access;
+		bufferMemoryBarrier.srcQueueFamilyIndex = ownership_transfer ? src_queue_family : VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.dstQueueFamilyIndex = ownership_transfer ? dst_queue_family : VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.buffer = resource.buffer;
+		bufferMemoryBarrier.offset = 0;
+		bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+		barrier.buffer_barriers.push_back(bufferMemoryBarrier);
+	}
+}
+
+void RenderGraph::destroyTransients()
+{
+	for (auto& resource : resources)
+	{
+		if (!resource.transient)
+		{
+			continue;
+		}
+
+		vkDestroyImageView(device, resource.view, nullptr);
+		vkDestroyImage(device, resource.image, nullptr);
+		resource.view = VK_NULL_HANDLE;
+		resource.image = VK_NULL_HANDLE;
+	}
+
+	for (auto& allocation : memory_blocks)
+	{
+		chaf::Allocator::get().freeMemory(allocation);
+	}
+	memory_blocks.clear();
+}
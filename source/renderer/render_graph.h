@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vulkanexamplebase.h>
+
+#include <scene/cacher/allocator.h>
+
+#include <functional>
+#include <string>
+
+// Minimal frame graph recorded into a single command buffer.
+// Passes declare how they access resources, barriers and layout transitions are derived from that,
+// passes whose results are never consumed are culled, transient images share memory when their lifetimes do not overlap
+class RenderGraph
+{
+public:
+	using ResourceHandle = uint32_t;
+	using PassHandle = uint32_t;
+
+	enum class Access
+	{
+		None,
+		ColorAttachmentWrite,
+		DepthAttachmentWrite,
+		ComputeSampledRead,
+		ComputeStorageRead,
+		ComputeStorageWrite,
+		FragmentSampledRead,
+		TransferRead,
+		TransferWrite,
+		IndirectRead
+	};
+
+	struct Stats
+	{
+		uint32_t pass_count{ 0 };
+		uint32_t culled_pass_count{ 0 };
+		uint32_t barrier_count{ 0 };
+		VkDeviceSize transient_memory{ 0 };
+		// Memory transient images would take without aliasing
+		VkDeviceSize transient_memory_unaliased{ 0 };
+	};
+
+public:
+	// Graph is recorded into command buffers of given queue family
+	RenderGraph(vks::VulkanDevice& device, uint32_t queue_family_index);
+
+	~RenderGraph();
+
+	// Image owned outside of graph, in given access state when the graph starts
+	ResourceHandle importImage(const std::string& name, VkImage image, const VkImageSubresourceRange& range, Access initial_access = Access::None);
+
+	ResourceHandle importBuffer(const std::string& name, VkBuffer buffer, Access initial_access = Access::None);
+
+	// Image created and owned by graph, only valid between its first and last use, or until the graph is reset if it
+	// has a final state. Images whose lifetimes do not overlap share memory, so content never survives an execution
+	ResourceHandle createImage(const std::string& name, const VkImageCreateInfo& create_info, VkImageAspectFlags aspect);
+
+	// Resource was released by another queue family with a transition from released access to its initial access
+	void acquire(ResourceHandle resource, Access released_access, uint32_t src_queue_family);
+
+	// State the resource is left in after the graph, optionally released to another queue family. Resources with a final state are graph outputs
+	void setFinalAccess(ResourceHandle resource, Access access, uint32_t dst_queue_family = VK_QUEUE_FAMILY_IGNORED);
+
+	PassHandle addPass(const std::string& name, std::function<void(VkCommandBuffer)> record);
+
+	void read(PassHandle pass, ResourceHandle resource, Access access);
+
+	void write(PassHandle pass, ResourceHandle resource, Access access);
+
+	// Pass is never culled, even if nothing reads its results
+	void setSideEffect(PassHandle pass);
+
+	// Cull passes, allocate transient memory and derive barriers
+	void compile();
+
+	void execute(VkCommandBuffer cmd_buffer);
+
+	// Drop all passes and resources, transient memory is freed. Command buffers recorded from the graph must have completed
+	void reset();
+
+	VkImage getImage(ResourceHandle resource) const;
+
+	VkImageView getImageView(ResourceHandle resource) const;
+
+	const Stats& getStats() const;
+
+private:
+	struct AccessInfo
+	{
+		VkPipelineStageFlags stage;
+		VkAccessFlags access;
+		VkImageLayout layout;
+		bool write;
+	};
+
+	static AccessInfo getAccessInfo(Access access);
+
+	struct Resource
+	{
+		std::string name;
+		bool is_image{ true };
+		bool transient{ false };
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VkImageSubresourceRange range{};
+		VkImageCreateInfo create_info{};
+		Access initial_access{ Access::None };
+		Access acquire_access{ Access::None };
+		uint32_t acquire_queue_family{ VK_QUEUE_FAMILY_IGNORED };
+		Access final_access{ Access::None };
+		uint32_t final_queue_family{ VK_QUEUE_FAMILY_IGNORED };
+		bool output{ false };
+
+		// Lifetime in executed pass order
+		int32_t first_pass{ -1 };
+		int32_t last_pass{ -1 };
+		// Transient memory block
+		int32_t memory_block{ -1 };
+	};
+
+	struct ResourceAccess
+	{
+		ResourceHandle resource;
+		Access access;
+	};
+
+	struct Barrier
+	{
+		VkPipelineStageFlags src_stage{ 0 };
+		VkPipelineStageFlags dst_stage{ 0 };
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		std::vector<VkBufferMemoryBarrier> buffer_barriers;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::function<void(VkCommandBuffer)> record;
+		std::vector<ResourceAccess> reads;
+		std::vector<ResourceAccess> writes;
+		bool side_effect{ false };
+		bool culled{ false };
+		Barrier barrier;
+	};
+
+	// Current synchronization state of a resource while walking passes
+	struct ResourceState
+	{
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkPipelineStageFlags write_stage{ 0 };
+		VkAccessFlags write_access{ 0 };
+		// Stages that read since last write
+		VkPipelineStageFlags read_stages{ 0 };
+		// Stages the last write has been made visible to
+		VkPipelineStageFlags visible_stages{ 0 };
+	};
+
+	void cullPasses();
+
+	void allocateTransients();
+
+	void buildBarriers();
+
+	void addBarrier(Barrier& barrier, Resource& resource, ResourceState& state, const AccessInfo& info, uint32_t src_queue_family, uint32_t dst_queue_family);
+
+	void destroyTransients();
+
+private:
+	vks::VulkanDevice& device;
+
+	uint32_t queue_family_index{ 0 };
+
+	std::vector<Resource> resources;
+
+	std::vector<Pass> passes;
+
+	std::vector<VmaAllocation> memory_blocks;
+
+	// Barrier after last pass, bringing outputs to their final state
+	Barrier final_barrier;
+
+	Stats stats;
+
+	bool compiled{ false };
+};
@@ -3,6 +3,8 @@
 #include <scene/node.h>
 #include <scene/components/mesh.h>
 #include <scene/components/transform.h>
+#include <scene/cacher/cacher.h>
+#include <core/job_system.h>
 
 ScenePipeline::ScenePipeline(vks::VulkanDevice& device, chaf::Scene& scene) :
 	chaf::PipelineBase{ device }, scene{ scene }
@@ -11,10 +13,21 @@ ScenePipeline::ScenePipeline(vks::VulkanDevice& device, chaf::Scene& scene) :
 
 ScenePipeline::~ScenePipeline()
 {
-	sceneUBO.buffer.destroy();
-	last_sceneUBO_buffer.destroy();
+	for (auto& buffer : sceneUBO.buffers)
+	{
+		buffer.destroy();
+	}
+	for (auto& buffer : last_sceneUBO.buffers)
+	{
+		buffer.destroy();
+	}
 	instanceIndexBuffer.destroy();
 
+	for (auto& data : thread_data)
+	{
+		vkDestroyCommandPool(device, data.command_pool, nullptr);
+	}
+
 	destroy();
 }
 
@@ -22,21 +35,19 @@ void ScenePipeline::destroy()
 {
 	if (has_init)
 	{
-		vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
 		vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 		vkDestroyPipeline(device, pipeline, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.scene, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.object, nullptr);
 		has_init = false;
 	}
 }
 
-void ScenePipeline::prepare(VkRenderPass render_pass, VkQueue queue)
+void ScenePipeline::prepare(VkRenderPass render_pass, VkQueue queue, uint32_t frame_count)
 {
-	// Scene Primitive count
-	maxCount = scene.images.size() > device.properties.limits.maxPerStageDescriptorUniformBuffers ? device.properties.limits.maxPerStageDescriptorUniformBuffers : static_cast<uint32_t>(scene.images.size());
+	this->frame_count = frame_count;
+
+	prepareThreadData();
 
-	vks::Buffer stagingBuffer;
+	chaf::Buffer stagingBuffer;
 
 	std::vector<uint32_t> instanceData(scene.primitive_count);
 	for (uint32_t i = 0; i < scene.primitive_count; i++)
@@ -44,110 +55,94 @@ void ScenePipeline::prepare(VkRenderPass render_pass, VkQueue queue)
 		instanceData[i] = i;
 	}
 
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		instanceData.size() * sizeof(uint32_t),
-		instanceData.data()));
+	auto& allocator = chaf::Allocator::get();
+
+	allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		instanceData.size() * sizeof(uint32_t), stagingBuffer, instanceData.data());
 
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&instanceIndexBuffer,
-		stagingBuffer.size));
+	allocator.createBuffer(chaf::MemoryUsage::Storage, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		stagingBuffer.size, instanceIndexBuffer);
 
-	device.copyBuffer(&stagingBuffer, &instanceIndexBuffer, queue);
+	allocator.copyBuffer(stagingBuffer, instanceIndexBuffer, queue);
 
 	stagingBuffer.destroy();
 
 
 
-	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 	1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 	1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
-	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes,  2);
+	// Both shader sets share one layout, so toggling tessellation only rebuilds the pipeline
+	auto layout = reflectLayout({
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing_tes.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing_tes.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing_tes.tesc.spv", VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/scene_indexing_tes.tese.spv", VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT } });
+
+	// Set 0: scene UBO and model matrices, set 1: all bindless texture slots, written by the image cacher between frames
+	uint32_t slot_capacity = scene.image_cacher->getSlotCapacity();
+	layout.setDescriptorCount(1, 0, slot_capacity);
+	layout.setBindingFlags(1, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT);
+	layout.sets[1].flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+
+	descriptor_set_layouts.scene = chaf::LayoutCache::get().getSetLayout(layout.sets[0]);
+	descriptor_set_layouts.object = chaf::LayoutCache::get().getSetLayout(layout.sets[1]);
+	pipeline_layout = chaf::LayoutCache::get().getPipelineLayout(layout);
+
+	// Prepare descriptor pool, one scene set and one object set per frame
+	std::vector<VkDescriptorPoolSize> poolSizes = layout.getPoolSizes(0, frame_count);
+	for (auto& pool_size : layout.getPoolSizes(1, frame_count))
+	{
+		poolSizes.push_back(pool_size);
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, frame_count * 2);
+	descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptor_pool));
 
-	// Prepare descriptor set layout
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		// Binding Scene UBO
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS, 0),
-		// binding all model matrices
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS, 1),
-	};
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptor_set_layouts.scene));
-	
-	setLayoutBindings = {
-		// binding all textures
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_ALL_GRAPHICS, 0, 1024)
-	}; 
-
-	descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
-	descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-
-	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlags{};
-	setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
-	setLayoutBindingFlags.bindingCount = 1;
-	std::vector<VkDescriptorBindingFlagsEXT> descriptorBindingFlags = {
-		//VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
-		//VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT
-	};
-	setLayoutBindingFlags.pBindingFlags = descriptorBindingFlags.data();
-	descriptorSetLayoutCI.pNext = &setLayoutBindingFlags;
-
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptor_set_layouts.object));
-
-	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptor_set_layouts.scene, descriptor_set_layouts.object };
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipeline_layout));
-
-	// Create scene UBO
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&sceneUBO.buffer,
-		sizeof(sceneUBO.values)));
-	VK_CHECK_RESULT(sceneUBO.buffer.map());
-
-	VK_CHECK_RESULT(device.createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&last_sceneUBO_buffer,
-		sizeof(sceneUBO.values)));
-	VK_CHECK_RESULT(last_sceneUBO_buffer.map());
-	 
-	// Descriptor set for scene UBO
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, &descriptor_set_layouts.scene, 1);
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_set.scene));
-
-	std::vector<VkWriteDescriptorSet>writeDescriptorSets = {
-		vks::initializers::writeDescriptorSet(descriptor_set.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &sceneUBO.buffer.descriptor),
-		vks::initializers::writeDescriptorSet(descriptor_set.scene, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &scene.object_buffer.descriptor)
-	};
+	// Create scene UBO for each frame in flight
+	sceneUBO.buffers.resize(frame_count);
+	last_sceneUBO.buffers.resize(frame_count);
+	descriptor_set.scene.resize(frame_count);
+
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		// Persistently mapped
+		allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(sceneUBO.values), sceneUBO.buffers[i]);
+		allocator.createBuffer(chaf::MemoryUsage::Upload, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(last_sceneUBO.values), last_sceneUBO.buffers[i]);
+
+		// Descriptor set for scene UBO
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, &descriptor_set_layouts.scene, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_set.scene[i]));
 
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		std::vector<VkWriteDescriptorSet>writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptor_set.scene[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &sceneUBO.buffers[i].descriptor),
+			vks::initializers::writeDescriptorSet(descriptor_set.scene[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &scene.object_buffer.descriptor)
+		};
 
-	//// Descriptor set for bindless object
-	//VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAllocInfo = {};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	// Texture sets are written while command buffers which bind them are pending, each frame only updates its own
+	descriptor_set.object.resize(frame_count);
+	texture_tables.resize(frame_count);
 
-	//uint32_t variableDescCounts[] = { 1024 };
+	std::vector<VkDescriptorSetLayout> object_layouts(frame_count, descriptor_set_layouts.object);
+	std::vector<uint32_t> variable_counts(frame_count, slot_capacity);
 
-	//variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
-	//variableDescriptorCountAllocInfo.descriptorSetCount = 1;
-	//variableDescriptorCountAllocInfo.pDescriptorCounts = variableDescCounts;
+	VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAllocInfo = {};
+	variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+	variableDescriptorCountAllocInfo.descriptorSetCount = frame_count;
+	variableDescriptorCountAllocInfo.pDescriptorCounts = variable_counts.data();
 
-	allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, &descriptor_set_layouts.object, 1);
-	//allocInfo.pNext = &variableDescriptorCountAllocInfo;
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, object_layouts.data(), frame_count);
+	allocInfo.pNext = &variableDescriptorCountAllocInfo;
 
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_set.object));
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, descriptor_set.object.data()));
 
-	updateDescriptors();
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		texture_tables[i] = scene.image_cacher->createTable();
+		updateDescriptors(i);
+	}
 
 	setupPipeline(render_pass);	
 
@@ -156,10 +151,17 @@ void ScenePipeline::prepare(VkRenderPass render_pass, VkQueue queue)
 
 void ScenePipeline::setupPipeline(VkRenderPass render_pass)
 {
+	this->render_pass = render_pass;
+
 	if (pipeline != VK_NULL_HANDLE)
 	{
 		vkDestroyPipeline(device, pipeline, nullptr);
 	}
+	pipeline = createPipeline();
+}
+
+VkPipeline ScenePipeline::createPipeline()
+{
 	// Pipeline state setup
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI;
 	if (enable_tessellation)
@@ -206,9 +208,9 @@ void ScenePipeline::setupPipeline(VkRenderPass render_pass)
 	pipelineCI.pViewportState = &viewportStateCI;
 	pipelineCI.pDepthStencilState = &depthStencilStateCI;
 	pipelineCI.pDynamicState = &dynamicStateCI;
+	VkPipelineTessellationStateCreateInfo tessellationStateCI = vks::initializers::pipelineTessellationStateCreateInfo(3);
 	if (enable_tessellation)
 	{
-		VkPipelineTessellationStateCreateInfo tessellationStateCI = vks::initializers::pipelineTessellationStateCreateInfo(3);
 		pipelineCI.pTessellationState = &tessellationStateCI;
 
 		shaderStages.resize(4);
@@ -226,70 +228,159 @@ void ScenePipeline::setupPipeline(VkRenderPass render_pass)
 	pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 	pipelineCI.pStages = shaderStages.data();
 
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineCI, nullptr, &pipeline));
+	VkPipeline new_pipeline;
+	createGraphicsPipeline(pipelineCI, &new_pipeline);
+	return new_pipeline;
+}
+
+void ScenePipeline::replacePipeline(VkPipeline pipeline)
+{
+	vkDestroyPipeline(device, this->pipeline, nullptr);
+	this->pipeline = pipeline;
+}
+
+void ScenePipeline::commandRecord(VkCommandBuffer& cmd_buffer, CullingPipeline& culling_pipeline, uint32_t frame_index)
+{
+	// All resident meshes live in the geometry arenas, draws of missing ones have no indices
+	bindResources(cmd_buffer, frame_index, scene.buffer_cacher->getVertexBuffer(), scene.buffer_cacher->getIndexBuffer());
+	drawIndirect(cmd_buffer, culling_pipeline, frame_index, 0, static_cast<uint32_t>(culling_pipeline.indirect_commands.size()));
+}
+
+std::vector<VkCommandBuffer> ScenePipeline::commandRecordMultiThread(const VkCommandBufferInheritanceInfo& inheritance_info, const VkViewport& viewport, const VkRect2D& scissor, CullingPipeline& culling_pipeline, uint32_t frame_index)
+{
+	std::vector<VkCommandBuffer> cmd_buffers;
+
+	// Look up geometry arenas once, the cacher is not touched by recording threads
+	VkBuffer vertex_buffer = scene.buffer_cacher->getVertexBuffer();
+	VkBuffer index_buffer = scene.buffer_cacher->getIndexBuffer();
+
+	uint32_t total_draw_count = static_cast<uint32_t>(culling_pipeline.indirect_commands.size());
+	uint32_t thread_count = std::max(1u, std::min(static_cast<uint32_t>(thread_data.size()), total_draw_count));
+	uint32_t group_size = total_draw_count / thread_count;
+
+	for (uint32_t i = 0; i < thread_count; i++)
+	{
+		cmd_buffers.push_back(thread_data[i].command_buffers[frame_index]);
+	}
+
+	// One group of draws per job, a command pool is only used by the job recording its group
+	chaf::JobSystem::get().parallelFor(chaf::JobPriority::Frame, thread_count, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			VkCommandBuffer cmd_buffer = cmd_buffers[i];
+			uint32_t first_draw = i * group_size;
+			uint32_t draw_count = (i == thread_count - 1) ? total_draw_count - first_draw : group_size;
+
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			cmdBufInfo.pInheritanceInfo = &inheritance_info;
+
+			VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buffer, &cmdBufInfo));
+
+			vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+			vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+			bindResources(cmd_buffer, frame_index, vertex_buffer, index_buffer);
+			drawIndirect(cmd_buffer, culling_pipeline, frame_index, first_draw, draw_count);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buffer));
+		}
+	}, 1);
+
+	return cmd_buffers;
+}
+
+void ScenePipeline::prepareThreadData()
+{
+	if (!thread_data.empty())
+	{
+		return;
+	}
+
+	thread_data.resize(std::max(1u, std::thread::hardware_concurrency()));
+
+	for (auto& data : thread_data)
+	{
+		VkCommandPoolCreateInfo cmdPoolInfo = {};
+		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmdPoolInfo.queueFamilyIndex = device.queueFamilyIndices.graphics;
+		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &data.command_pool));
+
+		data.command_buffers.resize(frame_count);
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+			vks::initializers::commandBufferAllocateInfo(
+				data.command_pool,
+				VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+				frame_count);
+
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, data.command_buffers.data()));
+	}
 }
 
-void ScenePipeline::commandRecord(VkCommandBuffer& cmd_buffer, CullingPipeline& culling_pipeline)
+void ScenePipeline::bindResources(VkCommandBuffer cmd_buffer, uint32_t frame_index, VkBuffer vertex_buffer, VkBuffer index_buffer)
 {
-	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set.scene, 0, nullptr);
-	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &descriptor_set.object, 0, nullptr);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set.scene[frame_index], 0, nullptr);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &descriptor_set.object[frame_index], 0, nullptr);
 	vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
 	VkDeviceSize offsets[1] = { 0 };
 
-	if (scene.buffer_cacher->hasVBO(0) && scene.buffer_cacher->hasEBO(0))
+	if (vertex_buffer != VK_NULL_HANDLE && index_buffer != VK_NULL_HANDLE)
 	{
-		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &scene.buffer_cacher->getVBO(0).buffer, offsets);
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &vertex_buffer, offsets);
 		vkCmdBindVertexBuffers(cmd_buffer, 1, 1, &instanceIndexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(cmd_buffer, scene.buffer_cacher->getEBO(0).buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindIndexBuffer(cmd_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
+}
 
-	if (scene.buffer_cacher->hasVBO(0) && scene.buffer_cacher->hasEBO(0))
+void ScenePipeline::drawIndirect(VkCommandBuffer cmd_buffer, CullingPipeline& culling_pipeline, uint32_t frame_index, uint32_t first_draw, uint32_t draw_count)
+{
+	if (draw_count == 0)
 	{
-		if (device.features.multiDrawIndirect)
-		{
-			// TODO: multi-threading
-			/*uint32_t thread_count = std::thread::hardware_concurrency();
-			uint32_t group_size = static_cast<uint32_t>(culling_pipeline.indirect_commands.size()) / thread_count;
-			for (uint32_t i = 0; i < thread_count - 1; i++)
-			{
-				vkCmdDrawIndexedIndirect(cmd_buffer, culling_pipeline.indirect_command_buffer.buffer, static_cast<uint64_t>(i) * static_cast<uint64_t>(group_size) * sizeof(VkDrawIndexedIndirectCommand), group_size, sizeof(VkDrawIndexedIndirectCommand));
-			}
-			vkCmdDrawIndexedIndirect(cmd_buffer, culling_pipeline.indirect_command_buffer.buffer, static_cast<uint64_t>(thread_count - 1) * static_cast<uint64_t>(group_size) * sizeof(VkDrawIndexedIndirectCommand), culling_pipeline.indirect_commands.size()-(thread_count - 1)*group_size, sizeof(VkDrawIndexedIndirectCommand));*/
-			vkCmdDrawIndexedIndirect(cmd_buffer, culling_pipeline.indirect_command_buffer.buffer, 0, static_cast<uint32_t>(culling_pipeline.indirect_commands.size()), sizeof(VkDrawIndexedIndirectCommand));
-		}
-		else
+		return;
+	}
+
+	VkBuffer indirect_buffer = culling_pipeline.indirect_command_buffers[frame_index].buffer;
+
+	if (device.features.multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(cmd_buffer, indirect_buffer, static_cast<VkDeviceSize>(first_draw) * sizeof(VkDrawIndexedIndirectCommand), draw_count, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else
+	{
+		// If multi draw is not available, we must issue separate draw commands
+		for (uint32_t j = first_draw; j < first_draw + draw_count; j++)
 		{
-			// If multi draw is not available, we must issue separate draw commands
-			for (auto j = 0; j < culling_pipeline.indirect_commands.size(); j++)
-			{
-				vkCmdDrawIndexedIndirect(cmd_buffer, culling_pipeline.indirect_command_buffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
-			}
+			vkCmdDrawIndexedIndirect(cmd_buffer, indirect_buffer, static_cast<VkDeviceSize>(j) * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
 	}
 }
 
-void ScenePipeline::updateDescriptors()
+void ScenePipeline::updateUniformBuffers(uint32_t frame_index, uint32_t latency)
 {
-	std::vector<VkDescriptorImageInfo> textureDescriptors(maxCount);	std::cout << maxCount << std::endl;
-	for (size_t i = 0; i < maxCount; i++)
+	last_sceneUBO.values = history.size() >= latency ? history[history.size() - latency] : sceneUBO.values;
+
+	// Only touch the buffers of given frame, the other frames may still be in flight
+	memcpy(last_sceneUBO.buffers[frame_index].mapped, &last_sceneUBO.values, sizeof(last_sceneUBO.values));
+	memcpy(sceneUBO.buffers[frame_index].mapped, &sceneUBO.values, sizeof(sceneUBO.values));
+
+	history.push_back(sceneUBO.values);
+	while (history.size() > HizPipeline::DEPTH_COPY_COUNT)
 	{
-		textureDescriptors[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		// TODO: Use Image Cacher
-		textureDescriptors[i].sampler = scene.images[i].texture.sampler;
-		textureDescriptors[i].imageView = scene.images[i].texture.view;
+		history.pop_front();
 	}
+}
 
-	VkWriteDescriptorSet writeDescriptorSet = {};
-	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet.dstBinding = 0;
-	writeDescriptorSet.dstArrayElement = 0;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeDescriptorSet.descriptorCount = static_cast<uint32_t>(textureDescriptors.size());
-	writeDescriptorSet.dstSet = descriptor_set.object;
-	writeDescriptorSet.pImageInfo = textureDescriptors.data();
+uint32_t ScenePipeline::getFrameCount() const
+{
+	return frame_count;
+}
 
-	vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+void ScenePipeline::updateDescriptors(uint32_t frame_index)
+{
+	scene.image_cacher->updateTable(texture_tables[frame_index], descriptor_set.object[frame_index], 0);
 }
 
 void ScenePipeline::setupDepth(uint32_t width, uint32_t height, VkFormat depthFormat, VkQueue queue)
@@ -309,21 +400,10 @@ void ScenePipeline::setupDepth(uint32_t width, uint32_t height, VkFormat depthFo
 	image.tiling = VK_IMAGE_TILING_OPTIMAL;
 	image.format = depthFormat;																// Depth stencil attachment
 	image.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;		// We will sample directly from the depth attachment for the shadow mapping
-	VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &depth_image.image));
-
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
+	chaf::Allocator::get().createImage(chaf::MemoryUsage::Attachment, image, depth_image.image, depth_image.allocation);
 
 	VkCommandBuffer layoutCmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-	// Setup memory
-	vkGetImageMemoryRequirements(device, depth_image.image, &memReqs);
-
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device.getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &depth_image.mem));
-	VK_CHECK_RESULT(vkBindImageMemory(device, depth_image.image, depth_image.mem, 0));
-
 	// Setup image barrier
 	VkImageSubresourceRange subresourceRange = {};
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
@@ -446,8 +526,7 @@ void ScenePipeline::resize(uint32_t width, uint32_t height, VkFormat depthFormat
 {
 	vkDestroySampler(device, depth_image.sampler, nullptr);
 	vkDestroyImageView(device, depth_image.view, nullptr);
-	vkDestroyImage(device, depth_image.image, nullptr);
-	vkFreeMemory(device, depth_image.mem, nullptr);
+	chaf::Allocator::get().destroyImage(depth_image.image, depth_image.allocation);
 
 	setupDepth(width, height, depthFormat, queue);
 }
\ No newline at end of file
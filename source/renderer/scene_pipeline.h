@@ -8,6 +8,8 @@
 
 #include <scene/scene.h>
 
+#include <deque>
+
 class ScenePipeline :public chaf::PipelineBase
 {
 public:
@@ -17,19 +19,40 @@ public:
 
 	void destroy();
 
-	void prepare(VkRenderPass render_pass, VkQueue queue);
+	void prepare(VkRenderPass render_pass, VkQueue queue, uint32_t frame_count);
 
 	void setupPipeline(VkRenderPass render_pass);
 
-	void commandRecord(VkCommandBuffer& cmd_buffer, CullingPipeline& culling_pipeline);
+	VkPipeline createPipeline() override;
+
+	void replacePipeline(VkPipeline pipeline) override;
+
+	void commandRecord(VkCommandBuffer& cmd_buffer, CullingPipeline& culling_pipeline, uint32_t frame_index);
+
+	// Split scene draws across per-thread secondary command buffers, returned command buffers are executed in order
+	std::vector<VkCommandBuffer> commandRecordMultiThread(const VkCommandBufferInheritanceInfo& inheritance_info, const VkViewport& viewport, const VkRect2D& scissor, CullingPipeline& culling_pipeline, uint32_t frame_index);
+
+	// Point texture slots of given frame at the textures resident now, must be called after that frame has finished
+	void updateDescriptors(uint32_t frame_index);
+
+	// Culling reads the scene values of the frame whose depth built the Hi-z pyramid, which is latency frames behind
+	void updateUniformBuffers(uint32_t frame_index, uint32_t latency = 1);
+
+	uint32_t getFrameCount() const;
+
+private:
+	void prepareThreadData();
+
+	void bindResources(VkCommandBuffer cmd_buffer, uint32_t frame_index, VkBuffer vertex_buffer, VkBuffer index_buffer);
 
-	void updateDescriptors();
+	void drawIndirect(VkCommandBuffer cmd_buffer, CullingPipeline& culling_pipeline, uint32_t frame_index, uint32_t first_draw, uint32_t draw_count);
 
 public:
 	struct SceneUBO
 	{
-		vks::Buffer buffer;
-		struct
+		// One buffer per frame in flight
+		std::vector<chaf::Buffer> buffers;
+		struct Values
 		{
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -41,7 +64,12 @@ public:
 	};
 
 	SceneUBO sceneUBO;
-	vks::Buffer last_sceneUBO_buffer;
+
+	// Scene UBO of previous frame, used by culling
+	SceneUBO last_sceneUBO;
+
+	// Scene values of recent frames, newest at back
+	std::deque<SceneUBO::Values> history;
 
 public:
 	chaf::Scene& scene;
@@ -52,7 +80,9 @@ public:
 
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 
-	vks::Buffer instanceIndexBuffer;
+	VkRenderPass render_pass{ VK_NULL_HANDLE };
+
+	chaf::Buffer instanceIndexBuffer;
 
 	struct
 	{
@@ -62,11 +92,14 @@ public:
 
 	struct
 	{
-		VkDescriptorSet scene{ VK_NULL_HANDLE };
-		VkDescriptorSet object{ VK_NULL_HANDLE };
+		std::vector<VkDescriptorSet> scene;
+		std::vector<VkDescriptorSet> object;
 	}descriptor_set;
 
-	uint32_t maxCount{ 0 };
+	// Image cacher table of each object set
+	std::vector<uint32_t> texture_tables;
+
+	uint32_t frame_count{ 1 };
 
 	bool has_init{ false };
 
@@ -74,6 +107,16 @@ public:
 
 	bool enable_multi_thread{ false };
 
+	// Command pools are externally synchronized, each recording thread owns one
+	struct ThreadData
+	{
+		VkCommandPool command_pool{ VK_NULL_HANDLE };
+		// One secondary command buffer per frame in flight
+		std::vector<VkCommandBuffer> command_buffers;
+	};
+
+	std::vector<ThreadData> thread_data;
+
 	bool line_mode{ false };
 
 	struct
@@ -81,7 +124,7 @@ public:
 		VkSampler sampler{ VK_NULL_HANDLE };
 		VkImageView view{ VK_NULL_HANDLE };
 		VkImage image{ VK_NULL_HANDLE };
-		VkDeviceMemory mem{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
 		VkDescriptorImageInfo descriptor;
 		uint32_t width, height;
 	} depth_image;
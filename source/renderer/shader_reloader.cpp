@@ -0,0 +1,147 @@
+#include <renderer/shader_reloader.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace chaf
+{
+	ShaderReloader::ShaderReloader(vks::VulkanDevice& device, const std::string& directory) :
+		device{ device }
+	{
+		watcher = std::make_unique<ShaderWatcher>(directory, [this](const std::vector<std::string>& files) {
+			markChanged(files);
+		});
+	}
+
+	ShaderReloader::~ShaderReloader()
+	{
+		watcher.reset();
+	}
+
+	void ShaderReloader::addPipeline(PipelineBase& pipeline)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pipelines.push_back(&pipeline);
+	}
+
+	bool ShaderReloader::update()
+	{
+		std::vector<std::string> files;
+		std::chrono::high_resolution_clock::time_point start;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			files.swap(changed_files);
+			start = change_time;
+		}
+
+		if (files.empty())
+		{
+			return false;
+		}
+
+		auto replacements = rebuild(files);
+
+		auto end = std::chrono::high_resolution_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.reload_count++;
+			stats.last_reload_time = std::chrono::duration<double, std::milli>(end - start).count();
+		}
+
+		if (replacements.empty())
+		{
+			return false;
+		}
+
+		// Old pipelines may still be used by frames in flight
+		vkDeviceWaitIdle(device);
+
+		for (auto& [pipeline_base, pipeline] : replacements)
+		{
+			pipeline_base->replacePipeline(pipeline);
+		}
+
+		return true;
+	}
+
+	ShaderReloader::Stats ShaderReloader::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	void ShaderReloader::markChanged(const std::vector<std::string>& files)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (changed_files.empty())
+		{
+			change_time = std::chrono::high_resolution_clock::now();
+		}
+
+		for (auto& file : files)
+		{
+			if (std::find(changed_files.begin(), changed_files.end(), file) == changed_files.end())
+			{
+				changed_files.push_back(file);
+			}
+		}
+	}
+
+	std::vector<std::pair<PipelineBase*, VkPipeline>> ShaderReloader::rebuild(const std::vector<std::string>& files)
+	{
+		std::vector<std::pair<PipelineBase*, VkPipeline>> replacements;
+
+		// Includes are resolved by the shader library, a changed header reloads every shader using it
+		auto sources = ShaderLibrary::get().getDependents(files);
+		if (sources.empty())
+		{
+			return replacements;
+		}
+
+		std::vector<PipelineBase*> targets;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			targets = pipelines;
+		}
+
+		for (auto pipeline_base : targets)
+		{
+			std::vector<ShaderLibrary::Job> jobs;
+			for (auto& job : pipeline_base->getShaderJobs())
+			{
+				if (std::find(sources.begin(), sources.end(), job.filename) != sources.end())
+				{
+					jobs.push_back(job);
+				}
+			}
+
+			if (jobs.empty())
+			{
+				continue;
+			}
+
+			// Compile first, so a broken shader keeps the current pipeline instead of falling back to prebuilt SPIR-V
+			try
+			{
+				ShaderLibrary::get().loadBatch(jobs);
+			}
+			catch (const std::runtime_error& e)
+			{
+				std::cerr << e.what() << std::endl;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.failure_count++;
+				continue;
+			}
+
+			VkPipeline pipeline = pipeline_base->createPipeline();
+			if (pipeline != VK_NULL_HANDLE)
+			{
+				replacements.emplace_back(pipeline_base, pipeline);
+			}
+		}
+
+		return replacements;
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <renderer/base_pipeline.h>
+
+#include <shader_compiler/shader_watcher.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace chaf
+{
+	// Watcher thread only collects changed shader files. Shaders are recompiled and pipelines rebuilt by update()
+	// on the render thread at a frame boundary, so pipelines are created from the state they are drawn with
+	class ShaderReloader
+	{
+	public:
+		struct Stats
+		{
+			uint32_t reload_count{ 0 };
+			uint32_t failure_count{ 0 };
+			// ms from file change to rebuilt pipelines
+			double last_reload_time{ 0.0 };
+		};
+
+	public:
+		ShaderReloader(vks::VulkanDevice& device, const std::string& directory);
+
+		~ShaderReloader();
+
+		// Pipelines must outlive the reloader
+		void addPipeline(PipelineBase& pipeline);
+
+		// Rebuild pipelines using changed shaders on the render thread, returns true if command buffers using them must be recorded again
+		bool update();
+
+		Stats getStats();
+
+	private:
+		void markChanged(const std::vector<std::string>& files);
+
+		// Pipelines rebuilt from changed shaders, with the pipeline they replace
+		std::vector<std::pair<PipelineBase*, VkPipeline>> rebuild(const std::vector<std::string>& files);
+
+	private:
+		vks::VulkanDevice& device;
+
+		std::mutex mutex;
+
+		std::vector<PipelineBase*> pipelines;
+
+		// Files changed since last update
+		std::vector<std::string> changed_files;
+
+		std::chrono::high_resolution_clock::time_point change_time;
+
+		Stats stats;
+
+		// Last member, so the watcher thread stops before anything it uses is destroyed
+		std::unique_ptr<ShaderWatcher> watcher;
+	};
+}
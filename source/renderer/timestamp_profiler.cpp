@@ -0,0 +1,167 @@
+#include <renderer/timestamp_profiler.h>
+
+#include <algorithm>
+
+TimestampProfiler::TimestampProfiler(vks::VulkanDevice& device, uint32_t frame_count, uint32_t max_scope_count) :
+	device{ device }, frame_count{ frame_count }, max_scope_count{ max_scope_count }
+{
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = max_scope_count * frame_count * 2;
+	VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &query_pool));
+}
+
+TimestampProfiler::~TimestampProfiler()
+{
+	for (auto& scope : scopes)
+	{
+		vkDestroyCommandPool(device, scope.command_pool, nullptr);
+	}
+
+	vkDestroyQueryPool(device, query_pool, nullptr);
+}
+
+uint32_t TimestampProfiler::addScope(const std::string& name, uint32_t queue_family_index)
+{
+	if (scopes.size() >= max_scope_count)
+	{
+		throw std::runtime_error("Timestamp profiler is out of scopes");
+	}
+
+	uint32_t scope_index = static_cast<uint32_t>(scopes.size());
+
+	Scope scope;
+	scope.name = name;
+	scope.queue_family_index = queue_family_index;
+	scope.supported = device.queueFamilyProperties[queue_family_index].timestampValidBits > 0 && device.properties.limits.timestampPeriod > 0.f;
+	scope.intervals.resize(frame_count);
+	scope.submitted.resize(frame_count, false);
+
+	VkCommandPoolCreateInfo cmdPoolInfo = {};
+	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmdPoolInfo.queueFamilyIndex = queue_family_index;
+	VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &scope.command_pool));
+
+	scope.begin_command_buffers.resize(frame_count);
+	scope.end_command_buffers.resize(frame_count);
+
+	VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+		vks::initializers::commandBufferAllocateInfo(
+			scope.command_pool,
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			frame_count);
+
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, scope.begin_command_buffers.data()));
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, scope.end_command_buffers.data()));
+
+	scopes.push_back(scope);
+
+	// Timestamp command buffers never change, record them once
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		uint32_t query_index = getQueryIndex(scope_index, i);
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(scope.begin_command_buffers[i], &cmdBufInfo));
+		if (scope.supported)
+		{
+			vkCmdResetQueryPool(scope.begin_command_buffers[i], query_pool, query_index, 2);
+			vkCmdWriteTimestamp(scope.begin_command_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, query_index);
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(scope.begin_command_buffers[i]));
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(scope.end_command_buffers[i], &cmdBufInfo));
+		if (scope.supported)
+		{
+			vkCmdWriteTimestamp(scope.end_command_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, query_index + 1);
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(scope.end_command_buffers[i]));
+	}
+
+	return scope_index;
+}
+
+VkCommandBuffer TimestampProfiler::getBeginCommandBuffer(uint32_t scope, uint32_t frame_index)
+{
+	return scopes[scope].begin_command_buffers[frame_index];
+}
+
+VkCommandBuffer TimestampProfiler::getEndCommandBuffer(uint32_t scope, uint32_t frame_index)
+{
+	return scopes[scope].end_command_buffers[frame_index];
+}
+
+void TimestampProfiler::markSubmitted(uint32_t scope, uint32_t frame_index)
+{
+	scopes[scope].submitted[frame_index] = true;
+}
+
+void TimestampProfiler::resolve(uint32_t frame_index)
+{
+	for (uint32_t i = 0; i < scopes.size(); i++)
+	{
+		auto& scope = scopes[i];
+
+		if (!scope.supported || !scope.submitted[frame_index])
+		{
+			scope.intervals[frame_index].valid = false;
+			continue;
+		}
+
+		uint64_t timestamps[2] = { 0, 0 };
+		VkResult result = vkGetQueryPoolResults(device, query_pool, getQueryIndex(i, frame_index), 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		scope.submitted[frame_index] = false;
+
+		if (result != VK_SUCCESS)
+		{
+			scope.intervals[frame_index].valid = false;
+			continue;
+		}
+
+		// Mask out invalid bits, then convert ticks to milliseconds
+		uint32_t valid_bits = device.queueFamilyProperties[scope.queue_family_index].timestampValidBits;
+		uint64_t mask = valid_bits >= 64 ? ~0ull : ((1ull << valid_bits) - 1);
+		double period = static_cast<double>(device.properties.limits.timestampPeriod) / 1000000.0;
+
+		scope.intervals[frame_index].begin = static_cast<double>(timestamps[0] & mask) * period;
+		scope.intervals[frame_index].end = static_cast<double>(timestamps[1] & mask) * period;
+		scope.intervals[frame_index].valid = true;
+	}
+}
+
+const TimestampProfiler::Interval& TimestampProfiler::getInterval(uint32_t scope, uint32_t frame_index) const
+{
+	return scopes[scope].intervals[frame_index];
+}
+
+const std::string& TimestampProfiler::getName(uint32_t scope) const
+{
+	return scopes[scope].name;
+}
+
+bool TimestampProfiler::isSupported(uint32_t scope) const
+{
+	return scopes[scope].supported;
+}
+
+double TimestampProfiler::getDuration(const Interval& interval)
+{
+	return interval.valid ? interval.end - interval.begin : 0.0;
+}
+
+double TimestampProfiler::getOverlap(const Interval& lhs, const Interval& rhs)
+{
+	if (!lhs.valid || !rhs.valid)
+	{
+		return 0.0;
+	}
+
+	return std::max(0.0, std::min(lhs.end, rhs.end) - std::max(lhs.begin, rhs.begin));
+}
+
+uint32_t TimestampProfiler::getQueryIndex(uint32_t scope, uint32_t frame_index) const
+{
+	return (scope * frame_count + frame_index) * 2;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkanexamplebase.h>
+
+#include <string>
+
+// GPU timestamps around submitted work, scopes on different queues share the device time domain so they can be compared
+class TimestampProfiler
+{
+public:
+	struct Interval
+	{
+		// Milliseconds in device time domain
+		double begin{ 0.0 };
+		double end{ 0.0 };
+		bool valid{ false };
+	};
+
+public:
+	TimestampProfiler(vks::VulkanDevice& device, uint32_t frame_count, uint32_t max_scope_count = 8);
+
+	~TimestampProfiler();
+
+	// Add a scope measured on given queue family, returns scope index
+	uint32_t addScope(const std::string& name, uint32_t queue_family_index);
+
+	// Submit begin command buffer before and end command buffer after the work of a scope
+	VkCommandBuffer getBeginCommandBuffer(uint32_t scope, uint32_t frame_index);
+
+	VkCommandBuffer getEndCommandBuffer(uint32_t scope, uint32_t frame_index);
+
+	// Mark timestamps of a scope as submitted in given frame
+	void markSubmitted(uint32_t scope, uint32_t frame_index);
+
+	// Read back timestamps of given frame, must be called after that frame has finished
+	void resolve(uint32_t frame_index);
+
+	const Interval& getInterval(uint32_t scope, uint32_t frame_index) const;
+
+	const std::string& getName(uint32_t scope) const;
+
+	bool isSupported(uint32_t scope) const;
+
+	static double getDuration(const Interval& interval);
+
+	static double getOverlap(const Interval& lhs, const Interval& rhs);
+
+private:
+	struct Scope
+	{
+		std::string name;
+		uint32_t queue_family_index{ 0 };
+		bool supported{ false };
+		VkCommandPool command_pool{ VK_NULL_HANDLE };
+		// One pair per frame in flight
+		std::vector<VkCommandBuffer> begin_command_buffers;
+		std::vector<VkCommandBuffer> end_command_buffers;
+		std::vector<Interval> intervals;
+		std::vector<bool> submitted;
+	};
+
+	uint32_t getQueryIndex(uint32_t scope, uint32_t frame_index) const;
+
+private:
+	vks::VulkanDevice& device;
+
+	uint32_t frame_count{ 1 };
+
+	// Queries for every scope of every frame, two timestamps each
+	VkQueryPool query_pool{ VK_NULL_HANDLE };
+
+	uint32_t max_scope_count{ 0 };
+
+	std::vector<Scope> scopes;
+};
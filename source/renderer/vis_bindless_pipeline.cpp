@@ -12,81 +12,69 @@ VisBindlessPipeline::~VisBindlessPipeline()
 
 void VisBindlessPipeline::destroy()
 {
-	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
 	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 }
 
-void VisBindlessPipeline::prepare(VkRenderPass render_pass, VkQueue queue)
+void VisBindlessPipeline::prepare(VkRenderPass render_pass, VkQueue queue, uint32_t frame_count)
 {
-	// Scene Primitive count
-	maxCount = scene.images.size() > device.properties.limits.maxPerStageDescriptorUniformBuffers ? device.properties.limits.maxPerStageDescriptorUniformBuffers : static_cast<uint32_t>(scene.images.size());
-
-	// Prepare descriptor pool
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxCount)
-	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	// Binding 0: all bindless texture slots, push constant: slot count
+	uint32_t slot_capacity = scene.image_cacher->getSlotCapacity();
+	auto layout = reflectLayout({
+		{ "../data/shaders/glsl/gpudrivenpipeline/vis_bindless.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
+		{ "../data/shaders/glsl/gpudrivenpipeline/vis_bindless.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT } });
+	layout.setDescriptorCount(0, 0, slot_capacity);
+	layout.setBindingFlags(0, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT);
+	layout.sets[0].flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+
+	descriptor_set_layout = chaf::LayoutCache::get().getSetLayout(layout.sets[0]);
+	pipeline_layout = chaf::LayoutCache::get().getPipelineLayout(layout);
+
+	// Prepare descriptor pool, one set per frame
+	std::vector<VkDescriptorPoolSize> poolSizes = layout.getPoolSizes(0, frame_count);
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, frame_count);
+	descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptor_pool));
 
-	// Prepare descriptor set layout
-	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-		// binding all textures
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_ALL_GRAPHICS, 0, maxCount)
-	};
-
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
-	descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
-	descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-
-	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlags{};
-	setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
-	setLayoutBindingFlags.bindingCount = 1;
-	std::vector<VkDescriptorBindingFlagsEXT> descriptorBindingFlags = {
-		0,
-		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT
-	};
-	setLayoutBindingFlags.pBindingFlags = descriptorBindingFlags.data();
-	descriptorSetLayoutCI.pNext = &setLayoutBindingFlags;
-
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device.logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptor_set_layout));
-
-	std::array<VkDescriptorSetLayout, 1> setLayouts = { descriptor_set_layout };
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
-	std::vector<VkPushConstantRange> pushConstantRanges = {
-		vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(int32_t), 0)
-	};
+	// Descriptor sets for bindless textures, one variable count per set
+	descriptor_sets.resize(frame_count);
+	texture_tables.resize(frame_count);
 
-	pipelineLayoutCI.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
-	pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
-	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipeline_layout));
+	std::vector<VkDescriptorSetLayout> set_layouts(frame_count, descriptor_set_layout);
+	std::vector<uint32_t> variable_counts(frame_count, slot_capacity);
 
-	// Descriptor set for bindless object
 	VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAllocInfo = {};
-
-	uint32_t variableDescCounts[] = { maxCount };
-
 	variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
-	variableDescriptorCountAllocInfo.descriptorSetCount = 0;
-	variableDescriptorCountAllocInfo.pDescriptorCounts = variableDescCounts;
+	variableDescriptorCountAllocInfo.descriptorSetCount = frame_count;
+	variableDescriptorCountAllocInfo.pDescriptorCounts = variable_counts.data();
 
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, &descriptor_set_layout, 1);
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptor_pool, set_layouts.data(), frame_count);
 	allocInfo.pNext = &variableDescriptorCountAllocInfo;
 
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptor_set));
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, descriptor_sets.data()));
 
-	updateDescriptors();
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		texture_tables[i] = scene.image_cacher->createTable();
+		updateDescriptors(i);
+	}
 
 	setupPipeline(render_pass);
 }
 
 void VisBindlessPipeline::setupPipeline(VkRenderPass render_pass)
 {
+	this->render_pass = render_pass;
+
 	if (pipeline != VK_NULL_HANDLE)
 	{
 		vkDestroyPipeline(device, pipeline, nullptr);
 	}
+	pipeline = createPipeline();
+}
+
+VkPipeline VisBindlessPipeline::createPipeline()
+{
 	// Pipeline state setup
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 	VkPipelineRasterizationStateCreateInfo rasterizationStateCI = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
@@ -130,39 +118,31 @@ void VisBindlessPipeline::setupPipeline(VkRenderPass render_pass)
 	pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 	pipelineCI.pStages = shaderStages.data();
 
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineCI, nullptr, &pipeline));
+	VkPipeline new_pipeline;
+	createGraphicsPipeline(pipelineCI, &new_pipeline);
+	return new_pipeline;
+}
+
+void VisBindlessPipeline::replacePipeline(VkPipeline pipeline)
+{
+	vkDestroyPipeline(device, this->pipeline, nullptr);
+	this->pipeline = pipeline;
 }
 
-void VisBindlessPipeline::commandRecord(VkCommandBuffer& cmd_buffer)
+void VisBindlessPipeline::commandRecord(VkCommandBuffer& cmd_buffer, uint32_t frame_index)
 {
 	vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-	vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int32_t), &maxCount);
+	// Slots above are never written
+	int32_t slot_count = static_cast<int32_t>(scene.image_cacher->getSlotCount());
+	vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int32_t), &slot_count);
 
-	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets[frame_index], 0, nullptr);
 
 	vkCmdDraw(cmd_buffer, 6, 1, 0, 0);
 }
 
-void VisBindlessPipeline::updateDescriptors()
+void VisBindlessPipeline::updateDescriptors(uint32_t frame_index)
 {
-	std::vector<VkDescriptorImageInfo> textureDescriptors(maxCount);
-	for (size_t i = 0; i < maxCount; i++)
-	{
-		textureDescriptors[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		// TODO: Use Image Cacher
-		textureDescriptors[i].sampler = scene.images[i].texture.sampler;
-		textureDescriptors[i].imageView = scene.images[i].texture.view;
-	}
-
-	VkWriteDescriptorSet writeDescriptorSet = {};
-	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSet.dstBinding = 0;
-	writeDescriptorSet.dstArrayElement = 0;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeDescriptorSet.descriptorCount = maxCount;
-	writeDescriptorSet.dstSet = descriptor_set;
-	writeDescriptorSet.pImageInfo = textureDescriptors.data();
-
-	vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+	scene.image_cacher->updateTable(texture_tables[frame_index], descriptor_sets[frame_index], 0);
 }
@@ -13,25 +13,33 @@ public:
 
 	void destroy();
 
-	void prepare(VkRenderPass render_pass, VkQueue queue);
+	void prepare(VkRenderPass render_pass, VkQueue queue, uint32_t frame_count);
 
 	void setupPipeline(VkRenderPass render_pass);
 
-	void commandRecord(VkCommandBuffer& cmd_buffer);
+	VkPipeline createPipeline() override;
 
-	void updateDescriptors();
+	void replacePipeline(VkPipeline pipeline) override;
+
+	void commandRecord(VkCommandBuffer& cmd_buffer, uint32_t frame_index);
+
+	// Point texture slots of given frame at the textures resident now, must be called after that frame has finished
+	void updateDescriptors(uint32_t frame_index);
 private:
 	chaf::Scene& scene;
 
-	uint32_t maxCount = 0;
-
 	VkPipelineLayout pipeline_layout{ VK_NULL_HANDLE };
 
 	VkDescriptorPool descriptor_pool{ VK_NULL_HANDLE };
 
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 
+	VkRenderPass render_pass{ VK_NULL_HANDLE };
+
 	VkDescriptorSetLayout descriptor_set_layout{ VK_NULL_HANDLE };
 
-	VkDescriptorSet descriptor_set{ VK_NULL_HANDLE };
+	// One per frame, each with an image cacher table
+	std::vector<VkDescriptorSet> descriptor_sets;
+
+	std::vector<uint32_t> texture_tables;
 };
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include <scene/cacher/allocator.h>
+
+#include <cstring>
+
+namespace chaf
+{
+	// Large blocks keep the number of VkDeviceMemory objects far below maxMemoryAllocationCount
+	static constexpr VkDeviceSize GEOMETRY_BLOCK_SIZE = 64ull << 20;
+
+	static constexpr VkDeviceSize STORAGE_BLOCK_SIZE = 32ull << 20;
+
+	static constexpr VkDeviceSize TEXTURE_BLOCK_SIZE = 128ull << 20;
+
+	static constexpr const char* POOL_NAMES[] = { "geometry", "storage", "texture", "attachment", "upload", "readback" };
+
+	static_assert(sizeof(POOL_NAMES) / sizeof(POOL_NAMES[0]) == static_cast<size_t>(MemoryUsage::Count));
+
+	void Buffer::destroy()
+	{
+		if (buffer != VK_NULL_HANDLE)
+		{
+			Allocator::get().destroyBuffer(buffer, allocation);
+		}
+		buffer = VK_NULL_HANDLE;
+		allocation = VK_NULL_HANDLE;
+		mapped = nullptr;
+	}
+
+	Allocator& Allocator::get()
+	{
+		static Allocator allocator;
+		return allocator;
+	}
+
+	void Allocator::initialize(VkInstance instance, vks::VulkanDevice& device, bool memory_budget_extension)
+	{
+		this->device = &device;
+
+		VmaAllocatorCreateInfo create_info{};
+		create_info.physicalDevice = device.physicalDevice;
+		create_info.device = device.logicalDevice;
+		create_info.instance = instance;
+		if (memory_budget_extension)
+		{
+			create_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
+		VK_CHECK_RESULT(vmaCreateAllocator(&create_info, &allocator));
+
+		// Memory types are picked with representative resources, resources not fitting a pool fall back to the default ones
+		uint32_t memory_type_index = 0;
+
+		VkBufferCreateInfo buffer_create_info = vks::initializers::bufferCreateInfo(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 1024);
+		VmaAllocationCreateInfo allocation_create_info = getAllocationCreateInfo(MemoryUsage::Geometry);
+		VK_CHECK_RESULT(vmaFindMemoryTypeIndexForBufferInfo(allocator, &buffer_create_info, &allocation_create_info, &memory_type_index));
+		createPool(MemoryUsage::Geometry, memory_type_index, GEOMETRY_BLOCK_SIZE);
+
+		buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		allocation_create_info = getAllocationCreateInfo(MemoryUsage::Storage);
+		VK_CHECK_RESULT(vmaFindMemoryTypeIndexForBufferInfo(allocator, &buffer_create_info, &allocation_create_info, &memory_type_index));
+		createPool(MemoryUsage::Storage, memory_type_index, STORAGE_BLOCK_SIZE);
+
+		VkImageCreateInfo image_create_info = vks::initializers::imageCreateInfo();
+		image_create_info.imageType = VK_IMAGE_TYPE_2D;
+		image_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+		image_create_info.extent = { 256, 256, 1 };
+		image_create_info.mipLevels = 1;
+		image_create_info.arrayLayers = 1;
+		image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		allocation_create_info = getAllocationCreateInfo(MemoryUsage::Texture);
+		VK_CHECK_RESULT(vmaFindMemoryTypeIndexForImageInfo(allocator, &image_create_info, &allocation_create_info, &memory_type_index));
+		createPool(MemoryUsage::Texture, memory_type_index, TEXTURE_BLOCK_SIZE);
+	}
+
+	void Allocator::destroy()
+	{
+		if (allocator == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		for (auto& pool : pools)
+		{
+			if (pool != VK_NULL_HANDLE)
+			{
+				vmaDestroyPool(allocator, pool);
+				pool = VK_NULL_HANDLE;
+			}
+		}
+
+		vmaDestroyAllocator(allocator);
+		allocator = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	void Allocator::update(uint32_t frame_index)
+	{
+		vmaSetCurrentFrameIndex(allocator, frame_index);
+	}
+
+	VmaAllocator Allocator::getHandle() const
+	{
+		return allocator;
+	}
+
+	void Allocator::createBuffer(MemoryUsage usage, VkBufferUsageFlags buffer_usage, VkDeviceSize size, Buffer& buffer, const void* data)
+	{
+		VkBufferCreateInfo buffer_create_info = vks::initializers::bufferCreateInfo(buffer_usage, size);
+		VmaAllocationCreateInfo allocation_create_info = getAllocationCreateInfo(usage);
+		VmaAllocationInfo allocation_info{};
+
+		VkResult result = vmaCreateBuffer(allocator, &buffer_create_info, &allocation_create_info, &buffer.buffer, &buffer.allocation, &allocation_info);
+		if ((result == VK_ERROR_FEATURE_NOT_PRESENT || result == VK_ERROR_OUT_OF_DEVICE_MEMORY) && allocation_create_info.pool != VK_NULL_HANDLE)
+		{
+			// Memory type of the pool does not fit this buffer, or it is larger than a block (geometry arenas)
+			allocation_create_info.pool = VK_NULL_HANDLE;
+			result = vmaCreateBuffer(allocator, &buffer_create_info, &allocation_create_info, &buffer.buffer, &buffer.allocation, &allocation_info);
+		}
+		VK_CHECK_RESULT(result);
+
+		buffer.size = size;
+		buffer.mapped = allocation_info.pMappedData;
+		buffer.descriptor = { buffer.buffer, 0, size };
+
+		if (data && buffer.mapped)
+		{
+			std::memcpy(buffer.mapped, data, size);
+		}
+	}
+
+	void Allocator::createBuffer(MemoryUsage usage, VkBufferUsageFlags buffer_usage, VkDeviceSize size, VkBuffer& buffer, VmaAllocation& allocation)
+	{
+		Buffer result;
+		createBuffer(usage, buffer_usage, size, result);
+		buffer = result.buffer;
+		allocation = result.allocation;
+	}
+
+	void Allocator::destroyBuffer(VkBuffer buffer, VmaAllocation allocation)
+	{
+		vmaDestroyBuffer(allocator, buffer, allocation);
+	}
+
+	void Allocator::createImage(MemoryUsage usage, const VkImageCreateInfo& create_info, VkImage& image, VmaAllocation& allocation, void** mapped)
+	{
+		VmaAllocationCreateInfo allocation_create_info = getAllocationCreateInfo(usage);
+		VmaAllocationInfo allocation_info{};
+
+		VkResult result = vmaCreateImage(allocator, &create_info, &allocation_create_info, &image, &allocation, &allocation_info);
+		if (result == VK_ERROR_FEATURE_NOT_PRESENT && allocation_create_info.pool != VK_NULL_HANDLE)
+		{
+			// Compressed and depth formats may need another memory type than the pool has
+			allocation_create_info.pool = VK_NULL_HANDLE;
+			result = vmaCreateImage(allocator, &create_info, &allocation_create_info, &image, &allocation, &allocation_info);
+		}
+		VK_CHECK_RESULT(result);
+
+		if (mapped)
+		{
+			*mapped = allocation_info.pMappedData;
+		}
+	}
+
+	void Allocator::destroyImage(VkImage image, VmaAllocation allocation)
+	{
+		vmaDestroyImage(allocator, image, allocation);
+	}
+
+	void Allocator::allocateMemory(MemoryUsage usage, const VkMemoryRequirements& requirements, VmaAllocation& allocation)
+	{
+		VmaAllocationCreateInfo allocation_create_info = getAllocationCreateInfo(usage);
+
+		VkResult result = vmaAllocateMemory(allocator, &requirements, &allocation_create_info, &allocation, nullptr);
+		if (result == VK_ERROR_FEATURE_NOT_PRESENT && allocation_create_info.pool != VK_NULL_HANDLE)
+		{
+			allocation_create_info.pool = VK_NULL_HANDLE;
+			result = vmaAllocateMemory(allocator, &requirements, &allocation_create_info, &allocation, nullptr);
+		}
+		VK_CHECK_RESULT(result);
+	}
+
+	void Allocator::bindImage(VkImage image, VmaAllocation allocation)
+	{
+		VK_CHECK_RESULT(vmaBindImageMemory(allocator, allocation, image));
+	}
+
+	void Allocator::freeMemory(VmaAllocation allocation)
+	{
+		vmaFreeMemory(allocator, allocation);
+	}
+
+	void Allocator::copyBuffer(const Buffer& src, Buffer& dst, VkQueue queue)
+	{
+		VkCommandBuffer copy_cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+		VkBufferCopy region{};
+		region.size = src.size;
+		vkCmdCopyBuffer(copy_cmd, src.buffer, dst.buffer, 1, &region);
+
+		device->flushCommandBuffer(copy_cmd, queue, true);
+	}
+
+	Allocator::Stats Allocator::getStats()
+	{
+		Stats stats;
+
+		for (size_t i = 0; i < pools.size(); i++)
+		{
+			if (pools[i] == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+
+			VmaPoolStats pool_stats{};
+			vmaGetPoolStats(allocator, pools[i], &pool_stats);
+
+			PoolStats result;
+			result.name = POOL_NAMES[i];
+			result.block_bytes = pool_stats.size;
+			result.unused_bytes = pool_stats.unusedSize;
+			result.allocation_count = pool_stats.allocationCount;
+			result.block_count = pool_stats.blockCount;
+			stats.pools.push_back(result);
+		}
+
+		VmaStats total{};
+		vmaCalculateStats(allocator, &total);
+		stats.block_count = total.total.blockCount;
+		stats.allocation_count = total.total.allocationCount;
+		stats.used_bytes = total.total.usedBytes;
+		stats.unused_bytes = total.total.unusedBytes;
+
+		const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+		vmaGetMemoryProperties(allocator, &memory_properties);
+
+		std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+		vmaGetBudget(allocator, budgets.data());
+		for (uint32_t i = 0; i < memory_properties->memoryHeapCount; i++)
+		{
+			if (memory_properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			{
+				stats.budget += budgets[i].budget;
+				stats.usage += budgets[i].usage;
+			}
+		}
+
+		return stats;
+	}
+
+	VmaAllocationCreateInfo Allocator::getAllocationCreateInfo(MemoryUsage usage) const
+	{
+		VmaAllocationCreateInfo create_info{};
+		create_info.pool = pools[static_cast<size_t>(usage)];
+
+		switch (usage)
+		{
+		case MemoryUsage::Attachment:
+			create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+			create_info.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+			break;
+		case MemoryUsage::Upload:
+			// Written without explicit flushes, so coherent is required
+			create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+			create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+		case MemoryUsage::Readback:
+			create_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+			create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+		default:
+			create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+			break;
+		}
+
+		return create_info;
+	}
+
+	void Allocator::createPool(MemoryUsage usage, uint32_t memory_type_index, VkDeviceSize block_size)
+	{
+		VmaPoolCreateInfo create_info{};
+		create_info.memoryTypeIndex = memory_type_index;
+		create_info.blockSize = block_size;
+		VK_CHECK_RESULT(vmaCreatePool(allocator, &create_info, &pools[static_cast<size_t>(usage)]));
+	}
+}
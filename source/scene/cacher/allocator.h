@@ -0,0 +1,124 @@
+#pragma once
+
+#include <VulkanDevice.h>
+#include <VulkanTools.h>
+
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <vector>
+
+namespace chaf
+{
+	// What a resource is used for decides where it is sub-allocated from
+	enum class MemoryUsage : uint32_t
+	{
+		// Vertex and index arenas of the buffer cacher
+		Geometry,
+		// Device local storage, indirect and vertex buffers written once or by the GPU
+		Storage,
+		// Sampled images
+		Texture,
+		// Render targets and depth pyramids, recreated on resize, always dedicated
+		Attachment,
+		// Host visible, coherent and persistently mapped, written by the CPU every frame
+		Upload,
+		// Host visible, coherent and persistently mapped, read back by the CPU
+		Readback,
+		Count
+	};
+
+	// Sub-allocated buffer, mirrors the parts of vks::Buffer in use
+	struct Buffer
+	{
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+		VkDeviceSize size{ 0 };
+		VkDescriptorBufferInfo descriptor{};
+		// Set for Upload and Readback buffers
+		void* mapped{ nullptr };
+
+		void destroy();
+	};
+
+	// All buffer and image memory goes through one VMA allocator. Geometry, storage and textures have pools
+	// of large blocks, so a scene with many meshes needs few VkDeviceMemory objects
+	class Allocator
+	{
+	public:
+		struct PoolStats
+		{
+			const char* name{ nullptr };
+			VkDeviceSize block_bytes{ 0 };
+			VkDeviceSize unused_bytes{ 0 };
+			size_t allocation_count{ 0 };
+			size_t block_count{ 0 };
+		};
+
+		struct Stats
+		{
+			// Per usage class with a pool
+			std::vector<PoolStats> pools;
+
+			// Whole allocator, including default pools and dedicated allocations
+			uint32_t block_count{ 0 };
+			uint32_t allocation_count{ 0 };
+			VkDeviceSize used_bytes{ 0 };
+			VkDeviceSize unused_bytes{ 0 };
+
+			// Sum over device local heaps, from VK_EXT_memory_budget if enabled
+			VkDeviceSize budget{ 0 };
+			VkDeviceSize usage{ 0 };
+		};
+
+	public:
+		static Allocator& get();
+
+		void initialize(VkInstance instance, vks::VulkanDevice& device, bool memory_budget_extension);
+
+		void destroy();
+
+		// Once per frame, budget is refreshed on frame index change
+		void update(uint32_t frame_index);
+
+		VmaAllocator getHandle() const;
+
+		// Data is copied for host visible usage classes only
+		void createBuffer(MemoryUsage usage, VkBufferUsageFlags buffer_usage, VkDeviceSize size, Buffer& buffer, const void* data = nullptr);
+
+		void createBuffer(MemoryUsage usage, VkBufferUsageFlags buffer_usage, VkDeviceSize size, VkBuffer& buffer, VmaAllocation& allocation);
+
+		void destroyBuffer(VkBuffer buffer, VmaAllocation allocation);
+
+		// Mapped pointer for Upload and Readback images, linear tiling only
+		void createImage(MemoryUsage usage, const VkImageCreateInfo& create_info, VkImage& image, VmaAllocation& allocation, void** mapped = nullptr);
+
+		void destroyImage(VkImage image, VmaAllocation allocation);
+
+		// Memory for images created outside the allocator, several images may be bound to it if they are never used at the same time
+		void allocateMemory(MemoryUsage usage, const VkMemoryRequirements& requirements, VmaAllocation& allocation);
+
+		void bindImage(VkImage image, VmaAllocation allocation);
+
+		void freeMemory(VmaAllocation allocation);
+
+		// Whole buffer copy on given queue, waits for completion
+		void copyBuffer(const Buffer& src, Buffer& dst, VkQueue queue);
+
+		Stats getStats();
+
+	private:
+		Allocator() = default;
+
+		VmaAllocationCreateInfo getAllocationCreateInfo(MemoryUsage usage) const;
+
+		void createPool(MemoryUsage usage, uint32_t memory_type_index, VkDeviceSize block_size);
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		VmaAllocator allocator{ VK_NULL_HANDLE };
+
+		std::array<VmaPool, static_cast<size_t>(MemoryUsage::Count)> pools{};
+	};
+}
@@ -1,40 +1,48 @@
 #include <scene/cacher/buffer_cacher.h>
 
+#include <algorithm>
+
 namespace chaf
 {
-	BufferCacher::BufferCacher(vks::VulkanDevice& device, VkQueue& queue) :
+	BufferCacher::BufferCacher(vks::VulkanDevice& device) :
+		Cacher{ "buffer" },
 		device{ device },
-		queue{ queue }
+		vertex_arena{ VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(Vertex) },
+		index_arena{ VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t) }
 	{
-		vbo_cache.setRelease([&device](VertexBuffer& vbo) {
-			if (vbo.buffer != VK_NULL_HANDLE)
-			{
-				vkDestroyBuffer(device.logicalDevice, vbo.buffer, nullptr);
-			}
+		vkGetDeviceQueue(device.logicalDevice, device.queueFamilyIndices.graphics, 0, &queue);
 
-			if (vbo.memory != VK_NULL_HANDLE)
-			{
-				vkFreeMemory(device.logicalDevice, vbo.memory, nullptr);
-			}
-			});
+		vertex_arena.create(VERTEX_ARENA_CAPACITY);
+		index_arena.create(INDEX_ARENA_CAPACITY);
 
-		ebo_cache.setRelease([&device](IndexBuffer& ebo) {
-			if (ebo.buffer != VK_NULL_HANDLE)
-			{
-				vkDestroyBuffer(device.logicalDevice, ebo.buffer, nullptr);
-			}
+		// Evicted ranges may still be drawn by frames in flight, they are freed later in update()
+		vbo_cache.setRelease([this](VertexBuffer& vbo) {
+			retire(vertex_arena, vbo.range);
+			});
 
-			if (ebo.memory != VK_NULL_HANDLE)
-			{
-				vkFreeMemory(device.logicalDevice, ebo.memory, nullptr);
-			}
+		ebo_cache.setRelease([this](IndexBuffer& ebo) {
+			retire(index_arena, ebo.range);
 			});
+
+		vbo_cache.setCost([](const VertexBuffer& vbo) { return static_cast<size_t>(vbo.size); });
+		ebo_cache.setCost([](const IndexBuffer& ebo) { return static_cast<size_t>(ebo.size); });
 	}
 
 	BufferCacher::~BufferCacher()
 	{
 		vbo_cache.clear();
 		ebo_cache.clear();
+
+		// Device is idle on destruction
+		for (auto& retired_buffer : retired_buffers)
+		{
+			Allocator::get().destroyBuffer(retired_buffer.buffer, retired_buffer.allocation);
+		}
+		retired_buffers.clear();
+		retired_ranges.clear();
+
+		vertex_arena.destroy();
+		index_arena.destroy();
 	}
 
 	bool BufferCacher::hasVBO(uint32_t key)
@@ -62,5 +70,461 @@ namespace chaf
 		return num_task != 0;
 	}
 
+	void BufferCacher::update(uint32_t frame_count)
+	{
+		uint64_t frame = ++frame_index;
+
+		MemoryBudget::get().update();
+
+		// Arenas are what geometry takes from the heap, their free space included.
+		// Budget is split between vertex and index buffers by what they hold now
+		VkDeviceSize vbo_size = vbo_cache.getCost();
+		VkDeviceSize ebo_size = ebo_cache.getCost();
+		VkDeviceSize arena_size = static_cast<VkDeviceSize>(vertex_arena.getCapacity()) * sizeof(Vertex) + static_cast<VkDeviceSize>(index_arena.getCapacity()) * sizeof(uint32_t);
+		auto [high_watermark, low_watermark] = MemoryBudget::get().getWatermarks(*this, arena_size);
+		double vbo_share = vbo_size + ebo_size == 0 ? 0.5 : static_cast<double>(vbo_size) / static_cast<double>(vbo_size + ebo_size);
+
+		if (high_watermark == 0)
+		{
+			vbo_cache.setBudget(0, 0);
+			ebo_cache.setBudget(0, 0);
+		}
+		else
+		{
+			size_t vbo_high = std::max<size_t>(static_cast<size_t>(high_watermark * vbo_share), 1);
+			size_t vbo_low = std::max<size_t>(static_cast<size_t>(low_watermark * vbo_share), 1);
+			vbo_cache.setBudget(vbo_high, vbo_low);
+			ebo_cache.setBudget(std::max<size_t>(high_watermark - vbo_high, 1), std::max<size_t>(low_watermark - std::min<size_t>(vbo_low, low_watermark), 1));
+		}
+
+		// Prefetches would only evict what is in use
+		prefetch_allowed = high_watermark == 0 || vbo_size + ebo_size < low_watermark;
+
+		// Prefetched meshes evicted before any request
+		{
+			std::lock_guard<std::mutex> lock(source_mutex);
+
+			for (auto it = prefetched.begin(); it != prefetched.end();)
+			{
+				if (loading.count(*it) == 0 && !(vbo_cache.contain(*it) && ebo_cache.contain(*it)))
+				{
+					prefetch_stats.wasted++;
+					it = prefetched.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			prefetch_pending = prefetched.size();
+		}
+
+		std::vector<RetiredRange> released_ranges;
+		{
+			std::lock_guard<std::mutex> lock(retired_mutex);
+
+			auto range_it = std::stable_partition(retired_ranges.begin(), retired_ranges.end(), [frame, frame_count](const RetiredRange& retired_range) {
+				return retired_range.frame + frame_count > frame;
+				});
+			released_ranges.assign(range_it, retired_ranges.end());
+			retired_ranges.erase(range_it, retired_ranges.end());
+
+			auto buffer_it = std::remove_if(retired_buffers.begin(), retired_buffers.end(), [frame, frame_count](const RetiredBuffer& retired_buffer) {
+				if (retired_buffer.frame + frame_count > frame)
+				{
+					return false;
+				}
+
+				Allocator::get().destroyBuffer(retired_buffer.buffer, retired_buffer.allocation);
+				return true;
+				});
+			retired_buffers.erase(buffer_it, retired_buffers.end());
+		}
+
+		std::vector<DeferredLoad> loads;
+		{
+			std::lock_guard<std::mutex> lock(arena_mutex);
+
+			for (auto& released_range : released_ranges)
+			{
+				released_range.arena->free(released_range.range);
+			}
+
+			// Relocation must not race with uploads into the arenas, which are counted as tasks until they completed
+			if (num_task != 0)
+			{
+				return;
+			}
+
+			// Arena capacity in units within the budget share of vertices or indices, zero without a budget
+			uint64_t vertex_limit = high_watermark == 0 ? 0 : static_cast<uint64_t>(high_watermark * vbo_share) / sizeof(Vertex);
+			uint64_t index_limit = high_watermark == 0 ? 0 : static_cast<uint64_t>(high_watermark * (1.0 - vbo_share)) / sizeof(uint32_t);
+
+			// Double until count fits, but never beyond the limit unless count alone needs more. Shrinks an arena over its limit
+			auto fitCapacity = [](uint64_t capacity, uint64_t count, uint64_t limit) {
+				while (capacity < count)
+				{
+					capacity *= 2;
+				}
+				if (limit != 0)
+				{
+					capacity = std::max<uint64_t>(std::min(capacity, limit), count);
+				}
+				return std::max<uint64_t>(capacity, 1);
+			};
+
+			uint64_t vertex_capacity = 0;
+			uint64_t index_capacity = 0;
+			bool needs_relocation = false;
+
+			if (!deferred.empty())
+			{
+				uint64_t vertex_count = 0;
+				uint64_t index_count = 0;
+				for (auto& load : deferred)
+				{
+					vertex_count += load.vertex_count;
+					index_count += load.index_count;
+				}
+
+				// Over budget, least recently used meshes make room for the loads instead of the arenas growing
+				VkDeviceSize deferred_size = vertex_count * sizeof(Vertex) + index_count * sizeof(uint32_t);
+				if (high_watermark != 0 && vbo_cache.getCost() + ebo_cache.getCost() + deferred_size > high_watermark)
+				{
+					VkDeviceSize room = high_watermark > deferred_size ? high_watermark - deferred_size : 0;
+					size_t vbo_room = std::max<size_t>(static_cast<size_t>(room * vbo_share), 1);
+					size_t ebo_room = std::max<size_t>(static_cast<size_t>(room - std::min<VkDeviceSize>(room, vbo_room)), 1);
+					vbo_cache.setBudget(vbo_room, vbo_room);
+					ebo_cache.setBudget(ebo_room, ebo_room);
+				}
+
+				// Relocation packs live ranges, so evicted and fragmented space is reclaimed before anything grows
+				vertex_count += vbo_cache.getCost() / sizeof(Vertex);
+				index_count += ebo_cache.getCost() / sizeof(uint32_t);
+
+				vertex_capacity = fitCapacity(vertex_arena.getCapacity(), vertex_count, vertex_limit);
+				index_capacity = fitCapacity(index_arena.getCapacity(), index_count, index_limit);
+				needs_relocation = true;
+
+				loads = std::move(deferred);
+				deferred.clear();
+			}
+			else
+			{
+				auto needsCompaction = [](const GeometryArena& arena) {
+					auto stats = arena.getStats();
+					return stats.capacity - stats.used >= stats.capacity / 4 && arena.getFragmentation() > COMPACT_FRAGMENTATION;
+				};
+
+				// Budget dropped well below what the arenas hold, with some slack so a fluctuating budget does not relocate every frame
+				auto overLimit = [](const GeometryArena& arena, uint64_t limit) {
+					return limit != 0 && arena.getCapacity() > limit + limit / 4;
+				};
+
+				vertex_capacity = vertex_arena.getCapacity();
+				index_capacity = index_arena.getCapacity();
+				if (overLimit(vertex_arena, vertex_limit) || overLimit(index_arena, index_limit))
+				{
+					vertex_capacity = fitCapacity(vertex_capacity, vbo_cache.getCost() / sizeof(Vertex), vertex_limit);
+					index_capacity = fitCapacity(index_capacity, ebo_cache.getCost() / sizeof(uint32_t), index_limit);
+					needs_relocation = true;
+				}
+
+				needs_relocation |= needsCompaction(vertex_arena) || needsCompaction(index_arena);
+			}
+
+			if (needs_relocation)
+			{
+				if (vertex_capacity > ~0u || index_capacity > ~0u)
+				{
+					vks::tools::exitFatal("Geometry arena exceeds 2^32 elements", -1);
+				}
+
+				relocate(static_cast<uint32_t>(vertex_capacity), static_cast<uint32_t>(index_capacity));
+			}
+		}
+
+		for (auto& load : loads)
+		{
+			load.load();
+		}
+	}
+
+	bool BufferCacher::tryGetRanges(uint32_t key, VertexBuffer& vbo, IndexBuffer& ebo)
+	{
+		return vbo_cache.peek(key, vbo) && ebo_cache.peek(key, ebo);
+	}
+
+	uint64_t BufferCacher::getPlacementVersion() const
+	{
+		return placement_version;
+	}
+
+	VkBuffer BufferCacher::getVertexBuffer() const
+	{
+		return vertex_arena.getBuffer();
+	}
+
+	VkBuffer BufferCacher::getIndexBuffer() const
+	{
+		return index_arena.getBuffer();
+	}
+
+	BufferCacher::ArenaStats BufferCacher::getArenaStats()
+	{
+		std::lock_guard<std::mutex> lock(arena_mutex);
+
+		ArenaStats stats;
+		stats.vertex = vertex_arena.getStats();
+		stats.index = index_arena.getStats();
+		stats.deferred_count = static_cast<uint32_t>(deferred.size());
+		return stats;
+	}
+
+	bool BufferCacher::compact()
+	{
+		std::lock_guard<std::mutex> lock(arena_mutex);
+
+		if (num_task != 0)
+		{
+			return false;
+		}
+
+		relocate(vertex_arena.getCapacity(), index_arena.getCapacity());
+		return true;
+	}
+
+	VkDeviceSize BufferCacher::getSize() const
+	{
+		return vbo_cache.getCost() + ebo_cache.getCost();
+	}
+
+	CacheStats BufferCacher::getStats() const
+	{
+		auto vbo_stats = vbo_cache.getStats();
+		auto ebo_stats = ebo_cache.getStats();
+
+		CacheStats stats;
+		stats.name = name;
+		stats.hit_count = vbo_stats.hit_count + ebo_stats.hit_count;
+		stats.miss_count = vbo_stats.miss_count + ebo_stats.miss_count;
+		stats.eviction_count = vbo_stats.eviction_count + ebo_stats.eviction_count;
+		stats.resident_count = vbo_cache.size() + ebo_cache.size();
+		stats.resident_bytes = getSize();
+		stats.in_flight = num_task;
+		stats.load_latency = load_latency.getBuckets();
+		stats.load_latency_total = load_latency.getTotal();
+		stats.lock_acquired = vbo_stats.lock_acquired + ebo_stats.lock_acquired;
+		stats.lock_contended = vbo_stats.lock_contended + ebo_stats.lock_contended;
+		return stats;
+	}
+
+	void BufferCacher::addBuffer(uint32_t key, const GeometrySource& source)
+	{
+		{
+			std::lock_guard<std::mutex> lock(source_mutex);
+			sources[key] = source;
+			if (!loading.insert(key).second)
+			{
+				return;
+			}
+		}
+
+		load(key, source, JobPriority::Load);
+	}
+
+	void BufferCacher::request(uint32_t key)
+	{
+		VertexBuffer vbo;
+		IndexBuffer ebo;
+		if (vbo_cache.try_get(key, vbo) && ebo_cache.try_get(key, ebo))
+		{
+			// First request since a prefetch settles it
+			if (prefetch_pending != 0)
+			{
+				std::lock_guard<std::mutex> lock(source_mutex);
+				if (prefetched.erase(key) != 0)
+				{
+					prefetch_stats.used++;
+					prefetch_pending = prefetched.size();
+				}
+			}
+			return;
+		}
+
+		GeometrySource source;
+		{
+			std::lock_guard<std::mutex> lock(source_mutex);
+
+			bool was_prefetched = prefetched.erase(key) != 0;
+			prefetch_pending = prefetched.size();
+
+			auto it = sources.find(key);
+			if (it == sources.end())
+			{
+				return;
+			}
+
+			if (!loading.insert(key).second)
+			{
+				prefetch_stats.late += was_prefetched ? 1 : 0;
+				return;
+			}
+
+			// Evicted before update() noticed
+			prefetch_stats.wasted += was_prefetched ? 1 : 0;
+			prefetch_stats.demand++;
+			source = it->second;
+		}
+
+		load(key, source, JobPriority::Load);
+	}
+
+	bool BufferCacher::prefetch(uint32_t key)
+	{
+		if (!prefetch_allowed)
+		{
+			return false;
+		}
+
+		// Not touched, a prefetch is no hit and does not keep a mesh from eviction
+		if (vbo_cache.contain(key) && ebo_cache.contain(key))
+		{
+			return false;
+		}
+
+		GeometrySource source;
+		{
+			std::lock_guard<std::mutex> lock(source_mutex);
+			auto it = sources.find(key);
+			if (it == sources.end() || !loading.insert(key).second)
+			{
+				return false;
+			}
+			source = it->second;
+
+			prefetched.insert(key);
+			prefetch_pending = prefetched.size();
+			prefetch_stats.issued++;
+		}
+
+		load(key, source, JobPriority::Prefetch);
+		return true;
+	}
+
+	PrefetchStats BufferCacher::getPrefetchStats() const
+	{
+		std::lock_guard<std::mutex> lock(source_mutex);
+		return prefetch_stats;
+	}
+
+	void BufferCacher::load(uint32_t key, const GeometrySource& source, JobPriority priority)
+	{
+		num_task++;
+		auto start = std::chrono::high_resolution_clock::now();
+		JobSystem::get().push(priority, [this, key, source, priority, start]() {
+
+			// Target ranges
+			VertexBuffer vertex_buffer{};
+			IndexBuffer index_buffer{};
 
+			vertex_buffer.size = static_cast<VkDeviceSize>(source.vertex_count) * sizeof(Vertex);
+			index_buffer.size = static_cast<VkDeviceSize>(source.index_count) * sizeof(uint32_t);
+			index_buffer.count = static_cast<int32_t>(source.index_count);
+
+			// Sub-allocated from the arenas, a load which does not fit waits for them to grow
+			VkBuffer vertex_arena_buffer, index_arena_buffer;
+			if (!allocateRanges(source.vertex_count, source.index_count, vertex_buffer, index_buffer, vertex_arena_buffer, index_arena_buffer))
+			{
+				defer([this, key, source, priority]() { load(key, source, priority); }, source.vertex_count, source.index_count);
+				this->num_task--;
+				return;
+			}
+
+			// Data goes through the staging ring, the ranges are cached once both copies are done.
+			// The index upload is queued last, so its batch completes last
+			auto& upload_manager = UploadManager::get();
+			upload_manager.uploadBuffer(vertex_arena_buffer, vertex_buffer.range.getOffset() * sizeof(Vertex), source.vertices, vertex_buffer.size,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+			upload_manager.uploadBuffer(index_arena_buffer, index_buffer.range.getOffset() * sizeof(uint32_t), source.indices, index_buffer.size,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+				[this, key, vertex_buffer, index_buffer, start]() mutable {
+					vbo_cache.insert(key, std::move(vertex_buffer));
+					ebo_cache.insert(key, std::move(index_buffer));
+					placement_version++;
+
+					{
+						std::lock_guard<std::mutex> lock(source_mutex);
+						loading.erase(key);
+					}
+
+					// Queue wait included, it is part of what the render thread waits for
+					load_latency.record(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+					this->num_task--; });
+			});
+	}
+
+	bool BufferCacher::allocateRanges(uint32_t vertex_count, uint32_t index_count, VertexBuffer& vbo, IndexBuffer& ebo, VkBuffer& vertex_buffer, VkBuffer& index_buffer)
+	{
+		std::lock_guard<std::mutex> lock(arena_mutex);
+
+		if (!vertex_arena.allocate(vertex_count, vbo.range))
+		{
+			return false;
+		}
+
+		if (!index_arena.allocate(index_count, ebo.range))
+		{
+			vertex_arena.free(vbo.range);
+			return false;
+		}
+
+		vertex_buffer = vertex_arena.getBuffer();
+		index_buffer = index_arena.getBuffer();
+		return true;
+	}
+
+	void BufferCacher::defer(std::function<void()>&& load, uint32_t vertex_count, uint32_t index_count)
+	{
+		std::lock_guard<std::mutex> lock(arena_mutex);
+		deferred.push_back({ std::move(load), vertex_count, index_count });
+	}
+
+	void BufferCacher::retire(GeometryArena& arena, const GeometryArena::Range& range)
+	{
+		{
+			std::lock_guard<std::mutex> lock(retired_mutex);
+			retired_ranges.push_back({ &arena, range, frame_index });
+		}
+
+		// Draws of the evicted mesh have to go
+		placement_version++;
+	}
+
+	void BufferCacher::relocate(uint32_t vertex_capacity, uint32_t index_capacity)
+	{
+		// Cache entries are only inserted and evicted on the render thread, the pointers stay valid meanwhile
+		std::vector<GeometryArena::Range*> vertex_ranges;
+		std::vector<GeometryArena::Range*> index_ranges;
+		vbo_cache.traverse([&vertex_ranges](VertexBuffer& vbo) { vertex_ranges.push_back(&vbo.range); });
+		ebo_cache.traverse([&index_ranges](IndexBuffer& ebo) { index_ranges.push_back(&ebo.range); });
+
+		RetiredBuffer old_vertex{ VK_NULL_HANDLE, VK_NULL_HANDLE, frame_index };
+		RetiredBuffer old_index{ VK_NULL_HANDLE, VK_NULL_HANDLE, frame_index };
+		vertex_arena.relocate(device, queue, vertex_capacity, vertex_ranges, old_vertex.buffer, old_vertex.allocation);
+		index_arena.relocate(device, queue, index_capacity, index_ranges, old_index.buffer, old_index.allocation);
+
+		// Frames in flight still draw from the old buffers
+		{
+			std::lock_guard<std::mutex> lock(retired_mutex);
+			retired_buffers.push_back(old_vertex);
+			retired_buffers.push_back(old_index);
+		}
+
+		placement_version++;
+
+		// Command buffers bind the arena buffers
+		updated = true;
+	}
 }
\ No newline at end of file
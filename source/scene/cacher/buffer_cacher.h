@@ -1,18 +1,47 @@
 #pragma once
 
 #include <scene/cacher/cacher.h>
-#include <scene/cacher/lru.h>
+#include <scene/cacher/sharded_lru.h>
+#include <scene/cacher/memory_budget.h>
+#include <scene/cacher/allocator.h>
+#include <scene/cacher/upload_manager.h>
+#include <scene/cacher/geometry_arena.h>
 #include <scene/components/primitive.h>
 
 #include <VulkanDevice.h>
 #include <VulkanTools.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace chaf
 {
+	// Meshes are cached as ranges of two geometry arenas, one vertex and one index buffer, so every resident mesh
+	// is drawn by one multi draw indirect with its offsets in firstIndex and vertexOffset
 	class BufferCacher: public Cacher
 	{
 	public:
-		BufferCacher(vks::VulkanDevice& device, VkQueue& queue);
+		struct ArenaStats
+		{
+			GeometryArena::Stats vertex;
+			GeometryArena::Stats index;
+			uint32_t deferred_count{ 0 };
+		};
+
+		// Vertices and indices of one mesh, indices are relative to its first vertex
+		struct GeometrySource
+		{
+			const Vertex* vertices{ nullptr };
+			uint32_t vertex_count{ 0 };
+			const uint32_t* indices{ nullptr };
+			uint32_t index_count{ 0 };
+		};
+
+	public:
+		BufferCacher(vks::VulkanDevice& device);
 
 		virtual ~BufferCacher();
 
@@ -26,108 +55,141 @@ namespace chaf
 
 		bool isBusy() const;
 
-		template<typename VBO_Ty, typename EBO_Ty>
-		void addBuffer(uint32_t key, std::vector<VBO_Ty>& vertex_buffer_data, std::vector<EBO_Ty>& index_buffer_data);
+		// Called once per frame: evict against the device memory budget and free ranges which were evicted at least
+		// frame_count frames ago, so no frame in flight uses them. Arenas grow, shrink or get compacted here when no load is running,
+		// growth stops at the memory budget and least recently used meshes are evicted for loads instead
+		void update(uint32_t frame_count);
+
+		// Ranges of a mesh if both its vertices and indices are resident, not a use of the mesh
+		bool tryGetRanges(uint32_t key, VertexBuffer& vbo, IndexBuffer& ebo);
+
+		// Mesh is drawn this frame: counts as a use for the replacement policy, an evicted mesh is loaded again
+		void request(uint32_t key);
+
+		// Mesh is likely drawn soon, it starts loading at prefetch priority unless resident, loading or the caches
+		// are above their low watermark. Returns whether a load started
+		bool prefetch(uint32_t key);
+
+		PrefetchStats getPrefetchStats() const;
+
+		// Changes whenever a mesh is added, evicted or moved, indirect commands built before are stale
+		uint64_t getPlacementVersion() const;
+
+		VkBuffer getVertexBuffer() const;
+
+		VkBuffer getIndexBuffer() const;
+
+		ArenaStats getArenaStats();
+
+		// Bytes held by vertex and index buffers
+		VkDeviceSize getSize() const;
+
+		// Vertex and index caches together
+		CacheStats getStats() const override;
+
+		// Pack both arenas, render thread only. Waits for the copy, skipped while loads are running
+		bool compact();
+
+		// Stream a mesh into the arenas under given key. Source data must outlive the cacher, evicted meshes are
+		// loaded from it again when requested
+		void addBuffer(uint32_t key, const GeometrySource& source);
 
 	private:
 		vks::VulkanDevice& device;
-		
-		VkQueue& queue;
 
-		LruCacher<uint32_t, VertexBuffer, std::mutex> vbo_cache;
+		// Relocation copies go on the graphics queue, which only the render thread submits to
+		VkQueue queue{ VK_NULL_HANDLE };
+
+		// Looked up by the render thread while workers insert, sharded so they rarely share a lock.
+		// Every frame request() uses the meshes in view, so W-TinyLFU keeps meshes passed once during a flythrough
+		// from flushing frequently drawn ones
+		ShardedLruCacher<uint32_t, VertexBuffer, 16, WTinyLfuPolicy> vbo_cache;
+
+		ShardedLruCacher<uint32_t, IndexBuffer, 16, WTinyLfuPolicy> ebo_cache;
+
+		// Initial capacity in vertices and indices, arenas double when full up to their share of the memory budget
+		static constexpr uint32_t VERTEX_ARENA_CAPACITY = 1u << 20;
+
+		static constexpr uint32_t INDEX_ARENA_CAPACITY = 4u << 20;
+
+		// Compact when at least a quarter of an arena is free and most of it is unusable for one large mesh
+		static constexpr float COMPACT_FRAGMENTATION = 0.5f;
+
+		GeometryArena vertex_arena;
+
+		GeometryArena index_arena;
+
+		// Guards both arenas
+		std::mutex arena_mutex;
 
-		LruCacher<uint32_t, IndexBuffer, std::mutex> ebo_cache;
+		// Loads which did not fit, added again after the arenas grew
+		struct DeferredLoad
+		{
+			std::function<void()> load;
+			uint32_t vertex_count;
+			uint32_t index_count;
+		};
 
-		uint32_t num_task{ 0 };
+		std::vector<DeferredLoad> deferred;
+
+		// Ranges evicted from the caches and arena buffers replaced by relocation, released after frames in flight
+		struct RetiredRange
+		{
+			GeometryArena* arena;
+			GeometryArena::Range range;
+			uint64_t frame;
+		};
+
+		struct RetiredBuffer
+		{
+			VkBuffer buffer;
+			VmaAllocation allocation;
+			uint64_t frame;
+		};
+
+		void load(uint32_t key, const GeometrySource& source, JobPriority priority);
+
+		bool allocateRanges(uint32_t vertex_count, uint32_t index_count, VertexBuffer& vbo, IndexBuffer& ebo, VkBuffer& vertex_buffer, VkBuffer& index_buffer);
+
+		void defer(std::function<void()>&& load, uint32_t vertex_count, uint32_t index_count);
+
+		void retire(GeometryArena& arena, const GeometryArena::Range& range);
+
+		// Move both arenas to new buffers of given capacity, live ranges are packed
+		void relocate(uint32_t vertex_capacity, uint32_t index_capacity);
+
+		std::mutex retired_mutex;
+
+		std::vector<RetiredRange> retired_ranges;
+
+		std::vector<RetiredBuffer> retired_buffers;
+
+		// Guards sources, loading, prefetched and prefetch_stats
+		mutable std::mutex source_mutex;
+
+		std::unordered_map<uint32_t, GeometrySource> sources;
+
+		// Keys with a load in flight, so a mesh is requested once until it is resident
+		std::unordered_set<uint32_t> loading;
+
+		// Keys loaded by prefetch and not requested since
+		std::unordered_set<uint32_t> prefetched;
+
+		PrefetchStats prefetch_stats;
+
+		// Size of prefetched, so requests of resident meshes skip the lock while nothing is pending
+		std::atomic<size_t> prefetch_pending{ 0 };
+
+		// Resident bytes are below the low watermark
+		std::atomic<bool> prefetch_allowed{ true };
+
+		std::atomic<uint64_t> placement_version{ 0 };
+
+		std::atomic<uint64_t> frame_index{ 0 };
+
+		std::atomic<uint32_t> num_task{ 0 };
 
 	public:
-		bool updated;
+		std::atomic<bool> updated{ false };
 	};
-
-	template<typename VBO_Ty, typename EBO_Ty>
-	inline void BufferCacher::addBuffer(uint32_t key, std::vector<VBO_Ty>& vertex_buffer_data, std::vector<EBO_Ty>& index_buffer_data)
-	{
-		num_task++;
-		Cacher::getThreadPool().push([this, key, &vertex_buffer_data, &index_buffer_data](size_t index) {
-
-			// Target buffer
-			auto vertex_buffer = std::make_unique<VertexBuffer>();
-			auto index_buffer = std::make_unique<IndexBuffer>();
-
-			size_t vertex_buffer_size = vertex_buffer_data.size() * sizeof(VBO_Ty);
-			size_t index_buffer_size = index_buffer_data.size() * sizeof(EBO_Ty);
-
-			struct StagingBuffer
-			{
-				VkBuffer buffer;
-				VkDeviceMemory memory;
-			} vertex_staging, index_staging;
-
-			// Create host visible staging buffers (source)
-			VK_CHECK_RESULT(device.createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				vertex_buffer_size,
-				&vertex_staging.buffer,
-				&vertex_staging.memory,
-				vertex_buffer_data.data()));
-			// Index data
-			VK_CHECK_RESULT(device.createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				index_buffer_size,
-				&index_staging.buffer,
-				&index_staging.memory,
-				index_buffer_data.data()));
-
-			// Create device local buffers (target)
-			VK_CHECK_RESULT(device.createBuffer(
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				vertex_buffer_size,
-				&vertex_buffer->buffer,
-				&vertex_buffer->memory));
-
-			VK_CHECK_RESULT(device.createBuffer(
-				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				index_buffer_size,
-				&index_buffer->buffer,
-				&index_buffer->memory));
-
-			// Transfer
-			VkCommandBuffer copyCmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-			VkBufferCopy    copyRegion = {};
-
-			copyRegion.size = vertex_buffer_size;
-			vkCmdCopyBuffer(
-				copyCmd,
-				vertex_staging.buffer,
-				vertex_buffer->buffer,
-				1,
-				&copyRegion);
-
-			copyRegion.size = index_buffer_size;
-			vkCmdCopyBuffer(
-				copyCmd,
-				index_staging.buffer,
-				index_buffer->buffer,
-				1,
-				&copyRegion);
-
-			device.flushCommandBuffer(copyCmd, queue, true);
-
-			// Free staging resources
-			vkDestroyBuffer(device.logicalDevice, vertex_staging.buffer, nullptr);
-			vkFreeMemory(device.logicalDevice, vertex_staging.memory, nullptr);
-			vkDestroyBuffer(device.logicalDevice, index_staging.buffer, nullptr);
-			vkFreeMemory(device.logicalDevice, index_staging.memory, nullptr);
-
-			vbo_cache.insert(key, std::move(vertex_buffer));
-			ebo_cache.insert(key, std::move(index_buffer));
-			
-			this->num_task--;
-			updated = true; });
-	}
-
-}
\ No newline at end of file
+}
@@ -0,0 +1,670 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Replacement policies of LruCacher. A policy orders entries by node index of the cacher's pool:
+//   resize(capacity)         pool grew, indices below capacity may be used from now on
+//   onInsert(index, hash)    new entry, hash of its key
+//   onAccess(index)          entry was read
+//   victim()                 entry to evict next, may reorganize internal queues
+//   onEvict(index)           entry was evicted, policies with history remember its hash
+//   onRemove(index)          entry was removed or replaced explicitly
+//   forEach(func)            visit entries, most valuable first
+// Policies only allocate in resize()
+
+namespace chaf
+{
+	inline uint64_t mixHash(uint64_t hash)
+	{
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	// Several doubly linked lists over one index space, an index is in at most one list
+	class IndexLists
+	{
+	public:
+		static constexpr uint32_t NIL = ~0u;
+
+		static constexpr uint8_t NONE = 0xff;
+
+	public:
+		explicit IndexLists(size_t list_count) :
+			lists(list_count)
+		{
+		}
+
+		void resize(size_t capacity)
+		{
+			prev.resize(capacity, NIL);
+			next.resize(capacity, NIL);
+			owners.resize(capacity, NONE);
+		}
+
+		void pushFront(uint8_t list, uint32_t index)
+		{
+			List& l = lists[list];
+			prev[index] = NIL;
+			next[index] = l.head;
+			if (l.head != NIL)
+			{
+				prev[l.head] = index;
+			}
+			l.head = index;
+			if (l.tail == NIL)
+			{
+				l.tail = index;
+			}
+			owners[index] = list;
+			l.size++;
+		}
+
+		void remove(uint32_t index)
+		{
+			if (owners[index] == NONE)
+			{
+				return;
+			}
+
+			List& l = lists[owners[index]];
+			(prev[index] != NIL ? next[prev[index]] : l.head) = next[index];
+			(next[index] != NIL ? prev[next[index]] : l.tail) = prev[index];
+			prev[index] = NIL;
+			next[index] = NIL;
+			owners[index] = NONE;
+			l.size--;
+		}
+
+		void moveToFront(uint8_t list, uint32_t index)
+		{
+			remove(index);
+			pushFront(list, index);
+		}
+
+		uint32_t front(uint8_t list) const
+		{
+			return lists[list].head;
+		}
+
+		uint32_t back(uint8_t list) const
+		{
+			return lists[list].tail;
+		}
+
+		size_t size(uint8_t list) const
+		{
+			return lists[list].size;
+		}
+
+		uint8_t owner(uint32_t index) const
+		{
+			return owners[index];
+		}
+
+		template<class Func>
+		void forEach(uint8_t list, Func&& func) const
+		{
+			for (uint32_t index = lists[list].head; index != NIL; index = next[index])
+			{
+				func(index);
+			}
+		}
+
+	private:
+		struct List
+		{
+			uint32_t head{ NIL };
+			uint32_t tail{ NIL };
+			size_t size{ 0 };
+		};
+
+		std::vector<List> lists;
+
+		std::vector<uint32_t> prev;
+
+		std::vector<uint32_t> next;
+
+		std::vector<uint8_t> owners;
+	};
+
+	// Bounded FIFO of hashes of evicted keys with constant time membership, oldest ghosts are forgotten first
+	class GhostQueue
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			ring.assign(std::max<size_t>(capacity, 1), 0);
+			alive.assign(ring.size(), 0);
+
+			size_t slot_count = 1;
+			while (slot_count < ring.size() * 2)
+			{
+				slot_count <<= 1;
+			}
+			slots.assign(slot_count, NIL);
+
+			first = 0;
+			ring_count = 0;
+			live_count = 0;
+		}
+
+		void push(uint64_t hash)
+		{
+			erase(hash);
+
+			if (ring_count == ring.size())
+			{
+				if (alive[first])
+				{
+					eraseSlot(findSlot(ring[first]));
+					alive[first] = 0;
+					live_count--;
+				}
+				first = (first + 1) % ring.size();
+				ring_count--;
+			}
+
+			uint32_t position = static_cast<uint32_t>((first + ring_count) % ring.size());
+			ring[position] = hash;
+			alive[position] = 1;
+			slots[findSlot(hash)] = position;
+			ring_count++;
+			live_count++;
+		}
+
+		// Returns true if hash was a ghost
+		bool erase(uint64_t hash)
+		{
+			size_t slot = findSlot(hash);
+			if (slots[slot] == NIL)
+			{
+				return false;
+			}
+
+			// Position stays in the ring until it is the oldest
+			alive[slots[slot]] = 0;
+			eraseSlot(slot);
+			live_count--;
+			return true;
+		}
+
+		size_t size() const
+		{
+			return live_count;
+		}
+
+	private:
+		static constexpr uint32_t NIL = ~0u;
+
+		size_t findSlot(uint64_t hash) const
+		{
+			size_t mask = slots.size() - 1;
+			for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+			{
+				if (slots[slot] == NIL || ring[slots[slot]] == hash)
+				{
+					return slot;
+				}
+			}
+		}
+
+		// Same backward shift deletion as LruCacher
+		void eraseSlot(size_t slot)
+		{
+			size_t mask = slots.size() - 1;
+			size_t next = slot;
+			while (true)
+			{
+				next = (next + 1) & mask;
+				if (slots[next] == NIL)
+				{
+					break;
+				}
+
+				size_t home = ring[slots[next]] & mask;
+				bool in_range = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+				if (!in_range)
+				{
+					slots[slot] = slots[next];
+					slot = next;
+				}
+			}
+			slots[slot] = NIL;
+		}
+
+	private:
+		std::vector<uint64_t> ring;
+
+		std::vector<uint8_t> alive;
+
+		std::vector<uint32_t> slots;
+
+		size_t first{ 0 };
+
+		size_t ring_count{ 0 };
+
+		size_t live_count{ 0 };
+	};
+
+	// Count-min sketch with 4 rows of counters saturating at 15, halved periodically so old popularity fades
+	class FrequencySketch
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			width = 16;
+			while (width < capacity)
+			{
+				width <<= 1;
+			}
+			table.assign(width * ROW_COUNT, 0);
+			additions = 0;
+			sample_size = width * 10;
+		}
+
+		void increment(uint64_t hash)
+		{
+			for (uint32_t row = 0; row < ROW_COUNT; row++)
+			{
+				uint8_t& counter = table[getIndex(hash, row)];
+				if (counter < 15)
+				{
+					counter++;
+				}
+			}
+
+			if (++additions >= sample_size)
+			{
+				for (auto& counter : table)
+				{
+					counter >>= 1;
+				}
+				additions /= 2;
+			}
+		}
+
+		uint32_t estimate(uint64_t hash) const
+		{
+			uint32_t frequency = 15;
+			for (uint32_t row = 0; row < ROW_COUNT; row++)
+			{
+				frequency = std::min<uint32_t>(frequency, table[getIndex(hash, row)]);
+			}
+			return frequency;
+		}
+
+	private:
+		static constexpr uint32_t ROW_COUNT = 4;
+
+		size_t getIndex(uint64_t hash, uint32_t row) const
+		{
+			static constexpr std::array<uint64_t, ROW_COUNT> seeds = { 0x97cb3127ull, 0xab1b3e8full, 0x51b1e83dull, 0x2f5d7a13ull };
+			uint64_t h = (hash + seeds[row]) * 0x9e3779b97f4a7c15ull;
+			h ^= h >> 32;
+			return row * width + (h & (width - 1));
+		}
+
+	private:
+		std::vector<uint8_t> table;
+
+		size_t width{ 0 };
+
+		size_t additions{ 0 };
+
+		size_t sample_size{ 0 };
+	};
+
+	// Least recently used
+	class LruPolicy
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			lists.resize(capacity);
+		}
+
+		void onInsert(uint32_t index, uint64_t)
+		{
+			lists.pushFront(0, index);
+		}
+
+		void onAccess(uint32_t index)
+		{
+			lists.moveToFront(0, index);
+		}
+
+		uint32_t victim()
+		{
+			return lists.back(0);
+		}
+
+		void onEvict(uint32_t index)
+		{
+			lists.remove(index);
+		}
+
+		void onRemove(uint32_t index)
+		{
+			lists.remove(index);
+		}
+
+		template<class Func>
+		void forEach(Func&& func) const
+		{
+			lists.forEach(0, func);
+		}
+
+	private:
+		IndexLists lists{ 1 };
+	};
+
+	// 2Q: new entries wait in a FIFO, only entries seen again after leaving it enter the LRU main queue,
+	// so a single pass over many keys only churns the FIFO
+	class TwoQPolicy
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			lists.resize(capacity);
+			hashes.resize(capacity);
+			in_capacity = std::max<size_t>(capacity / 4, 1);
+			ghosts.resize(std::max<size_t>(capacity / 2, 1));
+		}
+
+		void onInsert(uint32_t index, uint64_t hash)
+		{
+			hashes[index] = mixHash(hash);
+			lists.pushFront(ghosts.erase(hashes[index]) ? MAIN : IN, index);
+		}
+
+		void onAccess(uint32_t index)
+		{
+			// Hits in the FIFO do not promote, correlated references right after insert are not reuse
+			if (lists.owner(index) == MAIN)
+			{
+				lists.moveToFront(MAIN, index);
+			}
+		}
+
+		uint32_t victim()
+		{
+			if (lists.size(IN) > in_capacity || lists.size(MAIN) == 0)
+			{
+				return lists.back(IN);
+			}
+			return lists.back(MAIN);
+		}
+
+		void onEvict(uint32_t index)
+		{
+			if (lists.owner(index) == IN)
+			{
+				ghosts.push(hashes[index]);
+			}
+			lists.remove(index);
+		}
+
+		void onRemove(uint32_t index)
+		{
+			lists.remove(index);
+		}
+
+		template<class Func>
+		void forEach(Func&& func) const
+		{
+			lists.forEach(MAIN, func);
+			lists.forEach(IN, func);
+		}
+
+	private:
+		static constexpr uint8_t IN = 0;
+
+		static constexpr uint8_t MAIN = 1;
+
+		IndexLists lists{ 2 };
+
+		std::vector<uint64_t> hashes;
+
+		// Keys recently evicted from the FIFO
+		GhostQueue ghosts;
+
+		size_t in_capacity{ 1 };
+	};
+
+	// Adaptive replacement cache: recency and frequency lists, the split between them adapts to hits in
+	// the ghost lists of either side
+	class ArcPolicy
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			lists.resize(capacity);
+			hashes.resize(capacity);
+			this->capacity = capacity;
+			target = std::min(target, capacity);
+			recent_ghosts.resize(capacity);
+			frequent_ghosts.resize(capacity);
+		}
+
+		void onInsert(uint32_t index, uint64_t hash)
+		{
+			hashes[index] = mixHash(hash);
+
+			// Ghost hit in recency side: recency list deserved more space
+			if (recent_ghosts.erase(hashes[index]))
+			{
+				size_t delta = std::max<size_t>(frequent_ghosts.size() / std::max<size_t>(recent_ghosts.size(), 1), 1);
+				target = std::min(target + delta, capacity);
+				lists.pushFront(FREQUENT, index);
+			}
+			else if (frequent_ghosts.erase(hashes[index]))
+			{
+				size_t delta = std::max<size_t>(recent_ghosts.size() / std::max<size_t>(frequent_ghosts.size(), 1), 1);
+				target = target > delta ? target - delta : 0;
+				lists.pushFront(FREQUENT, index);
+			}
+			else
+			{
+				lists.pushFront(RECENT, index);
+			}
+		}
+
+		void onAccess(uint32_t index)
+		{
+			lists.moveToFront(FREQUENT, index);
+		}
+
+		uint32_t victim()
+		{
+			if (lists.size(RECENT) > 0 && (lists.size(RECENT) > target || lists.size(FREQUENT) == 0))
+			{
+				return lists.back(RECENT);
+			}
+			return lists.back(FREQUENT);
+		}
+
+		void onEvict(uint32_t index)
+		{
+			(lists.owner(index) == RECENT ? recent_ghosts : frequent_ghosts).push(hashes[index]);
+			lists.remove(index);
+		}
+
+		void onRemove(uint32_t index)
+		{
+			lists.remove(index);
+		}
+
+		template<class Func>
+		void forEach(Func&& func) const
+		{
+			lists.forEach(FREQUENT, func);
+			lists.forEach(RECENT, func);
+		}
+
+	private:
+		static constexpr uint8_t RECENT = 0;
+
+		static constexpr uint8_t FREQUENT = 1;
+
+		IndexLists lists{ 2 };
+
+		std::vector<uint64_t> hashes;
+
+		GhostQueue recent_ghosts;
+
+		GhostQueue frequent_ghosts;
+
+		size_t capacity{ 0 };
+
+		// Target size of the recency list
+		size_t target{ 0 };
+	};
+
+	// W-TinyLFU: a small LRU window admits new entries, leaving the window they queue as candidates which compete
+	// with the main queue's victim by estimated frequency, so keys seen once can not push out popular ones.
+	// Main queue is a segmented LRU of probation and protected entries
+	class WTinyLfuPolicy
+	{
+	public:
+		void resize(size_t capacity)
+		{
+			lists.resize(capacity);
+			hashes.resize(capacity);
+			sketch.resize(capacity);
+			window_capacity = std::max<size_t>(capacity / 100, 1);
+			protected_capacity = (capacity - std::min(capacity, window_capacity)) * 4 / 5;
+		}
+
+		void onInsert(uint32_t index, uint64_t hash)
+		{
+			hashes[index] = mixHash(hash);
+			sketch.increment(hashes[index]);
+
+			// Candidates the last evictions did not get to were within the cache's room, they are admitted
+			if (evicted)
+			{
+				while (lists.size(CANDIDATE) > 0)
+				{
+					lists.moveToFront(PROBATION, lists.back(CANDIDATE));
+				}
+				evicted = false;
+			}
+
+			lists.pushFront(WINDOW, index);
+
+			// Window overflow waits for the next evictions, which judge every candidate
+			if (lists.size(WINDOW) > window_capacity)
+			{
+				lists.moveToFront(CANDIDATE, lists.back(WINDOW));
+			}
+		}
+
+		void onAccess(uint32_t index)
+		{
+			sketch.increment(hashes[index]);
+
+			switch (lists.owner(index))
+			{
+			// Reuse after leaving the window admits a candidate like it promotes a probation entry
+			case PROBATION:
+			case CANDIDATE:
+				lists.moveToFront(PROTECTED, index);
+				if (lists.size(PROTECTED) > protected_capacity)
+				{
+					lists.moveToFront(PROBATION, lists.back(PROTECTED));
+				}
+				break;
+			default:
+				lists.moveToFront(lists.owner(index), index);
+				break;
+			}
+		}
+
+		uint32_t victim()
+		{
+			evicted = true;
+
+			// Newest candidate only enters probation if it is used more often than the entry it would replace,
+			// while the main queue is still empty older candidates stand in for it
+			if (lists.size(CANDIDATE) > 0)
+			{
+				uint32_t candidate = lists.front(CANDIDATE);
+				uint32_t incumbent = IndexLists::NIL;
+				for (uint8_t list : { PROBATION, PROTECTED, CANDIDATE })
+				{
+					if (lists.size(list) > 0)
+					{
+						incumbent = lists.back(list);
+						break;
+					}
+				}
+
+				if (incumbent == candidate || sketch.estimate(hashes[candidate]) <= sketch.estimate(hashes[incumbent]))
+				{
+					return candidate;
+				}
+
+				lists.moveToFront(PROBATION, candidate);
+				return incumbent;
+			}
+
+			for (uint8_t list : { PROBATION, PROTECTED, WINDOW })
+			{
+				if (lists.size(list) > 0)
+				{
+					return lists.back(list);
+				}
+			}
+			return IndexLists::NIL;
+		}
+
+		void onEvict(uint32_t index)
+		{
+			onRemove(index);
+		}
+
+		void onRemove(uint32_t index)
+		{
+			lists.remove(index);
+		}
+
+		template<class Func>
+		void forEach(Func&& func) const
+		{
+			lists.forEach(PROTECTED, func);
+			lists.forEach(PROBATION, func);
+			lists.forEach(CANDIDATE, func);
+			lists.forEach(WINDOW, func);
+		}
+
+	private:
+		static constexpr uint8_t WINDOW = 0;
+
+		static constexpr uint8_t PROBATION = 1;
+
+		static constexpr uint8_t PROTECTED = 2;
+
+		// Left the window, waiting for admission to probation
+		static constexpr uint8_t CANDIDATE = 3;
+
+		IndexLists lists{ 4 };
+
+		std::vector<uint64_t> hashes;
+
+		FrequencySketch sketch;
+
+		size_t window_capacity{ 1 };
+
+		size_t protected_capacity{ 0 };
+
+		// victim() was called since the last insert
+		bool evicted{ false };
+	};
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace chaf
+{
+	// Load latency histogram, bucket i counts loads which took less than 2^i ms, last bucket takes the rest
+	class LatencyHistogram
+	{
+	public:
+		static constexpr size_t BUCKET_COUNT = 16;
+
+		using Buckets = std::array<uint64_t, BUCKET_COUNT>;
+
+	public:
+		// Thread safe
+		void record(double ms)
+		{
+			size_t bucket = 0;
+			while (bucket + 1 < BUCKET_COUNT && ms >= static_cast<double>(1ull << bucket))
+			{
+				bucket++;
+			}
+
+			buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+			total_us.fetch_add(static_cast<uint64_t>(ms * 1000.0), std::memory_order_relaxed);
+		}
+
+		Buckets getBuckets() const
+		{
+			Buckets result;
+			for (size_t i = 0; i < BUCKET_COUNT; i++)
+			{
+				result[i] = buckets[i].load(std::memory_order_relaxed);
+			}
+			return result;
+		}
+
+		double getTotal() const
+		{
+			return static_cast<double>(total_us.load(std::memory_order_relaxed)) / 1000.0;
+		}
+
+	private:
+		std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+
+		std::atomic<uint64_t> total_us{ 0 };
+	};
+
+	// Common statistics every Cacher publishes
+	struct CacheStats
+	{
+		std::string name;
+
+		uint64_t hit_count{ 0 };
+		uint64_t miss_count{ 0 };
+		uint64_t eviction_count{ 0 };
+
+		uint64_t resident_count{ 0 };
+		uint64_t resident_bytes{ 0 };
+
+		// Loads queued or running
+		uint32_t in_flight{ 0 };
+
+		LatencyHistogram::Buckets load_latency{};
+		// ms summed over all loads
+		double load_latency_total{ 0.0 };
+
+		uint64_t lock_acquired{ 0 };
+		uint64_t lock_contended{ 0 };
+
+		uint64_t getLoadCount() const
+		{
+			uint64_t count = 0;
+			for (auto bucket : load_latency)
+			{
+				count += bucket;
+			}
+			return count;
+		}
+
+		double getHitRate() const
+		{
+			return hit_count + miss_count == 0 ? 0.0 : static_cast<double>(hit_count) / static_cast<double>(hit_count + miss_count);
+		}
+	};
+
+	// Accuracy of a cacher's prefetches, each prefetched key is settled by its first request or its eviction
+	struct PrefetchStats
+	{
+		// Loads started by prefetch
+		uint64_t issued{ 0 };
+		// Prefetched keys first requested once resident, or while still loading
+		uint64_t used{ 0 };
+		uint64_t late{ 0 };
+		// Prefetched keys evicted or removed before any request
+		uint64_t wasted{ 0 };
+		// Loads started by a request, the texture or mesh pops in
+		uint64_t demand{ 0 };
+
+		double getAccuracy() const
+		{
+			uint64_t settled = used + late + wasted;
+			return settled == 0 ? 0.0 : static_cast<double>(used + late) / settled;
+		}
+	};
+}
@@ -1,3 +1,88 @@
 #include <scene/cacher/cacher.h>
+#include <scene/cacher/memory_budget.h>
 
-ctpl::thread_pool chaf::Cacher::thread_pool;
\ No newline at end of file
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace chaf
+{
+	std::mutex Cacher::registry_mutex;
+
+	std::vector<Cacher*> Cacher::registry;
+
+	Cacher::Cacher(const std::string& name) :
+		name{ name }
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		registry.push_back(this);
+	}
+
+	Cacher::~Cacher()
+	{
+		MemoryBudget::get().removeCache(*this);
+
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+	}
+
+	std::vector<CacheStats> Cacher::getAllStats()
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+
+		std::vector<CacheStats> stats;
+		for (auto cacher : registry)
+		{
+			stats.push_back(cacher->getStats());
+		}
+		return stats;
+	}
+
+	bool Cacher::dumpStats(const std::string& path)
+	{
+		auto all_stats = getAllStats();
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		// Names are set in code, no escaping needed
+		file << "[\n";
+		for (size_t i = 0; i < all_stats.size(); i++)
+		{
+			auto& stats = all_stats[i];
+
+			file << "\t{\n";
+			file << "\t\t\"name\": \"" << stats.name << "\",\n";
+			file << "\t\t\"hits\": " << stats.hit_count << ",\n";
+			file << "\t\t\"misses\": " << stats.miss_count << ",\n";
+			file << "\t\t\"hit_rate\": " << stats.getHitRate() << ",\n";
+			file << "\t\t\"evictions\": " << stats.eviction_count << ",\n";
+			file << "\t\t\"resident_count\": " << stats.resident_count << ",\n";
+			file << "\t\t\"resident_bytes\": " << stats.resident_bytes << ",\n";
+			file << "\t\t\"in_flight\": " << stats.in_flight << ",\n";
+			file << "\t\t\"lock_acquired\": " << stats.lock_acquired << ",\n";
+			file << "\t\t\"lock_contended\": " << stats.lock_contended << ",\n";
+			file << "\t\t\"load_count\": " << stats.getLoadCount() << ",\n";
+			file << "\t\t\"load_latency_total_ms\": " << stats.load_latency_total << ",\n";
+
+			// Upper bound of each bucket in ms, the last one is open
+			file << "\t\t\"load_latency_histogram\": [";
+			for (size_t bucket = 0; bucket < stats.load_latency.size(); bucket++)
+			{
+				file << (bucket == 0 ? "" : ", ") << stats.load_latency[bucket];
+			}
+			file << "]\n";
+
+			file << "\t}" << (i + 1 < all_stats.size() ? "," : "") << "\n";
+		}
+		file << "]\n";
+
+		return file.good();
+	}
+}
@@ -1,27 +1,38 @@
 #pragma once
 
-#include <ctpl_stl.h>
+#include <scene/cacher/cache_stats.h>
+
+#include <core/job_system.h>
+
+#include <mutex>
+#include <vector>
 
 namespace chaf
 {
 	class Cacher
 	{
 	public:
-		Cacher() = default;
-		
-		virtual ~Cacher() = default;
+		// Registers the cacher in the stats registry under given name
+		Cacher(const std::string& name);
+
+		virtual ~Cacher();
+
+		virtual CacheStats getStats() const = 0;
 
-		static ctpl::thread_pool& getThreadPool()
-		{
-			if (thread_pool.size() < 1)
-			{
-				thread_pool.resize(std::thread::hardware_concurrency());
-			}
+		// Stats of every live cacher
+		static std::vector<CacheStats> getAllStats();
 
-			return thread_pool;
-		}
+		// Write stats of every live cacher as JSON, returns false if the file can not be written
+		static bool dumpStats(const std::string& path);
+
+	protected:
+		const std::string name;
+
+		LatencyHistogram load_latency;
 
 	private:
-		static ctpl::thread_pool thread_pool;
+		static std::mutex registry_mutex;
+
+		static std::vector<Cacher*> registry;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,303 @@
+#include <scene/cacher/free_list_allocator.h>
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace chaf
+{
+	// Index of the lowest set bit, value must not be 0
+	static inline uint32_t lowestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+	}
+
+	// Index of the highest set bit, value must not be 0
+	static inline uint32_t highestBit(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return 31u - static_cast<uint32_t>(__builtin_clz(value));
+#endif
+	}
+
+	FreeListAllocator::FreeListAllocator(uint32_t capacity)
+	{
+		reset(capacity);
+	}
+
+	void FreeListAllocator::reset(uint32_t capacity)
+	{
+		blocks.clear();
+		unused_blocks.clear();
+		fl_bitmap = 0;
+		sl_bitmaps.fill(0);
+		free_heads.fill(INVALID);
+
+		this->capacity = capacity;
+		used = 0;
+		allocation_count = 0;
+
+		if (capacity > 0)
+		{
+			uint32_t index = newBlock();
+			blocks[index].offset = 0;
+			blocks[index].size = capacity;
+			insertFree(index);
+		}
+	}
+
+	bool FreeListAllocator::allocate(uint32_t size, Allocation& allocation)
+	{
+		if (size == 0 || size > capacity - used)
+		{
+			return false;
+		}
+
+		// Round up to the next bin, every block found there is large enough
+		uint64_t search_size = size;
+		if (size >= SL_COUNT)
+		{
+			search_size += (1ull << (highestBit(size) - SL_BITS)) - 1;
+		}
+		uint32_t index = search_size > ~0u ? INVALID : findFree(static_cast<uint32_t>(search_size));
+
+		// Bin of the size itself may still hold a block which fits, e.g. the whole arena when empty
+		if (index == INVALID)
+		{
+			uint32_t fl, sl;
+			mapping(size, fl, sl);
+			for (index = free_heads[fl * SL_COUNT + sl]; index != INVALID && blocks[index].size < size; index = blocks[index].next_free);
+		}
+
+		if (index == INVALID)
+		{
+			return false;
+		}
+
+		removeFree(index);
+
+		// Remainder goes back as a free block right after the allocation
+		if (blocks[index].size > size)
+		{
+			uint32_t remainder = newBlock();
+			Block& block = blocks[index];
+			blocks[remainder].offset = block.offset + size;
+			blocks[remainder].size = block.size - size;
+			blocks[remainder].prev_physical = index;
+			blocks[remainder].next_physical = block.next_physical;
+			if (block.next_physical != INVALID)
+			{
+				blocks[block.next_physical].prev_physical = remainder;
+			}
+			block.next_physical = remainder;
+			block.size = size;
+			insertFree(remainder);
+		}
+
+		blocks[index].free = false;
+		used += size;
+		allocation_count++;
+
+		allocation.offset = blocks[index].offset;
+		allocation.size = size;
+		allocation.node = index;
+		return true;
+	}
+
+	void FreeListAllocator::free(const Allocation& allocation)
+	{
+		if (allocation.node == INVALID)
+		{
+			return;
+		}
+
+		uint32_t index = allocation.node;
+		assert(index < blocks.size() && !blocks[index].free && blocks[index].offset == allocation.offset);
+
+		used -= blocks[index].size;
+		allocation_count--;
+
+		uint32_t next = blocks[index].next_physical;
+		if (next != INVALID && blocks[next].free)
+		{
+			removeFree(next);
+			blocks[index].size += blocks[next].size;
+			blocks[index].next_physical = blocks[next].next_physical;
+			if (blocks[next].next_physical != INVALID)
+			{
+				blocks[blocks[next].next_physical].prev_physical = index;
+			}
+			releaseBlock(next);
+		}
+
+		uint32_t prev = blocks[index].prev_physical;
+		if (prev != INVALID && blocks[prev].free)
+		{
+			removeFree(prev);
+			blocks[prev].size += blocks[index].size;
+			blocks[prev].next_physical = blocks[index].next_physical;
+			if (blocks[index].next_physical != INVALID)
+			{
+				blocks[blocks[index].next_physical].prev_physical = prev;
+			}
+			releaseBlock(index);
+			index = prev;
+		}
+
+		insertFree(index);
+	}
+
+	uint32_t FreeListAllocator::getCapacity() const
+	{
+		return capacity;
+	}
+
+	uint32_t FreeListAllocator::getUsed() const
+	{
+		return used;
+	}
+
+	uint32_t FreeListAllocator::getAllocationCount() const
+	{
+		return allocation_count;
+	}
+
+	uint32_t FreeListAllocator::getLargestFree() const
+	{
+		if (fl_bitmap == 0)
+		{
+			return 0;
+		}
+
+		// Largest block is in the highest non empty bin
+		uint32_t fl = highestBit(fl_bitmap);
+		uint32_t sl = highestBit(sl_bitmaps[fl]);
+
+		uint32_t largest = 0;
+		for (uint32_t index = free_heads[fl * SL_COUNT + sl]; index != INVALID; index = blocks[index].next_free)
+		{
+			largest = std::max(largest, blocks[index].size);
+		}
+		return largest;
+	}
+
+	void FreeListAllocator::mapping(uint32_t size, uint32_t& fl, uint32_t& sl)
+	{
+		if (size < SL_COUNT)
+		{
+			fl = 0;
+			sl = size;
+		}
+		else
+		{
+			uint32_t msb = highestBit(size);
+			fl = msb - SL_BITS + 1;
+			sl = (size >> (msb - SL_BITS)) - SL_COUNT;
+		}
+	}
+
+	uint32_t FreeListAllocator::findFree(uint32_t size) const
+	{
+		uint32_t fl, sl;
+		mapping(size, fl, sl);
+
+		uint32_t sl_map = sl_bitmaps[fl] & (~0u << sl);
+		if (sl_map == 0)
+		{
+			uint32_t fl_map = fl_bitmap & (~0u << (fl + 1));
+			if (fl_map == 0)
+			{
+				return INVALID;
+			}
+			fl = lowestBit(fl_map);
+			sl_map = sl_bitmaps[fl];
+		}
+		sl = lowestBit(sl_map);
+
+		return free_heads[fl * SL_COUNT + sl];
+	}
+
+	uint32_t FreeListAllocator::newBlock()
+	{
+		if (!unused_blocks.empty())
+		{
+			uint32_t index = unused_blocks.back();
+			unused_blocks.pop_back();
+			blocks[index] = {};
+			return index;
+		}
+
+		blocks.push_back({});
+		return static_cast<uint32_t>(blocks.size() - 1);
+	}
+
+	void FreeListAllocator::releaseBlock(uint32_t index)
+	{
+		blocks[index] = {};
+		unused_blocks.push_back(index);
+	}
+
+	void FreeListAllocator::insertFree(uint32_t index)
+	{
+		uint32_t fl, sl;
+		mapping(blocks[index].size, fl, sl);
+
+		uint32_t& head = free_heads[fl * SL_COUNT + sl];
+		blocks[index].free = true;
+		blocks[index].prev_free = INVALID;
+		blocks[index].next_free = head;
+		if (head != INVALID)
+		{
+			blocks[head].prev_free = index;
+		}
+		head = index;
+
+		fl_bitmap |= 1u << fl;
+		sl_bitmaps[fl] |= 1u << sl;
+	}
+
+	void FreeListAllocator::removeFree(uint32_t index)
+	{
+		uint32_t fl, sl;
+		mapping(blocks[index].size, fl, sl);
+
+		Block& block = blocks[index];
+		if (block.prev_free != INVALID)
+		{
+			blocks[block.prev_free].next_free = block.next_free;
+		}
+		else
+		{
+			free_heads[fl * SL_COUNT + sl] = block.next_free;
+		}
+		if (block.next_free != INVALID)
+		{
+			blocks[block.next_free].prev_free = block.prev_free;
+		}
+		block.prev_free = INVALID;
+		block.next_free = INVALID;
+		block.free = false;
+
+		if (free_heads[fl * SL_COUNT + sl] == INVALID)
+		{
+			sl_bitmaps[fl] &= ~(1u << sl);
+			if (sl_bitmaps[fl] == 0)
+			{
+				fl_bitmap &= ~(1u << fl);
+			}
+		}
+	}
+}
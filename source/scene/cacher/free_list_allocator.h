@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace chaf
+{
+	// TLSF style allocator of ranges in [0, capacity), it only does the bookkeeping, so units are up to the user.
+	// Free blocks are binned by a two level size class (power of two, then 16 linear steps), found through two
+	// bitmaps in constant time and merged with their physical neighbours on free. Not thread safe
+	class FreeListAllocator
+	{
+	public:
+		static constexpr uint32_t INVALID = ~0u;
+
+		struct Allocation
+		{
+			uint32_t offset{ 0 };
+			uint32_t size{ 0 };
+			// Block index, needed to free
+			uint32_t node{ INVALID };
+		};
+
+	public:
+		FreeListAllocator(uint32_t capacity = 0);
+
+		// Drop all allocations, one free block of capacity is left
+		void reset(uint32_t capacity);
+
+		bool allocate(uint32_t size, Allocation& allocation);
+
+		void free(const Allocation& allocation);
+
+		uint32_t getCapacity() const;
+
+		uint32_t getUsed() const;
+
+		uint32_t getAllocationCount() const;
+
+		uint32_t getLargestFree() const;
+
+	private:
+		static constexpr uint32_t SL_BITS = 4;
+
+		static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+
+		// Sizes below SL_COUNT go to the first level 0, the rest by their most significant bit
+		static constexpr uint32_t FL_COUNT = 32 - SL_BITS + 1;
+
+		struct Block
+		{
+			uint32_t offset{ 0 };
+			uint32_t size{ 0 };
+			uint32_t prev_physical{ INVALID };
+			uint32_t next_physical{ INVALID };
+			uint32_t prev_free{ INVALID };
+			uint32_t next_free{ INVALID };
+			bool free{ false };
+		};
+
+		// Bin holding blocks of given size
+		static void mapping(uint32_t size, uint32_t& fl, uint32_t& sl);
+
+		// Head of the first non empty bin whose blocks are all at least size
+		uint32_t findFree(uint32_t size) const;
+
+		uint32_t newBlock();
+
+		void releaseBlock(uint32_t index);
+
+		void insertFree(uint32_t index);
+
+		void removeFree(uint32_t index);
+
+	private:
+		std::vector<Block> blocks;
+
+		std::vector<uint32_t> unused_blocks;
+
+		uint32_t fl_bitmap{ 0 };
+
+		std::array<uint32_t, FL_COUNT> sl_bitmaps{};
+
+		std::array<uint32_t, FL_COUNT * SL_COUNT> free_heads{};
+
+		uint32_t capacity{ 0 };
+
+		uint32_t used{ 0 };
+
+		uint32_t allocation_count{ 0 };
+	};
+}
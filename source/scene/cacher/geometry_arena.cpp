@@ -0,0 +1,147 @@
+#include <scene/cacher/geometry_arena.h>
+
+#include <algorithm>
+
+namespace chaf
+{
+	GeometryArena::GeometryArena(VkBufferUsageFlags buffer_usage, VkDeviceSize stride) :
+		buffer_usage{ buffer_usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		stride{ stride }
+	{
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		destroy();
+	}
+
+	void GeometryArena::create(uint32_t capacity)
+	{
+		destroy();
+
+		Allocator::get().createBuffer(MemoryUsage::Geometry, buffer_usage, capacity * stride, buffer, allocation);
+		allocator.reset(capacity);
+		generation++;
+	}
+
+	void GeometryArena::destroy()
+	{
+		if (buffer != VK_NULL_HANDLE)
+		{
+			Allocator::get().destroyBuffer(buffer, allocation);
+			buffer = VK_NULL_HANDLE;
+			allocation = VK_NULL_HANDLE;
+		}
+		allocator.reset(0);
+	}
+
+	bool GeometryArena::allocate(uint32_t count, Range& range)
+	{
+		range = {};
+		range.generation = generation;
+		return count == 0 || allocator.allocate(count, range.allocation);
+	}
+
+	void GeometryArena::free(const Range& range)
+	{
+		if (range.generation == generation)
+		{
+			allocator.free(range.allocation);
+		}
+	}
+
+	void GeometryArena::relocate(vks::VulkanDevice& device, VkQueue queue, uint32_t capacity, const std::vector<Range*>& live, VkBuffer& old_buffer, VmaAllocation& old_allocation)
+	{
+		VkBuffer new_buffer;
+		VmaAllocation new_allocation;
+		Allocator::get().createBuffer(MemoryUsage::Geometry, buffer_usage, capacity * stride, new_buffer, new_allocation);
+
+		// In offset order, allocations from a fresh allocator come out packed, neighbours are copied as one region
+		std::vector<Range*> ranges;
+		std::copy_if(live.begin(), live.end(), std::back_inserter(ranges), [](const Range* range) { return range->allocation.size > 0; });
+		std::sort(ranges.begin(), ranges.end(), [](const Range* a, const Range* b) { return a->allocation.offset < b->allocation.offset; });
+
+		allocator.reset(capacity);
+		generation++;
+
+		std::vector<VkBufferCopy> regions;
+		for (auto* range : ranges)
+		{
+			VkDeviceSize src_offset = range->allocation.offset * stride;
+			if (!allocator.allocate(range->allocation.size, range->allocation))
+			{
+				vks::tools::exitFatal("Geometry arena is too small for its live ranges", -1);
+			}
+			range->generation = generation;
+
+			VkDeviceSize dst_offset = range->allocation.offset * stride;
+			VkDeviceSize size = range->allocation.size * stride;
+			if (!regions.empty() && regions.back().srcOffset + regions.back().size == src_offset && regions.back().dstOffset + regions.back().size == dst_offset)
+			{
+				regions.back().size += size;
+			}
+			else
+			{
+				regions.push_back({ src_offset, dst_offset, size });
+			}
+		}
+
+		VkCommandBuffer copy_cmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+		if (!regions.empty())
+		{
+			vkCmdCopyBuffer(copy_cmd, buffer, new_buffer, static_cast<uint32_t>(regions.size()), regions.data());
+		}
+
+		// Later submissions on this queue draw from the new buffer
+		VkMemoryBarrier barrier = vks::initializers::memoryBarrier();
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(copy_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		device.flushCommandBuffer(copy_cmd, queue, true);
+
+		old_buffer = buffer;
+		old_allocation = allocation;
+		buffer = new_buffer;
+		allocation = new_allocation;
+		relocation_count++;
+	}
+
+	VkBuffer GeometryArena::getBuffer() const
+	{
+		return buffer;
+	}
+
+	VkDeviceSize GeometryArena::getStride() const
+	{
+		return stride;
+	}
+
+	uint32_t GeometryArena::getCapacity() const
+	{
+		return allocator.getCapacity();
+	}
+
+	float GeometryArena::getFragmentation() const
+	{
+		uint32_t free_count = allocator.getCapacity() - allocator.getUsed();
+		if (free_count == 0)
+		{
+			return 0.f;
+		}
+		return 1.f - static_cast<float>(allocator.getLargestFree()) / static_cast<float>(free_count);
+	}
+
+	GeometryArena::Stats GeometryArena::getStats() const
+	{
+		Stats stats;
+		stats.capacity = allocator.getCapacity();
+		stats.used = allocator.getUsed();
+		stats.largest_free = allocator.getLargestFree();
+		stats.allocation_count = allocator.getAllocationCount();
+		stats.relocation_count = relocation_count;
+		stats.stride = stride;
+		return stats;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <scene/cacher/allocator.h>
+#include <scene/cacher/free_list_allocator.h>
+
+#include <VulkanDevice.h>
+#include <VulkanTools.h>
+
+#include <vector>
+
+namespace chaf
+{
+	// One large device local buffer, ranges of it are handed out by a free list allocator in units of stride bytes,
+	// so meshes streamed in and out share a single vertex or index buffer binding. Not thread safe
+	class GeometryArena
+	{
+	public:
+		struct Range
+		{
+			FreeListAllocator::Allocation allocation;
+			// Ranges of an older buffer are left alone on free
+			uint32_t generation{ 0 };
+
+			// In units
+			uint32_t getOffset() const { return allocation.offset; }
+		};
+
+		struct Stats
+		{
+			uint32_t capacity{ 0 };
+			uint32_t used{ 0 };
+			uint32_t largest_free{ 0 };
+			uint32_t allocation_count{ 0 };
+			uint32_t relocation_count{ 0 };
+			VkDeviceSize stride{ 0 };
+		};
+
+	public:
+		GeometryArena(VkBufferUsageFlags buffer_usage, VkDeviceSize stride);
+
+		~GeometryArena();
+
+		void create(uint32_t capacity);
+
+		void destroy();
+
+		// Empty ranges always succeed and occupy nothing
+		bool allocate(uint32_t count, Range& range);
+
+		void free(const Range& range);
+
+		// Copy live ranges packed into a new buffer of given capacity and update them in place. Old buffer is handed back,
+		// it may still be used by frames in flight. Nothing may write the live ranges meanwhile
+		void relocate(vks::VulkanDevice& device, VkQueue queue, uint32_t capacity, const std::vector<Range*>& live, VkBuffer& old_buffer, VmaAllocation& old_allocation);
+
+		VkBuffer getBuffer() const;
+
+		VkDeviceSize getStride() const;
+
+		uint32_t getCapacity() const;
+
+		// Free units which a single allocation can not use, 0 when all free space is one block
+		float getFragmentation() const;
+
+		Stats getStats() const;
+
+	private:
+		VkBufferUsageFlags buffer_usage;
+
+		VkDeviceSize stride;
+
+		VkBuffer buffer{ VK_NULL_HANDLE };
+
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+
+		FreeListAllocator allocator;
+
+		uint32_t generation{ 0 };
+
+		uint32_t relocation_count{ 0 };
+	};
+}
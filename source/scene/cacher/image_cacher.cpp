@@ -0,0 +1,595 @@
+#include <scene/cacher/image_cacher.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace chaf
+{
+	ImageCacher::ImageCacher(vks::VulkanDevice& device, uint32_t slot_capacity) :
+		Cacher{ "image" },
+		device{ device },
+		slot_capacity{ slot_capacity }
+	{
+		// White, so material factors show through until the texture is resident
+		uint32_t white = 0xffffffff;
+		default_texture.loadFromBuffer(&white, sizeof(white), VK_FORMAT_R8G8B8A8_UNORM, 1, 1, &device, VK_FILTER_NEAREST);
+
+		slots.resize(slot_capacity);
+		descriptors.resize(slot_capacity, default_texture.descriptor);
+
+		cache.setRelease([this](Resident& resident) {
+			retire(resident);
+			});
+
+		cache.setCost([](const Resident& resident) {
+			VmaAllocationInfo info;
+			vmaGetAllocationInfo(Allocator::get().getHandle(), resident.texture.allocation, &info);
+			return static_cast<size_t>(info.size);
+			});
+	}
+
+	ImageCacher::~ImageCacher()
+	{
+		cache.clear();
+
+		// Device is idle on destruction
+		for (auto& retired_texture : retired)
+		{
+			retired_texture.texture.destory();
+		}
+		retired.clear();
+
+		default_texture.destory();
+	}
+
+	uint32_t ImageCacher::addImage(const std::string& path, bool srgb)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint32_t slot;
+		if (!free_slots.empty())
+		{
+			// Lowest first, so slots of a scene match its image indices
+			auto it = std::min_element(free_slots.begin(), free_slots.end());
+			slot = *it;
+			free_slots.erase(it);
+		}
+		else if (slot_count < slot_capacity)
+		{
+			slot = slot_count++;
+		}
+		else
+		{
+			return INVALID_SLOT;
+		}
+
+		slots[slot].path = path;
+		slots[slot].srgb = srgb;
+		slots[slot].used = true;
+		slots[slot].resolved = false;
+		slots[slot].loading = false;
+		markDirty(slot);
+
+		return slot;
+	}
+
+	void ImageCacher::removeImage(uint32_t slot)
+	{
+		uint64_t key = 0;
+		bool last = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (slot >= slot_count || !slots[slot].used)
+			{
+				return;
+			}
+
+			if (slots[slot].resolved)
+			{
+				key = slots[slot].key;
+				auto& sharing = key_slots[key];
+				sharing.erase(std::find(sharing.begin(), sharing.end(), slot));
+				last = sharing.empty();
+				if (last)
+				{
+					key_slots.erase(key);
+				}
+			}
+
+			// Other slots may keep the texture resident
+			if (descriptors[slot].imageView != default_texture.view)
+			{
+				descriptors[slot] = default_texture.descriptor;
+				markDirty(slot);
+			}
+
+			slots[slot].path.clear();
+			slots[slot].generation++;
+			slots[slot].used = false;
+			slots[slot].resolved = false;
+			slots[slot].loading = false;
+			prefetch_stats.wasted += slots[slot].prefetched ? 1 : 0;
+			slots[slot].prefetched = false;
+			free_slots.push_back(slot);
+		}
+
+		// Released texture is retired once no slot refers to it
+		if (last)
+		{
+			cache.remove(key);
+		}
+	}
+
+	void ImageCacher::request(uint32_t slot)
+	{
+		bool resolved;
+		bool prefetched;
+		uint64_t key = 0;
+		std::string path;
+		bool srgb = false;
+		uint32_t generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (slot >= slot_count || !slots[slot].used)
+			{
+				return;
+			}
+
+			// First request since a prefetch settles it
+			prefetched = slots[slot].prefetched;
+			slots[slot].prefetched = false;
+
+			resolved = slots[slot].resolved;
+			if (!resolved)
+			{
+				if (slots[slot].loading)
+				{
+					prefetch_stats.late += prefetched ? 1 : 0;
+					return;
+				}
+
+				slots[slot].loading = true;
+				path = slots[slot].path;
+				srgb = slots[slot].srgb;
+				generation = slots[slot].generation;
+				prefetch_stats.demand++;
+			}
+			key = slots[slot].key;
+		}
+
+		if (!resolved)
+		{
+			load(slot, generation, path, srgb, JobPriority::Load);
+			return;
+		}
+
+		Resident resident;
+		if (cache.try_get(key, resident))
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			prefetch_stats.used += prefetched ? 1 : 0;
+
+			// Texture may have been loaded for another slot of equal content
+			if (descriptors[slot].imageView != resident.texture.view)
+			{
+				descriptors[slot] = resident.texture.descriptor;
+				markDirty(slot);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!loading_keys.insert(key).second)
+			{
+				prefetch_stats.late += prefetched ? 1 : 0;
+				return;
+			}
+			path = slots[slot].path;
+			srgb = slots[slot].srgb;
+			prefetch_stats.demand++;
+		}
+
+		pushLoad(key, path, srgb, JobPriority::Load);
+	}
+
+	bool ImageCacher::prefetch(uint32_t slot)
+	{
+		if (!prefetch_allowed)
+		{
+			return false;
+		}
+
+		bool resolved;
+		uint64_t key = 0;
+		std::string path;
+		bool srgb = false;
+		uint32_t generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (slot >= slot_count || !slots[slot].used || slots[slot].loading)
+			{
+				return false;
+			}
+
+			resolved = slots[slot].resolved;
+			if (!resolved)
+			{
+				slots[slot].loading = true;
+				slots[slot].prefetched = true;
+				path = slots[slot].path;
+				srgb = slots[slot].srgb;
+				generation = slots[slot].generation;
+				prefetch_stats.issued++;
+			}
+			key = slots[slot].key;
+		}
+
+		if (!resolved)
+		{
+			load(slot, generation, path, srgb, JobPriority::Prefetch);
+			return true;
+		}
+
+		// Not touched, a prefetch is no hit and does not keep a texture from eviction
+		if (cache.contain(key))
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!loading_keys.insert(key).second)
+			{
+				return false;
+			}
+			path = slots[slot].path;
+			srgb = slots[slot].srgb;
+			slots[slot].prefetched = true;
+			prefetch_stats.issued++;
+		}
+
+		pushLoad(key, path, srgb, JobPriority::Prefetch);
+		return true;
+	}
+
+	uint32_t ImageCacher::createTable()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Table table;
+		table.dirty.resize(slot_capacity, 1);
+		table.dirty_slots.resize(slot_count);
+		for (uint32_t slot = 0; slot < slot_count; slot++)
+		{
+			table.dirty_slots[slot] = slot;
+		}
+
+		// Slots above slot_count are never indexed, partially bound sets may leave them unwritten
+		std::fill(table.dirty.begin() + slot_count, table.dirty.end(), 0);
+
+		tables.push_back(std::move(table));
+		return static_cast<uint32_t>(tables.size() - 1);
+	}
+
+	void ImageCacher::updateTable(uint32_t table_index, VkDescriptorSet set, uint32_t binding)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto& table = tables[table_index];
+		table.version = version;
+
+		if (table.dirty_slots.empty())
+		{
+			return;
+		}
+
+		// Neighbouring slots are written as one array range
+		std::sort(table.dirty_slots.begin(), table.dirty_slots.end());
+
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t slot : table.dirty_slots)
+		{
+			table.dirty[slot] = 0;
+
+			if (!writes.empty() && writes.back().dstArrayElement + writes.back().descriptorCount == slot)
+			{
+				writes.back().descriptorCount++;
+				continue;
+			}
+
+			VkWriteDescriptorSet write = vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding, &descriptors[slot]);
+			write.dstArrayElement = slot;
+			writes.push_back(write);
+		}
+		table.dirty_slots.clear();
+
+		vkUpdateDescriptorSets(device.logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void ImageCacher::update()
+	{
+		MemoryBudget::get().update();
+
+		auto [high_watermark, low_watermark] = MemoryBudget::get().getWatermarks(*this, cache.getCost());
+
+		VkDeviceSize limit = getBudgetLimit();
+		if (limit > 0 && (high_watermark == 0 || limit < high_watermark))
+		{
+			// Same ratio of low to high watermark as the memory budget
+			low_watermark = high_watermark == 0 ? limit - limit / 8 : static_cast<VkDeviceSize>(static_cast<double>(low_watermark) * limit / high_watermark);
+			high_watermark = limit;
+		}
+
+		// Evicted textures are retired through the release callback
+		cache.setBudget(high_watermark, low_watermark);
+
+		// Prefetches would only evict what is in use
+		prefetch_allowed = high_watermark == 0 || cache.getCost() < low_watermark;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Every table has been written without the texture, so no set refers to it and the GPU is done with the sets
+		// which did before
+		uint64_t written_version = version;
+		for (auto& table : tables)
+		{
+			written_version = std::min(written_version, table.version);
+		}
+
+		auto it = std::remove_if(retired.begin(), retired.end(), [written_version](RetiredTexture& retired_texture) {
+			if (retired_texture.version > written_version)
+			{
+				return false;
+			}
+
+			retired_texture.texture.destory();
+			return true;
+			});
+		retired.erase(it, retired.end());
+	}
+
+	void ImageCacher::setBudgetLimit(VkDeviceSize bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		budget_limit = bytes;
+	}
+
+	VkDeviceSize ImageCacher::getBudgetLimit() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return budget_limit;
+	}
+
+	uint32_t ImageCacher::getSlotCapacity() const
+	{
+		return slot_capacity;
+	}
+
+	uint32_t ImageCacher::getSlotCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return slot_count;
+	}
+
+	VkDeviceSize ImageCacher::getSize() const
+	{
+		return cache.getCost();
+	}
+
+	ImageCacher::SlotStats ImageCacher::getSlotStats()
+	{
+		uint32_t resident = static_cast<uint32_t>(cache.size());
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		SlotStats stats;
+		stats.capacity = slot_capacity;
+		stats.used = slot_count - static_cast<uint32_t>(free_slots.size());
+		stats.resident = resident;
+		stats.loading = num_task;
+		for (auto& [key, sharing] : key_slots)
+		{
+			stats.shared += static_cast<uint32_t>(sharing.size()) - 1;
+		}
+		stats.retired = static_cast<uint32_t>(retired.size());
+		return stats;
+	}
+
+	PrefetchStats ImageCacher::getPrefetchStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return prefetch_stats;
+	}
+
+	CacheStats ImageCacher::getStats() const
+	{
+		auto cache_stats = cache.getStats();
+
+		CacheStats stats;
+		stats.name = name;
+		stats.hit_count = cache_stats.hit_count;
+		stats.miss_count = cache_stats.miss_count;
+		stats.eviction_count = cache_stats.eviction_count;
+		stats.resident_count = cache.size();
+		stats.resident_bytes = getSize();
+		stats.in_flight = num_task;
+		stats.load_latency = load_latency.getBuckets();
+		stats.load_latency_total = load_latency.getTotal();
+		stats.lock_acquired = cache_stats.lock_acquired;
+		stats.lock_contended = cache_stats.lock_contended;
+		return stats;
+	}
+
+	void ImageCacher::load(uint32_t slot, uint32_t generation, const std::string& path, bool srgb, JobPriority priority)
+	{
+		num_task++;
+		auto start = std::chrono::high_resolution_clock::now();
+		JobSystem::get().push(priority, [this, slot, generation, path, srgb, start]() {
+			uint64_t key;
+			try
+			{
+				// Stat of the source when its content hash is indexed
+				key = TextureCache::get().getKey(path, srgb);
+			}
+			catch (const std::exception& e)
+			{
+				// Slot stays on the default texture and is not retried
+				std::cerr << e.what() << std::endl;
+				num_task--;
+				return;
+			}
+
+			bool load_texture;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (!slots[slot].used || slots[slot].generation != generation)
+				{
+					num_task--;
+					return;
+				}
+
+				slots[slot].key = key;
+				slots[slot].resolved = true;
+				slots[slot].loading = false;
+				key_slots[key].push_back(slot);
+
+				load_texture = loading_keys.insert(key).second;
+			}
+
+			// Resident for another slot, the next request refers the slot to it
+			if (load_texture && cache.contain(key))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				loading_keys.erase(key);
+				load_texture = false;
+			}
+
+			if (!load_texture)
+			{
+				num_task--;
+				return;
+			}
+
+			loadTexture(key, path, srgb, start);
+			});
+	}
+
+	void ImageCacher::pushLoad(uint64_t key, const std::string& path, bool srgb, JobPriority priority)
+	{
+		num_task++;
+		auto start = std::chrono::high_resolution_clock::now();
+		JobSystem::get().push(priority, [this, key, path, srgb, start]() {
+			loadTexture(key, path, srgb, start);
+			});
+	}
+
+	void ImageCacher::loadTexture(uint64_t key, const std::string& path, bool srgb, std::chrono::high_resolution_clock::time_point start)
+	{
+		try
+		{
+			// Decoded or mapped from the texture cache and staged on the worker, handed over once the copy is visible
+			// to the graphics queue
+			auto texture = std::make_shared<Texture2D>();
+			texture->loadFromFile(path, &device, VK_NULL_HANDLE, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false,
+				[this, key, texture, start]() {
+					onLoaded(key, *texture, start);
+				}, srgb);
+		}
+		catch (const std::exception& e)
+		{
+			// Key stays loading, so slots of this content keep the default texture
+			std::cerr << e.what() << std::endl;
+			num_task--;
+		}
+	}
+
+	void ImageCacher::onLoaded(uint64_t key, Texture2D& texture, std::chrono::high_resolution_clock::time_point start)
+	{
+		bool used;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto it = key_slots.find(key);
+			used = it != key_slots.end();
+			if (used)
+			{
+				// Before inserting, so an immediate eviction points the slots back at the default texture
+				for (uint32_t slot : it->second)
+				{
+					descriptors[slot] = texture.descriptor;
+					markDirty(slot);
+				}
+			}
+		}
+
+		if (!used)
+		{
+			// Every slot of this content was removed while loading, no table has seen the texture
+			texture.destory();
+		}
+		else
+		{
+			// May evict others, which are retired through the release callback
+			cache.insert(key, Resident{ texture, key });
+		}
+
+		{
+			// Only once resident, so a slot resolving meanwhile does not load the content again
+			std::lock_guard<std::mutex> lock(mutex);
+			loading_keys.erase(key);
+		}
+
+		// Queue wait included, it is part of what the render thread waits for
+		load_latency.record(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+		num_task--;
+	}
+
+	void ImageCacher::markDirty(uint32_t slot)
+	{
+		version++;
+
+		for (auto& table : tables)
+		{
+			if (!table.dirty[slot])
+			{
+				table.dirty[slot] = 1;
+				table.dirty_slots.push_back(slot);
+			}
+		}
+	}
+
+	void ImageCacher::retire(Resident& resident)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Slots fall back to the default texture unless they were handed out again, the texture itself lives until
+		// every table has been written since
+		auto it = key_slots.find(resident.key);
+		if (it != key_slots.end())
+		{
+			for (uint32_t slot : it->second)
+			{
+				prefetch_stats.wasted += slots[slot].prefetched ? 1 : 0;
+				slots[slot].prefetched = false;
+
+				if (descriptors[slot].imageView == resident.texture.view)
+				{
+					descriptors[slot] = default_texture.descriptor;
+					markDirty(slot);
+				}
+			}
+		}
+
+		retired.push_back({ resident.texture, version });
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <scene/cacher/cacher.h>
+#include <scene/cacher/sharded_lru.h>
+#include <scene/cacher/memory_budget.h>
+#include <scene/cacher/allocator.h>
+#include <scene/cacher/texture_cache.h>
+#include <scene/components/texture.h>
+
+#include <VulkanDevice.h>
+#include <VulkanTools.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace chaf
+{
+	// Textures are addressed by a bindless slot, the index into one combined image sampler array. Images are loaded
+	// when first requested and evicted least recently used against the device memory budget, a slot whose texture is
+	// not resident refers to a small default texture. Slots of images with equal content share one texture, keyed by
+	// the texture cache. Descriptor arrays are written through tables, which only get the slots changed since they
+	// were last written, so sets have to be UPDATE_AFTER_BIND to skip re-recording
+	class ImageCacher : public Cacher
+	{
+	public:
+		static constexpr uint32_t INVALID_SLOT = ~0u;
+
+		struct SlotStats
+		{
+			uint32_t capacity{ 0 };
+			uint32_t used{ 0 };
+			uint32_t resident{ 0 };
+			uint32_t loading{ 0 };
+			// Slots referring to the texture of another slot with equal content
+			uint32_t shared{ 0 };
+			// Evicted textures still referred to by a table
+			uint32_t retired{ 0 };
+		};
+
+	public:
+		// slot_capacity is the variable descriptor count of every table
+		ImageCacher(vks::VulkanDevice& device, uint32_t slot_capacity);
+
+		virtual ~ImageCacher();
+
+		// Slot of an image file, nothing is loaded yet. srgb marks color data, which is mip mapped in linear space. Slots
+		// are handed out lowest first, INVALID_SLOT once all are used
+		uint32_t addImage(const std::string& path, bool srgb = false);
+
+		// Slot may be handed out again right away, it refers to the default texture meanwhile
+		void removeImage(uint32_t slot);
+
+		// Slot is used by this frame, a texture which is not resident starts loading. Render thread
+		void request(uint32_t slot);
+
+		// Slot is likely used soon, its texture starts loading at prefetch priority unless resident, loading or the
+		// cache is above its low watermark. Returns whether a load started. Render thread
+		bool prefetch(uint32_t slot);
+
+		// Descriptor array kept in step with the slots, e.g. one per pipeline and swapchain image. All slots are dirty
+		uint32_t createTable();
+
+		// Write slots changed since the last write of table. The GPU must be done with set, which is the case right
+		// after waiting for the fence of the frame that last used it. Render thread
+		void updateTable(uint32_t table, VkDescriptorSet set, uint32_t binding);
+
+		// Called once per frame: evict against the budget and destroy evicted textures no table refers to anymore
+		void update();
+
+		// Cap on resident bytes below the memory budget, zero for no cap
+		void setBudgetLimit(VkDeviceSize bytes);
+
+		VkDeviceSize getBudgetLimit() const;
+
+		uint32_t getSlotCapacity() const;
+
+		// One past the highest slot in use, shaders may index below it
+		uint32_t getSlotCount() const;
+
+		// Bytes held by resident textures
+		VkDeviceSize getSize() const;
+
+		SlotStats getSlotStats();
+
+		PrefetchStats getPrefetchStats() const;
+
+		CacheStats getStats() const override;
+
+	private:
+		struct Resident
+		{
+			Texture2D texture;
+			uint64_t key;
+		};
+
+		// Find the content key of slot on a worker, then load its texture unless another slot did
+		void load(uint32_t slot, uint32_t generation, const std::string& path, bool srgb, JobPriority priority);
+
+		void pushLoad(uint64_t key, const std::string& path, bool srgb, JobPriority priority);
+
+		// Worker
+		void loadTexture(uint64_t key, const std::string& path, bool srgb, std::chrono::high_resolution_clock::time_point start);
+
+		// Render thread, from the upload callback
+		void onLoaded(uint64_t key, Texture2D& texture, std::chrono::high_resolution_clock::time_point start);
+
+		// Descriptor of slot changed, caller holds mutex
+		void markDirty(uint32_t slot);
+
+		void retire(Resident& resident);
+
+	private:
+		vks::VulkanDevice& device;
+
+		uint32_t slot_capacity;
+
+		// Referred to by every slot without a resident texture
+		Texture2D default_texture;
+
+		// Key is the content key, cost is the allocation size
+		ShardedLruCacher<uint64_t, Resident, 16, LruPolicy> cache{ 0, 0 };
+
+		struct Slot
+		{
+			std::string path;
+			bool srgb{ false };
+			uint64_t key{ 0 };
+			// Key lookups of a removed image are dropped on completion
+			uint32_t generation{ 0 };
+			bool used{ false };
+			bool resolved{ false };
+			// Key lookup in flight, or failed
+			bool loading{ false };
+			// Load was started by prefetch and the slot was not requested since
+			bool prefetched{ false };
+		};
+
+		struct Table
+		{
+			std::vector<uint32_t> dirty_slots;
+			std::vector<uint8_t> dirty;
+			// Descriptor version the table was last written with
+			uint64_t version{ 0 };
+		};
+
+		struct RetiredTexture
+		{
+			Texture2D texture;
+			uint64_t version;
+		};
+
+		// Guards everything below, never held while calling into the cache, whose release takes it
+		mutable std::mutex mutex;
+
+		std::vector<Slot> slots;
+
+		std::vector<uint32_t> free_slots;
+
+		// Slots with a resolved key, by key
+		std::unordered_map<uint64_t, std::vector<uint32_t>> key_slots;
+
+		// Keys whose texture is loading, or failed to
+		std::unordered_set<uint64_t> loading_keys;
+
+		uint32_t slot_count{ 0 };
+
+		// Current descriptor of every slot
+		std::vector<VkDescriptorImageInfo> descriptors;
+
+		std::vector<Table> tables;
+
+		std::vector<RetiredTexture> retired;
+
+		// Bumped on every descriptor change
+		uint64_t version{ 0 };
+
+		VkDeviceSize budget_limit{ 0 };
+
+		PrefetchStats prefetch_stats;
+
+		// Resident bytes are below the low watermark
+		std::atomic<bool> prefetch_allowed{ true };
+
+		std::atomic<uint32_t> num_task{ 0 };
+	};
+}
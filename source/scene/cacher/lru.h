@@ -1,9 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <stdexcept>
-#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <atomic>
 #include <mutex>
 #include <functional>
+#include <cstring>
+#include <type_traits>
+
+#include <scene/cacher/cache_policy.h>
 
 namespace chaf
 {
@@ -21,101 +30,211 @@ namespace chaf
 		KeyNotFound() :std::invalid_argument("Key not found!") {}
 	};
 
-	template<typename Key_Ty, typename Val_Ty>
-	struct KeyValuePair
-	{
-	public:
-		Key_Ty key;
-		Val_Ty value;
-
-		KeyValuePair(const Key_Ty& key, Val_Ty&& value) :
-			key{ key }, value{ std::move(value) }{}
-	};
-
-	template<class Key_Ty, class Val_Ty, class Lock = NullLock, class Map = std::unordered_map<Key_Ty, typename std::list<KeyValuePair<Key_Ty, std::unique_ptr<Val_Ty>>>::iterator>>
+	// Nodes live in a pool sized to the maximum allowed size and are ordered by index by the replacement policy
+	// (see cache_policy.h), keys are found through an open addressing hash index, so get and insert never
+	// allocate once the cache is bounded. References returned by get point into the pool and are invalidated by the next
+	// insert, which may grow the pool or evict, and by removal; a cache shared between threads must use try_get or get_copy.
+	// Besides entry count, the cache can be limited by a cost per entry such as its size in bytes.
+	// A locked cache of trivially copyable entries is read without its lock by peek, contain and try_get: writers bracket
+	// every change with a sequence number, a read which saw it change is repeated, and arrays replaced by growth stay
+	// allocated until destruction so a reader never touches freed memory. Uses found by try_get are queued in a lossy
+	// buffer which is drained into the policy under the lock
+	template<class Key_Ty, class Val_Ty, class Lock = NullLock, class Policy = LruPolicy, class Hash = std::hash<Key_Ty>>
 	class LruCacher
 	{
 	public:
-		using node_type = KeyValuePair<Key_Ty, std::unique_ptr<Val_Ty>>;
-		using list_type = std::list<KeyValuePair<Key_Ty, std::unique_ptr<Val_Ty>>>;
-		using map_type = Map;
 		using lock_type = Lock;
+		using policy_type = Policy;
 		using guard = std::lock_guard<lock_type>;
 
+		struct Stats
+		{
+			// Lookups through contain and try_get, get is not counted as it follows contain
+			uint64_t hit_count{ 0 };
+			uint64_t miss_count{ 0 };
+			uint64_t insert_count{ 0 };
+			// Entries evicted by size or budget, explicit removal is not counted
+			uint64_t eviction_count{ 0 };
+		};
+
+	private:
+		static constexpr uint32_t NIL = ~0u;
+
+		// Pool capacity of an unbounded cache before it first grows
+		static constexpr size_t INITIAL_CAPACITY = 16;
+
+		struct Node
+		{
+			Key_Ty key{};
+			std::optional<Val_Ty> value;
+			size_t cost{ 0 };
+			// Free list of unused nodes
+			uint32_t next{ NIL };
+		};
+
+		static constexpr bool OPTIMISTIC_READ = !std::is_same_v<Lock, NullLock> && std::is_trivially_copyable_v<Node>;
+
+		// Arrays a reader probes, replaced as a whole when the pool grows
+		struct Tables
+		{
+			const Node* nodes;
+			size_t capacity;
+			const uint32_t* slots;
+			size_t mask;
+		};
+
+		// Reads retried before falling back to the lock
+		static constexpr uint32_t OPTIMISTIC_ATTEMPTS = 4;
+
+		// Uses queued by optimistic try_get, dropped when full
+		static constexpr uint32_t TOUCH_BUFFER_SIZE = 64;
+
+		// Marks the cache as changing for optimistic readers while in scope, taken under the lock
+		class WriteScope
+		{
+		public:
+			WriteScope(const LruCacher& cache) :
+				cache{ cache }
+			{
+				if constexpr (OPTIMISTIC_READ)
+				{
+					cache.sequence.fetch_add(1, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_release);
+				}
+			}
+
+			~WriteScope()
+			{
+				if constexpr (OPTIMISTIC_READ)
+				{
+					cache.sequence.fetch_add(1, std::memory_order_release);
+				}
+			}
+
+		private:
+			const LruCacher& cache;
+		};
+
 	public:
 		LruCacher(size_t max_size = 128, size_t elastic_size = 10, std::function<void(Val_Ty&)> release_func = [](Val_Ty&) {}) :
-			max_size{ max_size }, elastic_size{ elastic_size }, release{ release_func } {}
+			max_size{ max_size }, elastic_size{ elastic_size }, release{ release_func }
+		{
+			// One more than max_size is held before pruning if there is no elastic size
+			reserve(max_size == 0 ? INITIAL_CAPACITY : max_size + std::max<size_t>(elastic_size, 1));
+		}
 
 		~LruCacher()
 		{
 			clear();
 		}
 
+		// Lock free, may be stale while another thread inserts
 		size_t size() const
 		{
-			guard g(lock);
-			return cache_map.size();
+			return count.load(std::memory_order_relaxed);
 		}
 
 		size_t empty() const
 		{
-			guard g(lock);
-			return cache_map.empty();
+			return size() == 0;
 		}
 
 		void clear()
 		{
-			traverse(release);
-			cache_map.clear();
-			cache_list.clear();
+			guard g(lock);
+			WriteScope w(*this);
+
+			while (count > 0)
+			{
+				erase(policy.victim(), false);
+			}
 		}
 
 		void insert(const Key_Ty& key, std::unique_ptr<Val_Ty>&& value)
+		{
+			insert(key, std::move(*value));
+		}
+
+		void insert(const Key_Ty& key, Val_Ty&& value)
 		{
 			guard g(lock);
+			WriteScope w(*this);
+			drainTouches();
 
-			const auto iter = cache_map.find(key);
+			// Replaced value is released like a removed one
+			size_t slot = findSlot(key);
+			if (slots[slot] != NIL)
+			{
+				erase(slots[slot], false);
+			}
 
-			if (iter != cache_map.end())
+			if (free_head == NIL)
 			{
-				LruCacher::remove(key);
-				insert(key, std::move(value));
-				return;
+				reserve(nodes.size() * 2);
 			}
 
-			cache_list.emplace_front(key, std::move(value));
-			cache_map[key] = cache_list.begin();
+			uint32_t index = free_head;
+			free_head = nodes[index].next;
+
+			Node& node = nodes[index];
+			node.key = key;
+			node.value.emplace(std::move(value));
+			node.cost = cost ? cost(*node.value) : 0;
+			total_cost += node.cost;
+			policy.onInsert(index, static_cast<uint64_t>(hash(key)));
+
+			slots[findSlot(key)] = index;
+			count++;
+			stats.insert_count++;
 
 			prune();
 		}
 
 		bool try_get(const Key_Ty& key, Val_Ty& value)
 		{
+			if constexpr (OPTIMISTIC_READ)
+			{
+				uint32_t index;
+				bool found;
+				if (readOptimistic(key, index, value, found))
+				{
+					(found ? optimistic_hit_count : optimistic_miss_count).fetch_add(1, std::memory_order_relaxed);
+					if (found)
+					{
+						touch(key, index);
+					}
+					return found;
+				}
+			}
+
 			guard g(lock);
 
-			const auto iter = cache_map.find(key);
-			if (iter == cache_map.end())
+			uint32_t index = slots[findSlot(key)];
+			if (index == NIL)
 			{
+				stats.miss_count++;
 				return false;
 			}
 
-			cache_list.splice(cache_list.begin(), cache_list, iter->second);
-			value = *(iter->second->value);
+			stats.hit_count++;
+			policy.onAccess(index);
+			value = *nodes[index].value;
 			return true;
 		}
 
+		// Reference is only valid until the cache is next modified, see above
 		Val_Ty& get(const Key_Ty& key)
 		{
 			guard g(lock);
 
-			const auto iter = cache_map.find(key);
-			if (iter == cache_map.end())
+			uint32_t index = slots[findSlot(key)];
+			if (index == NIL)
 			{
 				throw KeyNotFound();
 			}
 
-			cache_list.splice(cache_list.begin(), cache_list, iter->second);
-			return *(iter->second->value);
+			policy.onAccess(index);
+			return *nodes[index].value;
 		}
 
 		Val_Ty get_copy(const Key_Ty& key)
@@ -126,24 +245,63 @@ namespace chaf
 		bool remove(const Key_Ty& key)
 		{
 			guard g(lock);
+			WriteScope w(*this);
 
-			auto iter = cache_map.find(key);
-			if (iter == cache_map.end()) 
+			uint32_t index = slots[findSlot(key)];
+			if (index == NIL)
 			{
 				return false;
 			}
 
-			release(*(iter->second->value));
-			cache_list.erase(iter->second);
-			cache_map.erase(iter);
+			erase(index, false);
 			return true;
 		}
 
+		// Like try_get, but neither a use of the entry nor a lookup in stats
+		bool peek(const Key_Ty& key, Val_Ty& value) const
+		{
+			if constexpr (OPTIMISTIC_READ)
+			{
+				uint32_t index;
+				bool found;
+				if (readOptimistic(key, index, value, found))
+				{
+					return found;
+				}
+			}
+
+			guard g(lock);
+
+			uint32_t index = slots[findSlot(key)];
+			if (index == NIL)
+			{
+				return false;
+			}
+
+			value = *nodes[index].value;
+			return true;
+		}
+
+		// Does not count as a use of the entry
 		bool contain(const Key_Ty& key) const
 		{
+			if constexpr (OPTIMISTIC_READ)
+			{
+				uint32_t index;
+				bool found;
+				Val_Ty value;
+				if (readOptimistic(key, index, value, found))
+				{
+					(found ? optimistic_hit_count : optimistic_miss_count).fetch_add(1, std::memory_order_relaxed);
+					return found;
+				}
+			}
+
 			guard g(lock);
 
-			return cache_map.find(key) != cache_map.end();
+			bool found = slots[findSlot(key)] != NIL;
+			(found ? stats.hit_count : stats.miss_count)++;
+			return found;
 		}
 
 		size_t getMaxSize() const
@@ -161,14 +319,16 @@ namespace chaf
 			return max_size + elastic_size;
 		}
 
+		// Most valuable to keep first
 		void traverse(std::function<void(Val_Ty&)> func)
 		{
 			guard g(lock);
+			WriteScope w(*this);
+			drainTouches();
 
-			for (auto& cache : cache_list)
-			{
-				func(*cache.value);
-			}
+			policy.forEach([this, &func](uint32_t index) {
+				func(*nodes[index].value);
+			});
 		}
 
 		void setRelease(std::function<void(Val_Ty&)> func)
@@ -176,39 +336,339 @@ namespace chaf
 			release = func;
 		}
 
+		// Cost of an entry, evaluated once on insert
+		void setCost(std::function<size_t(const Val_Ty&)> func)
+		{
+			guard g(lock);
+			cost = func;
+		}
+
+		// Once total cost exceeds high watermark, least recently used entries are evicted down to low watermark.
+		// The most recent entry is kept even if it is over budget on its own, zero disables the limit
+		void setBudget(size_t high_watermark, size_t low_watermark)
+		{
+			guard g(lock);
+			WriteScope w(*this);
+			drainTouches();
+
+			this->high_watermark = high_watermark;
+			this->low_watermark = std::min(low_watermark, high_watermark);
+			prune();
+		}
+
+		size_t getCost() const
+		{
+			guard g(lock);
+			return total_cost;
+		}
+
+		lock_type& getLock() const
+		{
+			return lock;
+		}
+
+		Stats getStats() const
+		{
+			guard g(lock);
+
+			Stats result = stats;
+			result.hit_count += optimistic_hit_count.load(std::memory_order_relaxed);
+			result.miss_count += optimistic_miss_count.load(std::memory_order_relaxed);
+			return result;
+		}
+
 	private:
+		// Lookup without the lock, false if writers kept interfering. Racy reads are copies of trivially copyable
+		// nodes which are only used once the sequence shows no writer ran meanwhile
+		bool readOptimistic(const Key_Ty& key, uint32_t& index, Val_Ty& value, bool& found) const
+		{
+			for (uint32_t attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++)
+			{
+				uint64_t begin = sequence.load(std::memory_order_acquire);
+				if (begin & 1)
+				{
+					continue;
+				}
+
+				const Tables* current = tables.load(std::memory_order_acquire);
+				index = NIL;
+				Node node;
+
+				// Bounded, a torn index may have no empty slot
+				size_t slot = hash(key) & current->mask;
+				for (size_t probe = 0; probe <= current->mask; probe++, slot = (slot + 1) & current->mask)
+				{
+					uint32_t candidate;
+					std::memcpy(&candidate, current->slots + slot, sizeof(candidate));
+					if (candidate == NIL || candidate >= current->capacity)
+					{
+						break;
+					}
+
+					std::memcpy(static_cast<void*>(&node), current->nodes + candidate, sizeof(Node));
+					if (node.key == key)
+					{
+						index = candidate;
+						break;
+					}
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (sequence.load(std::memory_order_relaxed) != begin)
+				{
+					continue;
+				}
+
+				found = index != NIL && node.value.has_value();
+				if (found)
+				{
+					value = *node.value;
+				}
+				return true;
+			}
+
+			return false;
+		}
+
+		// Queue a use found without the lock, drained right away if nobody holds the lock and the buffer fills up
+		void touch(const Key_Ty& key, uint32_t index)
+		{
+			uint64_t position = touch_tail.fetch_add(1, std::memory_order_relaxed);
+			if (position < TOUCH_BUFFER_SIZE)
+			{
+				touches[position].store((static_cast<uint64_t>(index) + 1) << 32 | static_cast<uint32_t>(hash(key)), std::memory_order_release);
+			}
+
+			if (position + 1 >= TOUCH_BUFFER_SIZE / 2 && lock.try_lock())
+			{
+				drainTouches();
+				lock.unlock();
+			}
+		}
+
+		// Under lock. Entries removed since are recognized by their key hash and skipped
+		void drainTouches()
+		{
+			if constexpr (OPTIMISTIC_READ)
+			{
+				uint64_t count = std::min<uint64_t>(touch_tail.exchange(0, std::memory_order_acq_rel), TOUCH_BUFFER_SIZE);
+				for (uint64_t i = 0; i < count; i++)
+				{
+					uint64_t touched = touches[i].exchange(0, std::memory_order_acquire);
+					if (touched == 0)
+					{
+						continue;
+					}
+
+					uint32_t index = static_cast<uint32_t>((touched >> 32) - 1);
+					if (index < nodes.size() && nodes[index].value && static_cast<uint32_t>(hash(nodes[index].key)) == static_cast<uint32_t>(touched))
+					{
+						policy.onAccess(index);
+					}
+				}
+			}
+		}
+
 		size_t prune()
 		{
+			size_t evicted = 0;
+
 			size_t max_allow_size = max_size + elastic_size;
+			if (max_size != 0 && count >= max_allow_size)
+			{
+				while (count > max_size)
+				{
+					erase(policy.victim(), true);
+					evicted++;
+				}
+			}
+
+			if (high_watermark != 0 && total_cost > high_watermark)
+			{
+				while (total_cost > low_watermark && count > 1)
+				{
+					erase(policy.victim(), true);
+					evicted++;
+				}
+			}
+
+			return evicted;
+		}
+
+		// Release value and return the node to the free list, evicted entries may be remembered by the policy
+		void erase(uint32_t index, bool evicted)
+		{
+			Node& node = nodes[index];
+
+			release(*node.value);
+			node.value.reset();
+			total_cost -= node.cost;
+
+			eraseSlot(findSlot(node.key));
+			if (evicted)
+			{
+				policy.onEvict(index);
+				stats.eviction_count++;
+			}
+			else
+			{
+				policy.onRemove(index);
+			}
+
+			node.next = free_head;
+			free_head = index;
+			count--;
+		}
+
+		// Slot holding key, or the empty slot where it would be inserted
+		size_t findSlot(const Key_Ty& key) const
+		{
+			size_t mask = slots.size() - 1;
+			for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask)
+			{
+				if (slots[slot] == NIL || nodes[slots[slot]].key == key)
+				{
+					return slot;
+				}
+			}
+		}
 
-			if (max_size == 0 || cache_map.size() < max_allow_size)
+		// Linear probing without tombstones: shift later entries of the probe sequence back into the hole
+		void eraseSlot(size_t slot)
+		{
+			size_t mask = slots.size() - 1;
+			size_t next = slot;
+			while (true)
 			{
-				return 0;
+				next = (next + 1) & mask;
+				if (slots[next] == NIL)
+				{
+					break;
+				}
+
+				// Entry may move if its home slot is not cyclically within (slot, next]
+				size_t home = hash(nodes[slots[next]].key) & mask;
+				bool in_range = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+				if (!in_range)
+				{
+					slots[slot] = slots[next];
+					slot = next;
+				}
 			}
+			slots[slot] = NIL;
+		}
 
-			size_t count = 0;
+		// Grow node pool and hash index, only happens at construction or when an unbounded cache is full
+		void reserve(size_t capacity)
+		{
+			size_t old_capacity = nodes.size();
+			if (capacity <= old_capacity)
+			{
+				return;
+			}
+
+			if constexpr (OPTIMISTIC_READ)
+			{
+				// Readers may still probe the old arrays
+				std::vector<Node> grown(capacity);
+				std::copy(nodes.begin(), nodes.end(), grown.begin());
+				retired_nodes.push_back(std::move(nodes));
+				nodes = std::move(grown);
+			}
+			else
+			{
+				nodes.resize(capacity);
+			}
+			policy.resize(capacity);
+			for (size_t i = capacity; i > old_capacity; i--)
+			{
+				nodes[i - 1].next = free_head;
+				free_head = static_cast<uint32_t>(i - 1);
+			}
+
+			// At most half full, so probe sequences stay short
+			size_t slot_count = 1;
+			while (slot_count < capacity * 2)
+			{
+				slot_count <<= 1;
+			}
+
+			if constexpr (OPTIMISTIC_READ)
+			{
+				retired_slots.push_back(std::move(slots));
+				slots = std::vector<uint32_t>(slot_count, NIL);
+			}
+			else
+			{
+				slots.assign(slot_count, NIL);
+			}
 
-			while (cache_map.size() > max_size)
+			for (uint32_t index = 0; index < old_capacity; index++)
 			{
-				cache_map.erase(cache_list.back().key);
-				cache_list.pop_back();
-				count++;
+				if (nodes[index].value)
+				{
+					slots[findSlot(nodes[index].key)] = index;
+				}
 			}
 
-			return count;
+			if constexpr (OPTIMISTIC_READ)
+			{
+				table_history.push_back(std::make_unique<Tables>(Tables{ nodes.data(), nodes.size(), slots.data(), slots.size() - 1 }));
+				tables.store(table_history.back().get(), std::memory_order_release);
+			}
 		}
 
 	private:
 		mutable Lock lock;
 
-		map_type cache_map;
+		std::vector<Node> nodes;
+
+		std::vector<uint32_t> slots;
+
+		Hash hash;
+
+		Policy policy;
 
-		list_type cache_list;
+		uint32_t free_head{ NIL };
+
+		// Only changed under lock, atomic so size() does not need it
+		std::atomic<size_t> count{ 0 };
+
+		size_t total_cost{ 0 };
+
+		size_t high_watermark{ 0 };
+
+		size_t low_watermark{ 0 };
 
 		size_t max_size;
 
 		size_t elastic_size;
 
 		std::function<void(Val_Ty&)> release;
+
+		std::function<size_t(const Val_Ty&)> cost;
+
+		mutable Stats stats;
+
+		// Odd while a writer changes nodes or slots
+		mutable std::atomic<uint64_t> sequence{ 0 };
+
+		std::atomic<const Tables*> tables{ nullptr };
+
+		// Every table published and the arrays they replaced, freed on destruction
+		std::vector<std::unique_ptr<Tables>> table_history;
+
+		std::vector<std::vector<Node>> retired_nodes;
+
+		std::vector<std::vector<uint32_t>> retired_slots;
+
+		// Index + 1 and low hash bits of entries used without the lock, zero when empty
+		std::array<std::atomic<uint64_t>, TOUCH_BUFFER_SIZE> touches{};
+
+		std::atomic<uint64_t> touch_tail{ 0 };
+
+		mutable std::atomic<uint64_t> optimistic_hit_count{ 0 };
+
+		mutable std::atomic<uint64_t> optimistic_miss_count{ 0 };
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,138 @@
+#include <scene/cacher/memory_budget.h>
+
+#include <algorithm>
+
+namespace chaf
+{
+	// Budget changes with other processes, but querying every frame is not free
+	static constexpr std::chrono::milliseconds UPDATE_INTERVAL{ 500 };
+
+	// Evict once usage crosses the high watermark, down to the low watermark
+	static constexpr double HIGH_WATERMARK = 0.9;
+
+	static constexpr double LOW_WATERMARK = 0.75;
+
+	// Budget estimate without VK_EXT_memory_budget, same heuristic as VMA
+	static constexpr double HEAP_SIZE_BUDGET = 0.8;
+
+	MemoryBudget& MemoryBudget::get()
+	{
+		static MemoryBudget memory_budget;
+		return memory_budget;
+	}
+
+	void MemoryBudget::initialize(VkInstance instance, vks::VulkanDevice& device, bool memory_budget_extension)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			physical_device = device.physicalDevice;
+			if (memory_budget_extension)
+			{
+				vkGetPhysicalDeviceMemoryProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+					vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+			}
+		}
+
+		update(true);
+	}
+
+	void MemoryBudget::update(bool force)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto now = std::chrono::steady_clock::now();
+		if (physical_device == VK_NULL_HANDLE || (!force && now - last_update < UPDATE_INTERVAL))
+		{
+			return;
+		}
+		last_update = now;
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+		VkPhysicalDeviceMemoryProperties2 memory_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+
+		if (vkGetPhysicalDeviceMemoryProperties2KHR)
+		{
+			memory_properties.pNext = &budget_properties;
+			vkGetPhysicalDeviceMemoryProperties2KHR(physical_device, &memory_properties);
+		}
+		else
+		{
+			vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties.memoryProperties);
+		}
+
+		heaps = {};
+		heaps.from_extension = vkGetPhysicalDeviceMemoryProperties2KHR != nullptr;
+
+		auto& properties = memory_properties.memoryProperties;
+		for (uint32_t i = 0; i < properties.memoryHeapCount; i++)
+		{
+			if (!(properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+			{
+				continue;
+			}
+
+			heaps.size += properties.memoryHeaps[i].size;
+			if (heaps.from_extension)
+			{
+				heaps.budget += budget_properties.heapBudget[i];
+				heaps.usage += budget_properties.heapUsage[i];
+			}
+			else
+			{
+				heaps.budget += static_cast<VkDeviceSize>(properties.memoryHeaps[i].size * HEAP_SIZE_BUDGET);
+			}
+		}
+	}
+
+	MemoryBudget::Heaps MemoryBudget::getHeaps()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return heaps;
+	}
+
+	std::pair<VkDeviceSize, VkDeviceSize> MemoryBudget::getWatermarks(const Cacher& cache, VkDeviceSize cache_usage)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		cache_usages[&cache] = cache_usage;
+
+		// Not initialized, no limit
+		if (heaps.budget == 0)
+		{
+			return { 0, 0 };
+		}
+
+		// Heap usage covers the other caches too. Without the extension it is unknown, and only what the other caches
+		// hold is subtracted, so all caches together stay under the budget
+		VkDeviceSize other_usage = 0;
+		if (heaps.from_extension)
+		{
+			other_usage = heaps.usage > cache_usage ? heaps.usage - cache_usage : 0;
+		}
+		else
+		{
+			for (auto& [other, usage] : cache_usages)
+			{
+				if (other != &cache)
+				{
+					other_usage += usage;
+				}
+			}
+		}
+
+		auto watermark = [this, other_usage](double fraction) {
+			VkDeviceSize limit = static_cast<VkDeviceSize>(heaps.budget * fraction);
+			return limit > other_usage ? limit - other_usage : 0;
+		};
+
+		// At least one byte, zero means unlimited to the caches
+		return { std::max<VkDeviceSize>(watermark(HIGH_WATERMARK), 1), std::max<VkDeviceSize>(watermark(LOW_WATERMARK), 1) };
+	}
+
+	void MemoryBudget::removeCache(const Cacher& cache)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cache_usages.erase(&cache);
+	}
+}
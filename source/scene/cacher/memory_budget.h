@@ -0,0 +1,61 @@
+#pragma once
+
+#include <VulkanDevice.h>
+
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+namespace chaf
+{
+	class Cacher;
+
+	// Device local memory budget and usage of this process, shared by all GPU caches.
+	// Uses VK_EXT_memory_budget if enabled, otherwise 80% of heap size with only the caches' own usage known
+	class MemoryBudget
+	{
+	public:
+		struct Heaps
+		{
+			// Sum over device local heaps
+			VkDeviceSize budget{ 0 };
+			VkDeviceSize usage{ 0 };
+			VkDeviceSize size{ 0 };
+			bool from_extension{ false };
+		};
+
+	public:
+		static MemoryBudget& get();
+
+		void initialize(VkInstance instance, vks::VulkanDevice& device, bool memory_budget_extension);
+
+		// Query heaps again if the last query is older than the update interval
+		void update(bool force = false);
+
+		Heaps getHeaps();
+
+		// Bytes given cache may hold at high and low watermark, given the bytes it holds now, which are remembered.
+		// Memory used by everything else, the other caches included, is subtracted first. Zero if there is no budget yet
+		std::pair<VkDeviceSize, VkDeviceSize> getWatermarks(const Cacher& cache, VkDeviceSize cache_usage);
+
+		// Forget the usage of a destroyed cache
+		void removeCache(const Cacher& cache);
+
+	private:
+		MemoryBudget() = default;
+
+	private:
+		VkPhysicalDevice physical_device{ VK_NULL_HANDLE };
+
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR vkGetPhysicalDeviceMemoryProperties2KHR{ nullptr };
+
+		std::mutex mutex;
+
+		Heaps heaps;
+
+		// Last usage each cache reported, what other caches hold without VK_EXT_memory_budget
+		std::unordered_map<const Cacher*, VkDeviceSize> cache_usages;
+
+		std::chrono::steady_clock::time_point last_update;
+	};
+}
@@ -0,0 +1,102 @@
+#include <scene/cacher/prefetcher.h>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+
+namespace chaf
+{
+	// Below these over the whole look ahead the camera counts as still
+	static constexpr float MIN_DISTANCE = 1e-2f;
+	static constexpr float MIN_ANGLE = 1e-3f;
+
+	void Prefetcher::setBounds(const std::vector<AABB>& bounds)
+	{
+		grid.build(bounds);
+		draw_stamps.assign(bounds.size(), 0);
+		stamp = 0;
+	}
+
+	void Prefetcher::update(const glm::mat4& view)
+	{
+		auto now = std::chrono::steady_clock::now();
+		samples.push_back({ view, glm::vec3(glm::inverse(view)[3]), now });
+
+		// One sample may be older than the history, so velocities always span it
+		while (samples.size() > 2 && std::chrono::duration<float>(now - samples[1].time).count() >= settings.history)
+		{
+			samples.pop_front();
+		}
+
+		auto& first = samples.front();
+		float dt = std::chrono::duration<float>(now - first.time).count();
+		if (samples.size() < 2 || dt <= 0.f)
+		{
+			velocity = glm::vec3(0.f);
+			angular_speed = 0.f;
+			return;
+		}
+
+		velocity = (samples.back().eye - first.eye) / dt;
+
+		// Eye space rotation from the first view to this one, of the same handedness even if views mirror
+		glm::quat rotation = glm::quat_cast(glm::mat3(view) * glm::inverse(glm::mat3(first.view)));
+		if (rotation.w < 0.f)
+		{
+			rotation = -rotation;
+		}
+		angular_speed = glm::angle(rotation) / dt;
+		angular_axis = glm::axis(rotation);
+	}
+
+	void Prefetcher::query(const glm::mat4& projection, const glm::mat4& view, std::vector<uint32_t>& draws)
+	{
+		if (samples.size() < 2 || draw_stamps.empty())
+		{
+			return;
+		}
+
+		if (glm::length(velocity) * settings.look_ahead < MIN_DISTANCE && angular_speed * settings.look_ahead < MIN_ANGLE)
+		{
+			return;
+		}
+
+		stamp++;
+
+		// Draws in view are requested anyway
+		candidates.clear();
+		grid.query(Frustum(projection * view), candidates);
+		for (uint32_t draw : candidates)
+		{
+			draw_stamps[draw] = stamp;
+		}
+
+		for (uint32_t step = 1; step <= settings.step_count; step++)
+		{
+			float t = settings.look_ahead * step / settings.step_count;
+
+			// Turns are capped at a quarter turn
+			float angle = std::min(angular_speed * t, glm::half_pi<float>());
+			glm::mat4 rotation = glm::mat4_cast(glm::angleAxis(angle, angular_axis));
+			glm::mat4 predicted = rotation * view * glm::translate(glm::mat4(1.f), -velocity * t);
+
+			candidates.clear();
+			grid.query(Frustum(projection * predicted), candidates);
+			for (uint32_t draw : candidates)
+			{
+				if (draw_stamps[draw] != stamp)
+				{
+					draw_stamps[draw] = stamp;
+					draws.push_back(draw);
+				}
+			}
+		}
+	}
+
+	float Prefetcher::getSpeed() const
+	{
+		return glm::length(velocity);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <scene/geometry/spatial_grid.h>
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace chaf
+{
+	// Extrapolates the camera from its recent views and finds what enters the view ahead of time. Linear and angular
+	// velocity are measured over a short history, the view is moved along them to a few look ahead times and draws
+	// inside those frusta but outside the current one are reported, nearest look ahead first
+	class Prefetcher
+	{
+	public:
+		struct Settings
+		{
+			// Farthest look ahead in seconds
+			float look_ahead{ 1.f };
+			// Frusta between now and look_ahead
+			uint32_t step_count{ 3 };
+			// Seconds of camera history velocities are measured over
+			float history{ 0.25f };
+		};
+
+	public:
+		// World bounds of every draw, indexed like the draws reported
+		void setBounds(const std::vector<AABB>& bounds);
+
+		// Record the view of this frame
+		void update(const glm::mat4& view);
+
+		// Append draws entering the view, none while the camera is still
+		void query(const glm::mat4& projection, const glm::mat4& view, std::vector<uint32_t>& draws);
+
+		// World units per second
+		float getSpeed() const;
+
+	public:
+		Settings settings;
+
+	private:
+		struct Sample
+		{
+			glm::mat4 view;
+			glm::vec3 eye;
+			std::chrono::steady_clock::time_point time;
+		};
+
+		SpatialGrid grid;
+
+		std::deque<Sample> samples;
+
+		glm::vec3 velocity{ 0.f };
+
+		// Eye space rotation per second
+		glm::vec3 angular_axis{ 0.f, 1.f, 0.f };
+		float angular_speed{ 0.f };
+
+		// Frame a draw was last reported or seen in, reported once per query
+		std::vector<uint32_t> draw_stamps;
+		uint32_t stamp{ 0 };
+
+		std::vector<uint32_t> candidates;
+	};
+}
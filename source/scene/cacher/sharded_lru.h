@@ -0,0 +1,224 @@
+#pragma once
+
+#include <scene/cacher/lru.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+
+namespace chaf
+{
+	// Mutex counting how often it was found locked, to measure contention of caches
+	class ContentionMutex
+	{
+	public:
+		void lock()
+		{
+			if (!mutex.try_lock())
+			{
+				contended.fetch_add(1, std::memory_order_relaxed);
+				mutex.lock();
+			}
+			acquired.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void unlock()
+		{
+			mutex.unlock();
+		}
+
+		bool try_lock()
+		{
+			if (!mutex.try_lock())
+			{
+				return false;
+			}
+			acquired.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		uint64_t getAcquired() const
+		{
+			return acquired.load(std::memory_order_relaxed);
+		}
+
+		uint64_t getContended() const
+		{
+			return contended.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::mutex mutex;
+
+		std::atomic<uint64_t> acquired{ 0 };
+
+		std::atomic<uint64_t> contended{ 0 };
+	};
+
+	// Lock striped LRU cache: keys are spread over independent LruCacher shards with their own lock,
+	// so render thread lookups and worker thread inserts only serialize when they hit the same shard.
+	// Lookups of trivially copyable entries take no lock at all, see LruCacher.
+	// Replacement policy runs per shard, which approximates a global one
+	template<class Key_Ty, class Val_Ty, size_t Shard_Count = 16, class Policy = LruPolicy, class Hash = std::hash<Key_Ty>>
+	class ShardedLruCacher
+	{
+	public:
+		using shard_type = LruCacher<Key_Ty, Val_Ty, ContentionMutex, Policy, Hash>;
+
+		struct Stats : shard_type::Stats
+		{
+			uint64_t lock_acquired{ 0 };
+			uint64_t lock_contended{ 0 };
+		};
+
+	public:
+		// Entry limits are split evenly over the shards
+		ShardedLruCacher(size_t max_size = 128, size_t elastic_size = 10, std::function<void(Val_Ty&)> release_func = [](Val_Ty&) {})
+		{
+			size_t shard_max_size = (max_size + Shard_Count - 1) / Shard_Count;
+			size_t shard_elastic_size = (elastic_size + Shard_Count - 1) / Shard_Count;
+			for (auto& shard : shards)
+			{
+				shard = std::make_unique<shard_type>(shard_max_size, shard_elastic_size, release_func);
+			}
+		}
+
+		size_t size() const
+		{
+			size_t count = 0;
+			for (auto& shard : shards)
+			{
+				count += shard->size();
+			}
+			return count;
+		}
+
+		size_t empty() const
+		{
+			return size() == 0;
+		}
+
+		void clear()
+		{
+			for (auto& shard : shards)
+			{
+				shard->clear();
+			}
+		}
+
+		void insert(const Key_Ty& key, std::unique_ptr<Val_Ty>&& value)
+		{
+			getShard(key).insert(key, std::move(value));
+		}
+
+		void insert(const Key_Ty& key, Val_Ty&& value)
+		{
+			getShard(key).insert(key, std::move(value));
+		}
+
+		bool try_get(const Key_Ty& key, Val_Ty& value)
+		{
+			return getShard(key).try_get(key, value);
+		}
+
+		bool peek(const Key_Ty& key, Val_Ty& value) const
+		{
+			return getShard(key).peek(key, value);
+		}
+
+		Val_Ty& get(const Key_Ty& key)
+		{
+			return getShard(key).get(key);
+		}
+
+		Val_Ty get_copy(const Key_Ty& key)
+		{
+			return getShard(key).get_copy(key);
+		}
+
+		bool remove(const Key_Ty& key)
+		{
+			return getShard(key).remove(key);
+		}
+
+		bool contain(const Key_Ty& key) const
+		{
+			return getShard(key).contain(key);
+		}
+
+		// Shard by shard, in policy order within a shard
+		void traverse(std::function<void(Val_Ty&)> func)
+		{
+			for (auto& shard : shards)
+			{
+				shard->traverse(func);
+			}
+		}
+
+		void setRelease(std::function<void(Val_Ty&)> func)
+		{
+			for (auto& shard : shards)
+			{
+				shard->setRelease(func);
+			}
+		}
+
+		void setCost(std::function<size_t(const Val_Ty&)> func)
+		{
+			for (auto& shard : shards)
+			{
+				shard->setCost(func);
+			}
+		}
+
+		// Budget is split evenly over the shards like the entry limits. Keys are spread uniformly by the hash,
+		// so shard costs stay close, while a shard that is empty now still gets room to fill
+		void setBudget(size_t high_watermark, size_t low_watermark)
+		{
+			size_t shard_high_watermark = (high_watermark + Shard_Count - 1) / Shard_Count;
+			size_t shard_low_watermark = (low_watermark + Shard_Count - 1) / Shard_Count;
+			for (auto& shard : shards)
+			{
+				shard->setBudget(shard_high_watermark, shard_low_watermark);
+			}
+		}
+
+		size_t getCost() const
+		{
+			size_t cost = 0;
+			for (auto& shard : shards)
+			{
+				cost += shard->getCost();
+			}
+			return cost;
+		}
+
+		Stats getStats() const
+		{
+			Stats stats;
+			for (auto& shard : shards)
+			{
+				auto shard_stats = shard->getStats();
+				stats.hit_count += shard_stats.hit_count;
+				stats.miss_count += shard_stats.miss_count;
+				stats.insert_count += shard_stats.insert_count;
+				stats.eviction_count += shard_stats.eviction_count;
+				stats.lock_acquired += shard->getLock().getAcquired();
+				stats.lock_contended += shard->getLock().getContended();
+			}
+			return stats;
+		}
+
+	private:
+		// Shards use the low bits of the hash for their own index, so the shard is picked from high mixed bits
+		shard_type& getShard(const Key_Ty& key) const
+		{
+			return *shards[(mixHash(static_cast<uint64_t>(hash(key))) >> 32) % Shard_Count];
+		}
+
+	private:
+		std::array<std::unique_ptr<shard_type>, Shard_Count> shards;
+
+		Hash hash;
+	};
+}
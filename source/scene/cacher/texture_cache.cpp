@@ -0,0 +1,518 @@
+#include <scene/cacher/texture_cache.h>
+#include <scene/components/astc.h>
+
+#include <vk_format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chaf
+{
+	static constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x58544843;
+
+	// Bump when cache file layout or decoding changes
+	static constexpr uint32_t TEXTURE_CACHE_VERSION = 2;
+
+	// Payload offset in cache files, a multiple of every texel block size
+	static constexpr uint64_t PAYLOAD_ALIGNMENT = 16;
+
+	static constexpr const char* INDEX_FILENAME = "index.txt";
+
+	static void hashContent(uint64_t& hash, const void* data, size_t size)
+	{
+		// FNV-1a
+		auto bytes = reinterpret_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	static std::vector<uint8_t> readFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open file: " + filename);
+		}
+
+		std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(data.data()), data.size());
+		return data;
+	}
+
+	// Read only view of a whole file, nullptr if it is missing or empty
+	static std::shared_ptr<const void> mapFile(const std::string& path, size_t& size)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return nullptr;
+		}
+
+		LARGE_INTEGER file_size{};
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+		{
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		}
+		CloseHandle(file);
+
+		if (!mapping)
+		{
+			return nullptr;
+		}
+
+		// View keeps the mapping alive
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if (!view)
+		{
+			return nullptr;
+		}
+
+		size = static_cast<size_t>(file_size.QuadPart);
+		return std::shared_ptr<const void>(view, [](const void* address) {
+			UnmapViewOfFile(address);
+			});
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return nullptr;
+		}
+
+		struct stat file_stat {};
+		void* view = MAP_FAILED;
+		if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		{
+			view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+
+		if (view == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		size = static_cast<size_t>(file_stat.st_size);
+		return std::shared_ptr<const void>(view, [size](const void* address) {
+			munmap(const_cast<void*>(address), size);
+			});
+#endif
+	}
+
+	TextureCache& TextureCache::get()
+	{
+		static TextureCache texture_cache;
+		return texture_cache;
+	}
+
+	void TextureCache::initialize(vks::VulkanDevice& device, const std::string& cache_directory, MipGeneration mip_generation)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			this->device = &device;
+			this->cache_directory = cache_directory;
+			this->mip_generation = mip_generation;
+
+			variant = 14695981039346656037ull;
+			hashContent(variant, &TEXTURE_CACHE_VERSION, sizeof(TEXTURE_CACHE_VERSION));
+			hashContent(variant, &device.features.textureCompressionASTC_LDR, sizeof(VkBool32));
+			hashContent(variant, &mip_generation, sizeof(mip_generation));
+		}
+
+		if (!cache_directory.empty())
+		{
+			std::error_code error;
+			std::filesystem::create_directories(cache_directory, error);
+
+			loadIndex();
+		}
+	}
+
+	void TextureCache::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		payloads.clear();
+
+		if (cache_directory.empty() || !index_dirty)
+		{
+			return;
+		}
+
+		auto path = (std::filesystem::path(cache_directory) / INDEX_FILENAME).string();
+		auto temp_path = path + ".tmp";
+		{
+			std::ofstream file(temp_path, std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Could not write texture cache index " << temp_path << std::endl;
+				return;
+			}
+
+			// Path last, it may contain spaces
+			for (auto& [filename, entry] : index)
+			{
+				file << std::hex << std::setw(16) << std::setfill('0') << entry.content_hash << std::dec << ' '
+					<< entry.size << ' ' << entry.write_time << ' ' << filename << '\n';
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temp_path, error);
+		}
+
+		index_dirty = false;
+	}
+
+	uint64_t TextureCache::getKey(const std::string& filename, bool srgb)
+	{
+		std::error_code error;
+		uint64_t size = std::filesystem::file_size(filename, error);
+		if (error)
+		{
+			throw std::runtime_error("Failed to open file: " + filename);
+		}
+		int64_t write_time = static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto it = index.find(filename);
+			if (it != index.end() && it->second.size == size && it->second.write_time == write_time)
+			{
+				return makeKey(it->second.content_hash, srgb);
+			}
+		}
+
+		auto data = readFile(filename);
+
+		uint64_t content_hash = 14695981039346656037ull;
+		hashContent(content_hash, data.data(), data.size());
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		index[filename] = { size, write_time, content_hash };
+		index_dirty = true;
+		stats.hash_count++;
+
+		return makeKey(content_hash, srgb);
+	}
+
+	std::shared_ptr<const TextureCache::Payload> TextureCache::load(const std::string& filename, bool srgb)
+	{
+		return load(getKey(filename, srgb), filename, srgb);
+	}
+
+	std::shared_ptr<const TextureCache::Payload> TextureCache::load(uint64_t key, const std::string& filename, bool srgb)
+	{
+		if (!device)
+		{
+			throw std::runtime_error("Texture cache is used before initialization");
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = payloads.find(key);
+			if (it != payloads.end())
+			{
+				if (auto payload = it->second.lock())
+				{
+					stats.memory_hit_count++;
+					return payload;
+				}
+				payloads.erase(it);
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		auto payload = loadFromDisk(key, srgb);
+		if (payload)
+		{
+			auto end = std::chrono::high_resolution_clock::now();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.disk_hit_count++;
+			stats.map_time += std::chrono::duration<double, std::milli>(end - start).count();
+			payloads[key] = payload;
+			return payload;
+		}
+
+		payload = decode(key, filename, readFile(filename), srgb);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		saveToDisk(*payload);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.decode_count++;
+		stats.decode_time += std::chrono::duration<double, std::milli>(end - start).count();
+		payloads[key] = payload;
+		return payload;
+	}
+
+	TextureCache::MipGeneration TextureCache::getMipGeneration() const
+	{
+		return mip_generation;
+	}
+
+	TextureCache::Stats TextureCache::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	uint64_t TextureCache::makeKey(uint64_t content_hash, bool srgb) const
+	{
+		uint64_t key = content_hash;
+		hashContent(key, &variant, sizeof(variant));
+		if (srgb)
+		{
+			// Levels of color and data filtered differently
+			hashContent(key, &srgb, sizeof(srgb));
+		}
+		return key;
+	}
+
+	bool TextureCache::blitsMipmaps(const Payload& payload) const
+	{
+		return mip_generation == MipGeneration::Gpu && payload.format == VK_FORMAT_R8G8B8A8_UNORM && payload.mipmaps.size() == 1 &&
+			(payload.extent.width > 1 || payload.extent.height > 1);
+	}
+
+	std::shared_ptr<const TextureCache::Payload> TextureCache::decode(uint64_t key, const std::string& filename, const std::vector<uint8_t>& raw_data, bool srgb)
+	{
+		std::shared_ptr<Image> image = Image::decode(filename, raw_data);
+		if (!image)
+		{
+			throw std::runtime_error("Unsupported image format: " + filename);
+		}
+
+		if (image->isAstc() && !image->checkFormatSupport(*device))
+		{
+			// Decoded to an sRGB format
+			auto start = std::chrono::high_resolution_clock::now();
+			image = std::make_shared<Astc>(*image);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.astc_decoded_bytes += image->getData().size();
+				stats.astc_decode_time += std::chrono::duration<double, std::milli>(end - start).count();
+			}
+
+			image->generateMipmap();
+		}
+		else if (image->getFormat() == VK_FORMAT_R8G8B8A8_UNORM && image->getMipMaps().size() == 1 &&
+			(image->getExtent().width > 1 || image->getExtent().height > 1) && mip_generation == MipGeneration::Cpu)
+		{
+			// Done once per content instead of on every load
+			auto start = std::chrono::high_resolution_clock::now();
+			image->generateMipmap(srgb);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.mipmap_time += std::chrono::duration<double, std::milli>(end - start).count();
+		}
+
+		auto payload = std::make_shared<Payload>();
+		payload->key = key;
+		payload->format = image->getFormat();
+		payload->extent = image->getExtent();
+		payload->mipmaps = image->getMipMaps();
+		payload->data = image->getData().data();
+		payload->size = image->getData().size();
+		payload->storage = image;
+		payload->srgb = srgb;
+		payload->blit_mipmaps = blitsMipmaps(*payload);
+		return payload;
+	}
+
+	std::shared_ptr<const TextureCache::Payload> TextureCache::loadFromDisk(uint64_t key, bool srgb)
+	{
+		if (cache_directory.empty())
+		{
+			return nullptr;
+		}
+
+		size_t size = 0;
+		auto view = mapFile(getCachePath(key), size);
+		if (!view || size < sizeof(FileHeader))
+		{
+			return nullptr;
+		}
+
+		auto bytes = static_cast<const uint8_t*>(view.get());
+
+		FileHeader header;
+		std::memcpy(&header, bytes, sizeof(header));
+		if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION || header.key != key || header.mip_count == 0 ||
+			header.data_offset < sizeof(FileHeader) + header.mip_count * sizeof(FileMip) || header.data_offset > size ||
+			header.data_size > size - header.data_offset)
+		{
+			return nullptr;
+		}
+
+		auto payload = std::make_shared<Payload>();
+		payload->key = key;
+		payload->format = static_cast<VkFormat>(header.format);
+		payload->extent = { header.width, header.height, header.depth };
+		payload->data = bytes + header.data_offset;
+		payload->size = static_cast<size_t>(header.data_size);
+
+		// Formats without a known block size can not be validated
+		VkFormatSize format_size{};
+		vkGetFormatSize(payload->format, &format_size);
+		if (format_size.blockSizeInBits == 0 || header.width == 0 || header.height == 0 || header.depth == 0)
+		{
+			return nullptr;
+		}
+
+		payload->mipmaps.resize(header.mip_count);
+		for (uint32_t i = 0; i < header.mip_count; i++)
+		{
+			FileMip mip;
+			std::memcpy(&mip, bytes + sizeof(FileHeader) + i * sizeof(FileMip), sizeof(mip));
+
+			// Extent must be what the level implies, and every byte the copy of it reads must lie inside the data
+			if (mip.level >= 32 ||
+				mip.width != std::max(header.width >> mip.level, 1u) ||
+				mip.height != std::max(header.height >> mip.level, 1u) ||
+				mip.depth != std::max(header.depth >> mip.level, 1u))
+			{
+				return nullptr;
+			}
+
+			uint64_t block_count = static_cast<uint64_t>((mip.width + format_size.blockWidth - 1) / format_size.blockWidth) *
+				((mip.height + format_size.blockHeight - 1) / format_size.blockHeight) *
+				((mip.depth + format_size.blockDepth - 1) / format_size.blockDepth);
+			uint64_t level_size = block_count * format_size.blockSizeInBits / 8;
+			if (static_cast<uint64_t>(mip.offset) + level_size > header.data_size)
+			{
+				return nullptr;
+			}
+
+			payload->mipmaps[i].level = mip.level;
+			payload->mipmaps[i].offset = mip.offset;
+			payload->mipmaps[i].extent = { mip.width, mip.height, mip.depth };
+		}
+
+		payload->storage = std::move(view);
+		payload->srgb = srgb;
+		payload->blit_mipmaps = blitsMipmaps(*payload);
+		return payload;
+	}
+
+	void TextureCache::saveToDisk(const Payload& payload)
+	{
+		if (cache_directory.empty())
+		{
+			return;
+		}
+
+		FileHeader header{};
+		header.magic = TEXTURE_CACHE_MAGIC;
+		header.version = TEXTURE_CACHE_VERSION;
+		header.key = payload.key;
+		header.format = static_cast<uint32_t>(payload.format);
+		header.width = payload.extent.width;
+		header.height = payload.extent.height;
+		header.depth = payload.extent.depth;
+		header.mip_count = static_cast<uint32_t>(payload.mipmaps.size());
+		header.data_offset = sizeof(FileHeader) + payload.mipmaps.size() * sizeof(FileMip);
+		header.data_offset = (header.data_offset + PAYLOAD_ALIGNMENT - 1) / PAYLOAD_ALIGNMENT * PAYLOAD_ALIGNMENT;
+		header.data_size = payload.size;
+
+		// Write to a temporary file first, a concurrent reader never maps a partial entry
+		std::string path = getCachePath(payload.key);
+		std::string temp_path = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Could not write texture cache " << temp_path << std::endl;
+				return;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (auto& mipmap : payload.mipmaps)
+			{
+				FileMip mip{ mipmap.level, mipmap.offset, mipmap.extent.width, mipmap.extent.height, mipmap.extent.depth };
+				file.write(reinterpret_cast<const char*>(&mip), sizeof(mip));
+			}
+
+			std::vector<char> padding(static_cast<size_t>(header.data_offset - sizeof(FileHeader) - payload.mipmaps.size() * sizeof(FileMip)), 0);
+			file.write(padding.data(), padding.size());
+			file.write(reinterpret_cast<const char*>(payload.data), payload.size);
+		}
+
+		// Fails while another process maps the entry on some platforms, which then keeps its equal copy
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temp_path, error);
+		}
+	}
+
+	void TextureCache::loadIndex()
+	{
+		std::ifstream file(std::filesystem::path(cache_directory) / INDEX_FILENAME);
+		if (!file.is_open())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream ss(line);
+			IndexEntry entry;
+			std::string filename;
+			if (!(ss >> std::hex >> entry.content_hash >> std::dec >> entry.size >> entry.write_time) || !std::getline(ss >> std::ws, filename))
+			{
+				continue;
+			}
+			index[filename] = entry;
+		}
+	}
+
+	std::string TextureCache::getCachePath(uint64_t key) const
+	{
+		std::stringstream ss;
+		ss << std::hex << std::setw(16) << std::setfill('0') << key << ".tex";
+		return (std::filesystem::path(cache_directory) / ss.str()).string();
+	}
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <scene/components/image.h>
+
+#include <VulkanDevice.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace chaf
+{
+	// Decoded, mip mapped images as uploaded, cached on disk by a hash of the source file content, so copies of an
+	// image under different names share one entry. Warm loads map the cache file instead of decoding. Content hashes
+	// are indexed by path, size and modification time of the source, so unchanged sources are not read to find them
+	class TextureCache
+	{
+	public:
+		// Where mip levels of RGBA8 sources are made
+		enum class MipGeneration
+		{
+			// Box filtered on load and cached with the payload
+			Cpu,
+			// Blitted from level 0 after upload
+			Gpu
+		};
+
+		struct Payload
+		{
+			uint64_t key{ 0 };
+			VkFormat format{ VK_FORMAT_UNDEFINED };
+			VkExtent3D extent{ 0, 0, 0 };
+			std::vector<Image::MipMap> mipmaps;
+			// All mip levels, offsets of mipmaps are relative to it
+			const uint8_t* data{ nullptr };
+			size_t size{ 0 };
+			// Mapped cache file or decoded image, which data points into
+			std::shared_ptr<const void> storage;
+			// Color data, mip levels are filtered in linear space
+			bool srgb{ false };
+			// Only level 0 is stored, the others are blitted after upload
+			bool blit_mipmaps{ false };
+		};
+
+		struct Stats
+		{
+			// Payload still alive from a load of the same content
+			uint32_t memory_hit_count{ 0 };
+			uint32_t disk_hit_count{ 0 };
+			uint32_t decode_count{ 0 };
+			// Sources whose content hash was not indexed
+			uint32_t hash_count{ 0 };
+			// ms spent in decoding and mip generation
+			double decode_time{ 0.0 };
+			// ms spent in mapping cache files
+			double map_time{ 0.0 };
+			// ms of decode_time spent in CPU mip generation
+			double mipmap_time{ 0.0 };
+			// RGBA8 bytes written by software decoding of unsupported ASTC, and ms of decode_time spent on it
+			uint64_t astc_decoded_bytes{ 0 };
+			double astc_decode_time{ 0.0 };
+
+			// MB per second of software ASTC decoding
+			double getAstcThroughput() const
+			{
+				return astc_decode_time <= 0.0 ? 0.0 : static_cast<double>(astc_decoded_bytes) / (1 << 20) / (astc_decode_time / 1000.0);
+			}
+		};
+
+	public:
+		static TextureCache& get();
+
+		// Without a cache directory payloads are decoded on every load
+		void initialize(vks::VulkanDevice& device, const std::string& cache_directory, MipGeneration mip_generation = MipGeneration::Cpu);
+
+		// Save the content hash index
+		void destroy();
+
+		// Identifies the payload of a source, equal for sources with equal content and use. Throws if the source can not
+		// be read
+		uint64_t getKey(const std::string& filename, bool srgb = false);
+
+		// Throws if the source can not be read or decoded. srgb marks color data. Any thread
+		std::shared_ptr<const Payload> load(const std::string& filename, bool srgb = false);
+
+		std::shared_ptr<const Payload> load(uint64_t key, const std::string& filename, bool srgb = false);
+
+		MipGeneration getMipGeneration() const;
+
+		Stats getStats();
+
+	private:
+		TextureCache() = default;
+
+		struct IndexEntry
+		{
+			uint64_t size;
+			int64_t write_time;
+			uint64_t content_hash;
+		};
+
+		// Header of cache file, followed by one FileMip per level and the payload at data_offset
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint32_t format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t depth;
+			uint32_t mip_count;
+			uint32_t reserved;
+			uint64_t data_offset;
+			uint64_t data_size;
+		};
+
+		struct FileMip
+		{
+			uint32_t level;
+			uint32_t offset;
+			uint32_t width;
+			uint32_t height;
+			uint32_t depth;
+		};
+
+		std::shared_ptr<const Payload> decode(uint64_t key, const std::string& filename, const std::vector<uint8_t>& raw_data, bool srgb);
+
+		std::shared_ptr<const Payload> loadFromDisk(uint64_t key, bool srgb);
+
+		uint64_t makeKey(uint64_t content_hash, bool srgb) const;
+
+		// Single level RGBA8 payloads get their mip levels on the GPU
+		bool blitsMipmaps(const Payload& payload) const;
+
+		void saveToDisk(const Payload& payload);
+
+		void loadIndex();
+
+		std::string getCachePath(uint64_t key) const;
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		std::string cache_directory;
+
+		// Mixed into every key, payloads of ASTC sources depend on device support and RGBA8 ones on mip generation
+		uint64_t variant{ 0 };
+
+		MipGeneration mip_generation{ MipGeneration::Cpu };
+
+		std::mutex mutex;
+
+		// Collapses loads of equal content while any of them is alive
+		std::unordered_map<uint64_t, std::weak_ptr<const Payload>> payloads;
+
+		std::unordered_map<std::string, IndexEntry> index;
+
+		bool index_dirty{ false };
+
+		Stats stats;
+	};
+}
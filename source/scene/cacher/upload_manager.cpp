@@ -0,0 +1,607 @@
+#include <scene/cacher/upload_manager.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace chaf
+{
+	// Larger uploads are split (buffers) or get their own staging buffer (images), so one upload
+	// never takes the whole ring and the transfer of one batch overlaps writing the next
+	static constexpr VkDeviceSize MAX_CHUNK_FRACTION = 4;
+
+	// Covers copy offset requirements of every format in use, compressed blocks are 16 bytes
+	static constexpr VkDeviceSize COPY_ALIGNMENT = 16;
+
+	UploadManager& UploadManager::get()
+	{
+		static UploadManager upload_manager;
+		return upload_manager;
+	}
+
+	void UploadManager::initialize(vks::VulkanDevice& device, VkQueue graphics_queue, VkDeviceSize ring_size)
+	{
+		this->device = &device;
+		this->graphics_queue = graphics_queue;
+		render_thread = std::this_thread::get_id();
+
+		// The framework only creates a transfer queue if a dedicated family exists, otherwise transfer equals graphics.
+		// A separate compute family can copy as well and is the next best thing
+		auto& indices = device.queueFamilyIndices;
+		if (indices.transfer != indices.graphics)
+		{
+			transfer_family = indices.transfer;
+		}
+		else if (indices.compute != indices.graphics)
+		{
+			transfer_family = indices.compute;
+		}
+		else
+		{
+			transfer_family = indices.graphics;
+		}
+
+		if (hasDedicatedQueue())
+		{
+			vkGetDeviceQueue(device.logicalDevice, transfer_family, 0, &transfer_queue);
+			graphics_command_pool = device.createCommandPool(indices.graphics);
+		}
+		else
+		{
+			transfer_queue = graphics_queue;
+		}
+		transfer_command_pool = device.createCommandPool(transfer_family);
+
+		VK_CHECK_RESULT(device.createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&ring,
+			ring_size));
+		VK_CHECK_RESULT(ring.map());
+
+		head = tail = used = 0;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats = {};
+		stats.ring_size = ring_size;
+		stats.dedicated_queue = hasDedicatedQueue();
+	}
+
+	void UploadManager::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+
+		flush();
+
+		for (auto& commands : free_commands)
+		{
+			vkFreeCommandBuffers(device->logicalDevice, transfer_command_pool, 1, &commands.transfer_cmd);
+			if (commands.graphics_cmd != VK_NULL_HANDLE)
+			{
+				vkFreeCommandBuffers(device->logicalDevice, graphics_command_pool, 1, &commands.graphics_cmd);
+			}
+			if (commands.semaphore != VK_NULL_HANDLE)
+			{
+				vkDestroySemaphore(device->logicalDevice, commands.semaphore, nullptr);
+			}
+			vkDestroyFence(device->logicalDevice, commands.fence, nullptr);
+		}
+		free_commands.clear();
+
+		vkDestroyCommandPool(device->logicalDevice, transfer_command_pool, nullptr);
+		if (graphics_command_pool != VK_NULL_HANDLE)
+		{
+			vkDestroyCommandPool(device->logicalDevice, graphics_command_pool, nullptr);
+		}
+		transfer_command_pool = graphics_command_pool = VK_NULL_HANDLE;
+
+		ring.unmap();
+		ring.destroy();
+
+		device = nullptr;
+	}
+
+	void UploadManager::uploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, Callback&& on_complete)
+	{
+		auto bytes = static_cast<const uint8_t*>(data);
+		VkDeviceSize max_chunk = ring.size / MAX_CHUNK_FRACTION;
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// Chunks may end up in different batches, the callback goes with the last one
+		for (VkDeviceSize offset = 0; offset < size;)
+		{
+			VkDeviceSize chunk = std::min(size - offset, max_chunk);
+			VkDeviceSize src_offset = allocate(lock, chunk, COPY_ALIGNMENT);
+
+			std::memcpy(static_cast<uint8_t*>(ring.mapped) + src_offset, bytes + offset, chunk);
+
+			BufferCopy copy{};
+			copy.dst = dst;
+			copy.region.srcOffset = src_offset;
+			copy.region.dstOffset = dst_offset + offset;
+			copy.region.size = chunk;
+			copy.dst_stage = dst_stage;
+			copy.dst_access = dst_access;
+			pending.buffer_copies.push_back(copy);
+
+			offset += chunk;
+		}
+
+		if (on_complete)
+		{
+			pending.callbacks.push_back(std::move(on_complete));
+		}
+
+		stats.uploaded_bytes += size;
+		stats.upload_count++;
+	}
+
+	void UploadManager::uploadImage(VkImage image, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions,
+		const VkImageSubresourceRange& subresource_range, VkImageLayout final_layout,
+		VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, Callback&& on_complete, bool blit_mipmaps)
+	{
+		ImageCopy copy{};
+		copy.image = image;
+		copy.regions = regions;
+		copy.subresource_range = subresource_range;
+		copy.final_layout = final_layout;
+		copy.dst_stage = dst_stage;
+		copy.dst_access = dst_access;
+		copy.blit_mipmaps = blit_mipmaps && subresource_range.levelCount > 1;
+
+		if (size > ring.size / MAX_CHUNK_FRACTION)
+		{
+			// Regions of one image can not be split across batches without tracking layouts, stage it on its own
+			vks::Buffer staging;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&staging,
+				size,
+				const_cast<void*>(data)));
+			copy.src = staging.buffer;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.dedicated_staging.push_back(staging);
+			pending.image_copies.push_back(std::move(copy));
+			if (on_complete)
+			{
+				pending.callbacks.push_back(std::move(on_complete));
+			}
+			stats.uploaded_bytes += size;
+			stats.upload_count++;
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		VkDeviceSize src_offset = allocate(lock, size, COPY_ALIGNMENT);
+		std::memcpy(static_cast<uint8_t*>(ring.mapped) + src_offset, data, size);
+
+		copy.src = ring.buffer;
+		for (auto& region : copy.regions)
+		{
+			region.bufferOffset += src_offset;
+		}
+
+		pending.image_copies.push_back(std::move(copy));
+		if (on_complete)
+		{
+			pending.callbacks.push_back(std::move(on_complete));
+		}
+
+		stats.uploaded_bytes += size;
+		stats.upload_count++;
+	}
+
+	void UploadManager::update()
+	{
+		finishBatches(false);
+		submitPending();
+	}
+
+	void UploadManager::flush()
+	{
+		submitPending();
+		finishBatches(true);
+	}
+
+	UploadManager::Stats UploadManager::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.ring_used = used;
+		return stats;
+	}
+
+	VkDeviceSize UploadManager::allocate(std::unique_lock<std::mutex>& lock, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		for (bool stalled = false;; stalled = true)
+		{
+			if (used == 0)
+			{
+				head = tail = 0;
+			}
+
+			VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+			VkDeviceSize end = 0;
+			bool fits = false;
+
+			if (head > tail || used == 0)
+			{
+				// Free space is [head, size) and [0, tail)
+				if (offset + size <= ring.size)
+				{
+					end = offset + size;
+					fits = true;
+				}
+				else if (size <= tail)
+				{
+					// Wrap around, the rest of the ring stays unused until this batch completes
+					offset = 0;
+					end = size;
+					fits = true;
+				}
+			}
+			else if (head < tail && offset + size <= tail)
+			{
+				end = offset + size;
+				fits = true;
+			}
+
+			if (fits)
+			{
+				VkDeviceSize bytes = end >= head ? end - head : ring.size - head + end;
+				used += bytes;
+				head = end;
+
+				pending.ring_bytes += bytes;
+				pending.ring_end = head;
+				return offset;
+			}
+
+			// Backpressure: the ring is full of copies queued or in flight
+			if (!stalled)
+			{
+				stats.stall_count++;
+			}
+			if (std::this_thread::get_id() == render_thread)
+			{
+				// Nobody else submits for the render thread
+				lock.unlock();
+				flush();
+				lock.lock();
+			}
+			else
+			{
+				space_available.wait(lock);
+			}
+		}
+	}
+
+	void UploadManager::submitPending()
+	{
+		Batch batch;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pending.empty())
+			{
+				return;
+			}
+			batch = std::move(pending);
+			pending = Batch{};
+		}
+
+		submit(std::move(batch));
+	}
+
+	void UploadManager::submit(Batch&& batch)
+	{
+		bool dedicated = hasDedicatedQueue();
+
+		Commands commands{};
+		if (!free_commands.empty())
+		{
+			commands = free_commands.back();
+			free_commands.pop_back();
+		}
+		else
+		{
+			commands.transfer_cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, transfer_command_pool, false);
+			if (dedicated)
+			{
+				commands.graphics_cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, graphics_command_pool, false);
+				VkSemaphoreCreateInfo semaphore_create_info = vks::initializers::semaphoreCreateInfo();
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphore_create_info, nullptr, &commands.semaphore));
+			}
+			VkFenceCreateInfo fence_create_info = vks::initializers::fenceCreateInfo();
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fence_create_info, nullptr, &commands.fence));
+		}
+
+		VkCommandBufferBeginInfo begin_info = vks::initializers::commandBufferBeginInfo();
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		// Transfer: undefined -> transfer dst, copy, then release to graphics or make visible directly
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commands.transfer_cmd, &begin_info));
+
+		if (!batch.image_copies.empty())
+		{
+			std::vector<VkImageMemoryBarrier> barriers;
+			for (auto& copy : batch.image_copies)
+			{
+				VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.image = copy.image;
+				barrier.subresourceRange = copy.subresource_range;
+				barriers.push_back(barrier);
+			}
+			vkCmdPipelineBarrier(commands.transfer_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+		}
+
+		for (auto& copy : batch.buffer_copies)
+		{
+			VkBuffer src = ring.buffer;
+			vkCmdCopyBuffer(commands.transfer_cmd, src, copy.dst, 1, &copy.region);
+		}
+
+		for (auto& copy : batch.image_copies)
+		{
+			vkCmdCopyBufferToImage(commands.transfer_cmd, copy.src, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(copy.regions.size()), copy.regions.data());
+		}
+
+		// Same barriers release on the transfer queue and acquire on the graphics queue, only access masks differ
+		std::vector<VkBufferMemoryBarrier> buffer_barriers;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		VkPipelineStageFlags dst_stage = 0;
+
+		for (auto& copy : batch.buffer_copies)
+		{
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = copy.dst_access;
+			barrier.srcQueueFamilyIndex = dedicated ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = dedicated ? device->queueFamilyIndices.graphics : VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = copy.dst;
+			barrier.offset = copy.region.dstOffset;
+			barrier.size = copy.region.size;
+			buffer_barriers.push_back(barrier);
+			dst_stage |= copy.dst_stage;
+		}
+
+		uint32_t blit_count = 0;
+		for (auto& copy : batch.image_copies)
+		{
+			VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = copy.dst_access;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = copy.final_layout;
+			if (copy.blit_mipmaps)
+			{
+				// Mip levels are blitted first, they reach the final layout afterwards
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				blit_count++;
+			}
+			barrier.srcQueueFamilyIndex = dedicated ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = dedicated ? device->queueFamilyIndices.graphics : VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = copy.image;
+			barrier.subresourceRange = copy.subresource_range;
+			image_barriers.push_back(barrier);
+			dst_stage |= copy.blit_mipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : copy.dst_stage;
+		}
+
+		bool has_barriers = !buffer_barriers.empty() || !image_barriers.empty();
+
+		if (has_barriers && !dedicated)
+		{
+			vkCmdPipelineBarrier(commands.transfer_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr,
+				static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+				static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+
+			// Transfer queue is the graphics queue here
+			for (auto& copy : batch.image_copies)
+			{
+				if (copy.blit_mipmaps)
+				{
+					recordMipmapBlits(commands.transfer_cmd, copy);
+				}
+			}
+		}
+		else if (has_barriers)
+		{
+			// Release, destination access is ignored here
+			auto release_buffer_barriers = buffer_barriers;
+			auto release_image_barriers = image_barriers;
+			for (auto& barrier : release_buffer_barriers)
+			{
+				barrier.dstAccessMask = 0;
+			}
+			for (auto& barrier : release_image_barriers)
+			{
+				barrier.dstAccessMask = 0;
+			}
+			vkCmdPipelineBarrier(commands.transfer_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+				static_cast<uint32_t>(release_buffer_barriers.size()), release_buffer_barriers.data(),
+				static_cast<uint32_t>(release_image_barriers.size()), release_image_barriers.data());
+		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commands.transfer_cmd));
+
+		VkSubmitInfo submit_info = vks::initializers::submitInfo();
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &commands.transfer_cmd;
+
+		if (!dedicated)
+		{
+			VK_CHECK_RESULT(vkQueueSubmit(transfer_queue, 1, &submit_info, commands.fence));
+		}
+		else
+		{
+			submit_info.signalSemaphoreCount = 1;
+			submit_info.pSignalSemaphores = &commands.semaphore;
+			VK_CHECK_RESULT(vkQueueSubmit(transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+			// Acquire, source access is ignored here
+			for (auto& barrier : buffer_barriers)
+			{
+				barrier.srcAccessMask = 0;
+			}
+			for (auto& barrier : image_barriers)
+			{
+				barrier.srcAccessMask = 0;
+			}
+
+			VK_CHECK_RESULT(vkBeginCommandBuffer(commands.graphics_cmd, &begin_info));
+			if (has_barriers)
+			{
+				vkCmdPipelineBarrier(commands.graphics_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0, 0, nullptr,
+					static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+					static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+			}
+			for (auto& copy : batch.image_copies)
+			{
+				if (copy.blit_mipmaps)
+				{
+					recordMipmapBlits(commands.graphics_cmd, copy);
+				}
+			}
+			VK_CHECK_RESULT(vkEndCommandBuffer(commands.graphics_cmd));
+
+			VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkSubmitInfo acquire_submit_info = vks::initializers::submitInfo();
+			acquire_submit_info.waitSemaphoreCount = 1;
+			acquire_submit_info.pWaitSemaphores = &commands.semaphore;
+			acquire_submit_info.pWaitDstStageMask = &wait_stage;
+			acquire_submit_info.commandBufferCount = 1;
+			acquire_submit_info.pCommandBuffers = &commands.graphics_cmd;
+			VK_CHECK_RESULT(vkQueueSubmit(graphics_queue, 1, &acquire_submit_info, commands.fence));
+		}
+
+		batch.commands = commands;
+		in_flight.push_back(std::move(batch));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.batch_count++;
+		stats.batches_in_flight = static_cast<uint32_t>(in_flight.size());
+		stats.mipmap_blit_count += blit_count;
+	}
+
+	void UploadManager::recordMipmapBlits(VkCommandBuffer cmd, const ImageCopy& copy)
+	{
+		auto& range = copy.subresource_range;
+		VkExtent3D extent = copy.regions.front().imageExtent;
+
+		VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+		barrier.image = copy.image;
+		barrier.subresourceRange = range;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		uint32_t last_level = range.baseMipLevel + range.levelCount - 1;
+		for (uint32_t level = range.baseMipLevel + 1; level <= last_level; level++)
+		{
+			// Level before is written, it becomes the source
+			barrier.subresourceRange.baseMipLevel = level - 1;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			VkImageBlit blit{};
+			blit.srcSubresource = { range.aspectMask, level - 1, range.baseArrayLayer, range.layerCount };
+			blit.srcOffsets[1] = { static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1 };
+
+			extent.width = std::max(1u, extent.width / 2);
+			extent.height = std::max(1u, extent.height / 2);
+
+			blit.dstSubresource = { range.aspectMask, level, range.baseArrayLayer, range.layerCount };
+			blit.dstOffsets[1] = { static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1 };
+
+			vkCmdBlitImage(cmd, copy.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+		}
+
+		// Sources read, last level written
+		std::array<VkImageMemoryBarrier, 2> barriers{ barrier, barrier };
+		barriers[0].subresourceRange.baseMipLevel = range.baseMipLevel;
+		barriers[0].subresourceRange.levelCount = range.levelCount - 1;
+		barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[0].dstAccessMask = copy.dst_access;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].newLayout = copy.final_layout;
+
+		barriers[1].subresourceRange.baseMipLevel = last_level;
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].dstAccessMask = copy.dst_access;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].newLayout = copy.final_layout;
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, copy.dst_stage, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	bool UploadManager::finishBatches(bool wait)
+	{
+		bool finished = false;
+
+		while (!in_flight.empty())
+		{
+			VkFence fence = in_flight.front().commands.fence;
+			if (wait)
+			{
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+			}
+			else if (vkGetFenceStatus(device->logicalDevice, fence) != VK_SUCCESS)
+			{
+				break;
+			}
+
+			// Taken out of the queue before callbacks run, they may re-enter through a flush when the ring is full
+			Batch batch;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				batch = std::move(in_flight.front());
+				in_flight.pop_front();
+				if (batch.ring_bytes > 0)
+				{
+					used -= batch.ring_bytes;
+					tail = batch.ring_end;
+				}
+				stats.batches_in_flight = static_cast<uint32_t>(in_flight.size());
+			}
+			space_available.notify_all();
+
+			for (auto& staging : batch.dedicated_staging)
+			{
+				staging.destroy();
+			}
+
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &batch.commands.fence));
+			free_commands.push_back(batch.commands);
+
+			// Callbacks may queue new uploads, no lock held
+			for (auto& callback : batch.callbacks)
+			{
+				callback();
+			}
+
+			finished = true;
+		}
+
+		return finished;
+	}
+
+	bool UploadManager::hasDedicatedQueue() const
+	{
+		return transfer_family != device->queueFamilyIndices.graphics;
+	}
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <VulkanDevice.h>
+#include <VulkanBuffer.h>
+#include <VulkanTools.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chaf
+{
+	// Streams data to device local buffers and images through a persistently mapped staging ring.
+	// Any thread may queue uploads, the data is copied into the ring right away and the caller only waits
+	// if the ring is full. Queued copies are recorded and submitted in one batch by update() on the render
+	// thread, which also submits to the graphics queue, so queues are never accessed concurrently.
+	// Copies run on a dedicated transfer (or async compute) queue family if there is one, resources are
+	// then released to the graphics queue family and acquired there
+	class UploadManager
+	{
+	public:
+		// Runs on the render thread in update() once the upload is visible to the graphics queue
+		using Callback = std::function<void()>;
+
+		struct Stats
+		{
+			uint64_t uploaded_bytes{ 0 };
+			uint64_t upload_count{ 0 };
+			uint64_t batch_count{ 0 };
+			// Times a caller waited for ring space
+			uint64_t stall_count{ 0 };
+			// Images whose mip levels were blitted after upload
+			uint64_t mipmap_blit_count{ 0 };
+			VkDeviceSize ring_size{ 0 };
+			VkDeviceSize ring_used{ 0 };
+			uint32_t batches_in_flight{ 0 };
+			bool dedicated_queue{ false };
+		};
+
+	public:
+		static UploadManager& get();
+
+		void initialize(vks::VulkanDevice& device, VkQueue graphics_queue, VkDeviceSize ring_size);
+
+		// Submit and wait for everything queued, then release resources
+		void destroy();
+
+		// Copy data to dst at dst_offset, dst must have been created with TRANSFER_DST usage.
+		// dst_stage and dst_access are the first use on the graphics queue
+		void uploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size,
+			VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, Callback&& on_complete = {});
+
+		// Copy data to all regions of image, buffer offsets of the regions are relative to data.
+		// Image is transitioned from undefined layout to final_layout. With blit_mipmaps the regions fill the first
+		// level of subresource_range and the others are blitted from it on the graphics queue, which needs TRANSFER_SRC
+		// usage and linear blit filtering of the format
+		void uploadImage(VkImage image, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions,
+			const VkImageSubresourceRange& subresource_range, VkImageLayout final_layout,
+			VkPipelineStageFlags dst_stage, VkAccessFlags dst_access, Callback&& on_complete = {}, bool blit_mipmaps = false);
+
+		// Render thread, once per frame before graphics submission: finish completed batches and submit queued copies
+		void update();
+
+		// Render thread: submit queued copies and wait until all are complete, for loading outside the frame loop
+		void flush();
+
+		Stats getStats();
+
+	private:
+		struct BufferCopy
+		{
+			VkBuffer dst;
+			VkBufferCopy region;
+			VkPipelineStageFlags dst_stage;
+			VkAccessFlags dst_access;
+		};
+
+		struct ImageCopy
+		{
+			VkImage image;
+			VkBuffer src;
+			std::vector<VkBufferImageCopy> regions;
+			VkImageSubresourceRange subresource_range;
+			VkImageLayout final_layout;
+			VkPipelineStageFlags dst_stage;
+			VkAccessFlags dst_access;
+			bool blit_mipmaps;
+		};
+
+		// Recycled once a batch completes
+		struct Commands
+		{
+			VkCommandBuffer transfer_cmd{ VK_NULL_HANDLE };
+			// Acquires ownership on the graphics queue, only with a dedicated queue
+			VkCommandBuffer graphics_cmd{ VK_NULL_HANDLE };
+			VkSemaphore semaphore{ VK_NULL_HANDLE };
+			VkFence fence{ VK_NULL_HANDLE };
+		};
+
+		struct Batch
+		{
+			Commands commands;
+
+			std::vector<BufferCopy> buffer_copies;
+			std::vector<ImageCopy> image_copies;
+			std::vector<Callback> callbacks;
+
+			// Staging buffers of uploads too large for the ring, destroyed on completion
+			std::vector<vks::Buffer> dedicated_staging;
+
+			// Ring space taken by this batch, freed up to ring_end on completion
+			VkDeviceSize ring_bytes{ 0 };
+			VkDeviceSize ring_end{ 0 };
+
+			bool empty() const
+			{
+				return buffer_copies.empty() && image_copies.empty() && callbacks.empty() && dedicated_staging.empty();
+			}
+		};
+
+	private:
+		UploadManager() = default;
+
+		// Offset of size bytes in the ring, waits for completed batches if it is full. Called with mutex locked
+		VkDeviceSize allocate(std::unique_lock<std::mutex>& lock, VkDeviceSize size, VkDeviceSize alignment);
+
+		// Render thread only
+		void submitPending();
+
+		void submit(Batch&& batch);
+
+		// Blit every level from the one before and transition all to the final layout. Graphics queue only
+		void recordMipmapBlits(VkCommandBuffer cmd, const ImageCopy& copy);
+
+		// Returns true if any batch was finished
+		bool finishBatches(bool wait);
+
+		bool hasDedicatedQueue() const;
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		VkQueue graphics_queue{ VK_NULL_HANDLE };
+
+		VkQueue transfer_queue{ VK_NULL_HANDLE };
+
+		uint32_t transfer_family{ 0 };
+
+		VkCommandPool transfer_command_pool{ VK_NULL_HANDLE };
+
+		VkCommandPool graphics_command_pool{ VK_NULL_HANDLE };
+
+		vks::Buffer ring;
+
+		// Ring offsets: allocations are made at head and freed from tail in submission order
+		VkDeviceSize head{ 0 };
+		VkDeviceSize tail{ 0 };
+		VkDeviceSize used{ 0 };
+
+		std::mutex mutex;
+
+		std::condition_variable space_available;
+
+		// Copies queued since last submission
+		Batch pending;
+
+		std::deque<Batch> in_flight;
+
+		std::vector<Commands> free_commands;
+
+		// Uploads from this thread submit by themselves instead of waiting for ring space
+		std::thread::id render_thread;
+
+		Stats stats;
+	};
+}
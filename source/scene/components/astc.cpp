@@ -10,10 +10,754 @@
 #define NO_STB_IMAGE_IMPLEMENTATION
 #include <astc_codec_internals.h>
 
+#include <core/job_system.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
 #include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ASTC_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace chaf
 {
+	// Bytes of one compressed block
+	static constexpr size_t BLOCK_SIZE = 16;
+
+	// Decoded texels per job
+	static constexpr uint32_t TEXELS_PER_JOB = 16384;
+
+	// Float RGBA of a decoded LDR texel to RGBA8, rounded like the codec writes images
+	static inline void storeTexel(const float* rgba, uint8_t* dst)
+	{
+#ifdef ASTC_SSE2
+		__m128i texel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(rgba), _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+		texel = _mm_packs_epi32(texel, texel);
+		texel = _mm_packus_epi16(texel, texel);
+		uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(texel));
+		std::memcpy(dst, &packed, sizeof(packed));
+#else
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			dst[c] = static_cast<uint8_t>(std::min(255.f, std::max(0.f, std::floor(rgba[c] * 255.f + 0.5f))));
+		}
+#endif
+	}
+
+	// Block inside the image of a common 2D size, fixed loops the compiler unrolls
+	template <uint32_t XDIM, uint32_t YDIM>
+	static void writeBlock(const imageblock& block, uint8_t* dst, size_t row_pitch)
+	{
+		for (uint32_t y = 0; y < YDIM; y++)
+		{
+			for (uint32_t x = 0; x < XDIM; x++)
+			{
+				storeTexel(block.orig_data + (y * XDIM + x) * 4, dst + y * row_pitch + x * 4);
+			}
+		}
+	}
+
+	// Any block, texels outside the image are dropped
+	static void writeBlock(const imageblock& block, const Astc::BlockDim& block_dim, uint32_t columns, uint32_t rows, uint32_t slices,
+		uint8_t* dst, size_t row_pitch, size_t slice_pitch)
+	{
+		for (uint32_t z = 0; z < slices; z++)
+		{
+			for (uint32_t y = 0; y < rows; y++)
+			{
+				for (uint32_t x = 0; x < columns; x++)
+				{
+					storeTexel(block.orig_data + ((z * block_dim.y + y) * block_dim.x + x) * 4, dst + z * slice_pitch + y * row_pitch + x * 4);
+				}
+			}
+		}
+	}
+
+	// Integer sequence encoding of each quantization level, levels 0 to 11 may hold weights, 4 to 20 colors
+	struct IseLevel
+	{
+		uint32_t count;
+		uint8_t bits;
+		uint8_t trits;
+		uint8_t quints;
+	};
+
+	static constexpr uint32_t ISE_LEVEL_COUNT = 21;
+
+	static constexpr IseLevel ISE_LEVELS[ISE_LEVEL_COUNT] = {
+		{ 2, 1, 0, 0 }, { 3, 0, 1, 0 }, { 4, 2, 0, 0 }, { 5, 0, 0, 1 }, { 6, 1, 1, 0 }, { 8, 3, 0, 0 }, { 10, 1, 0, 1 },
+		{ 12, 2, 1, 0 }, { 16, 4, 0, 0 }, { 20, 2, 0, 1 }, { 24, 3, 1, 0 }, { 32, 5, 0, 0 }, { 40, 3, 0, 1 }, { 48, 4, 1, 0 },
+		{ 64, 6, 0, 0 }, { 80, 4, 0, 1 }, { 96, 5, 1, 0 }, { 128, 7, 0, 0 }, { 160, 5, 0, 1 }, { 192, 6, 1, 0 }, { 256, 8, 0, 0 }
+	};
+
+	// Lowest level colors may use, a block needing less is an error block
+	static constexpr uint32_t MIN_COLOR_LEVEL = 4;
+
+	// Weight grid limits of a legal block
+	static constexpr uint32_t MAX_WEIGHTS = 64;
+	static constexpr uint32_t MIN_WEIGHT_BITS = 24;
+	static constexpr uint32_t MAX_WEIGHT_BITS = 96;
+
+	static constexpr uint32_t MAX_BLOCK_DIM = 12;
+
+	// Filled by Astc::init. Five trits packed in 8 bits and three quints in 7 bits, unpacked
+	static uint8_t trit_values[256][5];
+	static uint8_t quint_values[128][3];
+
+	// Quantized value to 0..255 for colors, to 0..64 for weights
+	static uint8_t color_unquantized[ISE_LEVEL_COUNT][256];
+	static uint8_t weight_unquantized[12][32];
+
+	static uint32_t getIseBitCount(uint32_t count, uint32_t level)
+	{
+		const auto& ise = ISE_LEVELS[level];
+		return count * ise.bits + (ise.trits ? (8 * count + 4) / 5 : 0) + (ise.quints ? (7 * count + 2) / 3 : 0);
+	}
+
+	static uint32_t replicateBits(uint32_t value, uint32_t from, uint32_t to)
+	{
+		uint32_t result = 0;
+		for (int32_t shift = static_cast<int32_t>(to) - static_cast<int32_t>(from); shift > -static_cast<int32_t>(from); shift -= from)
+		{
+			result |= shift >= 0 ? value << shift : value >> -shift;
+		}
+		return result & ((1u << to) - 1);
+	}
+
+	static void buildIseTables()
+	{
+		auto bit = [](uint32_t value, uint32_t index) { return (value >> index) & 1; };
+
+		for (uint32_t t = 0; t < 256; t++)
+		{
+			uint32_t c;
+			auto& trits = trit_values[t];
+			if (((t >> 2) & 7) == 7)
+			{
+				c = ((t >> 5) & 7) << 2 | (t & 3);
+				trits[4] = 2;
+				trits[3] = 2;
+			}
+			else
+			{
+				c = t & 0x1F;
+				if (((t >> 5) & 3) == 3)
+				{
+					trits[4] = 2;
+					trits[3] = static_cast<uint8_t>(bit(t, 7));
+				}
+				else
+				{
+					trits[4] = static_cast<uint8_t>(bit(t, 7));
+					trits[3] = static_cast<uint8_t>((t >> 5) & 3);
+				}
+			}
+
+			if ((c & 3) == 3)
+			{
+				trits[2] = 2;
+				trits[1] = static_cast<uint8_t>(bit(c, 4));
+				trits[0] = static_cast<uint8_t>(bit(c, 3) << 1 | (bit(c, 2) & ~bit(c, 3) & 1));
+			}
+			else if (((c >> 2) & 3) == 3)
+			{
+				trits[2] = 2;
+				trits[1] = 2;
+				trits[0] = static_cast<uint8_t>(c & 3);
+			}
+			else
+			{
+				trits[2] = static_cast<uint8_t>(bit(c, 4));
+				trits[1] = static_cast<uint8_t>((c >> 2) & 3);
+				trits[0] = static_cast<uint8_t>(bit(c, 1) << 1 | (bit(c, 0) & ~bit(c, 1) & 1));
+			}
+		}
+
+		for (uint32_t q = 0; q < 128; q++)
+		{
+			auto& quints = quint_values[q];
+			if (((q >> 1) & 3) == 3 && ((q >> 5) & 3) == 0)
+			{
+				quints[2] = static_cast<uint8_t>(bit(q, 0) << 2 | (bit(q, 4) & ~bit(q, 0) & 1) << 1 | (bit(q, 3) & ~bit(q, 0) & 1));
+				quints[1] = 4;
+				quints[0] = 4;
+				continue;
+			}
+
+			uint32_t c;
+			if (((q >> 1) & 3) == 3)
+			{
+				quints[2] = 4;
+				c = ((q >> 3) & 3) << 3 | (~(q >> 5) & 3) << 1 | bit(q, 0);
+			}
+			else
+			{
+				quints[2] = static_cast<uint8_t>((q >> 5) & 3);
+				c = q & 0x1F;
+			}
+
+			if ((c & 7) == 5)
+			{
+				quints[1] = 4;
+				quints[0] = static_cast<uint8_t>((c >> 3) & 3);
+			}
+			else
+			{
+				quints[1] = static_cast<uint8_t>((c >> 3) & 3);
+				quints[0] = static_cast<uint8_t>(c & 7);
+			}
+		}
+
+		// Trits and quints scale the high bits by C and spread the low bits as B, then the lowest bit inverts
+		for (uint32_t level = 0; level < ISE_LEVEL_COUNT; level++)
+		{
+			const auto& ise = ISE_LEVELS[level];
+			for (uint32_t value = 0; value < ise.count; value++)
+			{
+				uint32_t m = value & ((1u << ise.bits) - 1);
+				uint32_t d = value >> ise.bits;
+				if (!ise.trits && !ise.quints)
+				{
+					color_unquantized[level][value] = static_cast<uint8_t>(replicateBits(value, ise.bits, 8));
+					continue;
+				}
+
+				uint32_t a = (m & 1) ? 0x1FF : 0;
+				uint32_t b = 0, c = 0;
+				uint32_t b1 = bit(m, 1), b2 = bit(m, 2), b3 = bit(m, 3), b4 = bit(m, 4), b5 = bit(m, 5);
+				if (ise.trits)
+				{
+					switch (ise.bits)
+					{
+					case 1: c = 204; break;
+					case 2: c = 93; b = b1 << 8 | b1 << 4 | b1 << 2 | b1 << 1; break;
+					case 3: c = 44; b = b2 << 8 | b1 << 7 | b2 << 3 | b1 << 2 | b2 << 1 | b1; break;
+					case 4: c = 22; b = b3 << 8 | b2 << 7 | b1 << 6 | b3 << 2 | b2 << 1 | b1; break;
+					case 5: c = 11; b = b4 << 8 | b3 << 7 | b2 << 6 | b1 << 5 | b4; break;
+					case 6: c = 5; b = b5 << 8 | b4 << 7 | b3 << 6 | b2 << 5 | b1 << 4 | b5; break;
+					}
+				}
+				else
+				{
+					switch (ise.bits)
+					{
+					case 1: c = 113; break;
+					case 2: c = 54; b = b1 << 8 | b1 << 3 | b1 << 2; break;
+					case 3: c = 26; b = b2 << 8 | b1 << 7 | b2 << 2 | b1 << 1 | b2; break;
+					case 4: c = 13; b = b3 << 8 | b2 << 7 | b1 << 6 | b3 << 1 | b2; break;
+					case 5: c = 6; b = b4 << 8 | b3 << 7 | b2 << 6 | b1 << 5 | b4; break;
+					}
+				}
+
+				uint32_t t = (d * c + b) ^ a;
+				color_unquantized[level][value] = static_cast<uint8_t>((a & 0x80) | (t >> 2));
+			}
+		}
+
+		for (uint32_t level = 0; level < 12; level++)
+		{
+			const auto& ise = ISE_LEVELS[level];
+			for (uint32_t value = 0; value < ise.count; value++)
+			{
+				uint32_t m = value & ((1u << ise.bits) - 1);
+				uint32_t d = value >> ise.bits;
+				uint32_t result;
+				if (!ise.trits && !ise.quints)
+				{
+					result = replicateBits(value, ise.bits, 6);
+				}
+				else if (ise.bits == 0)
+				{
+					static constexpr uint8_t TRITS[3] = { 0, 32, 63 };
+					static constexpr uint8_t QUINTS[5] = { 0, 16, 32, 47, 63 };
+					result = ise.trits ? TRITS[d] : QUINTS[d];
+				}
+				else
+				{
+					uint32_t a = (m & 1) ? 0x7F : 0;
+					uint32_t b = 0, c = 0;
+					uint32_t b1 = bit(m, 1), b2 = bit(m, 2);
+					if (ise.trits)
+					{
+						switch (ise.bits)
+						{
+						case 1: c = 50; break;
+						case 2: c = 23; b = b1 << 6 | b1 << 2 | b1; break;
+						case 3: c = 11; b = b2 << 6 | b1 << 5 | b2 << 1 | b1; break;
+						}
+					}
+					else
+					{
+						switch (ise.bits)
+						{
+						case 1: c = 28; break;
+						case 2: c = 13; b = b1 << 6 | b1 << 1; break;
+						}
+					}
+
+					uint32_t t = (d * c + b) ^ a;
+					result = (a & 0x20) | (t >> 2);
+				}
+
+				// 0..63 to 0..64
+				weight_unquantized[level][value] = static_cast<uint8_t>(result > 32 ? result + 1 : result);
+			}
+		}
+	}
+
+	// Bits [start, start + count) of a little endian 128 bit block, bits at or past end read as zero
+	static inline uint32_t readBits(const uint64_t* block, uint32_t start, uint32_t count, uint32_t end)
+	{
+		if (start >= end || count == 0)
+		{
+			return 0;
+		}
+		count = std::min(count, end - start);
+
+		uint64_t value;
+		if (start >= 64)
+		{
+			value = block[1] >> (start - 64);
+		}
+		else
+		{
+			value = block[0] >> start;
+			if (start > 0)
+			{
+				value |= block[1] << (64 - start);
+			}
+		}
+		return static_cast<uint32_t>(value & ((1ull << count) - 1));
+	}
+
+	static inline uint64_t reverseBits(uint64_t value)
+	{
+		value = ((value >> 1) & 0x5555555555555555ull) | ((value & 0x5555555555555555ull) << 1);
+		value = ((value >> 2) & 0x3333333333333333ull) | ((value & 0x3333333333333333ull) << 2);
+		value = ((value >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((value & 0x0F0F0F0F0F0F0F0Full) << 4);
+		value = ((value >> 8) & 0x00FF00FF00FF00FFull) | ((value & 0x00FF00FF00FF00FFull) << 8);
+		value = ((value >> 16) & 0x0000FFFF0000FFFFull) | ((value & 0x0000FFFF0000FFFFull) << 16);
+		return (value >> 32) | (value << 32);
+	}
+
+	// count values of level, starting at bit offset
+	static void decodeIse(const uint64_t* block, uint32_t offset, uint32_t count, uint32_t level, uint8_t* values)
+	{
+		const auto& ise = ISE_LEVELS[level];
+		uint32_t end = offset + getIseBitCount(count, level);
+
+		if (ise.trits)
+		{
+			static constexpr uint32_t T_BITS[5] = { 2, 2, 1, 2, 1 };
+			for (uint32_t i = 0; i < count; i += 5)
+			{
+				uint32_t m[5];
+				uint32_t t = 0;
+				for (uint32_t j = 0, shift = 0; j < 5; shift += T_BITS[j], j++)
+				{
+					m[j] = readBits(block, offset, ise.bits, end);
+					offset += ise.bits;
+					t |= readBits(block, offset, T_BITS[j], end) << shift;
+					offset += T_BITS[j];
+				}
+
+				for (uint32_t j = 0; j < 5 && i + j < count; j++)
+				{
+					values[i + j] = static_cast<uint8_t>(trit_values[t][j] << ise.bits | m[j]);
+				}
+			}
+		}
+		else if (ise.quints)
+		{
+			static constexpr uint32_t Q_BITS[3] = { 3, 2, 2 };
+			for (uint32_t i = 0; i < count; i += 3)
+			{
+				uint32_t m[3];
+				uint32_t q = 0;
+				for (uint32_t j = 0, shift = 0; j < 3; shift += Q_BITS[j], j++)
+				{
+					m[j] = readBits(block, offset, ise.bits, end);
+					offset += ise.bits;
+					q |= readBits(block, offset, Q_BITS[j], end) << shift;
+					offset += Q_BITS[j];
+				}
+
+				for (uint32_t j = 0; j < 3 && i + j < count; j++)
+				{
+					values[i + j] = static_cast<uint8_t>(quint_values[q][j] << ise.bits | m[j]);
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				values[i] = static_cast<uint8_t>(readBits(block, offset, ise.bits, end));
+				offset += ise.bits;
+			}
+		}
+	}
+
+	// Weight grid of a 2D block mode, false for reserved modes
+	static bool decodeBlockMode(uint32_t mode, uint32_t& grid_x, uint32_t& grid_y, bool& dual_plane, uint32_t& level)
+	{
+		uint32_t base_level = (mode >> 4) & 1;
+		uint32_t h = (mode >> 9) & 1;
+		uint32_t d = (mode >> 10) & 1;
+		uint32_t a = (mode >> 5) & 3;
+
+		if ((mode & 3) != 0)
+		{
+			base_level |= (mode & 3) << 1;
+			uint32_t b = (mode >> 7) & 3;
+			switch ((mode >> 2) & 3)
+			{
+			case 0: grid_x = b + 4; grid_y = a + 2; break;
+			case 1: grid_x = b + 8; grid_y = a + 2; break;
+			case 2: grid_x = a + 2; grid_y = b + 8; break;
+			default:
+				b &= 1;
+				if (mode & 0x100)
+				{
+					grid_x = b + 2;
+					grid_y = a + 2;
+				}
+				else
+				{
+					grid_x = a + 2;
+					grid_y = b + 6;
+				}
+				break;
+			}
+		}
+		else
+		{
+			base_level |= ((mode >> 2) & 3) << 1;
+			if (((mode >> 2) & 3) == 0)
+			{
+				return false;
+			}
+
+			uint32_t b = (mode >> 9) & 3;
+			switch ((mode >> 7) & 3)
+			{
+			case 0: grid_x = 12; grid_y = a + 2; break;
+			case 1: grid_x = a + 2; grid_y = 12; break;
+			case 2: grid_x = a + 6; grid_y = b + 6; d = 0; h = 0; break;
+			default:
+				if (a > 1)
+				{
+					return false;
+				}
+				grid_x = a == 0 ? 6 : 10;
+				grid_y = a == 0 ? 10 : 6;
+				break;
+			}
+		}
+
+		dual_plane = d != 0;
+		level = base_level - 2 + 6 * h;
+		return true;
+	}
+
+	static inline int32_t clampUnorm8(int32_t value)
+	{
+		return std::min(255, std::max(0, value));
+	}
+
+	// Moves the top bit of b into a, which becomes a signed 6 bit offset
+	static inline void bitTransferSigned(int32_t& a, int32_t& b)
+	{
+		b >>= 1;
+		b |= a & 0x80;
+		a >>= 1;
+		a &= 0x3F;
+		if (a & 0x20)
+		{
+			a -= 0x40;
+		}
+	}
+
+	static inline void blueContract(int32_t* e)
+	{
+		e[0] = (e[0] + e[2]) >> 1;
+		e[1] = (e[1] + e[2]) >> 1;
+	}
+
+	// LDR endpoint modes, false for HDR ones
+	static bool decodeEndpoints(uint32_t mode, const uint8_t* values, int32_t* e0, int32_t* e1)
+	{
+		int32_t v[8];
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			v[i] = values[i];
+		}
+
+		auto set = [](int32_t* e, int32_t r, int32_t g, int32_t b, int32_t a) {
+			e[0] = r;
+			e[1] = g;
+			e[2] = b;
+			e[3] = a;
+		};
+
+		switch (mode)
+		{
+		case 0:
+			set(e0, v[0], v[0], v[0], 0xFF);
+			set(e1, v[1], v[1], v[1], 0xFF);
+			return true;
+		case 1:
+		{
+			int32_t l0 = (v[0] >> 2) | (v[1] & 0xC0);
+			int32_t l1 = std::min(l0 + (v[1] & 0x3F), 0xFF);
+			set(e0, l0, l0, l0, 0xFF);
+			set(e1, l1, l1, l1, 0xFF);
+			return true;
+		}
+		case 4:
+			set(e0, v[0], v[0], v[0], v[2]);
+			set(e1, v[1], v[1], v[1], v[3]);
+			return true;
+		case 5:
+			bitTransferSigned(v[1], v[0]);
+			bitTransferSigned(v[3], v[2]);
+			set(e0, v[0], v[0], v[0], v[2]);
+			set(e1, v[0] + v[1], v[0] + v[1], v[0] + v[1], v[2] + v[3]);
+			break;
+		case 6:
+			set(e0, (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, 0xFF);
+			set(e1, v[0], v[1], v[2], 0xFF);
+			return true;
+		case 8:
+		case 12:
+		{
+			int32_t a0 = mode == 12 ? v[6] : 0xFF;
+			int32_t a1 = mode == 12 ? v[7] : 0xFF;
+			if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4])
+			{
+				set(e0, v[0], v[2], v[4], a0);
+				set(e1, v[1], v[3], v[5], a1);
+			}
+			else
+			{
+				set(e0, v[1], v[3], v[5], a1);
+				set(e1, v[0], v[2], v[4], a0);
+				blueContract(e0);
+				blueContract(e1);
+			}
+			return true;
+		}
+		case 9:
+		case 13:
+		{
+			bitTransferSigned(v[1], v[0]);
+			bitTransferSigned(v[3], v[2]);
+			bitTransferSigned(v[5], v[4]);
+			if (mode == 13)
+			{
+				bitTransferSigned(v[7], v[6]);
+			}
+			int32_t a0 = mode == 13 ? v[6] : 0xFF;
+			int32_t a1 = mode == 13 ? v[6] + v[7] : 0xFF;
+			if (v[1] + v[3] + v[5] >= 0)
+			{
+				set(e0, v[0], v[2], v[4], a0);
+				set(e1, v[0] + v[1], v[2] + v[3], v[4] + v[5], a1);
+			}
+			else
+			{
+				set(e0, v[0] + v[1], v[2] + v[3], v[4] + v[5], a1);
+				set(e1, v[0], v[2], v[4], a0);
+				blueContract(e0);
+				blueContract(e1);
+			}
+			break;
+		}
+		case 10:
+			set(e0, (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, v[4]);
+			set(e1, v[0], v[1], v[2], v[5]);
+			return true;
+		default:
+			return false;
+		}
+
+		// Offset modes may leave the range
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			e0[c] = clampUnorm8(e0[c]);
+			e1[c] = clampUnorm8(e1[c]);
+		}
+		return true;
+	}
+
+	// Bilinear infill of a weight grid onto the texels of a block, two grid weights per texel per axis
+	struct WeightInfill
+	{
+		// Grid index and factor in sixteenths of the four neighbours of each texel
+		std::vector<std::array<uint8_t, 4>> indices;
+		std::vector<std::array<uint8_t, 4>> factors;
+	};
+
+	static void buildWeightInfill(uint32_t xdim, uint32_t ydim, uint32_t grid_x, uint32_t grid_y, WeightInfill& infill)
+	{
+		uint32_t ds = (1024 + xdim / 2) / (xdim - 1);
+		uint32_t dt = (1024 + ydim / 2) / (ydim - 1);
+
+		infill.indices.resize(xdim * ydim);
+		infill.factors.resize(xdim * ydim);
+		for (uint32_t t = 0; t < ydim; t++)
+		{
+			for (uint32_t s = 0; s < xdim; s++)
+			{
+				uint32_t gs = (ds * s * (grid_x - 1) + 32) >> 6;
+				uint32_t gt = (dt * t * (grid_y - 1) + 32) >> 6;
+				uint32_t js = gs >> 4, fs = gs & 0xF;
+				uint32_t jt = gt >> 4, ft = gt & 0xF;
+
+				uint32_t w11 = (fs * ft + 8) >> 4;
+				uint32_t w10 = ft - w11;
+				uint32_t w01 = fs - w11;
+				uint32_t w00 = 16 - fs - ft + w11;
+
+				// Neighbours past the grid edge have no weight, they are clamped so they can be read
+				uint32_t js1 = std::min(js + 1, grid_x - 1);
+				uint32_t jt1 = std::min(jt + 1, grid_y - 1);
+
+				uint32_t texel = t * xdim + s;
+				infill.indices[texel] = { static_cast<uint8_t>(jt * grid_x + js), static_cast<uint8_t>(jt * grid_x + js1),
+					static_cast<uint8_t>(jt1 * grid_x + js), static_cast<uint8_t>(jt1 * grid_x + js1) };
+				infill.factors[texel] = { static_cast<uint8_t>(w00), static_cast<uint8_t>(w01), static_cast<uint8_t>(w10), static_cast<uint8_t>(w11) };
+			}
+		}
+	}
+
+	// Single partition LDR block of a 2D image straight to RGBA8 texels, row pitch xdim. Follows the ASTC specification
+	// in integer math, interpolating endpoints in 8 bits gives the top byte of its 16 bit sRGB interpolation. Returns
+	// false for any other block, which goes through the codec's symbolic decode, including error blocks
+	static bool decodeSimpleBlock(const uint8_t* data, uint32_t xdim, uint32_t ydim, const std::vector<WeightInfill>& infills, uint8_t* texels)
+	{
+		uint64_t block[2];
+		std::memcpy(block, data, sizeof(block));
+
+		uint32_t mode = readBits(block, 0, 11, 128);
+
+		// Void extent, a constant UNORM16 color
+		if ((mode & 0x1FF) == 0x1FC)
+		{
+			if (mode & 0x200)
+			{
+				return false;
+			}
+
+			// Reserved bits, anything else is an error block
+			if (readBits(block, 10, 2, 128) != 3)
+			{
+				return false;
+			}
+
+			uint8_t color[4];
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				color[c] = static_cast<uint8_t>(readBits(block, 64 + c * 16, 16, 128) >> 8);
+			}
+			for (uint32_t i = 0; i < xdim * ydim; i++)
+			{
+				std::memcpy(texels + i * 4, color, 4);
+			}
+			return true;
+		}
+
+		uint32_t grid_x, grid_y, weight_level;
+		bool dual_plane;
+		if (!decodeBlockMode(mode, grid_x, grid_y, dual_plane, weight_level) || grid_x > xdim || grid_y > ydim)
+		{
+			return false;
+		}
+
+		// Single partition only
+		if (readBits(block, 11, 2, 128) != 0)
+		{
+			return false;
+		}
+
+		uint32_t plane_count = dual_plane ? 2 : 1;
+		uint32_t weight_count = grid_x * grid_y * plane_count;
+		uint32_t weight_bits = getIseBitCount(weight_count, weight_level);
+		if (weight_count > MAX_WEIGHTS || weight_bits < MIN_WEIGHT_BITS || weight_bits > MAX_WEIGHT_BITS)
+		{
+			return false;
+		}
+
+		// Colors take what is left between the endpoint mode and the weights, at the highest level that fits
+		uint32_t endpoint_mode = readBits(block, 13, 4, 128);
+		uint32_t value_count = ((endpoint_mode >> 2) + 1) * 2;
+		uint32_t color_bits = 128 - 17 - weight_bits - (dual_plane ? 2 : 0);
+		uint32_t color_level = ISE_LEVEL_COUNT;
+		while (color_level > MIN_COLOR_LEVEL && getIseBitCount(value_count, color_level - 1) > color_bits)
+		{
+			color_level--;
+		}
+		if (color_level == MIN_COLOR_LEVEL)
+		{
+			return false;
+		}
+		color_level--;
+
+		uint8_t values[8];
+		decodeIse(block, 17, value_count, color_level, values);
+		for (uint32_t i = 0; i < value_count; i++)
+		{
+			values[i] = color_unquantized[color_level][values[i]];
+		}
+
+		int32_t e0[4], e1[4];
+		if (!decodeEndpoints(endpoint_mode, values, e0, e1))
+		{
+			return false;
+		}
+
+		// Component of the second plane
+		uint32_t plane2_component = dual_plane ? readBits(block, 128 - weight_bits - 2, 2, 128) : 4;
+
+		// Weights are stored bit reversed from the top of the block, planes interleaved
+		uint64_t reversed[2] = { reverseBits(block[1]), reverseBits(block[0]) };
+		uint8_t weights[MAX_WEIGHTS];
+		decodeIse(reversed, 0, weight_count, weight_level, weights);
+
+		uint8_t plane_weights[2][MAX_WEIGHTS];
+		for (uint32_t i = 0; i < weight_count; i++)
+		{
+			plane_weights[i % plane_count][i / plane_count] = weight_unquantized[weight_level][weights[i]];
+		}
+
+		const auto& infill = infills[grid_y * (MAX_BLOCK_DIM + 1) + grid_x];
+		for (uint32_t texel = 0; texel < xdim * ydim; texel++)
+		{
+			const auto& indices = infill.indices[texel];
+			const auto& factors = infill.factors[texel];
+
+			uint32_t w[2];
+			for (uint32_t plane = 0; plane < plane_count; plane++)
+			{
+				const uint8_t* grid = plane_weights[plane];
+				w[plane] = (grid[indices[0]] * factors[0] + grid[indices[1]] * factors[1] + grid[indices[2]] * factors[2] + grid[indices[3]] * factors[3] + 8) >> 4;
+			}
+
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				int32_t weight = static_cast<int32_t>(c == plane2_component ? w[1] : w[0]);
+				texels[texel * 4 + c] = static_cast<uint8_t>((e0[c] * (64 - weight) + e1[c] * weight + 32) >> 6);
+			}
+		}
+
+		return true;
+	}
+
 	Astc::BlockDim to_blockdim(const VkFormat format)
 	{
 		switch (format)
@@ -81,15 +825,14 @@ namespace chaf
 	Astc::Astc(const Image& image):
 		Image(image.getName())
 	{
-		init();
-		decode(to_blockdim(image.getFormat()), image.getExtent(), image.getData().data());
+		// Level 0 only, it leads the data
+		auto& level = image.getMipMaps().at(0);
+		decode(to_blockdim(image.getFormat()), level.extent, image.getData().data() + level.offset, image.getData().size() - level.offset);
 	}
 
 	Astc::Astc(const std::string& filename, const std::vector<uint8_t>& data) :
 		Image(filename)
 	{
-		init();
-
 		// Read header
 		if (data.size() < sizeof(AstcHeader))
 		{
@@ -113,15 +856,13 @@ namespace chaf
 			/* height = */ static_cast<uint32_t>(header.ysize[0] + 256 * header.ysize[1] + 65536 * header.ysize[2]),
 			/* depth  = */ static_cast<uint32_t>(header.zsize[0] + 256 * header.zsize[1] + 65536 * header.zsize[2]) };
 
-		decode(blockdim, extent, data.data() + sizeof(AstcHeader));
+		decode(blockdim, extent, data.data() + sizeof(AstcHeader), data.size() - sizeof(AstcHeader));
 	}
 
-	void Astc::decode(BlockDim block_dim, VkExtent3D extent, const uint8_t* data)
+	void Astc::decode(BlockDim block_dim, VkExtent3D extent, const uint8_t* data, size_t size)
 	{
 		// Actual decoding
 		astc_decode_mode decode_mode = DECODE_LDR_SRGB;
-		uint32_t         bitness = 8;
-		swizzlepattern   swz_decode = { 0, 1, 2, 3 };
 
 		int xdim = block_dim.x;
 		int ydim = block_dim.y;
@@ -134,52 +875,115 @@ namespace chaf
 			throw std::runtime_error{ "Error reading astc: invalid block" };
 		}
 
-		int xsize = extent.width;
-		int ysize = extent.height;
-		int zsize = extent.depth;
-
-		if (xsize == 0 || ysize == 0 || zsize == 0)
+		if (extent.width == 0 || extent.height == 0 || extent.depth == 0)
 		{
 			throw std::runtime_error{ "Error reading astc: invalid size" };
 		}
 
-		int xblocks = (xsize + xdim - 1) / xdim;
-		int yblocks = (ysize + ydim - 1) / ydim;
-		int zblocks = (zsize + zdim - 1) / zdim;
+		uint32_t xblocks = (extent.width + xdim - 1) / xdim;
+		uint32_t yblocks = (extent.height + ydim - 1) / ydim;
+		uint32_t zblocks = (extent.depth + zdim - 1) / zdim;
 
-		auto astc_image = allocate_image(bitness, xsize, ysize, zsize, 0);
-		//initialize_image(astc_image);
+		if (size / BLOCK_SIZE < static_cast<size_t>(xblocks) * yblocks * zblocks)
+		{
+			throw std::runtime_error{ "Error reading astc: truncated data" };
+		}
+
+		init(block_dim);
+
+		// Blocks are written straight into the image data
+		size_t row_pitch = static_cast<size_t>(extent.width) * 4;
+		size_t slice_pitch = row_pitch * extent.height;
+		auto& texels = getMutData();
+		texels.resize(slice_pitch * extent.depth);
+
+		// Infill of every weight grid a block of this size may have, by grid_y * (MAX_BLOCK_DIM + 1) + grid_x
+		std::vector<WeightInfill> infills;
+		if (zdim == 1)
+		{
+			infills.resize((MAX_BLOCK_DIM + 1) * (MAX_BLOCK_DIM + 1));
+			for (uint32_t grid_y = 2; grid_y <= static_cast<uint32_t>(ydim); grid_y++)
+			{
+				for (uint32_t grid_x = 2; grid_x <= static_cast<uint32_t>(xdim); grid_x++)
+				{
+					buildWeightInfill(xdim, ydim, grid_x, grid_y, infills[grid_y * (MAX_BLOCK_DIM + 1) + grid_x]);
+				}
+			}
+		}
 
-		imageblock pb;
-		for (int z = 0; z < zblocks; z++)
+		using FullBlockWriter = void (*)(const imageblock&, uint8_t*, size_t);
+		FullBlockWriter write_full_block = nullptr;
+		if (zdim == 1)
 		{
-			for (int y = 0; y < yblocks; y++)
+			if (xdim == 4 && ydim == 4)
+			{
+				write_full_block = writeBlock<4, 4>;
+			}
+			else if (xdim == 6 && ydim == 6)
+			{
+				write_full_block = writeBlock<6, 6>;
+			}
+			else if (xdim == 8 && ydim == 8)
+			{
+				write_full_block = writeBlock<8, 8>;
+			}
+		}
+
+		// Rows of blocks in parallel, each block is decoded and written by one job
+		uint32_t row_count = yblocks * zblocks;
+		uint32_t grain = std::max(1u, TEXELS_PER_JOB / (xblocks * xdim * ydim * zdim));
+		JobSystem::get().parallelFor(JobPriority::Load, row_count, [&](uint32_t begin, uint32_t end) {
+			imageblock pb;
+			uint8_t block_texels[MAX_BLOCK_DIM * MAX_BLOCK_DIM * 4];
+			for (uint32_t row = begin; row < end; row++)
 			{
-				for (int x = 0; x < xblocks; x++)
+				uint32_t z = row / yblocks;
+				uint32_t y = row % yblocks;
+
+				uint32_t rows = std::min<uint32_t>(ydim, extent.height - y * ydim);
+				uint32_t slices = std::min<uint32_t>(zdim, extent.depth - z * zdim);
+
+				for (uint32_t x = 0; x < xblocks; x++)
 				{
-					int            offset = (((z * yblocks + y) * xblocks) + x) * 16;
-					const uint8_t* bp = data + offset;
+					const uint8_t* bp = data + ((static_cast<size_t>(z) * yblocks + y) * xblocks + x) * BLOCK_SIZE;
+
+					uint32_t columns = std::min<uint32_t>(xdim, extent.width - x * xdim);
+					uint8_t* dst = texels.data() + z * zdim * slice_pitch + y * ydim * row_pitch + static_cast<size_t>(x) * xdim * 4;
 
-					physical_compressed_block pcb = *reinterpret_cast<const physical_compressed_block*>(bp);
+					if (zdim == 1 && decodeSimpleBlock(bp, xdim, ydim, infills, block_texels))
+					{
+						for (uint32_t block_row = 0; block_row < rows; block_row++)
+						{
+							std::memcpy(dst + block_row * row_pitch, block_texels + block_row * xdim * 4, columns * 4);
+						}
+						continue;
+					}
+
+					physical_compressed_block pcb;
+					std::memcpy(&pcb, bp, sizeof(pcb));
 					symbolic_compressed_block scb;
 
 					physical_to_symbolic(xdim, ydim, zdim, pcb, &scb);
 					decompress_symbolic_block(decode_mode, xdim, ydim, zdim, x * xdim, y * ydim, z * zdim, &scb, &pb);
-					write_imageblock(astc_image, &pb, xdim, ydim, zdim, x * xdim, y * ydim, z * zdim, swz_decode);
+					if (write_full_block && columns == static_cast<uint32_t>(xdim) && rows == static_cast<uint32_t>(ydim))
+					{
+						write_full_block(pb, dst, row_pitch);
+					}
+					else
+					{
+						writeBlock(pb, block_dim, columns, rows, slices, dst, row_pitch, slice_pitch);
+					}
 				}
 			}
-		}
+			}, grain);
 
-		setData(astc_image->imagedata8[0][0], astc_image->xsize * astc_image->ysize * astc_image->zsize * 4);
 		setFormat(VK_FORMAT_R8G8B8A8_SRGB);
-		setWidth(static_cast<uint32_t>(astc_image->xsize));
-		setHeight(static_cast<uint32_t>(astc_image->ysize));
-		setDepth(static_cast<uint32_t>(astc_image->zsize));
-
-		destroy_image(astc_image);
+		setWidth(extent.width);
+		setHeight(extent.height);
+		setDepth(extent.depth);
 	}
 
-	void Astc::init()
+	void Astc::init(BlockDim block_dim)
 	{
 		static bool                  initialized{ false };
 		static std::mutex            initialization;
@@ -189,8 +993,16 @@ namespace chaf
 			// Init stuff
 			prepare_angular_tables();
 			build_quantization_mode_table();
+			buildIseTables();
 			initialized = true;
 		}
+
+		// Built on first use of a block size, only read once they exist
+		get_block_size_descriptor(block_dim.x, block_dim.y, block_dim.z);
+		for (int partition_count = 1; partition_count <= 4; partition_count++)
+		{
+			get_partition_table(block_dim.x, block_dim.y, block_dim.z, partition_count);
+		}
 	}
 
 }
\ No newline at end of file
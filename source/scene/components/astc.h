@@ -22,8 +22,11 @@ namespace chaf
 		virtual ~Astc() = default;
 
 	private:
-		void decode(BlockDim block_dim, VkExtent3D extent, const uint8_t* data);
+		// Decode the first level of blocks in parallel, lower levels are box filtered from it by generateMipmap,
+		// which is cheaper than decoding them
+		void decode(BlockDim block_dim, VkExtent3D extent, const uint8_t* data, size_t size);
 
-		void init();
+		// Codec tables, and block size tables which the codec builds lazily and unguarded
+		static void init(BlockDim block_dim);
 	};
 }
\ No newline at end of file
@@ -3,13 +3,154 @@
 #include <scene/components/stb.h>
 #include <scene/components/astc.h>
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include <stb_image_resize.h>
+#include <core/job_system.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <filesystem>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace chaf
 {
+	// Mip generation works on RGBA8 texels
+	static constexpr uint32_t TEXEL_SIZE = 4;
+
+	// Rows of a level filtered per job
+	static constexpr uint32_t TEXELS_PER_JOB = 16384;
+
+	// Linear color is filtered as 14 bit integers, so four texels sum up to at most 16 bits
+	static constexpr uint32_t LINEAR_MAX = (1u << 14) - 1;
+
+	struct SrgbTables
+	{
+		std::array<uint16_t, 256> to_linear;
+		std::array<uint8_t, LINEAR_MAX + 1> to_srgb;
+
+		SrgbTables()
+		{
+			for (uint32_t i = 0; i < to_linear.size(); i++)
+			{
+				float c = i / 255.f;
+				float l = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				to_linear[i] = static_cast<uint16_t>(l * LINEAR_MAX + 0.5f);
+			}
+
+			for (uint32_t i = 0; i < to_srgb.size(); i++)
+			{
+				float l = static_cast<float>(i) / LINEAR_MAX;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+				to_srgb[i] = static_cast<uint8_t>(std::min(255.f, c * 255.f + 0.5f));
+			}
+		}
+	};
+
+	static const SrgbTables& getSrgbTables()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	// Widen a row of texels, color to linear if srgb. Alpha is always linear
+	static void decodeRow(const uint8_t* src, uint32_t width, bool srgb, uint16_t* dst)
+	{
+		uint32_t count = width * TEXEL_SIZE;
+
+		if (srgb)
+		{
+			auto& to_linear = getSrgbTables().to_linear;
+			for (uint32_t i = 0; i < count; i += TEXEL_SIZE)
+			{
+				dst[i + 0] = to_linear[src[i + 0]];
+				dst[i + 1] = to_linear[src[i + 1]];
+				dst[i + 2] = to_linear[src[i + 2]];
+				dst[i + 3] = src[i + 3];
+			}
+			return;
+		}
+
+		uint32_t i = 0;
+#ifdef MIPMAP_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(bytes, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(bytes, zero));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i] = src[i];
+		}
+	}
+
+	// Average 2x2 blocks of two decoded rows, a source one texel wide repeats its column
+	static void reduceRows(const uint16_t* row0, const uint16_t* row1, uint32_t src_width, uint16_t* dst, uint32_t dst_width)
+	{
+		uint32_t x = 0;
+#ifdef MIPMAP_SSE2
+		// Two texels of each row per register, sums stay below 2^16 and are shifted unsigned
+		const __m128i rounding = _mm_set1_epi16(2);
+		for (; x + 2 <= dst_width && 2 * x + 4 <= src_width; x += 2)
+		{
+			const uint16_t* a0 = row0 + 2 * x * TEXEL_SIZE;
+			const uint16_t* a1 = row1 + 2 * x * TEXEL_SIZE;
+			__m128i left = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a0)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a1)));
+			__m128i right = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a0 + 8)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a1 + 8)));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * TEXEL_SIZE), _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2));
+		}
+#endif
+		for (; x < dst_width; x++)
+		{
+			uint32_t x0 = std::min(2 * x, src_width - 1) * TEXEL_SIZE;
+			uint32_t x1 = std::min(2 * x + 1, src_width - 1) * TEXEL_SIZE;
+			for (uint32_t c = 0; c < TEXEL_SIZE; c++)
+			{
+				uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+				dst[x * TEXEL_SIZE + c] = static_cast<uint16_t>((sum + 2) >> 2);
+			}
+		}
+	}
+
+	// Narrow a filtered row back to texels, linear color to sRGB if srgb
+	static void encodeRow(const uint16_t* src, uint32_t width, bool srgb, uint8_t* dst)
+	{
+		uint32_t count = width * TEXEL_SIZE;
+
+		if (srgb)
+		{
+			auto& to_srgb = getSrgbTables().to_srgb;
+			for (uint32_t i = 0; i < count; i += TEXEL_SIZE)
+			{
+				dst[i + 0] = to_srgb[src[i + 0]];
+				dst[i + 1] = to_srgb[src[i + 1]];
+				dst[i + 2] = to_srgb[src[i + 2]];
+				dst[i + 3] = static_cast<uint8_t>(src[i + 3]);
+			}
+			return;
+		}
+
+		uint32_t i = 0;
+#ifdef MIPMAP_SSE2
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i] = static_cast<uint8_t>(src[i]);
+		}
+	}
+
 	Image::Image(const std::string& filename, std::vector<uint8_t>&& data, std::vector<MipMap>&& mipmaps) :
 		filename{ filename },
 		data{ std::move(data) },
@@ -19,8 +160,6 @@ namespace chaf
 
 	std::unique_ptr<Image> Image::load(const std::string& filename)
 	{
-		std::unique_ptr<Image> image{ nullptr };
-
 		std::vector<uint8_t> raw_data;
 
 		std::ifstream file;
@@ -40,6 +179,13 @@ namespace chaf
 		file.read(reinterpret_cast<char*>(raw_data.data()), read_count);
 		file.close();
 
+		return decode(filename, raw_data);
+	}
+
+	std::unique_ptr<Image> Image::decode(const std::string& filename, const std::vector<uint8_t>& raw_data)
+	{
+		std::unique_ptr<Image> image{ nullptr };
+
 		auto ext = std::filesystem::path(filename).extension();
 
 		if (ext == ".ktx")
@@ -58,47 +204,59 @@ namespace chaf
 		return image;
 	}
 
-	void Image::generateMipmap()
+	void Image::generateMipmap(bool srgb)
 	{
 		if (mipmaps.size() > 1)
 		{
 			return;        // Do not generate again
 		}
 
-		auto extent = mipmaps.at(0).extent;
-		auto next_width = std::max<uint32_t>(1u, extent.width / 2);
-		auto next_height = std::max<uint32_t>(1u, extent.height / 2);
-		auto channels = 4;
-		auto next_size = next_width * next_height * channels;
+		srgb = srgb || format == VK_FORMAT_R8G8B8A8_SRGB;
 
-		while (true)
+		// Whole chain laid out first, so data is allocated once
+		auto extent = mipmaps.at(0).extent;
+		size_t size = data.size();
+		while (extent.width > 1 || extent.height > 1)
 		{
-			// Make space for next mipmap
-			auto old_size = static_cast<uint32_t>(data.size());
-			data.resize(old_size + next_size);
-
-			auto& prev_mipmap = mipmaps.back();
-			// Update mipmaps
-			MipMap next_mipmap{};
-			next_mipmap.level = prev_mipmap.level + 1;
-			next_mipmap.offset = old_size;
-			next_mipmap.extent = { next_width, next_height, 1u };
-
-			// Fill next mipmap memory
-			stbir_resize_uint8(data.data() + prev_mipmap.offset, prev_mipmap.extent.width, prev_mipmap.extent.height, 0,
-				data.data() + next_mipmap.offset, next_mipmap.extent.width, next_mipmap.extent.height, 0, channels);
+			extent.width = std::max<uint32_t>(1u, extent.width / 2);
+			extent.height = std::max<uint32_t>(1u, extent.height / 2);
 
-			mipmaps.emplace_back(std::move(next_mipmap));
+			MipMap mipmap{};
+			mipmap.level = mipmaps.back().level + 1;
+			mipmap.offset = static_cast<uint32_t>(size);
+			mipmap.extent = { extent.width, extent.height, 1u };
+			mipmaps.push_back(mipmap);
 
-			// Next mipmap values
-			next_width = std::max<uint32_t>(1u, next_width / 2);
-			next_height = std::max<uint32_t>(1u, next_height / 2);
-			next_size = next_width * next_height * channels;
+			size += static_cast<size_t>(extent.width) * extent.height * TEXEL_SIZE;
+		}
+		data.resize(size);
 
-			if (next_width == 1 && next_height == 1)
-			{
-				break;
-			}
+		for (size_t level = 1; level < mipmaps.size(); level++)
+		{
+			auto& src = mipmaps[level - 1];
+			auto& dst = mipmaps[level];
+			const uint8_t* src_data = data.data() + src.offset;
+			uint8_t* dst_data = data.data() + dst.offset;
+
+			uint32_t grain = std::max(1u, TEXELS_PER_JOB / dst.extent.width);
+			JobSystem::get().parallelFor(JobPriority::Load, dst.extent.height, [&](uint32_t begin, uint32_t end) {
+				std::vector<uint16_t> rows(static_cast<size_t>(src.extent.width) * 2 * 4 + static_cast<size_t>(dst.extent.width) * 4);
+				uint16_t* row0 = rows.data();
+				uint16_t* row1 = row0 + src.extent.width * 4;
+				uint16_t* row_dst = row1 + src.extent.width * 4;
+
+				for (uint32_t y = begin; y < end; y++)
+				{
+					// Odd last rows and columns are dropped, a single one is repeated
+					uint32_t y0 = std::min(2 * y, src.extent.height - 1);
+					uint32_t y1 = std::min(2 * y + 1, src.extent.height - 1);
+
+					decodeRow(src_data + static_cast<size_t>(y0) * src.extent.width * TEXEL_SIZE, src.extent.width, srgb, row0);
+					decodeRow(src_data + static_cast<size_t>(y1) * src.extent.width * TEXEL_SIZE, src.extent.width, srgb, row1);
+					reduceRows(row0, row1, src.extent.width, row_dst, dst.extent.width);
+					encodeRow(row_dst, dst.extent.width, srgb, dst_data + static_cast<size_t>(y) * dst.extent.width * TEXEL_SIZE);
+				}
+				}, grain);
 		}
 	}
 
@@ -22,9 +22,14 @@ namespace chaf
 
 		static std::unique_ptr<Image> load(const std::string& filename);
 
+		// File content already read, filename only selects the decoder by extension. nullptr for unknown extensions
+		static std::unique_ptr<Image> decode(const std::string& filename, const std::vector<uint8_t>& raw_data);
+
 		virtual ~Image() = default;
 
-		void generateMipmap();
+		// Full chain of 2x2 box filtered levels of an RGBA8 image. Color channels are averaged in linear space if srgb
+		// is set or the format is sRGB, rows of a level are filtered in parallel
+		void generateMipmap(bool srgb = false);
 
 		bool checkFormatSupport(vks::VulkanDevice& device);
 
@@ -7,6 +7,7 @@
 #include <unordered_map>
 
 #include <scene/geometry/aabb.h>
+#include <scene/cacher/geometry_arena.h>
 
 namespace chaf
 {
@@ -19,25 +20,31 @@ namespace chaf
 		glm::vec4 tangent;
 	};
 
+	// Range of the vertex arena, offset in vertices
 	struct VertexBuffer
 	{
-		VkBuffer buffer;
-		VkDeviceMemory memory;
+		GeometryArena::Range range;
+		VkDeviceSize size;
 	};
 
+	// Range of the index arena, offset in indices
 	struct IndexBuffer
 	{
 		int32_t count;
-		VkBuffer buffer;
-		VkDeviceMemory memory;
+		GeometryArena::Range range;
+		VkDeviceSize size;
 	};
 
 	struct Primitive
 	{
 		AABB bbox;
+		// Ranges of the loader's index and vertex data, indices are relative to first vertex
 		uint32_t first_index{ 0 };
 		uint32_t index_count{ 0 };
+		uint32_t first_vertex{ 0 };
+		uint32_t vertex_count{ 0 };
 		int32_t material_index{ 0 };
+		// Key of its geometry in the buffer cacher
 		uint32_t buffer_index{ 0 };
 		size_t id{ 0 };
 		bool visible{ true };
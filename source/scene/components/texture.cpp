@@ -1,7 +1,12 @@
 #include <scene/components/texture.h>
 #include <scene/components/astc.h>
+#include <scene/cacher/upload_manager.h>
+#include <scene/cacher/allocator.h>
+#include <scene/cacher/texture_cache.h>
 
 #include	<filesystem>
+#include <algorithm>
+#include <cmath>
 
 namespace chaf
 {
@@ -15,12 +20,11 @@ namespace chaf
 	void Texture::destory()
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
-		vkDestroyImage(device->logicalDevice, image, nullptr);
 		if (sampler)
 		{
 			vkDestroySampler(device->logicalDevice, sampler, nullptr);
 		}
-		vkFreeMemory(device->logicalDevice, device_memory, nullptr);
+		Allocator::get().destroyImage(image, allocation);
 	}
 
 	std::unique_ptr<Image> Texture::load(const std::string& filename, vks::VulkanDevice* device)
@@ -38,61 +42,45 @@ namespace chaf
 		return image;
 	}
 
-	void Texture2D::loadFromFile(const std::string& filename, vks::VulkanDevice* device, VkQueue copy_queue, VkImageUsageFlags image_usage_flags, VkImageLayout image_layout, bool force_linear)
+	void Texture2D::loadFromFile(const std::string& filename, vks::VulkanDevice* device, VkQueue copy_queue, VkImageUsageFlags image_usage_flags, VkImageLayout image_layout, bool force_linear, UploadManager::Callback&& on_complete, bool srgb)
 	{
-		auto img = Texture::load(filename, device);
+		// Decoded and mip mapped once per content, later loads map the cached payload
+		auto payload = TextureCache::get().load(filename, srgb);
 
 		this->device = device;
 
-		width = img->getExtent().width;
-		height = img->getExtent().height;
-		depth = img->getExtent().depth;
-		mip_level = static_cast<uint32_t>(img->getMipMaps().size());
+		width = payload->extent.width;
+		height = payload->extent.height;
+		depth = payload->extent.depth;
+		mip_level = static_cast<uint32_t>(payload->mipmaps.size());
 
 		VkFormatProperties formatProperties;
-		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, img->getFormat(), &formatProperties);
+		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, payload->format, &formatProperties);
 
 		VkBool32 useStaging = !force_linear;
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		if (useStaging)
+		// Levels below the first are blitted after upload, of a color image through an sRGB alias so the blit
+		// filters in linear space while shaders still sample the stored values
+		bool blit_mipmaps = useStaging && payload->blit_mipmaps;
+		VkFormat image_format = blit_mipmaps && payload->srgb ? VK_FORMAT_R8G8B8A8_SRGB : payload->format;
+		if (blit_mipmaps)
 		{
-			// Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-			bufferCreateInfo.size = img->getData().size();
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			mip_level = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
+			VkFormatProperties blitProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, image_format, &blitProperties);
+			assert((blitProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) &&
+				(blitProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) && (blitProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT));
+		}
 
-			// Copy texture data into staging buffer
-			uint8_t* data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-			memcpy(data, img->getData().data(), img->getData().size());
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
+		// Queued once the view and sampler exist, so the completion callback sees a complete texture
+		std::vector<VkBufferImageCopy> bufferCopyRegions;
+		VkImageSubresourceRange subresourceRange = {};
 
+		if (useStaging)
+		{
 			// Setup buffer copy regions for each mip level
-			std::vector<VkBufferImageCopy> bufferCopyRegions;
-
-			for (auto& mipmap: img->getMipMaps())
+			for (auto& mipmap: payload->mipmaps)
 			{
 				VkBufferImageCopy bufferCopyRegion = {};
 				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -108,7 +96,7 @@ namespace chaf
 			// Create optimal tiled target image
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = img->getFormat();
+			imageCreateInfo.format = image_format;
 			imageCreateInfo.mipLevels = mip_level;
 			imageCreateInfo.arrayLayers = 1;
 			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -122,55 +110,23 @@ namespace chaf
 			{
 				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 			}
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &device_memory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, device_memory, 0));
+			if (blit_mipmaps)
+			{
+				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			}
+			if (image_format != payload->format)
+			{
+				// Viewed in the payload format
+				imageCreateInfo.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+			}
+			Allocator::get().createImage(MemoryUsage::Texture, imageCreateInfo, image, allocation);
 
-			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			subresourceRange.baseMipLevel = 0;
 			subresourceRange.levelCount = mip_level;
 			subresourceRange.layerCount = 1;
 
-			// Image barrier for optimal image (target)
-			// Optimal image will be used as destination for the copy
-			vks::tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				subresourceRange);
-
-			// Copy mip levels from staging buffer
-			vkCmdCopyBufferToImage(
-				copyCmd,
-				stagingBuffer,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				static_cast<uint32_t>(bufferCopyRegions.size()),
-				bufferCopyRegions.data()
-			);
-
-			// Change texture image layout to shader read after all mip levels have been copied
 			this->image_layout = image_layout;
-			vks::tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				image_layout,
-				subresourceRange);
-
-			device->flushCommandBuffer(copyCmd, copy_queue);
-
-			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 		}
 		else
 		{
@@ -181,12 +137,9 @@ namespace chaf
 			// Check if this support is supported for linear tiling
 			assert(formatProperties.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
-			VkImage mappableImage;
-			VkDeviceMemory mappableMemory;
-
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = img->getFormat();
+			imageCreateInfo.format = payload->format;
 			imageCreateInfo.extent = { width, height, 1 };
 			imageCreateInfo.mipLevels = 1;
 			imageCreateInfo.arrayLayers = 1;
@@ -196,52 +149,19 @@ namespace chaf
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-			// Load mip map level 0 to linear tiling image
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &mappableImage));
-
-			// Get memory requirements for this image 
-			// like size and alignment
-			vkGetImageMemoryRequirements(device->logicalDevice, mappableImage, &memReqs);
-			// Set memory allocation size to required memory size
-			memAllocInfo.allocationSize = memReqs.size;
-
-			// Get memory type that can be mapped to host memory
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			// Load mip map level 0 to linear tiling image, in host visible memory which stays mapped
+			void* data = nullptr;
+			Allocator::get().createImage(MemoryUsage::Upload, imageCreateInfo, image, allocation, &data);
 
-			// Allocate host memory
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &mappableMemory));
-
-			// Bind allocated image for use
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, mappableImage, mappableMemory, 0));
-
-			// Get sub resource layout
-			// Mip map count, array layer, etc.
-			VkImageSubresource subRes = {};
-			subRes.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subRes.mipLevel = 0;
-
-			VkSubresourceLayout subResLayout;
-			void* data;
-
-			// Get sub resources layout 
-			// Includes row pitch, size offsets, etc.
-			vkGetImageSubresourceLayout(device->logicalDevice, mappableImage, &subRes, &subResLayout);
-
-			// Map image memory
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, mappableMemory, 0, memReqs.size, 0, &data));
-
-			// Copy image data into memory
-			memcpy(data, img->getData().data(), memReqs.size);
-
-			vkUnmapMemory(device->logicalDevice, mappableMemory);
+			// Copy level 0 into memory, the linear image has no mip chain
+			memcpy(data, payload->data, payload->mipmaps.size() > 1 ? payload->mipmaps[1].offset : payload->size);
 
 			// Linear tiled images don't need to be staged
 			// and can be directly used as textures
-			image = mappableImage;
-			device_memory = mappableMemory;
 			this->image_layout = image_layout;
 
 			// Setup image memory barrier
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, image_layout);
 
 			device->flushCommandBuffer(copyCmd, copy_queue);
@@ -260,7 +180,7 @@ namespace chaf
 		samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 		samplerCreateInfo.minLod = 0.0f;
 		// Max level-of-detail should match mip level count
-		samplerCreateInfo.maxLod = (useStaging) ? (float)img->getMipMaps().size() : 0.0f;
+		samplerCreateInfo.maxLod = (useStaging) ? (float)mip_level : 0.0f;
 		// Only enable anisotropic filtering if enabled on the device
 		samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
 		samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
@@ -274,7 +194,7 @@ namespace chaf
 		VkImageViewCreateInfo viewCreateInfo = {};
 		viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewCreateInfo.format = img->getFormat();
+		viewCreateInfo.format = payload->format;
 		viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 		// Linear tiling usually won't support mip maps
@@ -285,9 +205,22 @@ namespace chaf
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
+
+		if (useStaging)
+		{
+			// Copied through the staging ring and submitted with other uploads, the image is ready in image_layout
+			// before any later submission to the graphics queue
+			UploadManager::get().uploadImage(image, payload->data, payload->size, bufferCopyRegions, subresourceRange, image_layout,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, std::move(on_complete), blit_mipmaps);
+		}
+		else if (on_complete)
+		{
+			// Linear images are ready once the layout transition was flushed
+			on_complete();
+		}
 	}
 
-	void Texture2D::loadFromBuffer(void* buffer, VkDeviceSize bufferSize, VkFormat format, uint32_t texWidth, uint32_t texHeight, vks::VulkanDevice* device, VkQueue copyQueue, VkFilter filter, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
+	void Texture2D::loadFromBuffer(void* buffer, VkDeviceSize bufferSize, VkFormat format, uint32_t texWidth, uint32_t texHeight, vks::VulkanDevice* device, VkFilter filter, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
 	{
 		assert(buffer);
 
@@ -296,40 +229,6 @@ namespace chaf
 		height = texHeight;
 		mip_level = 1;
 
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = bufferSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Get memory requirements for the staging buffer (alignment, memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		VkBufferImageCopy bufferCopyRegion = {};
 		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		bufferCopyRegion.imageSubresource.mipLevel = 0;
@@ -357,15 +256,7 @@ namespace chaf
 		{
 			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		}
-		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &device_memory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, device_memory, 0));
+		Allocator::get().createImage(MemoryUsage::Texture, imageCreateInfo, image, allocation);
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -373,39 +264,10 @@ namespace chaf
 		subresourceRange.levelCount = mip_level;
 		subresourceRange.layerCount = 1;
 
-		// Image barrier for optimal image (target)
-		// Optimal image will be used as destination for the copy
-		vks::tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy mip levels from staging buffer
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&bufferCopyRegion
-		);
-
-		// Change texture image layout to shader read after all mip levels have been copied
-		this->image_layout = image_layout;
-		vks::tools::setImageLayout(
-			copyCmd,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			image_layout,
-			subresourceRange);
-
-		device->flushCommandBuffer(copyCmd, copyQueue);
-
-		// Clean up staging resources
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		// Copied through the staging ring like file textures
+		this->image_layout = imageLayout;
+		UploadManager::get().uploadImage(image, buffer, bufferSize, { bufferCopyRegion }, subresourceRange, imageLayout,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = {};
@@ -3,7 +3,10 @@
 #include <VulkanTools.h>
 #include <VulkanDevice.h>
 
+#include <vk_mem_alloc.h>
+
 #include <scene/components/image.h>
+#include <scene/cacher/upload_manager.h>
 
 namespace chaf
 {
@@ -28,7 +31,7 @@ namespace chaf
 		vks::VulkanDevice* device;
 		VkImage image;
 		VkImageLayout image_layout;
-		VkDeviceMemory device_memory;
+		VmaAllocation allocation;
 		VkImageView view;
 		uint32_t width, height, depth;
 		uint32_t mip_level;
@@ -40,13 +43,19 @@ namespace chaf
 	class Texture2D :public Texture
 	{
 	public:
+		// Any thread may load. on_complete runs on the render thread once the staged copy is visible to the
+		// graphics queue, the texture is complete by then and must not be touched by the loading thread anymore.
+		// Linear textures are copied synchronously on copy_queue and call on_complete before returning.
+		// srgb marks color data, whose mip levels are filtered in linear space
 		void loadFromFile(
 			const std::string& filename,
 			vks::VulkanDevice* device,
 			VkQueue copy_queue,
 			VkImageUsageFlags image_usage_flags = VK_IMAGE_USAGE_SAMPLED_BIT,
 			VkImageLayout image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			bool force_linear = false);
+			bool force_linear = false,
+			UploadManager::Callback&& on_complete = {},
+			bool srgb = false);
 
 		void loadFromBuffer(
 			void* buffer,
@@ -55,7 +64,6 @@ namespace chaf
 			uint32_t texWidth,
 			uint32_t texHeight,
 			vks::VulkanDevice* device,
-			VkQueue copyQueue,
 			VkFilter filter = VK_FILTER_LINEAR,
 			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
 			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
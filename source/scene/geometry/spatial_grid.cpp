@@ -0,0 +1,85 @@
+#include <scene/geometry/spatial_grid.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace chaf
+{
+	void SpatialGrid::build(const std::vector<AABB>& bounds, uint32_t items_per_cell)
+	{
+		cells.clear();
+		items.clear();
+		item_bounds = bounds;
+
+		if (bounds.empty())
+		{
+			return;
+		}
+
+		AABB centers;
+		for (auto& aabb : bounds)
+		{
+			centers.update(aabb.getCenter());
+		}
+
+		// Cells about as wide on every axis, about items_per_cell items each if spread evenly
+		glm::vec3 extent = glm::max(centers.getMax() - centers.getMin(), glm::vec3(1e-3f));
+		float cell_count = std::max(1.f, static_cast<float>(bounds.size()) / std::max(1u, items_per_cell));
+		float cell_size = std::cbrt(extent.x * extent.y * extent.z / cell_count);
+		glm::uvec3 dims = glm::clamp(glm::uvec3(glm::ceil(extent / cell_size)), glm::uvec3(1), glm::uvec3(256));
+
+		std::vector<uint32_t> item_cells(bounds.size());
+		for (size_t i = 0; i < bounds.size(); i++)
+		{
+			glm::vec3 t = (bounds[i].getCenter() - centers.getMin()) / extent;
+			glm::uvec3 cell = glm::min(glm::uvec3(t * glm::vec3(dims)), dims - 1u);
+			item_cells[i] = (cell.z * dims.y + cell.y) * dims.x + cell.x;
+		}
+
+		items.resize(bounds.size());
+		for (uint32_t i = 0; i < items.size(); i++)
+		{
+			items[i] = i;
+		}
+		std::stable_sort(items.begin(), items.end(), [&item_cells](uint32_t a, uint32_t b) { return item_cells[a] < item_cells[b]; });
+
+		for (uint32_t i = 0; i < items.size(); i++)
+		{
+			uint32_t item = items[i];
+			if (i == 0 || item_cells[item] != item_cells[items[i - 1]])
+			{
+				cells.push_back({});
+				cells.back().first = i;
+			}
+
+			auto& cell = cells.back();
+			cell.count++;
+			cell.bounds.update(bounds[item].getMin());
+			cell.bounds.update(bounds[item].getMax());
+		}
+	}
+
+	void SpatialGrid::query(Frustum frustum, std::vector<uint32_t>& result) const
+	{
+		for (auto& cell : cells)
+		{
+			if (!frustum.checkAABB(cell.bounds))
+			{
+				continue;
+			}
+
+			for (uint32_t i = cell.first; i < cell.first + cell.count; i++)
+			{
+				if (frustum.checkAABB(item_bounds[items[i]]))
+				{
+					result.push_back(items[i]);
+				}
+			}
+		}
+	}
+
+	uint32_t SpatialGrid::getCellCount() const
+	{
+		return static_cast<uint32_t>(cells.size());
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <scene/geometry/aabb.h>
+#include <scene/geometry/frustum.h>
+
+#include <vector>
+
+namespace chaf
+{
+	// Loose uniform grid over static bounds. Items are bucketed by the cell of their center and a cell's bounds grow to
+	// cover its items, so an item is in exactly one cell and queries return it once
+	class SpatialGrid
+	{
+	public:
+		void build(const std::vector<AABB>& bounds, uint32_t items_per_cell = 16);
+
+		// Append items whose bounds intersect frustum, in cell order
+		void query(Frustum frustum, std::vector<uint32_t>& result) const;
+
+		uint32_t getCellCount() const;
+
+	private:
+		struct Cell
+		{
+			AABB bounds;
+			uint32_t first{ 0 };
+			uint32_t count{ 0 };
+		};
+
+		// Non empty cells only
+		std::vector<Cell> cells;
+
+		// Grouped by cell
+		std::vector<uint32_t> items;
+
+		std::vector<AABB> item_bounds;
+	};
+}
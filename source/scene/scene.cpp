@@ -12,14 +12,7 @@ namespace chaf
 	Scene::~Scene()
 	{
 		buffer_cacher.reset();
-
-		for (auto& image : images)
-		{
-			vkDestroyImageView(device.logicalDevice, image.texture.view, nullptr);
-			vkDestroyImage(device.logicalDevice, image.texture.image, nullptr);
-			vkDestroySampler(device.logicalDevice, image.texture.sampler, nullptr);
-			vkFreeMemory(device.logicalDevice, image.texture.device_memory, nullptr);
-		}
+		image_cacher.reset();
 
 		object_buffer.destroy();
 	}
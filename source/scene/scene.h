@@ -7,6 +7,8 @@
 #include <scene/components/texture.h>
 
 #include <scene/cacher/buffer_cacher.h>
+#include <scene/cacher/image_cacher.h>
+#include <scene/cacher/allocator.h>
 
 #include <VulkanTexture.h>
 #include <VulkanBuffer.h>
@@ -77,8 +79,9 @@ namespace chaf
 		std::string name;
 
 	public:
+		// Loaded on demand by the image cacher, the slot of image i is i
 		struct Image {
-			Texture2D texture;
+			std::string path;
 		};
 
 		struct Texture {
@@ -88,10 +91,12 @@ namespace chaf
 		std::vector<Image> images;
 		std::vector<Texture> textures;
 		std::vector<Material> materials;
-		vks::Buffer object_buffer;
+		Buffer object_buffer;
 
 		std::unique_ptr<BufferCacher> buffer_cacher;
 
+		std::unique_ptr<ImageCacher> image_cacher;
+
 		size_t index_count{ 0 };
 		size_t vertex_count{ 0 };
 		size_t primitive_count{ 0 };
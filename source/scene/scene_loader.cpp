@@ -12,6 +12,7 @@
 #include <scene/components/image.h>
 #include <scene/components/light.h>
 #include <scene/components/virtual_texture.h>
+#include <scene/cacher/upload_manager.h>
 
 #include <filesystem>
 #include <iostream>
@@ -62,7 +63,7 @@ namespace chaf
 		auto scene = std::make_unique<Scene>(device, "Scene");
 
 
-		parseImages(device, gltf_input, *scene, copy_queue);
+		parseImages(gltf_input, *scene);
 		parseTextures(gltf_input, *scene);
 		parseMaterials(gltf_input, *scene);
 		parseMesh(gltf_input, *scene);
@@ -70,7 +71,7 @@ namespace chaf
 		// Parse nodes
 		parseNodes(device, gltf_input, *scene);
 
-		genPrimitiveBuffer(device, *scene, copy_queue);
+		genPrimitiveBuffer(device, *scene);
 
 		return scene;
 	}
@@ -180,30 +181,13 @@ namespace chaf
 		}
 	}
 
-	void SceneLoader::parseImages(vks::VulkanDevice& device, tinygltf::Model& model, Scene& scene, VkQueue copy_queue)
+	void SceneLoader::parseImages(tinygltf::Model& model, Scene& scene)
 	{
+		// Only paths, textures are streamed in by the image cacher once they are drawn
 		scene.images.resize(model.images.size());
-		
-		// TODO: multi-thread
-		//std::vector<std::future<void>> futures;
-
-		//for (size_t i = 0; i < model.images.size(); i++) 
-		//{
-		//	futures.push_back(chaf::Cacher::getThreadPool().push([i, &model, &device, copy_queue,&scene](size_t) {
-		//		tinygltf::Image& glTFImage = model.images[i];
-		//		scene.images[i].texture.loadFromFile(path + "/" + glTFImage.uri, &device, copy_queue);
-		//		}));
-		//}
-
-		//for (auto& future : futures)
-		//{
-		//	future.get();
-		//}
-
 		for (size_t i = 0; i < model.images.size(); i++) 
 		{
-			tinygltf::Image& glTFImage = model.images[i];
-			scene.images[i].texture.loadFromFile(path + "/" + glTFImage.uri, &device, copy_queue);
+			scene.images[i].path = path + "/" + model.images[i].uri;
 		}
 	}
 
@@ -222,6 +206,9 @@ namespace chaf
 		index_buffer.clear();
 		vertex_buffer.clear();
 
+		// Every glTF primitive is streamed on its own, nodes instancing a mesh share its keys
+		uint32_t buffer_index = 0;
+
 		primitives.resize(model.meshes.size());
 		for (uint32_t mesh_id = 0; mesh_id < model.meshes.size(); mesh_id++)
 		{
@@ -318,7 +305,7 @@ namespace chaf
 						uint32_t* buf = new uint32_t[accessor.count];
 						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
 						for (size_t index = 0; index < accessor.count; index++) {
-							index_buffer.push_back(buf[index] + vertex_start);
+							index_buffer.push_back(buf[index]);
 						}
 						break;
 					}
@@ -326,7 +313,7 @@ namespace chaf
 						uint16_t* buf = new uint16_t[accessor.count];
 						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
 						for (size_t index = 0; index < accessor.count; index++) {
-							index_buffer.push_back(buf[index] + vertex_start);
+							index_buffer.push_back(buf[index]);
 						}
 						break;
 					}
@@ -334,7 +321,7 @@ namespace chaf
 						uint8_t* buf = new uint8_t[accessor.count];
 						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
 						for (size_t index = 0; index < accessor.count; index++) {
-							index_buffer.push_back(buf[index] + vertex_start);
+							index_buffer.push_back(buf[index]);
 						}
 						break;
 					}
@@ -346,6 +333,9 @@ namespace chaf
 
 				primitive.first_index = first_index;
 				primitive.index_count = index_count;
+				primitive.first_vertex = vertex_start;
+				primitive.vertex_count = static_cast<uint32_t>(vertex_count);
+				primitive.buffer_index = buffer_index++;
 				primitive.material_index = gltf_primitive.material;
 				primitive.updateID();
 				primitives[mesh_id][primitive_id] = primitive;
@@ -496,10 +486,8 @@ namespace chaf
 		light.setProperties(properties);
 	}
 
-	void SceneLoader::genPrimitiveBuffer(vks::VulkanDevice& device, Scene& scene, VkQueue& queue)
+	void SceneLoader::genPrimitiveBuffer(vks::VulkanDevice& device, Scene& scene)
 	{
-		vks::Buffer stagingBuffer;
-
 		struct Data
 		{
 			Material material;
@@ -526,20 +514,11 @@ namespace chaf
 			}
 		}
 
-		VK_CHECK_RESULT(device.createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer,
-			sizeof(Data)* buffer_data.size(),
-			buffer_data.data()));
-
-		VK_CHECK_RESULT(device.createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&scene.object_buffer,
-			stagingBuffer.size));
-
-		device.copyBuffer(&stagingBuffer, &scene.object_buffer, queue);
-		stagingBuffer.destroy();
+		Allocator::get().createBuffer(MemoryUsage::Storage, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			sizeof(Data) * buffer_data.size(), scene.object_buffer);
+
+		// Read by scene shaders on the graphics queue only
+		UploadManager::get().uploadBuffer(scene.object_buffer.buffer, 0, buffer_data.data(), scene.object_buffer.size,
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 	}
 }
\ No newline at end of file
@@ -27,14 +27,14 @@ namespace chaf
 		static void parseTransform(tinygltf::Node& gltf_node, Node& node);
 		static void parseCamera(tinygltf::Model& model, tinygltf::Node& gltf_node, Node& node);
 		static void parsePrimitives(tinygltf::Model& model, tinygltf::Node& gltf_node, Node& node, Scene& scene);
-		static void parseImages(vks::VulkanDevice& device, tinygltf::Model& model, Scene& scene, VkQueue copy_queue);
+		static void parseImages(tinygltf::Model& model, Scene& scene);
 		static void parseTextures(tinygltf::Model& model, Scene& scene);
 		static void parseMesh(tinygltf::Model& model, Scene& scene);
 		static void parseMaterials(tinygltf::Model& model, Scene& scene);
 		static void parseExtensions(tinygltf::Model& model, tinygltf::Node& gltf_node, Node& node);
 		static void parseLight(tinygltf::Model& model, tinygltf::Node& gltf_node, Node& node);
 
-		static void genPrimitiveBuffer(vks::VulkanDevice& device, Scene& scene, VkQueue& queue);
+		static void genPrimitiveBuffer(vks::VulkanDevice& device, Scene& scene);
 
 	public:
 		static std::vector<uint32_t> index_buffer;
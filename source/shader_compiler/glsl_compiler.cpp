@@ -9,8 +9,61 @@
 #include <glslang/Include/ShHandle.h>
 #include <glslang/OSDependent/osinclude.h>
 
+#include <fstream>
+
 namespace chaf
 {
+	// Resolves #include through GLSLCompiler::resolveInclude, contents live until glslang releases them
+	class FileIncluder : public glslang::TShader::Includer
+	{
+	public:
+		FileIncluder(const std::vector<std::string>& include_directories) :
+			include_directories{ include_directories }
+		{
+		}
+
+		IncludeResult* includeSystem(const char* header_name, const char* includer_name, size_t depth) override
+		{
+			return include(header_name, includer_name, false);
+		}
+
+		IncludeResult* includeLocal(const char* header_name, const char* includer_name, size_t depth) override
+		{
+			return include(header_name, includer_name, true);
+		}
+
+		void releaseInclude(IncludeResult* result) override
+		{
+			if (result)
+			{
+				delete static_cast<std::string*>(result->userData);
+				delete result;
+			}
+		}
+
+	private:
+		IncludeResult* include(const char* header_name, const char* includer_name, bool local)
+		{
+			auto path = GLSLCompiler::resolveInclude(header_name, includer_name, local, include_directories);
+			if (path.empty())
+			{
+				return nullptr;
+			}
+
+			std::ifstream file(path, std::ios::in);
+			if (!file.is_open())
+			{
+				return nullptr;
+			}
+
+			auto content = new std::string{ (std::istreambuf_iterator<char>(file)), (std::istreambuf_iterator<char>()) };
+			return new IncludeResult(path.string(), content->data(), content->size(), content);
+		}
+
+	private:
+		const std::vector<std::string>& include_directories;
+	};
+
 	inline EShLanguage shaderStageConvert(VkShaderStageFlagBits stage)
 	{
 		switch (stage)
@@ -56,38 +109,101 @@ namespace chaf
 		}
 	}
 
-	glslang::EShTargetLanguage GLSLCompiler::env_target_language = glslang::EShTargetLanguage::EShTargetNone;
-	glslang::EShTargetLanguageVersion GLSLCompiler::env_target_language_version = (glslang::EShTargetLanguageVersion)0;
+	GLSLCompiler::GLSLCompiler(glslang::EShTargetLanguage target_language, glslang::EShTargetLanguageVersion target_language_version) :
+		env_target_language{ target_language },
+		env_target_language_version{ target_language_version }
+	{
+	}
 
 	void GLSLCompiler::setTargetEnvironment(glslang::EShTargetLanguage target_language, glslang::EShTargetLanguageVersion target_language_version)
 	{
-		GLSLCompiler::env_target_language = target_language;
-		GLSLCompiler::env_target_language_version = target_language_version;
+		env_target_language = target_language;
+		env_target_language_version = target_language_version;
 	}
 
 	void GLSLCompiler::resetTargetEnvironment()
 	{
-		GLSLCompiler::env_target_language = glslang::EShTargetLanguage::EShTargetNone;
-		GLSLCompiler::env_target_language_version = (glslang::EShTargetLanguageVersion)0;
+		env_target_language = glslang::EShTargetLanguage::EShTargetNone;
+		env_target_language_version = static_cast<glslang::EShTargetLanguageVersion>(0);
+	}
+
+	void GLSLCompiler::setIncludeDirectories(const std::vector<std::string>& include_directories)
+	{
+		this->include_directories = include_directories;
+	}
+
+	std::filesystem::path GLSLCompiler::resolveInclude(
+		const std::string& header_name,
+		const std::filesystem::path& includer,
+		bool local,
+		const std::vector<std::string>& include_directories)
+	{
+		std::error_code error;
+
+		if (local)
+		{
+			auto path = includer.parent_path() / header_name;
+			if (std::filesystem::is_regular_file(path, error))
+			{
+				return path;
+			}
+		}
+
+		for (auto& directory : include_directories)
+		{
+			auto path = std::filesystem::path(directory) / header_name;
+			if (std::filesystem::is_regular_file(path, error))
+			{
+				return path;
+			}
+		}
+
+		return {};
+	}
+
+	void GLSLCompiler::initializeProcess()
+	{
+		struct GlslangProcess
+		{
+			GlslangProcess()
+			{
+				glslang::InitializeProcess();
+			}
+
+			~GlslangProcess()
+			{
+				glslang::FinalizeProcess();
+			}
+		};
+
+		// Static local initialization is thread safe
+		static GlslangProcess glslang_process;
+	}
+
+	std::string GLSLCompiler::getVersion() const
+	{
+		return std::string(glslang::GetGlslVersionString()) + ";" + std::string(glslang::GetEsslVersionString()) +
+			";target " + std::to_string(static_cast<int>(env_target_language)) + "." + std::to_string(static_cast<int>(env_target_language_version));
 	}
 
 	bool GLSLCompiler::compileToSpirv(
 		VkShaderStageFlagBits stage, 
 		const std::vector<uint8_t>& glsl_source, 
+		const std::string& filename,
 		const std::string& entry_point, 
 		const ShaderVariant& variant, 
 		std::vector<uint32_t>& spirv, 
 		std::string& info_log)
 	{
-		// Initialize glslang library.
-		glslang::InitializeProcess();
+		initializeProcess();
 
 		EShMessages messages = static_cast<EShMessages>(EShMsgDefault | EShMsgVulkanRules | EShMsgSpvRules);
 
 		EShLanguage language = shaderStageConvert(stage);
 		std::string source = std::string(glsl_source.begin(), glsl_source.end());
 
-		const char* file_name_list[1] = { "" };
+		// Named after the file, local includes are relative to it
+		const char* file_name_list[1] = { filename.c_str() };
 		const char* shader_source = reinterpret_cast<const char*>(source.data());
 
 		glslang::TShader shader(language);
@@ -96,12 +212,13 @@ namespace chaf
 		shader.setSourceEntryPoint(entry_point.c_str());
 		shader.setPreamble(variant.getPreamble().c_str());
 		shader.addProcesses(variant.getProcesses());
-		if (GLSLCompiler::env_target_language != glslang::EShTargetLanguage::EShTargetNone)
+		if (env_target_language != glslang::EShTargetLanguage::EShTargetNone)
 		{
-			shader.setEnvTarget(GLSLCompiler::env_target_language, GLSLCompiler::env_target_language_version);
+			shader.setEnvTarget(env_target_language, env_target_language_version);
 		}
 
-		if (!shader.parse(&glslang::DefaultTBuiltInResource, 100, false, messages))
+		FileIncluder includer(include_directories);
+		if (!shader.parse(&glslang::DefaultTBuiltInResource, 100, false, messages, includer))
 		{
 			info_log = std::string(shader.getInfoLog()) + "\n" + std::string(shader.getInfoDebugLog());
 			return false;
@@ -144,9 +261,6 @@ namespace chaf
 
 		info_log += logger.getAllMessages() + "\n";
 
-		// Shutdown glslang library.
-		glslang::FinalizeProcess();
-
 		return true;
 	}
 }
\ No newline at end of file
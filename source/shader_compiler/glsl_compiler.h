@@ -4,25 +4,54 @@
 
 #include <shader_compiler/shader_compiler.h>
 
+#include <filesystem>
+
 namespace chaf
 {
+	// Compiler state is carried per instance, so instances can compile concurrently on different threads
 	class GLSLCompiler
 	{
 	public:
-		static void setTargetEnvironment(glslang::EShTargetLanguage target_language, glslang::EShTargetLanguageVersion target_language_version);
+		GLSLCompiler() = default;
+
+		GLSLCompiler(glslang::EShTargetLanguage target_language, glslang::EShTargetLanguageVersion target_language_version);
+
+		void setTargetEnvironment(glslang::EShTargetLanguage target_language, glslang::EShTargetLanguageVersion target_language_version);
+
+		void resetTargetEnvironment();
+
+		// Identifies compiler and target environment, compiled SPIR-V may differ when it changes
+		std::string getVersion() const;
 
-		static void resetTargetEnvironment();
+		// Searched in order for #include <name>, and for #include "name" after the directory of the including file
+		void setIncludeDirectories(const std::vector<std::string>& include_directories);
 
+		// File #include of header_name refers to, empty if there is none. Shared with source hashing, so a cached
+		// shader covers exactly the files the compiler reads
+		static std::filesystem::path resolveInclude(
+			const std::string& header_name,
+			const std::filesystem::path& includer,
+			bool local,
+			const std::vector<std::string>& include_directories);
+
+		// Includes are resolved relative to filename, which may be empty for source without a file
 		bool compileToSpirv(
 			VkShaderStageFlagBits stage,
 			const std::vector<uint8_t>& glsl_source,
+			const std::string& filename,
 			const std::string& entry_point,
 			const ShaderVariant& variant,
 			std::vector<uint32_t>& spirv,
 			std::string& info_log);
 
 	private:
-		static glslang::EShTargetLanguage env_target_language;
-		static glslang::EShTargetLanguageVersion env_target_language_version;
+		// glslang is initialized once per process and finalized at exit
+		static void initializeProcess();
+
+	private:
+		glslang::EShTargetLanguage env_target_language{ glslang::EShTargetLanguage::EShTargetNone };
+		glslang::EShTargetLanguageVersion env_target_language_version{ static_cast<glslang::EShTargetLanguageVersion>(0) };
+
+		std::vector<std::string> include_directories;
 	};
 }
\ No newline at end of file
@@ -94,12 +94,14 @@ namespace chaf
 		VkShaderStageFlagBits stage,
 		const std::string& filename,
 		const std::string& entry_point,
-		const ShaderVariant& shader_variant) :
+		const ShaderVariant& shader_variant,
+		const std::vector<std::string>& include_directories) :
 		device{ device },
 		stage{ stage },
 		filename{ filename },
 		entry_point{ entry_point },
-		shader_variant{ shader_variant }
+		shader_variant{ shader_variant },
+		include_directories{ include_directories }
 	{
 	}
 
@@ -127,8 +129,9 @@ namespace chaf
 		auto shader_data = convertToBytes(raw_data);
 
 		GLSLCompiler compiler;
+		compiler.setIncludeDirectories(include_directories);
 
-		if (!compiler.compileToSpirv(stage, shader_data, entry_point, shader_variant, spirv, info_log))
+		if (!compiler.compileToSpirv(stage, shader_data, filename, entry_point, shader_variant, spirv, info_log))
 		{
 			return false;
 		}
@@ -164,6 +167,11 @@ namespace chaf
 		this->shader_variant = variant;
 	}
 
+	void ShaderCompiler::setIncludeDirectories(const std::vector<std::string>& include_directories)
+	{
+		this->include_directories = include_directories;
+	}
+
 	const std::vector<uint32_t>& ShaderCompiler::getSpirv() const
 	{
 		return spirv;
@@ -116,7 +116,8 @@ namespace chaf
 			VkShaderStageFlagBits stage,
 			const std::string& filename,
 			const std::string& entry_point,
-			const ShaderVariant& shader_variant);
+			const ShaderVariant& shader_variant,
+			const std::vector<std::string>& include_directories = {});
 
 		bool compile();
 
@@ -128,6 +129,9 @@ namespace chaf
 
 		void setVariant(const ShaderVariant& variant);
 
+		// Searched for includes after the directory of the including file
+		void setIncludeDirectories(const std::vector<std::string>& include_directories);
+
 		const std::vector<uint32_t>& getSpirv() const;
 
 		const std::vector<ShaderResource>& getResources() const;
@@ -145,6 +149,8 @@ namespace chaf
 
 		ShaderVariant shader_variant;
 
+		std::vector<std::string> include_directories;
+
 		// Compile result
 		std::vector<uint32_t> spirv;
 
@@ -0,0 +1,505 @@
+#include <shader_compiler/shader_library.h>
+#include <shader_compiler/glsl_compiler.h>
+#include <shader_compiler/spirv_reflection.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace chaf
+{
+	static constexpr uint32_t SHADER_CACHE_MAGIC = 0x43565053;
+
+	// Bump when cache file layout or reflection changes
+	static constexpr uint32_t SHADER_CACHE_VERSION = 1;
+
+	inline void hashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		// FNV-1a
+		auto bytes = reinterpret_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	inline void hashString(uint64_t& hash, const std::string& str)
+	{
+		hashBytes(hash, str.data(), str.size());
+		// Separator, so "ab"+"c" and "a"+"bc" differ
+		hashBytes(hash, "\0", 1);
+	}
+
+	// Hash a source file and, recursively, every file it includes, found the same way as by the compiler
+	inline void hashSource(uint64_t& hash, const std::filesystem::path& path, const std::vector<std::string>& include_directories, std::set<std::filesystem::path>& visited)
+	{
+		auto canonical = std::filesystem::weakly_canonical(path);
+		if (!visited.insert(canonical).second)
+		{
+			return;
+		}
+
+		std::ifstream file(path, std::ios::in);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open shader: " + path.string());
+		}
+
+		std::string source{ (std::istreambuf_iterator<char>(file)), (std::istreambuf_iterator<char>()) };
+		hashString(hash, source);
+
+		std::istringstream lines(source);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			auto pos = line.find("#include");
+			if (pos == std::string::npos)
+			{
+				continue;
+			}
+
+			auto begin = line.find_first_of("\"<", pos);
+			auto end = line.find_first_of("\">", begin + 1);
+			if (begin == std::string::npos || end == std::string::npos)
+			{
+				continue;
+			}
+
+			// Unresolved includes are left to the compiler, the line may be commented out or disabled
+			bool local = line[begin] == '"';
+			auto include = GLSLCompiler::resolveInclude(line.substr(begin + 1, end - begin - 1), path, local, include_directories);
+			if (!include.empty())
+			{
+				hashSource(hash, include, include_directories, visited);
+			}
+		}
+	}
+
+	template <typename T>
+	inline void writeValue(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	inline bool readValue(std::ifstream& file, T& value)
+	{
+		file.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return file.gcount() == sizeof(T);
+	}
+
+	ShaderLibrary& ShaderLibrary::get()
+	{
+		static ShaderLibrary shader_library;
+		return shader_library;
+	}
+
+	void ShaderLibrary::initialize(vks::VulkanDevice& device, const std::string& cache_directory, const std::vector<std::string>& include_directories)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->device = &device;
+		this->cache_directory = cache_directory;
+		this->include_directories = include_directories;
+
+		// Hashed with the previous include directories
+		sources.clear();
+
+		std::error_code error;
+		std::filesystem::create_directories(cache_directory, error);
+	}
+
+	std::shared_ptr<const ShaderLibrary::Shader> ShaderLibrary::load(
+		VkShaderStageFlagBits stage,
+		const std::string& filename,
+		const ShaderVariant& variant,
+		const std::string& entry_point)
+	{
+		return loadWithKey(getKey(stage, filename, variant, entry_point), stage, filename, variant, entry_point);
+	}
+
+	std::shared_ptr<const ShaderLibrary::Shader> ShaderLibrary::loadPrebuilt(VkShaderStageFlagBits stage, const std::string& filename, const ShaderVariant& variant)
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open shader: " + filename);
+		}
+
+		size_t size = static_cast<size_t>(file.tellg());
+		if (size == 0 || size % sizeof(uint32_t) != 0)
+		{
+			throw std::runtime_error("Invalid SPIR-V size: " + filename);
+		}
+
+		auto shader = std::make_shared<Shader>();
+		shader->spirv.resize(size / sizeof(uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(shader->spirv.data()), size);
+
+		if (!SpirvReflection::reflectShaderResources(stage, shader->spirv, shader->resources, variant))
+		{
+			throw std::runtime_error("Failed to reflect shader: " + filename);
+		}
+
+		return shader;
+	}
+
+	std::vector<std::shared_ptr<const ShaderLibrary::Shader>> ShaderLibrary::loadBatch(const std::vector<Job>& jobs)
+	{
+		std::vector<std::shared_ptr<const Shader>> results(jobs.size());
+
+		// Identical jobs are compiled once
+		std::vector<uint64_t> keys(jobs.size());
+		std::unordered_map<uint64_t, size_t> unique_jobs;
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			keys[i] = getKey(jobs[i].stage, jobs[i].filename, jobs[i].variant, jobs[i].entry_point);
+			unique_jobs.emplace(keys[i], i);
+		}
+
+		// Every job writes its own entry, the map is not modified meanwhile
+		std::unordered_map<uint64_t, std::shared_ptr<const Shader>> compiled;
+		for (auto& [key, index] : unique_jobs)
+		{
+			compiled[key] = nullptr;
+		}
+
+		JobHandle group;
+		for (auto& [key, index] : unique_jobs)
+		{
+			auto& job = jobs[index];
+			auto& result = compiled[key];
+			group = JobSystem::get().push(JobPriority::Load, [this, key = key, &job, &result]() {
+				result = loadWithKey(key, job.stage, job.filename, job.variant, job.entry_point);
+			}, group);
+		}
+
+		// Rethrows the first failure once every job is done
+		group.wait();
+
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			results[i] = compiled[keys[i]];
+		}
+
+		return results;
+	}
+
+	std::shared_ptr<const ShaderLibrary::Shader> ShaderLibrary::loadWithKey(
+		uint64_t key,
+		VkShaderStageFlagBits stage,
+		const std::string& filename,
+		const ShaderVariant& variant,
+		const std::string& entry_point)
+	{
+		if (!device)
+		{
+			throw std::runtime_error("Shader library is used before initialization");
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = shaders.find(key);
+			if (it != shaders.end())
+			{
+				stats.memory_hit_count++;
+				return it->second;
+			}
+		}
+
+		auto shader = loadFromDisk(key);
+		if (shader)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.disk_hit_count++;
+			return shaders.emplace(key, shader).first->second;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		ShaderCompiler compiler(*device, stage, filename, entry_point, variant, include_directories);
+		if (!compiler.compile())
+		{
+			throw std::runtime_error("Failed to compile shader " + filename + ":\n" + compiler.getInfo());
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		auto compiled = std::make_shared<Shader>();
+		compiled->spirv = compiler.getSpirv();
+		compiled->resources = compiler.getResources();
+
+		saveToDisk(key, *compiled);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.compile_count++;
+		stats.compile_time += std::chrono::duration<double, std::milli>(end - start).count();
+		return shaders.emplace(key, compiled).first->second;
+	}
+
+	void ShaderLibrary::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shaders.clear();
+	}
+
+	std::vector<std::string> ShaderLibrary::getDependents(const std::vector<std::string>& files)
+	{
+		std::set<std::filesystem::path> changed;
+		for (auto& file : files)
+		{
+			changed.insert(std::filesystem::weakly_canonical(file));
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::vector<std::string> dependents;
+		for (auto& [filename, source] : sources)
+		{
+			for (auto& [path, write_time] : source.files)
+			{
+				if (changed.count(path))
+				{
+					dependents.push_back(filename);
+					break;
+				}
+			}
+		}
+
+		return dependents;
+	}
+
+	ShaderLibrary::Stats ShaderLibrary::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	uint64_t ShaderLibrary::getKey(VkShaderStageFlagBits stage, const std::string& filename, const ShaderVariant& variant, const std::string& entry_point)
+	{
+		uint64_t hash = getSourceHash(filename);
+
+		hashString(hash, variant.getPreamble());
+		for (auto& process : variant.getProcesses())
+		{
+			hashString(hash, process);
+		}
+
+		// Runtime array sizes only change reflection, hash them in a stable order
+		std::map<std::string, size_t> runtime_array_sizes(variant.getRuntimeArraySizes().begin(), variant.getRuntimeArraySizes().end());
+		for (auto& [name, size] : runtime_array_sizes)
+		{
+			hashString(hash, name);
+			hashBytes(hash, &size, sizeof(size));
+		}
+
+		// The same include may resolve to another file with other directories
+		for (auto& directory : include_directories)
+		{
+			hashString(hash, directory);
+		}
+
+		hashString(hash, entry_point);
+		hashBytes(hash, &stage, sizeof(stage));
+		hashString(hash, GLSLCompiler().getVersion());
+		hashBytes(hash, &SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+
+		return hash;
+	}
+
+	uint64_t ShaderLibrary::getSourceHash(const std::string& filename)
+	{
+		Source source;
+		bool found = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = sources.find(filename);
+			if (it != sources.end())
+			{
+				source = it->second;
+				found = true;
+			}
+		}
+
+		// Reuse the hash while no file it covers has been written since, a stat per file instead of reading them all
+		if (found)
+		{
+			bool unchanged = std::all_of(source.files.begin(), source.files.end(), [](const auto& file) {
+				std::error_code error;
+				auto write_time = std::filesystem::last_write_time(file.first, error);
+				return !error && write_time == file.second;
+			});
+
+			if (unchanged)
+			{
+				return source.hash;
+			}
+		}
+
+		source = {};
+		source.hash = 14695981039346656037ull;
+
+		std::set<std::filesystem::path> visited;
+		hashSource(source.hash, filename, include_directories, visited);
+
+		for (auto& path : visited)
+		{
+			std::error_code error;
+			source.files[path] = std::filesystem::last_write_time(path, error);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		sources[filename] = source;
+		return source.hash;
+	}
+
+	std::shared_ptr<const ShaderLibrary::Shader> ShaderLibrary::loadFromDisk(uint64_t key)
+	{
+		std::ifstream file(getCachePath(key), std::ios::binary);
+		if (!file.is_open())
+		{
+			return nullptr;
+		}
+
+		uint32_t magic = 0, version = 0;
+		uint64_t stored_key = 0;
+		uint32_t spirv_size = 0, resource_count = 0;
+		if (!readValue(file, magic) || !readValue(file, version) || !readValue(file, stored_key) ||
+			!readValue(file, spirv_size) || !readValue(file, resource_count) ||
+			magic != SHADER_CACHE_MAGIC || version != SHADER_CACHE_VERSION || stored_key != key)
+		{
+			return nullptr;
+		}
+
+		// Sizes come from the file, never trust them further than the bytes actually left
+		std::error_code error;
+		auto file_size = std::filesystem::file_size(getCachePath(key), error);
+		auto position = file.tellg();
+		if (error || position < 0 || file_size < static_cast<uint64_t>(position))
+		{
+			return nullptr;
+		}
+		uint64_t remaining = file_size - static_cast<uint64_t>(position);
+
+		if (static_cast<uint64_t>(spirv_size) * sizeof(uint32_t) > remaining)
+		{
+			return nullptr;
+		}
+		remaining -= static_cast<uint64_t>(spirv_size) * sizeof(uint32_t);
+
+		auto shader = std::make_shared<Shader>();
+		shader->spirv.resize(spirv_size);
+		file.read(reinterpret_cast<char*>(shader->spirv.data()), spirv_size * sizeof(uint32_t));
+		if (static_cast<size_t>(file.gcount()) != spirv_size * sizeof(uint32_t))
+		{
+			return nullptr;
+		}
+
+		// Every resource takes at least its name size
+		if (static_cast<uint64_t>(resource_count) * sizeof(uint32_t) > remaining)
+		{
+			return nullptr;
+		}
+
+		shader->resources.resize(resource_count);
+		for (auto& resource : shader->resources)
+		{
+			uint32_t name_size = 0;
+			bool valid = readValue(file, resource.stages) && readValue(file, resource.type) && readValue(file, resource.mode) &&
+				readValue(file, resource.set) && readValue(file, resource.binding) && readValue(file, resource.location) &&
+				readValue(file, resource.input_attachment_index) && readValue(file, resource.vec_size) && readValue(file, resource.columns) &&
+				readValue(file, resource.array_size) && readValue(file, resource.offset) && readValue(file, resource.size) &&
+				readValue(file, resource.constant_id) && readValue(file, resource.qualifiers) && readValue(file, name_size);
+
+			if (!valid)
+			{
+				return nullptr;
+			}
+
+			position = file.tellg();
+			if (position < 0 || static_cast<uint64_t>(position) + name_size > file_size)
+			{
+				return nullptr;
+			}
+
+			resource.name.resize(name_size);
+			file.read(resource.name.data(), name_size);
+			if (static_cast<uint32_t>(file.gcount()) != name_size)
+			{
+				return nullptr;
+			}
+		}
+
+		return shader;
+	}
+
+	void ShaderLibrary::saveToDisk(uint64_t key, const Shader& shader)
+	{
+		if (cache_directory.empty())
+		{
+			return;
+		}
+
+		// Write to a temporary file first, a concurrent reader never sees a partial entry
+		std::string path = getCachePath(key);
+		std::string temp_path = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Could not write shader cache " << temp_path << std::endl;
+				return;
+			}
+
+			writeValue(file, SHADER_CACHE_MAGIC);
+			writeValue(file, SHADER_CACHE_VERSION);
+			writeValue(file, key);
+			writeValue(file, static_cast<uint32_t>(shader.spirv.size()));
+			writeValue(file, static_cast<uint32_t>(shader.resources.size()));
+			file.write(reinterpret_cast<const char*>(shader.spirv.data()), shader.spirv.size() * sizeof(uint32_t));
+
+			for (auto& resource : shader.resources)
+			{
+				writeValue(file, resource.stages);
+				writeValue(file, resource.type);
+				writeValue(file, resource.mode);
+				writeValue(file, resource.set);
+				writeValue(file, resource.binding);
+				writeValue(file, resource.location);
+				writeValue(file, resource.input_attachment_index);
+				writeValue(file, resource.vec_size);
+				writeValue(file, resource.columns);
+				writeValue(file, resource.array_size);
+				writeValue(file, resource.offset);
+				writeValue(file, resource.size);
+				writeValue(file, resource.constant_id);
+				writeValue(file, resource.qualifiers);
+				writeValue(file, static_cast<uint32_t>(resource.name.size()));
+				file.write(resource.name.data(), resource.name.size());
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temp_path, error);
+		}
+	}
+
+	std::string ShaderLibrary::getCachePath(uint64_t key) const
+	{
+		std::stringstream ss;
+		ss << std::hex << std::setw(16) << std::setfill('0') << key << ".spvc";
+		return (std::filesystem::path(cache_directory) / ss.str()).string();
+	}
+}
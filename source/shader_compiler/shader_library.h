@@ -0,0 +1,115 @@
+#pragma once
+
+#include <shader_compiler/shader_compiler.h>
+
+#include <core/job_system.h>
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace chaf
+{
+	// Compiles GLSL on demand and caches SPIR-V with reflected resources in memory and on disk.
+	// Results are keyed by a hash of source, includes, include directories, variant, entry point, stage and compiler version
+	class ShaderLibrary
+	{
+	public:
+		struct Shader
+		{
+			std::vector<uint32_t> spirv;
+			std::vector<ShaderResource> resources;
+		};
+
+		struct Job
+		{
+			VkShaderStageFlagBits stage;
+			std::string filename;
+			ShaderVariant variant;
+			std::string entry_point{ "main" };
+		};
+
+		struct Stats
+		{
+			uint32_t memory_hit_count{ 0 };
+			uint32_t disk_hit_count{ 0 };
+			uint32_t compile_count{ 0 };
+			// ms spent in compilation
+			double compile_time{ 0.0 };
+		};
+
+	public:
+		static ShaderLibrary& get();
+
+		// Includes are searched in include_directories after the directory of the including file
+		void initialize(vks::VulkanDevice& device, const std::string& cache_directory, const std::vector<std::string>& include_directories = {});
+
+		// Throws if the shader can not be read or compiled
+		std::shared_ptr<const Shader> load(
+			VkShaderStageFlagBits stage,
+			const std::string& filename,
+			const ShaderVariant& variant = {},
+			const std::string& entry_point = "main");
+
+		// Load prebuilt SPIR-V and reflect its resources, not cached
+		static std::shared_ptr<const Shader> loadPrebuilt(VkShaderStageFlagBits stage, const std::string& filename, const ShaderVariant& variant = {});
+
+		// Compile jobs across the job system, results are in job order and identical to loading jobs one by one.
+		// Rethrows the first failure after all jobs have finished
+		std::vector<std::shared_ptr<const Shader>> loadBatch(const std::vector<Job>& jobs);
+
+		// Drop shaders cached in memory, disk cache is kept
+		void clear();
+
+		// Loaded shader sources which are, or include, any of given files
+		std::vector<std::string> getDependents(const std::vector<std::string>& files);
+
+		Stats getStats();
+
+	private:
+		ShaderLibrary() = default;
+
+		std::shared_ptr<const Shader> loadWithKey(
+			uint64_t key,
+			VkShaderStageFlagBits stage,
+			const std::string& filename,
+			const ShaderVariant& variant,
+			const std::string& entry_point);
+
+		uint64_t getKey(VkShaderStageFlagBits stage, const std::string& filename, const ShaderVariant& variant, const std::string& entry_point);
+
+		// Hash of a source file and its includes, rehashed only when one of them was written
+		uint64_t getSourceHash(const std::string& filename);
+
+		std::shared_ptr<const Shader> loadFromDisk(uint64_t key);
+
+		void saveToDisk(uint64_t key, const Shader& shader);
+
+		std::string getCachePath(uint64_t key) const;
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+
+		std::string cache_directory;
+
+		std::vector<std::string> include_directories;
+
+		std::mutex mutex;
+
+		std::unordered_map<uint64_t, std::shared_ptr<const Shader>> shaders;
+
+		struct Source
+		{
+			uint64_t hash{ 0 };
+			// Source file and its includes, with their write time when hashed
+			std::map<std::filesystem::path, std::filesystem::file_time_type> files;
+		};
+
+		// Every loaded shader source, by shader file name
+		std::unordered_map<std::string, Source> sources;
+
+		Stats stats;
+	};
+}
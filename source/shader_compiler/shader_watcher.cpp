@@ -0,0 +1,171 @@
+#include <shader_compiler/shader_watcher.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace chaf
+{
+	// Editors save in several writes, changes are reported once the directory was quiet this long
+	static constexpr int DEBOUNCE_MS = 50;
+
+	static constexpr int POLL_INTERVAL_MS = 250;
+
+	ShaderWatcher::ShaderWatcher(const std::string& directory, Callback&& callback) :
+		directory{ directory }, callback{ std::move(callback) }
+	{
+		thread = std::thread(&ShaderWatcher::watch, this);
+	}
+
+	ShaderWatcher::~ShaderWatcher()
+	{
+		running = false;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	bool ShaderWatcher::isSource(const std::string& filename)
+	{
+		auto path = std::filesystem::path(filename);
+		auto name = path.filename().string();
+		auto extension = path.extension().string();
+
+		return !name.empty() && name.front() != '.' && name.back() != '~' &&
+			extension != ".spv" && extension != ".spvc" && extension != ".swp" && extension != ".tmp";
+	}
+
+	void ShaderWatcher::watch()
+	{
+		auto notify = [this](const std::set<std::string>& changed) {
+			try
+			{
+				callback(std::vector<std::string>(changed.begin(), changed.end()));
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Shader reload failed: " << e.what() << std::endl;
+			}
+		};
+
+#ifdef __linux__
+		int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0)
+		{
+			std::cerr << "Could not watch shader directory " << directory << std::endl;
+			return;
+		}
+
+		std::unordered_map<int, std::filesystem::path> watches;
+		auto addWatch = [fd, &watches](const std::filesystem::path& path) {
+			int wd = inotify_add_watch(fd, path.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd >= 0)
+			{
+				watches[wd] = path;
+			}
+		};
+
+		std::error_code error;
+		addWatch(directory);
+		for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error))
+		{
+			if (entry.is_directory())
+			{
+				addWatch(entry.path());
+			}
+		}
+
+		std::set<std::string> changed;
+		alignas(inotify_event) char buffer[4096];
+
+		while (running)
+		{
+			pollfd poll_fd{ fd, POLLIN, 0 };
+			int ready = poll(&poll_fd, 1, changed.empty() ? POLL_INTERVAL_MS : DEBOUNCE_MS);
+
+			if (ready > 0)
+			{
+				ssize_t length;
+				while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+				{
+					const inotify_event* event = nullptr;
+					for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + event->len)
+					{
+						event = reinterpret_cast<const inotify_event*>(ptr);
+
+						auto it = watches.find(event->wd);
+						if (event->len == 0 || it == watches.end())
+						{
+							continue;
+						}
+
+						auto path = it->second / event->name;
+						if (event->mask & IN_ISDIR)
+						{
+							addWatch(path);
+						}
+						// Created files are reported when they are closed
+						else if (!(event->mask & IN_CREATE) && isSource(path.string()))
+						{
+							changed.insert(path.string());
+						}
+					}
+				}
+			}
+			else if (ready == 0 && !changed.empty())
+			{
+				notify(changed);
+				changed.clear();
+			}
+		}
+
+		close(fd);
+#else
+		using FileTimes = std::unordered_map<std::string, std::filesystem::file_time_type>;
+
+		auto scan = [this](FileTimes& times, std::set<std::string>& changed) {
+			std::error_code error;
+			for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error))
+			{
+				if (!entry.is_regular_file(error) || !isSource(entry.path().string()))
+				{
+					continue;
+				}
+
+				auto time = entry.last_write_time(error);
+				auto [it, inserted] = times.emplace(entry.path().string(), time);
+				if (!inserted && it->second != time)
+				{
+					it->second = time;
+					changed.insert(it->first);
+				}
+			}
+		};
+
+		FileTimes times;
+		std::set<std::string> changed;
+		scan(times, changed);
+
+		while (running)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+
+			scan(times, changed);
+			if (!changed.empty())
+			{
+				notify(changed);
+				changed.clear();
+			}
+		}
+#endif // __linux__
+	}
+}
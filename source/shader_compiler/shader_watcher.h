@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chaf
+{
+	// Watches a shader directory and its subdirectories on a background thread.
+	// Uses inotify on Linux and falls back to polling modification times elsewhere
+	class ShaderWatcher
+	{
+	public:
+		// Called on the watcher thread with the changed files of one burst of writes
+		using Callback = std::function<void(const std::vector<std::string>&)>;
+
+	public:
+		ShaderWatcher(const std::string& directory, Callback&& callback);
+
+		~ShaderWatcher();
+
+		ShaderWatcher(const ShaderWatcher&) = delete;
+
+		ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	private:
+		void watch();
+
+		// Prebuilt SPIR-V and editor temporaries are not shader sources
+		static bool isSource(const std::string& filename);
+
+	private:
+		std::string directory;
+
+		Callback callback;
+
+		std::atomic<bool> running{ true };
+
+		std::thread thread;
+	};
+}